@@ -7,6 +7,12 @@
 //
 
 #import <UIKit/UIKit.h>
+#import <atomic>
+#import <cmath>
+#import <functional>
+#import <limits>
+#import <set>
+#import <thread>
 #import <unordered_set>
 #import <XCTest/XCTest.h>
 
@@ -31,6 +37,336 @@ using namespace HLCommon;
 // 63 64 65   66 67 68   69 70 71
 // 72 73 74   75 76 77   78 79 80
 
+template <typename SectorTableBackend, size_t SectorSize>
+static int
+lookupSparseTrackPoints(const DenseSectorTable<int, SectorTableBackend, SectorSize>& denseSectorTable)
+{
+  // note: Look up each point in a 1024x1024 area, which is sparsely populated: one point
+  // in every 3x3 block, with sectors scattered in both positive and negative coordinates.
+  int hitCount = 0;
+  for (int y = -512; y < 512; ++y) {
+    for (int x = -512; x < 512; ++x) {
+      if (denseSectorTable.getPoint(x, y) != -1) {
+        ++hitCount;
+      }
+    }
+  }
+  return hitCount;
+}
+
+template <typename SectorTableBackend, size_t SectorSize>
+static void
+fillSparseWorld(DenseSectorTable<int, SectorTableBackend, SectorSize>& denseSectorTable, int worldSize)
+{
+  // note: One point in every 3x3 block of a square world centered on the origin.
+  for (int y = -worldSize / 2; y < worldSize / 2; y += 3) {
+    for (int x = -worldSize / 2; x < worldSize / 2; x += 3) {
+      denseSectorTable.setPoint(x, y, 1);
+    }
+  }
+}
+
+/**
+ Allocates blocks from the system, but counts them.
+*/
+class CountingBlockAllocator : public DenseSectorTableBlockAllocator
+{
+public:
+  CountingBlockAllocator() : allocationCount(0), deallocationCount(0), byteCount(0) {}
+  void *allocate(size_t allocationByteCount, size_t alignment) override {
+    ++allocationCount;
+    byteCount += allocationByteCount;
+    return systemAllocate(allocationByteCount, alignment);
+  }
+  void deallocate(void *memory, size_t allocationByteCount) override {
+    ++deallocationCount;
+    byteCount -= allocationByteCount;
+    systemDeallocate(memory);
+  }
+  std::atomic<size_t> allocationCount;
+  std::atomic<size_t> deallocationCount;
+  std::atomic<size_t> byteCount;
+};
+
+template<typename SectorTableBackend, size_t SectorSize>
+static void
+fillTrackRowWorld(DenseSectorTable<int, SectorTableBackend, SectorSize>& denseSectorTable, int worldSize)
+{
+  // note: Long horizontal runs of track in every other row of a square world centered on
+  // the origin.
+  for (int y = -worldSize / 2; y < worldSize / 2; y += 2) {
+    for (int x = -worldSize / 2; x < worldSize / 2; ++x) {
+      denseSectorTable.setPoint(x, y, 1);
+    }
+  }
+}
+
+template<typename Table, typename Iterator>
+static size_t
+countNeighbors(const Table& denseSectorTable, Iterator begin, Iterator end)
+{
+  // note: As in trackGridFindAdjacent: For each point, fetch the surrounding 3x3 block.
+  size_t neighborCount = 0;
+  int block[9];
+  for (auto p = begin; p != end; ++p) {
+    std::pair<int, int> xy = (*p).first;
+    denseSectorTable.getBlock(xy.first - 1, xy.second - 1, 3, 3, block);
+    for (int b = 0; b < 9; ++b) {
+      if (b != 4 && block[b] != -1) {
+        ++neighborCount;
+      }
+    }
+  }
+  return neighborCount;
+}
+
+static std::vector<std::tuple<int, int, int>>
+shuffledSquareWorld(int worldSize)
+{
+  // note: Every point of a square world, in a scrambled (but repeatable) order, like the
+  // children of a track node.
+  std::vector<std::tuple<int, int, int>> points;
+  for (int y = 0; y < worldSize; ++y) {
+    for (int x = 0; x < worldSize; ++x) {
+      points.emplace_back(x - worldSize / 2, y - worldSize / 2, y * worldSize + x);
+    }
+  }
+  unsigned int random = 1;
+  for (size_t i = points.size() - 1; i > 0; --i) {
+    random = random * 1103515245 + 12345;
+    std::swap(points[i], points[(random >> 8) % (i + 1)]);
+  }
+  return points;
+}
+
+/**
+ Stands in for FLSegmentNode in scan benchmarks: a separately-allocated object whose
+ properties are read through dynamically-dispatched calls.
+*/
+class ScanSegment
+{
+public:
+  ScanSegment(int segmentType, int zRotationQuarters, int switchPathId)
+    : segmentType_(segmentType), zRotationQuarters_(zRotationQuarters), switchPathId_(switchPathId) {}
+  virtual ~ScanSegment() {}
+  virtual int segmentType() const { return segmentType_; }
+  virtual int zRotationQuarters() const { return zRotationQuarters_; }
+  virtual int switchPathId() const { return switchPathId_; }
+private:
+  int segmentType_;
+  int zRotationQuarters_;
+  int switchPathId_;
+  char padding_[48];
+};
+
+typedef DenseSectorColumnTable<16, uint8_t, int8_t, char> ScanColumnTable;
+
+static const int scanWorldSize = 512;
+
+static uint8_t
+scanTypeAndRotation(int x, int y)
+{
+  // note: Segment type in the high bits, rotation quarters in the low two bits.
+  return static_cast<uint8_t>((((x * 7 + y * 13) % 12 + 1) << 2) | ((x + y) & 3));
+}
+
+static size_t countingStdAllocatorByteCount = 0;
+
+/**
+ A standard allocator which counts the bytes it has outstanding (in a global, since
+ containers default-construct their allocators).
+*/
+template<typename T>
+class CountingStdAllocator
+{
+public:
+  typedef T value_type;
+  CountingStdAllocator() {}
+  template<typename U> CountingStdAllocator(const CountingStdAllocator<U>&) {}
+  T *allocate(size_t n) {
+    countingStdAllocatorByteCount += n * sizeof(T);
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) {
+    countingStdAllocatorByteCount -= n * sizeof(T);
+    ::operator delete(p);
+  }
+  template<typename U> bool operator==(const CountingStdAllocator<U>&) const { return true; }
+  template<typename U> bool operator!=(const CountingStdAllocator<U>&) const { return false; }
+};
+
+struct CountingUnorderedMapBackend
+{
+  template<typename Key, typename Mapped, typename Hash>
+  struct SectorTable
+  {
+    typedef std::unordered_map<Key, Mapped, Hash, std::equal_to<Key>, CountingStdAllocator<std::pair<const Key, Mapped>>> type;
+  };
+};
+
+static void
+replayDrag(DenseSectorTable<int>& denseSectorTable, int stepCount)
+{
+  // note: As in FL_trackMoveUpdateWithLocation: Each grid step, erase every cell of a
+  // 24x12 selection (pruning emptied sectors), and then set them again one cell to the
+  // right.
+  for (int step = 0; step < stepCount; ++step) {
+    for (int y = 0; y < 12; ++y) {
+      for (int x = step; x < step + 24; ++x) {
+        denseSectorTable.erasePoint(x, y, true);
+      }
+    }
+    for (int y = 0; y < 12; ++y) {
+      for (int x = step + 1; x < step + 25; ++x) {
+        denseSectorTable.setPoint(x, y, y * 24 + x - step - 1);
+      }
+    }
+  }
+}
+
+template<size_t SectorSize>
+static size_t
+countStencilMismatches(bool simdEnabled)
+{
+  // note: Compare each stencil operation against a per-point computation, over a random
+  // world straddling sector edges (including negative coordinates), plus a few lone points.
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, SectorSize> denseSectorTable(SectorSize, 64, -1);
+  std::set<std::pair<int, int>> points;
+  unsigned int seed = 17;
+  for (int y = -40; y <= 40; ++y) {
+    for (int x = -40; x <= 40; ++x) {
+      seed = seed * 1103515245U + 12345U;
+      if ((seed >> 16) % 3 == 0) {
+        points.insert(std::make_pair(x, y));
+      }
+    }
+  }
+  points.insert(std::make_pair(-100, 63));
+  points.insert(std::make_pair(95, -64));
+  for (auto& point : points) {
+    denseSectorTable.setPoint(point.first, point.second, 1);
+  }
+
+  DenseSectorTableOccupancyBitmap<SectorSize> occupied(denseSectorTable);
+  occupied.setSimdEnabled(simdEnabled);
+  DenseSectorTableOccupancyBitmap<SectorSize> stripes;
+  for (int y = -128; y < 128; y += 3) {
+    for (int x = -128; x < 128; ++x) {
+      stripes.set(x, y);
+    }
+  }
+  auto isSet = [&points](int x, int y) { return points.count(std::make_pair(x, y)) != 0; };
+  auto neighborCount = [&isSet](int x, int y) {
+    int count = 0;
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        if ((dx != 0 || dy != 0) && isSet(x + dx, y + dy)) {
+          ++count;
+        }
+      }
+    }
+    return count;
+  };
+
+  size_t mismatchCount = 0;
+  auto check = [&mismatchCount](const DenseSectorTableOccupancyBitmap<SectorSize>& bitmap, std::function<bool(int, int)> expected) {
+    size_t expectedCount = 0;
+    for (int y = -128; y < 128; ++y) {
+      for (int x = -128; x < 128; ++x) {
+        bool e = expected(x, y);
+        if (e) {
+          ++expectedCount;
+        }
+        if (bitmap.isSet(x, y) != e) {
+          ++mismatchCount;
+        }
+      }
+    }
+    if (bitmap.pointCount() != expectedCount) {
+      ++mismatchCount;
+    }
+  };
+  check(occupied, isSet);
+  for (int dy = -1; dy <= 1; ++dy) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      check(occupied.shifted(dx, dy), [&isSet, dx, dy](int x, int y) { return isSet(x - dx, y - dy); });
+    }
+  }
+  check(occupied.dilated(), [&isSet, &neighborCount](int x, int y) { return isSet(x, y) || neighborCount(x, y) > 0; });
+  for (int count = 0; count <= 8; ++count) {
+    check(occupied.neighborCountEquals(count), [&isSet, &neighborCount, count](int x, int y) {
+      return neighborCount(x, y) == count && (count > 0 || isSet(x, y));
+    });
+    check(occupied.neighborCountAtLeast(count), [&isSet, &neighborCount, count](int x, int y) {
+      return neighborCount(x, y) >= count && (count > 0 || isSet(x, y) || neighborCount(x, y) > 0);
+    });
+  }
+  auto isStripe = [](int x, int y) { return x >= -128 && x < 128 && (y + 128) % 3 == 0; };
+  check(occupied & stripes, [&isSet, &isStripe](int x, int y) { return isSet(x, y) && isStripe(x, y); });
+  check(occupied | stripes, [&isSet, &isStripe](int x, int y) { return isSet(x, y) || isStripe(x, y); });
+  check(occupied ^ stripes, [&isSet, &isStripe](int x, int y) { return isSet(x, y) != isStripe(x, y); });
+  check(occupied.andNot(stripes), [&isSet, &isStripe](int x, int y) { return isSet(x, y) && !isStripe(x, y); });
+
+  size_t visitedCount = 0;
+  occupied.forEachSetPoint([&isSet, &visitedCount, &mismatchCount](int x, int y) {
+    ++visitedCount;
+    if (!isSet(x, y)) {
+      ++mismatchCount;
+    }
+  });
+  if (visitedCount != points.size()) {
+    ++mismatchCount;
+  }
+  return mismatchCount;
+}
+
+static std::vector<std::pair<int, int>>
+adversarialSectorLayout(int layout)
+{
+  // note: Sector coordinates for hash tests: a long rail along x, a long rail along y, a
+  // rail far from the origin, a diagonal, and a lattice with spacing 65536 (which defeats
+  // hashes that look at only the low 16 bits of each coordinate).
+  std::vector<std::pair<int, int>> keys;
+  for (int i = 0; i < 4096; ++i) {
+    switch (layout) {
+      case 0:
+        keys.emplace_back(i, 0);
+        break;
+      case 1:
+        keys.emplace_back(0, i);
+        break;
+      case 2:
+        keys.emplace_back((1 << 27) - 4096 + i, -(1 << 27));
+        break;
+      case 3:
+        keys.emplace_back(i - 2048, i - 2048);
+        break;
+      default:
+        keys.emplace_back((i % 64 - 32) * 65536, (i / 64 - 32) * 65536);
+        break;
+    }
+  }
+  return keys;
+}
+
+static size_t
+countBucketCollisions(const std::vector<std::pair<int, int>>& keys, size_t bucketCount)
+{
+  // note: Keys which land in an already-occupied bucket, with buckets chosen from the low
+  // bits of the hash (as in the flat map).
+  std::vector<bool> occupied(bucketCount, false);
+  size_t collisionCount = 0;
+  DenseSectorTableKeyHash hash;
+  for (auto& key : keys) {
+    size_t bucket = hash(key) & (bucketCount - 1);
+    if (occupied[bucket]) {
+      ++collisionCount;
+    }
+    occupied[bucket] = true;
+  }
+  return collisionCount;
+}
+
 @implementation DenseSectorTableTests
 
 - (void)testSetPoint
@@ -223,4 +559,1580 @@ using namespace HLCommon;
   XCTAssertEqual(notYetFoundValues.size(), 0UL);
 }
 
+- (void)testSectorIteration
+{
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+
+  denseSectorTable.setPoint(4, 3, 31);
+  denseSectorTable.setPoint(5, 5, 50);
+  denseSectorTable.setPoint(6, 6, 60);
+
+  // Iterate only set points in sector.
+  unordered_set<int> notYetFoundValues({ 31, 50 });
+  for (auto p = denseSectorTable.beginSector(3, 4); p != denseSectorTable.endSector(3, 4); ++p) {
+    auto v = notYetFoundValues.find((*p).second);
+    XCTAssertNotEqual(v, notYetFoundValues.end());
+    notYetFoundValues.erase(v);
+  }
+  XCTAssertEqual(notYetFoundValues.size(), 0UL);
+
+  // Iterate all points in sector, including unset points, in row-major order.
+  int pointCount = 0;
+  int setPointCount = 0;
+  for (auto p = denseSectorTable.beginSector(3, 4, true); p != denseSectorTable.endSector(3, 4, true); ++p) {
+    XCTAssertEqual((*p).first.first, 3 + pointCount % 3);
+    XCTAssertEqual((*p).first.second, 3 + pointCount / 3);
+    if ((*p).second != -1) {
+      ++setPointCount;
+    }
+    ++pointCount;
+  }
+  XCTAssertEqual(pointCount, 9);
+  XCTAssertEqual(setPointCount, 2);
+
+  // Missing sector.
+  XCTAssertEqual(denseSectorTable.beginSector(0, 0), denseSectorTable.endSector(0, 0));
+  XCTAssertEqual(denseSectorTable.beginSector(0, 0, true), denseSectorTable.endSector(0, 0, true));
+}
+
+- (void)testInsertSector
+{
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+
+  // Insert an empty sector and fill it through the iterator.
+  auto insertion = denseSectorTable.insertSector(7, 1, true);
+  XCTAssertTrue(insertion.second);
+  XCTAssertEqual(denseSectorTable.sectorCount(), 1UL);
+  XCTAssertEqual(denseSectorTable.pointCount(), 0UL);
+  for (auto p = insertion.first; p != denseSectorTable.endSector(7, 1, true); ++p) {
+    (*p).second = (*p).first.second * 9 + (*p).first.first;
+  }
+  XCTAssertEqual(denseSectorTable.pointCount(), 9UL);
+  XCTAssertEqual(denseSectorTable.sectorPointCount(7, 1), 9UL);
+  XCTAssertEqual(denseSectorTable.getPoint(6, 0), 6);
+  XCTAssertEqual(denseSectorTable.getPoint(8, 2), 26);
+
+  // Insert again: no change.
+  insertion = denseSectorTable.insertSector(6, 2);
+  XCTAssertFalse(insertion.second);
+  XCTAssertEqual(denseSectorTable.pointCount(), 9UL);
+  XCTAssertNotEqual(insertion.first, denseSectorTable.endSector(6, 2));
+  XCTAssertEqual((*insertion.first).second, 6);
+}
+
+- (void)testExtractSector
+{
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+
+  denseSectorTable.setPoint(0, 0, 0);
+  denseSectorTable.setPoint(2, 2, 20);
+  denseSectorTable.setPoint(3, 3, 30);
+
+  DenseSectorTable<int>::sector_type sector;
+  XCTAssertTrue(denseSectorTable.extractSector(1, 1, &sector));
+  XCTAssertFalse(sector.empty());
+  XCTAssertEqual(denseSectorTable.sectorCount(), 1UL);
+  XCTAssertEqual(denseSectorTable.pointCount(), 1UL);
+  XCTAssertEqual(denseSectorTable.getPoint(0, 0), -1);
+  XCTAssertFalse(denseSectorTable.extractSector(1, 1, &sector));
+
+  // Insert somewhere else entirely: points move with the sector.
+  auto insertion = denseSectorTable.insertSector(-3, -3, std::move(sector));
+  XCTAssertTrue(insertion.second);
+  XCTAssertEqual(denseSectorTable.sectorCount(), 2UL);
+  XCTAssertEqual(denseSectorTable.pointCount(), 3UL);
+  XCTAssertEqual(denseSectorTable.getPoint(-3, -3), 0);
+  XCTAssertEqual(denseSectorTable.getPoint(-1, -1), 20);
+  XCTAssertEqual((*insertion.first).second, 0);
+
+  // Insert on top of an existing sector: not moved.
+  DenseSectorTable<int>::sector_type otherSector;
+  denseSectorTable.extractSector(3, 3, &otherSector);
+  denseSectorTable.setPoint(4, 4, 40);
+  insertion = denseSectorTable.insertSector(5, 5, std::move(otherSector));
+  XCTAssertFalse(insertion.second);
+  XCTAssertFalse(otherSector.empty());
+  XCTAssertEqual(denseSectorTable.getPoint(3, 3), -1);
+  XCTAssertEqual(denseSectorTable.getPoint(4, 4), 40);
+}
+
+- (void)testEraseSector
+{
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+
+  denseSectorTable.setPoint(1, 1, 10);
+  denseSectorTable.setPoint(4, 4, 40);
+  denseSectorTable.setPoint(5, 5, 50);
+  XCTAssertEqual(denseSectorTable.sectorCount(), 2UL);
+
+  // Erase by point coordinates.
+  XCTAssertTrue(denseSectorTable.eraseSector(2, 0));
+  XCTAssertFalse(denseSectorTable.eraseSector(2, 0));
+  XCTAssertEqual(denseSectorTable.sectorCount(), 1UL);
+  XCTAssertEqual(denseSectorTable.pointCount(), 2UL);
+
+  // Erase by iterator.
+  DenseSectorTable<int>::const_iterator i = denseSectorTable.findPoint(5, 5);
+  XCTAssertTrue(denseSectorTable.eraseSector(i));
+  XCTAssertEqual(i, denseSectorTable.endPoint());
+  XCTAssertEqual(denseSectorTable.sectorCount(), 0UL);
+  XCTAssertEqual(denseSectorTable.pointCount(), 0UL);
+  XCTAssertFalse(denseSectorTable.eraseSector(i));
+}
+
+- (void)testPerformancePointTransfer
+{
+  // note: Pages a 16x16 sector out of one table and into another, one point at a time.
+  __block DenseSectorTable<int> sourceTable(16, 64, -1);
+  __block DenseSectorTable<int> destinationTable(16, 64, -1);
+  for (int y = 0; y < 256; ++y) {
+    for (int x = 0; x < 256; ++x) {
+      sourceTable.setPoint(x, y, y * 256 + x);
+    }
+  }
+  [self measureBlock:^{
+    for (int sy = 0; sy < 256; sy += 16) {
+      for (int sx = 0; sx < 256; sx += 16) {
+        for (int y = sy; y < sy + 16; ++y) {
+          for (int x = sx; x < sx + 16; ++x) {
+            destinationTable.setPoint(x, y, sourceTable.getPoint(x, y));
+            sourceTable.erasePoint(x, y);
+          }
+        }
+        sourceTable.pruneSector(sx, sy);
+      }
+    }
+    std::swap(sourceTable, destinationTable);
+  }];
+}
+
+- (void)testPerformanceSectorTransfer
+{
+  // note: Pages a 16x16 sector out of one table and into another, as a block.
+  __block DenseSectorTable<int> sourceTable(16, 64, -1);
+  __block DenseSectorTable<int> destinationTable(16, 64, -1);
+  for (int y = 0; y < 256; ++y) {
+    for (int x = 0; x < 256; ++x) {
+      sourceTable.setPoint(x, y, y * 256 + x);
+    }
+  }
+  [self measureBlock:^{
+    for (int sy = 0; sy < 256; sy += 16) {
+      for (int sx = 0; sx < 256; sx += 16) {
+        DenseSectorTable<int>::sector_type sector;
+        sourceTable.extractSector(sx, sy, &sector);
+        destinationTable.insertSector(sx, sy, std::move(sector));
+      }
+    }
+    std::swap(sourceTable, destinationTable);
+  }];
+}
+
+- (void)testPointCountAfterAssignment
+{
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+
+  // Assign through operator[].
+  denseSectorTable[{1, 1}] = 10;
+  denseSectorTable[{2, 1}] = denseSectorTable[{1, 1}];
+  XCTAssertEqual(denseSectorTable.getPoint(2, 1), 10);
+  XCTAssertEqual(denseSectorTable.pointCount(), 2UL);
+  denseSectorTable[{1, 1}] = -1;
+  XCTAssertEqual(denseSectorTable.pointCount(), 1UL);
+  XCTAssertEqual(denseSectorTable.sectorPointCount(1, 1), 1UL);
+  int value = denseSectorTable[{2, 1}];
+  XCTAssertEqual(value, 10);
+
+  // Assign through an iterator: accounted for at once.
+  denseSectorTable.setPoint(0, 0, 0);
+  denseSectorTable.setPoint(2, 2, 20);
+  XCTAssertEqual(denseSectorTable.pointCount(), 3UL);
+  for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+    if ((*p).second == 10) {
+      (*p).second = -1;
+    }
+  }
+  XCTAssertEqual(denseSectorTable.pointCount(), 2UL);
+  XCTAssertEqual(denseSectorTable.sectorPointCount(0, 0), 2UL);
+  XCTAssertFalse(denseSectorTable.sectorEmpty(0, 0));
+
+  // Assign and then stop iterating: the iterator is never advanced past the write.
+  DenseSectorTable<int> breakTable(16, 0, -1);
+  breakTable.setPoint(0, 0, 5);
+  breakTable.setPoint(1, 0, 6);
+  for (auto p = breakTable.beginPoint(); p != breakTable.endPoint(); ++p) {
+    if ((*p).first == make_pair(0, 0)) {
+      (*p).second = -1;
+      break;
+    }
+  }
+  XCTAssertEqual(breakTable.pointCount(), 1UL);
+  size_t iteratedCount = 0;
+  for (auto p = breakTable.beginPoint(); p != breakTable.endPoint(); ++p) {
+    ++iteratedCount;
+    XCTAssertNotEqual((*p).second, -1);
+  }
+  XCTAssertEqual(iteratedCount, 1UL);
+
+  // Assign through a lone iterator at the last (here, only) point.
+  DenseSectorTable<int> loneTable(16, 0, -1);
+  loneTable.setPoint(0, 0, 5);
+  (*loneTable.beginPoint()).second = -1;
+  XCTAssertEqual(loneTable.pointCount(), 0UL);
+  XCTAssertTrue(loneTable.sectorEmpty(0, 0));
+  XCTAssertTrue(loneTable.beginPoint() == loneTable.endPoint());
+  auto s = loneTable.beginSector(0, 0, true);
+  (*s).second = 3;
+  XCTAssertEqual(loneTable.pointCount(), 1UL);
+  XCTAssertFalse(loneTable.sectorEmpty(0, 0));
+  XCTAssertEqual(loneTable.getPoint(0, 0), 3);
+}
+
+- (void)testPerformanceIterationSparse
+{
+  // note: One point in each of 4096 16x16 sectors.
+  DenseSectorTable<int> denseSectorTable(16, 4096, -1);
+  for (int sy = 0; sy < 64; ++sy) {
+    for (int sx = 0; sx < 64; ++sx) {
+      denseSectorTable.setPoint(sx * 16 + 7, sy * 16 + 7, sy * 64 + sx);
+    }
+  }
+  [self measureBlock:^{
+    size_t pointCount = 0;
+    for (int i = 0; i < 10; ++i) {
+      for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+        ++pointCount;
+      }
+      pointCount += denseSectorTable.pointCount();
+    }
+    XCTAssertEqual(pointCount, 10UL * 2UL * 4096UL);
+  }];
+}
+
+- (void)testPerformanceIterationDense
+{
+  // note: Every point in each of 256 16x16 sectors.
+  DenseSectorTable<int> denseSectorTable(16, 256, -1);
+  for (int y = 0; y < 256; ++y) {
+    for (int x = 0; x < 256; ++x) {
+      denseSectorTable.setPoint(x, y, y * 256 + x);
+    }
+  }
+  [self measureBlock:^{
+    size_t pointCount = 0;
+    for (int i = 0; i < 10; ++i) {
+      for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+        ++pointCount;
+      }
+      pointCount += denseSectorTable.pointCount();
+    }
+    XCTAssertEqual(pointCount, 10UL * 2UL * 65536UL);
+  }];
+}
+
+- (void)testFlatMapBackend
+{
+  // note: Mirror every operation in a table with the default backend, and compare.  Use
+  // many small sectors so that the flat map rehashes, and erase enough of them to leave
+  // tombstones on probe paths.
+  DenseSectorTable<int> expectedTable(2, 4, -1);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend> denseSectorTable(2, 4, -1);
+  for (int y = -40; y < 40; ++y) {
+    for (int x = -40; x < 40; ++x) {
+      if ((x * 7 + y * 3) % 5 == 0) {
+        expectedTable.setPoint(x, y, y * 100 + x);
+        denseSectorTable.setPoint(x, y, y * 100 + x);
+      }
+    }
+  }
+  for (int y = -40; y < 40; y += 3) {
+    for (int x = -40; x < 40; ++x) {
+      expectedTable.erasePoint(x, y, true);
+      denseSectorTable.erasePoint(x, y, true);
+    }
+  }
+  denseSectorTable.eraseSector(-40, -40);
+  expectedTable.eraseSector(-40, -40);
+  XCTAssertEqual(denseSectorTable.pointCount(), expectedTable.pointCount());
+  XCTAssertEqual(denseSectorTable.sectorCount(), expectedTable.sectorCount());
+  for (int y = -42; y < 42; ++y) {
+    for (int x = -42; x < 42; ++x) {
+      XCTAssertEqual(denseSectorTable.getPoint(x, y), expectedTable.getPoint(x, y));
+    }
+  }
+
+  size_t iteratedCount = 0;
+  for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+    XCTAssertEqual((*p).second, expectedTable.getPoint((*p).first.first, (*p).first.second));
+    ++iteratedCount;
+  }
+  XCTAssertEqual(iteratedCount, expectedTable.pointCount());
+
+  // Move a sector out and back in.
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend>::sector_type sector;
+  XCTAssertTrue(denseSectorTable.extractSector(1, 1, &sector));
+  XCTAssertEqual(denseSectorTable.getPoint(1, 1), -1);
+  XCTAssertTrue(denseSectorTable.insertSector(1, 1, std::move(sector)).second);
+  XCTAssertEqual(denseSectorTable.getPoint(1, 1), expectedTable.getPoint(1, 1));
+  XCTAssertEqual(denseSectorTable.pointCount(), expectedTable.pointCount());
+
+  // Point references remain valid while the flat map rehashes.
+  auto reference = denseSectorTable[{ 0, 0 }];
+  for (int s = 0; s < 1000; ++s) {
+    denseSectorTable.setPoint(1000 + s * 2, 0, s);
+  }
+  reference = 42;
+  XCTAssertEqual(denseSectorTable.getPoint(0, 0), 42);
+}
+
+- (void)testPerformanceGetPointUnorderedMap
+{
+  DenseSectorTable<int> denseSectorTable(16, 4096, -1);
+  for (int y = -512; y < 512; y += 3) {
+    for (int x = -512; x < 512; x += 3) {
+      denseSectorTable.setPoint(x, y, 1);
+    }
+  }
+  [self measureBlock:^{
+    XCTAssertEqual(lookupSparseTrackPoints(denseSectorTable), 342 * 342);
+  }];
+}
+
+- (void)testPerformanceGetPointFlatMap
+{
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend> denseSectorTable(16, 4096, -1);
+  for (int y = -512; y < 512; y += 3) {
+    for (int x = -512; x < 512; x += 3) {
+      denseSectorTable.setPoint(x, y, 1);
+    }
+  }
+  [self measureBlock:^{
+    XCTAssertEqual(lookupSparseTrackPoints(denseSectorTable), 342 * 342);
+  }];
+}
+
+- (void)testCompileTimeSectorSize
+{
+  // note: Compare against the runtime-sized table across sector boundaries in all four
+  // quadrants.
+  DenseSectorTable<int> expectedTable(4, 16, -1);
+  DenseSectorTable<int, DenseSectorTableUnorderedMapBackend, 4> denseSectorTable(4, 16, -1);
+  XCTAssertEqual(denseSectorTable.sectorSize(), 4UL);
+  for (int y = -9; y < 9; ++y) {
+    for (int x = -9; x < 9; ++x) {
+      expectedTable.setPoint(x, y, (y + 9) * 18 + (x + 9));
+      denseSectorTable.setPoint(x, y, (y + 9) * 18 + (x + 9));
+    }
+  }
+  XCTAssertEqual(denseSectorTable.sectorCount(), expectedTable.sectorCount());
+  XCTAssertEqual(denseSectorTable.sectorPointCount(-1, -1), 16UL);
+  XCTAssertEqual(denseSectorTable.sectorPointCount(-9, 8), 1UL);
+  for (int y = -9; y < 9; ++y) {
+    for (int x = -9; x < 9; ++x) {
+      XCTAssertEqual(denseSectorTable.getPoint(x, y), expectedTable.getPoint(x, y));
+    }
+  }
+  size_t iteratedCount = 0;
+  for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+    const std::pair<int, int>& xy = (*p).first;
+    XCTAssertEqual((*p).second, (xy.second + 9) * 18 + (xy.first + 9));
+    ++iteratedCount;
+  }
+  XCTAssertEqual(iteratedCount, 18UL * 18UL);
+}
+
+- (void)testPerformanceGetPointCompileTimeSectorSize
+{
+  // note: Same as testPerformanceGetPointFlatMap, which is the runtime-sized baseline.
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 4096, -1);
+  for (int y = -512; y < 512; y += 3) {
+    for (int x = -512; x < 512; x += 3) {
+      denseSectorTable.setPoint(x, y, 1);
+    }
+  }
+  [self measureBlock:^{
+    XCTAssertEqual(lookupSparseTrackPoints(denseSectorTable), 342 * 342);
+  }];
+}
+
+- (void)testPerformanceGetPointBoundedBackend
+{
+  DenseSectorTable<int, DenseSectorTableBoundedBackend, 16> denseSectorTable(16, -512, -512, 511, 511, -1);
+  for (int y = -512; y < 512; y += 3) {
+    for (int x = -512; x < 512; x += 3) {
+      denseSectorTable.setPoint(x, y, 1);
+    }
+  }
+  [self measureBlock:^{
+    XCTAssertEqual(lookupSparseTrackPoints(denseSectorTable), 342 * 342);
+  }];
+}
+
+- (void)testGetBlock
+{
+  // note: Windows spanning sectors in all four quadrants, including sectors which don't
+  // exist in the table.
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 4> compileTimeTable(4, 9, -1);
+  for (int y = -5; y < 5; ++y) {
+    for (int x = -5; x < 5; ++x) {
+      if ((x + y) % 3 != 0) {
+        denseSectorTable.setPoint(x, y, (y + 5) * 10 + (x + 5));
+        compileTimeTable.setPoint(x, y, (y + 5) * 10 + (x + 5));
+      }
+    }
+  }
+  for (int y0 = -8; y0 < 4; y0 += 3) {
+    for (int x0 = -8; x0 < 4; x0 += 2) {
+      const int width = 7;
+      const int height = 5;
+      int block[width * height];
+      int compileTimeBlock[width * height];
+      denseSectorTable.getBlock(x0, y0, width, height, block);
+      compileTimeTable.getBlock(x0, y0, width, height, compileTimeBlock);
+      for (int by = 0; by < height; ++by) {
+        for (int bx = 0; bx < width; ++bx) {
+          XCTAssertEqual(block[by * width + bx], denseSectorTable.getPoint(x0 + bx, y0 + by));
+          XCTAssertEqual(compileTimeBlock[by * width + bx], denseSectorTable.getPoint(x0 + bx, y0 + by));
+        }
+      }
+    }
+  }
+
+  int single = 0;
+  denseSectorTable.getBlock(1, 0, 1, 1, &single);
+  XCTAssertEqual(single, 56);
+}
+
+- (void)testRegionIteration
+{
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+  for (int y = -10; y < 10; ++y) {
+    for (int x = -10; x < 10; ++x) {
+      if ((x * 7 + y * 3) % 4 == 0) {
+        denseSectorTable.setPoint(x, y, (y + 10) * 20 + (x + 10));
+      }
+    }
+  }
+
+  // note: Regions inside, overlapping, and outside the set points; the last is big
+  // enough that the iterator scans the table instead of looking up sectors.
+  int regions[][4] = {
+    { 0, 0, 0, 0 }, { -1, -1, 1, 1 }, { -5, 2, 4, 8 }, { -12, -12, -8, -11 }, { 20, 20, 30, 30 },
+    { 3, 3, 2, 2 }, { -1000, -1000, 1000, 1000 },
+  };
+  for (auto& region : regions) {
+    unordered_set<int> expectedValues;
+    for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+      const std::pair<int, int>& xy = (*p).first;
+      if (xy.first >= region[0] && xy.first <= region[2] && xy.second >= region[1] && xy.second <= region[3]) {
+        expectedValues.insert((*p).second);
+      }
+    }
+    unordered_set<int> values;
+    const DenseSectorTable<int>& constDenseSectorTable = denseSectorTable;
+    for (auto p = constDenseSectorTable.beginRegion(region[0], region[1], region[2], region[3]); p != constDenseSectorTable.endRegion(); ++p) {
+      const std::pair<int, int>& xy = (*p).first;
+      XCTAssertEqual((*p).second, (xy.second + 10) * 20 + (xy.first + 10));
+      XCTAssertTrue(values.insert((*p).second).second);
+    }
+    XCTAssertTrue(values == expectedValues);
+  }
+
+  // Assign through a non-const region iterator.
+  size_t pointCount = denseSectorTable.pointCount();
+  size_t regionPointCount = 0;
+  for (auto p = denseSectorTable.beginRegion(-2, -2, 2, 2); p != denseSectorTable.endRegion(); ++p) {
+    (*p).second = -2 - (*p).second;
+    ++regionPointCount;
+  }
+  XCTAssertGreaterThan(regionPointCount, 0UL);
+  XCTAssertEqual(denseSectorTable.pointCount(), pointCount);
+  XCTAssertEqual(denseSectorTable.getPoint(0, 0), -2 - 210);
+
+  // Convert region_iterator to const_region_iterator.
+  DenseSectorTable<int>::const_region_iterator i = denseSectorTable.beginRegion(0, 0, 0, 0);
+  XCTAssertEqual((*i).second, -2 - 210);
+  ++i;
+  XCTAssertTrue(i == denseSectorTable.endRegion());
+
+  // Iterate over an empty table, and over a table emptied by pruning.
+  DenseSectorTable<int> emptyDenseSectorTable(16, 0, 0);
+  XCTAssertTrue(emptyDenseSectorTable.beginRegion(0, 0, 1000, 1000) == emptyDenseSectorTable.endRegion());
+  emptyDenseSectorTable.setPoint(3, 4, 1);
+  emptyDenseSectorTable.erasePoint(3, 4);
+  emptyDenseSectorTable.pruneSectors();
+  XCTAssertTrue(emptyDenseSectorTable.beginRegion(-1000, -1000, 1000, 1000) == emptyDenseSectorTable.endRegion());
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend> emptyFlatMapDenseSectorTable(16, 0, 0);
+  XCTAssertTrue(emptyFlatMapDenseSectorTable.beginRegion(0, 0, 1000, 1000) == emptyFlatMapDenseSectorTable.endRegion());
+  DenseSectorTable<int, DenseSectorTableBoundedBackend> emptyBoundedDenseSectorTable(16, -4, -4, 4, 4, 0);
+  XCTAssertTrue(emptyBoundedDenseSectorTable.beginRegion(-1000, -1000, 1000, 1000) == emptyBoundedDenseSectorTable.endRegion());
+}
+
+- (void)testPerformanceRegionIterationSmallWorld
+{
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 64, -1);
+  fillSparseWorld(denseSectorTable, 128);
+  [self measureBlock:^{
+    size_t pointCount = 0;
+    for (int i = 0; i < 1000; ++i) {
+      for (auto p = denseSectorTable.beginRegion(-20, -20, 19, 19); p != denseSectorTable.endRegion(); ++p) {
+        ++pointCount;
+      }
+    }
+    XCTAssertEqual(pointCount, 1000UL * 13UL * 13UL);
+  }];
+}
+
+- (void)testPerformanceRegionIterationLargeWorld
+{
+  // note: Same region as testPerformanceRegionIterationSmallWorld, but the world is 256
+  // times larger; time should be about the same.
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 16384, -1);
+  fillSparseWorld(denseSectorTable, 2048);
+  [self measureBlock:^{
+    size_t pointCount = 0;
+    for (int i = 0; i < 1000; ++i) {
+      for (auto p = denseSectorTable.beginRegion(-20, -20, 19, 19); p != denseSectorTable.endRegion(); ++p) {
+        ++pointCount;
+      }
+    }
+    XCTAssertEqual(pointCount, 1000UL * 13UL * 13UL);
+  }];
+}
+
+- (void)testCopyOnWrite
+{
+  DenseSectorTable<int> denseSectorTable(3, 9, -1);
+  for (int p = 0; p < 81; p += 2) {
+    denseSectorTable.setPoint(p % 9, p / 9, p);
+  }
+  DenseSectorTable<int> snapshot(denseSectorTable);
+
+  // Writes to the original don't affect the copy, and vice versa.
+  denseSectorTable.setPoint(0, 0, 100);
+  denseSectorTable.erasePoint(2, 0);
+  denseSectorTable[{ 4, 0 }] = 104;
+  denseSectorTable.eraseSector(8, 8);
+  snapshot.setPoint(1, 0, 201);
+  XCTAssertEqual(denseSectorTable.getPoint(0, 0), 100);
+  XCTAssertEqual(denseSectorTable.getPoint(1, 0), -1);
+  XCTAssertEqual(denseSectorTable.getPoint(2, 0), -1);
+  XCTAssertEqual(denseSectorTable.getPoint(4, 0), 104);
+  XCTAssertEqual(denseSectorTable.getPoint(8, 8), -1);
+  XCTAssertEqual(denseSectorTable.pointCount(), 41UL - 1UL - 5UL);
+  XCTAssertEqual(snapshot.getPoint(0, 0), 0);
+  XCTAssertEqual(snapshot.getPoint(1, 0), 201);
+  XCTAssertEqual(snapshot.getPoint(2, 0), 2);
+  XCTAssertEqual(snapshot.getPoint(4, 0), 4);
+  XCTAssertEqual(snapshot.getPoint(8, 8), 80);
+  XCTAssertEqual(snapshot.pointCount(), 42UL);
+
+  // Writes through iterators and extracted sectors don't affect the copy.
+  DenseSectorTable<int> secondSnapshot(denseSectorTable);
+  for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+    (*p).second = -(*p).second - 2;
+  }
+  DenseSectorTable<int>::sector_type sector;
+  XCTAssertTrue(secondSnapshot.extractSector(3, 3, &sector));
+  DenseSectorTable<int>::sector_type sectorCopy(sector);
+  DenseSectorTable<int> otherTable(3, 9, -1);
+  XCTAssertTrue(otherTable.insertSector(3, 3, std::move(sectorCopy)).second);
+  otherTable.setPoint(3, 3, 300);
+  XCTAssertTrue(secondSnapshot.insertSector(3, 3, std::move(sector)).second);
+  XCTAssertEqual(secondSnapshot.getPoint(3, 3), 30);
+  XCTAssertEqual(otherTable.getPoint(3, 3), 300);
+  XCTAssertEqual(secondSnapshot.getPoint(4, 4), 40);
+  XCTAssertEqual(denseSectorTable.getPoint(4, 4), -42);
+  XCTAssertEqual(snapshot.getPoint(4, 4), 40);
+}
+
+- (void)testSnapshotConcurrentEdit
+{
+  // note: Each generation, take a snapshot, and then, while another thread iterates over
+  // the snapshot, rewrite (and restructure) the original.  The snapshot must always see
+  // the complete previous generation.
+  typedef DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> TestTable;
+  const int worldSize = 96;
+  TestTable denseSectorTable(16, 64, -1);
+  for (int y = -worldSize / 2; y < worldSize / 2; ++y) {
+    for (int x = -worldSize / 2; x < worldSize / 2; ++x) {
+      denseSectorTable.setPoint(x, y, 0);
+    }
+  }
+
+  for (int generation = 1; generation <= 50; ++generation) {
+    std::unique_ptr<const TestTable> snapshot(new TestTable(denseSectorTable));
+    std::atomic<size_t> badPointCount(0);
+    std::thread reader([&snapshot, &badPointCount, generation, worldSize]() {
+      for (int pass = 0; pass < 4; ++pass) {
+        size_t pointCount = 0;
+        for (auto p = snapshot->beginPoint(); p != snapshot->endPoint(); ++p) {
+          if ((*p).second != generation - 1) {
+            ++badPointCount;
+          }
+          ++pointCount;
+        }
+        if (pointCount != static_cast<size_t>(worldSize * worldSize) || snapshot->pointCount() != pointCount) {
+          ++badPointCount;
+        }
+      }
+      // note: Destroy the snapshot here, too, concurrently with writes to the original.
+      snapshot.reset();
+    });
+    for (int y = -worldSize / 2; y < worldSize / 2; ++y) {
+      if (y % 16 == 0) {
+        denseSectorTable.eraseSector(generation % worldSize - worldSize / 2, y);
+      }
+      for (int x = -worldSize / 2; x < worldSize / 2; ++x) {
+        denseSectorTable.setPoint(x, y, generation);
+      }
+    }
+    reader.join();
+    XCTAssertEqual(badPointCount.load(), 0UL);
+    XCTAssertEqual(denseSectorTable.pointCount(), static_cast<size_t>(worldSize * worldSize));
+  }
+}
+
+- (void)testBlockPool
+{
+  DenseSectorTableBlockPool blockPool(2);
+  {
+    DenseSectorTable<int> denseSectorTable(4, 9, -1, &blockPool);
+    denseSectorTable.setPoint(0, 0, 1);
+    denseSectorTable.setPoint(4, 0, 2);
+    denseSectorTable.setPoint(8, 0, 3);
+    XCTAssertEqual(blockPool.systemAllocationCount(), 3UL);
+
+    // Pruned sectors are recycled.
+    denseSectorTable.erasePoint(4, 0, true);
+    denseSectorTable.erasePoint(8, 0, true);
+    XCTAssertEqual(blockPool.freeBlockCount(), 2UL);
+    denseSectorTable.setPoint(0, 4, 4);
+    denseSectorTable.setPoint(0, 8, 5);
+    XCTAssertEqual(blockPool.systemAllocationCount(), 3UL);
+    XCTAssertEqual(blockPool.allocationCount(), 5UL);
+    XCTAssertEqual(blockPool.freeBlockCount(), 0UL);
+    XCTAssertEqual(denseSectorTable.getPoint(0, 8), 5);
+    XCTAssertEqual(denseSectorTable.pointCount(), 3UL);
+
+    // Copy-on-write copies come from the pool, too.
+    DenseSectorTable<int> snapshot(denseSectorTable);
+    denseSectorTable.setPoint(1, 0, 6);
+    XCTAssertEqual(blockPool.allocationCount(), 6UL);
+    XCTAssertEqual(snapshot.getPoint(1, 0), -1);
+  }
+  // note: Only two free blocks are retained; the rest go back to the system.
+  XCTAssertEqual(blockPool.freeBlockCount(), 2UL);
+}
+
+- (void)testPerformanceDragReplaySystemAllocator
+{
+  // note: Allocators aren't copyable, so pass them to the block by pointer.
+  CountingBlockAllocator countingAllocator;
+  CountingBlockAllocator *allocator = &countingAllocator;
+  [self measureBlock:^{
+    DenseSectorTable<int> denseSectorTable(16, 64, -1, allocator);
+    replayDrag(denseSectorTable, 500);
+  }];
+  // note: Without a pool, every block comes from the system (compare the block pool
+  // test, which needs only a handful).
+  XCTAssertGreaterThan(countingAllocator.allocationCount.load(), 1000UL);
+}
+
+- (void)testPerformanceDragReplayBlockPool
+{
+  DenseSectorTableBlockPool blockPool;
+  DenseSectorTableBlockPool *allocator = &blockPool;
+  [self measureBlock:^{
+    DenseSectorTable<int> denseSectorTable(16, 64, -1, allocator);
+    replayDrag(denseSectorTable, 500);
+  }];
+  XCTAssertGreaterThan(blockPool.allocationCount(), 1000UL);
+  XCTAssertLessThanOrEqual(blockPool.systemAllocationCount(), 6UL);
+}
+
+- (void)testSparseDenseSectors
+{
+  // note: Mirror operations in an all-dense table, crossing the threshold in both
+  // directions, and compare everything observable.
+  DenseSectorTable<int> expectedTable(4, 9, -1);
+  expectedTable.setDenseFillThreshold(0);
+  DenseSectorTable<int> denseSectorTable(4, 9, -1);
+  denseSectorTable.setDenseFillThreshold(4);
+  XCTAssertEqual(denseSectorTable.denseFillThreshold(), 4UL);
+
+  auto compareTables = [&]() {
+    XCTAssertEqual(denseSectorTable.pointCount(), expectedTable.pointCount());
+    XCTAssertEqual(denseSectorTable.sectorCount(), expectedTable.sectorCount());
+    auto e = expectedTable.beginPoint();
+    for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p, ++e) {
+      XCTAssertTrue(e != expectedTable.endPoint());
+      XCTAssertTrue((*p).first == (*e).first);
+      XCTAssertEqual((*p).second, (*e).second);
+    }
+    XCTAssertTrue(e == expectedTable.endPoint());
+    int block[100];
+    int expectedBlock[100];
+    denseSectorTable.getBlock(-5, -5, 10, 10, block);
+    expectedTable.getBlock(-5, -5, 10, 10, expectedBlock);
+    for (int b = 0; b < 100; ++b) {
+      XCTAssertEqual(block[b], expectedBlock[b]);
+    }
+  };
+
+  unsigned int random = 1;
+  for (int round = 0; round < 2000; ++round) {
+    random = random * 1103515245 + 12345;
+    int x = static_cast<int>((random >> 8) % 10) - 5;
+    int y = static_cast<int>((random >> 16) % 10) - 5;
+    // note: Set more often in the first half, and erase more often in the second half.
+    bool set = ((random >> 4) % 4 != 0) == (round < 1000);
+    if (set) {
+      denseSectorTable.setPoint(x, y, round);
+      expectedTable.setPoint(x, y, round);
+    } else {
+      denseSectorTable.erasePoint(x, y, true);
+      expectedTable.erasePoint(x, y, true);
+    }
+    XCTAssertEqual(denseSectorTable.getPoint(x, y), expectedTable.getPoint(x, y));
+    if (round % 100 == 0) {
+      compareTables();
+    }
+  }
+  compareTables();
+
+  // Assign through iterators, including to unset points in a sparse sector.
+  denseSectorTable.eraseSector(0, 0);
+  expectedTable.eraseSector(0, 0);
+  denseSectorTable.setPoint(1, 1, 11);
+  expectedTable.setPoint(1, 1, 11);
+  for (auto p = denseSectorTable.beginSector(0, 0, true); p != denseSectorTable.endSector(0, 0, true); ++p) {
+    (*p).second = ((*p).first.first == (*p).first.second ? 100 : -1);
+  }
+  for (auto p = expectedTable.beginSector(0, 0, true); p != expectedTable.endSector(0, 0, true); ++p) {
+    (*p).second = ((*p).first.first == (*p).first.second ? 100 : -1);
+  }
+  for (auto p = denseSectorTable.beginPoint(); p != denseSectorTable.endPoint(); ++p) {
+    if ((*p).second % 3 == 0) {
+      (*p).second = -1;
+    }
+  }
+  for (auto p = expectedTable.beginPoint(); p != expectedTable.endPoint(); ++p) {
+    if ((*p).second % 3 == 0) {
+      (*p).second = -1;
+    }
+  }
+  compareTables();
+}
+
+- (void)testSparseDenseMemory
+{
+  // note: A sparse world, like an infinite-grid track of long straight runs: one 16-point
+  // run in each 16x16 sector.  And a dense world: every point set.
+  CountingBlockAllocator adaptiveAllocator;
+  CountingBlockAllocator denseAllocator;
+  DenseSectorTable<int> adaptiveTable(16, 256, -1, &adaptiveAllocator);
+  DenseSectorTable<int> denseTable(16, 256, -1, &denseAllocator);
+  denseTable.setDenseFillThreshold(0);
+  for (int sy = 0; sy < 16; ++sy) {
+    for (int sx = 0; sx < 16; ++sx) {
+      for (int i = 0; i < 16; ++i) {
+        adaptiveTable.setPoint(sx * 16 + i, sy * 16 + 5, i);
+        denseTable.setPoint(sx * 16 + i, sy * 16 + 5, i);
+      }
+    }
+  }
+  XCTAssertLessThan(adaptiveAllocator.byteCount.load() * 4, denseAllocator.byteCount.load());
+
+  for (int y = 0; y < 256; ++y) {
+    for (int x = 0; x < 256; ++x) {
+      adaptiveTable.setPoint(x, y, x);
+      denseTable.setPoint(x, y, x);
+    }
+  }
+  XCTAssertEqual(adaptiveAllocator.byteCount.load(), denseAllocator.byteCount.load());
+}
+
+- (void)testHandleValueMemory
+{
+  // note: FLTrackGrid stores 32-bit segment handles rather than object pointers; compare
+  // the two for a 256x256 world, both full and with one 16-point run per sector.  Totals
+  // include what FLSegmentHandleTable::byteCount() reports for one segment per cell: a
+  // node pointer per handle.
+  const size_t handleTableBytesPerSegment = sizeof(void *);
+  DenseSectorTable<void *, DenseSectorTableBoundedBackend, 16> pointerTable(16, 0, 0, 255, 255, nullptr);
+  DenseSectorTable<uint32_t, DenseSectorTableBoundedBackend, 16> handleTable(16, 0, 0, 255, 255, 0);
+  static int objects[16];
+  for (int sy = 0; sy < 16; ++sy) {
+    for (int sx = 0; sx < 16; ++sx) {
+      for (int i = 0; i < 16; ++i) {
+        pointerTable.setPoint(sx * 16 + i, sy * 16 + 5, &objects[i]);
+        handleTable.setPoint(sx * 16 + i, sy * 16 + 5, static_cast<uint32_t>(i + 1));
+      }
+    }
+  }
+  size_t sparsePointerByteCount = pointerTable.memoryUsage().sectorBlockByteCount;
+  size_t sparseHandleByteCount = handleTable.memoryUsage().sectorBlockByteCount;
+  size_t sparseHandleTableByteCount = handleTable.pointCount() * handleTableBytesPerSegment;
+  XCTAssertLessThan(sparseHandleByteCount, sparsePointerByteCount);
+  // note: A run of track saves a pointer's worth of block per segment, paying for the table.
+  XCTAssertLessThanOrEqual(sparseHandleByteCount + sparseHandleTableByteCount, sparsePointerByteCount);
+
+  for (int y = 0; y < 256; ++y) {
+    for (int x = 0; x < 256; ++x) {
+      pointerTable.setPoint(x, y, &objects[x % 16]);
+      handleTable.setPoint(x, y, static_cast<uint32_t>(x % 16 + 1));
+    }
+  }
+  size_t densePointerByteCount = pointerTable.memoryUsage().sectorBlockByteCount;
+  size_t denseHandleByteCount = handleTable.memoryUsage().sectorBlockByteCount;
+  size_t denseHandleTableByteCount = handleTable.pointCount() * handleTableBytesPerSegment;
+  // note: Values are most of a dense block, but the bitmap and block header are not halved.
+  XCTAssertLessThan(denseHandleByteCount * 10, densePointerByteCount * 6);
+  // note: But a full world saves only four bytes per cell, and the table costs more than
+  // that: handles are for address independence (snapshots, serialization), not memory.
+  XCTAssertGreaterThan(denseHandleByteCount + denseHandleTableByteCount, densePointerByteCount);
+}
+
+- (void)testMemoryUsage
+{
+  CountingBlockAllocator allocator;
+  {
+    DenseSectorTable<int, CountingUnorderedMapBackend> denseSectorTable(16, 8, -1, &allocator);
+    DenseSectorTableMemoryUsage memoryUsage = denseSectorTable.memoryUsage();
+    XCTAssertEqual(memoryUsage.sectorTableByteCount, 0UL);
+    XCTAssertEqual(memoryUsage.sectorBlockByteCount, 0UL);
+    XCTAssertEqual(memoryUsage.bucketArrayByteCount, countingStdAllocatorByteCount);
+
+    // note: Sparse sectors (one run each) and dense sectors (full); enough sectors to rehash.
+    for (int sy = 0; sy < 10; ++sy) {
+      for (int sx = 0; sx < 10; ++sx) {
+        int length = ((sx + sy) % 3 == 0 ? 256 : 16);
+        for (int p = 0; p < length; ++p) {
+          denseSectorTable.setPoint(sx * 16 + p % 16, sy * 16 + p / 16, p);
+        }
+      }
+    }
+    denseSectorTable.erasePoint(0, 0);
+    denseSectorTable.setPoint(-1, -1, 1);
+    denseSectorTable.erasePoint(-1, -1);
+    memoryUsage = denseSectorTable.memoryUsage();
+    XCTAssertEqual(memoryUsage.sectorTableByteCount + memoryUsage.bucketArrayByteCount, countingStdAllocatorByteCount);
+    XCTAssertEqual(memoryUsage.sectorBlockByteCount, allocator.byteCount.load());
+    XCTAssertEqual(memoryUsage.totalByteCount(),
+                   memoryUsage.sectorTableByteCount + memoryUsage.bucketArrayByteCount + memoryUsage.sectorBlockByteCount);
+
+    std::vector<size_t> histogram = denseSectorTable.sectorFillHistogram();
+    XCTAssertEqual(histogram.size(), 257UL);
+    XCTAssertEqual(histogram[0], 1UL);
+    XCTAssertEqual(histogram[16], 66UL);
+    XCTAssertEqual(histogram[255], 1UL);
+    XCTAssertEqual(histogram[256], 33UL);
+    size_t sectorCount = 0;
+    for (size_t count : histogram) {
+      sectorCount += count;
+    }
+    XCTAssertEqual(sectorCount, denseSectorTable.sectorCount());
+
+    // note: Shared blocks are counted by each copy.
+    DenseSectorTable<int, CountingUnorderedMapBackend> copyTable(denseSectorTable);
+    XCTAssertEqual(copyTable.memoryUsage().sectorBlockByteCount, allocator.byteCount.load());
+  }
+  XCTAssertEqual(countingStdAllocatorByteCount, 0UL);
+  XCTAssertEqual(allocator.byteCount.load(), 0UL);
+
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> flatMapTable(16, 8, -1, &allocator);
+  fillSparseWorld(flatMapTable, 200);
+  DenseSectorTableMemoryUsage flatMapMemoryUsage = flatMapTable.memoryUsage();
+  XCTAssertEqual(flatMapMemoryUsage.sectorTableByteCount, 0UL);
+  XCTAssertGreaterThanOrEqual(flatMapMemoryUsage.bucketArrayByteCount, flatMapTable.sectorCount() * sizeof(void *));
+  XCTAssertEqual(flatMapMemoryUsage.sectorBlockByteCount, allocator.byteCount.load());
+}
+
+- (void)testMortonIteration
+{
+  XCTAssertLessThan(DenseSectorTableMortonCode(0, 0), DenseSectorTableMortonCode(1, 0));
+  XCTAssertLessThan(DenseSectorTableMortonCode(1, 0), DenseSectorTableMortonCode(0, 1));
+  XCTAssertLessThan(DenseSectorTableMortonCode(0, 1), DenseSectorTableMortonCode(1, 1));
+  XCTAssertLessThan(DenseSectorTableMortonCode(1, 1), DenseSectorTableMortonCode(2, 0));
+  XCTAssertLessThan(DenseSectorTableMortonCode(-1, -1), DenseSectorTableMortonCode(0, 0));
+  XCTAssertLessThan(DenseSectorTableMortonCode(-1, 0), DenseSectorTableMortonCode(0, 0));
+
+  // note: Same points, inserted in different orders into tables with different backends.
+  DenseSectorTable<int> denseSectorTable(4, 4, -1);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 4> otherTable(4, 64, -1);
+  std::vector<std::pair<int, int>> points;
+  for (int y = -10; y < 14; ++y) {
+    for (int x = -13; x < 11; ++x) {
+      if ((x * 7 + y * 3) % 5 == 0) {
+        points.emplace_back(x, y);
+      }
+    }
+  }
+  for (auto& xy : points) {
+    denseSectorTable.setPoint(xy.first, xy.second, xy.first * 100 + xy.second);
+  }
+  for (auto xy = points.rbegin(); xy != points.rend(); ++xy) {
+    otherTable.setPoint(xy->first, xy->second, xy->first * 100 + xy->second);
+  }
+  denseSectorTable.setPoint(40, 40, 1);
+  denseSectorTable.erasePoint(40, 40);
+
+  std::vector<std::pair<int, int>> order;
+  for (auto p = denseSectorTable.beginPointMorton(); p != denseSectorTable.endPointMorton(); ++p) {
+    std::pair<int, int> xy = (*p).first;
+    XCTAssertEqual((*p).second, xy.first * 100 + xy.second);
+    if (!order.empty()) {
+      // Sectors in Morton order; points in the same sector in row-major order.
+      std::pair<int, int> lastXY = order.back();
+      int sx = xy.first >> 2;
+      int sy = xy.second >> 2;
+      int lastSX = lastXY.first >> 2;
+      int lastSY = lastXY.second >> 2;
+      if (sx == lastSX && sy == lastSY) {
+        XCTAssertTrue(xy.second > lastXY.second || (xy.second == lastXY.second && xy.first > lastXY.first));
+      } else {
+        XCTAssertLessThan(DenseSectorTableMortonCode(lastSX, lastSY), DenseSectorTableMortonCode(sx, sy));
+      }
+    }
+    order.push_back(xy);
+  }
+  XCTAssertEqual(order.size(), points.size());
+  std::vector<std::pair<int, int>> sortedOrder(order);
+  std::sort(sortedOrder.begin(), sortedOrder.end());
+  std::vector<std::pair<int, int>> sortedPoints(points);
+  std::sort(sortedPoints.begin(), sortedPoints.end());
+  XCTAssertTrue(sortedOrder == sortedPoints);
+
+  size_t o = 0;
+  const DenseSectorTable<int, DenseSectorTableFlatMapBackend, 4>& constOtherTable = otherTable;
+  for (auto p = constOtherTable.beginPointMorton(); p != constOtherTable.endPointMorton(); ++p, ++o) {
+    XCTAssertTrue(o < order.size() && (*p).first == order[o]);
+  }
+  XCTAssertEqual(o, order.size());
+
+  // Assignment through the iterator, including erasing by assigning the null value.
+  for (auto p = denseSectorTable.beginPointMorton(); p != denseSectorTable.endPointMorton(); ++p) {
+    if ((*p).first.first < 0) {
+      (*p).second = -1;
+    } else {
+      (*p).second = 7;
+    }
+  }
+  size_t positiveCount = 0;
+  for (auto& xy : points) {
+    if (xy.first >= 0) {
+      ++positiveCount;
+      XCTAssertEqual(denseSectorTable.getPoint(xy.first, xy.second), 7);
+    } else {
+      XCTAssertEqual(denseSectorTable.getPoint(xy.first, xy.second), -1);
+    }
+  }
+  XCTAssertEqual(denseSectorTable.pointCount(), positiveCount);
+  DenseSectorTable<int>::const_morton_iterator c = denseSectorTable.beginPointMorton();
+  XCTAssertTrue(c != static_cast<const DenseSectorTable<int>&>(denseSectorTable).endPointMorton());
+
+  DenseSectorTable<int> emptyTable(4, 4, -1);
+  XCTAssertTrue(emptyTable.beginPointMorton() == emptyTable.endPointMorton());
+}
+
+- (void)testPerformanceNeighborPassHashOrder
+{
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 4096, -1);
+  fillTrackRowWorld(denseSectorTable, 1024);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> *table = &denseSectorTable;
+  [self measureBlock:^{
+    size_t neighborCount = countNeighbors(*table, table->beginPoint(), table->endPoint());
+    XCTAssertEqual(neighborCount, 512UL * (1024UL * 2UL - 2UL));
+  }];
+}
+
+- (void)testPerformanceNeighborPassMortonOrder
+{
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 4096, -1);
+  fillTrackRowWorld(denseSectorTable, 1024);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> *table = &denseSectorTable;
+  [self measureBlock:^{
+    size_t neighborCount = countNeighbors(*table, table->beginPointMorton(), table->endPointMorton());
+    XCTAssertEqual(neighborCount, 512UL * (1024UL * 2UL - 2UL));
+  }];
+}
+
+- (void)testSetPoints
+{
+  // note: Compare against setPoint() on each tuple in order: duplicates (last wins), null
+  // values, existing sectors (sparse and dense), and new sectors (sparse and dense).
+  DenseSectorTable<int> expectedTable(4, 4, -1);
+  DenseSectorTable<int> denseSectorTable(4, 4, -1);
+  for (int p = 0; p < 16; ++p) {
+    expectedTable.setPoint(p % 4, p / 4, p);
+    denseSectorTable.setPoint(p % 4, p / 4, p);
+  }
+  expectedTable.setPoint(4, 0, 40);
+  denseSectorTable.setPoint(4, 0, 40);
+
+  std::vector<std::tuple<int, int, int>> points;
+  points.emplace_back(1, 1, 100);
+  points.emplace_back(2, 2, -1);
+  points.emplace_back(5, 0, 50);
+  points.emplace_back(-3, -3, 7);
+  points.emplace_back(-3, -3, 8);
+  points.emplace_back(-4, -3, 9);
+  points.emplace_back(-4, -3, -1);
+  points.emplace_back(20, 20, -1);
+  for (int p = 0; p < 16; ++p) {
+    points.emplace_back(10 + p % 4 - 2, 10 + p / 4 - 2, 1000 + p);
+  }
+  points.emplace_back(1, 1, 101);
+  for (auto& point : points) {
+    expectedTable.setPoint(std::get<0>(point), std::get<1>(point), std::get<2>(point));
+  }
+  denseSectorTable.setPoints(points);
+
+  XCTAssertEqual(denseSectorTable.pointCount(), expectedTable.pointCount());
+  XCTAssertEqual(denseSectorTable.sectorCount(), expectedTable.sectorCount());
+  for (int y = -8; y < 24; ++y) {
+    for (int x = -8; x < 24; ++x) {
+      XCTAssertEqual(denseSectorTable.getPoint(x, y), expectedTable.getPoint(x, y));
+    }
+  }
+  XCTAssertEqual(denseSectorTable.getPoint(1, 1), 101);
+  XCTAssertEqual(denseSectorTable.getPoint(-3, -3), 8);
+  XCTAssertEqual(denseSectorTable.getPoint(-4, -3), -1);
+
+  // note: Points spread too far apart for the counting sort.
+  std::vector<std::tuple<int, int, int>> farPoints;
+  farPoints.emplace_back(1000000, -1000000, 1);
+  farPoints.emplace_back(-1000000, 1000000, 2);
+  farPoints.emplace_back(0, 0, 3);
+  farPoints.emplace_back(1000001, -1000000, 4);
+  farPoints.emplace_back(1000000, -1000000, 5);
+  DenseSectorTable<int> farTable(4, 4, -1);
+  farTable.setPoints(farPoints);
+  XCTAssertEqual(farTable.pointCount(), 4UL);
+  XCTAssertEqual(farTable.sectorCount(), 3UL);
+  XCTAssertEqual(farTable.getPoint(1000000, -1000000), 5);
+  XCTAssertEqual(farTable.getPoint(-1000000, 1000000), 2);
+  XCTAssertEqual(farTable.getPoint(0, 0), 3);
+  XCTAssertEqual(farTable.getPoint(1000001, -1000000), 4);
+
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> flatMapTable(16, 0, -1);
+  std::vector<std::tuple<int, int, int>> squareWorld = shuffledSquareWorld(100);
+  flatMapTable.setPoints(squareWorld);
+  XCTAssertEqual(flatMapTable.pointCount(), 10000UL);
+  for (auto& point : squareWorld) {
+    XCTAssertEqual(flatMapTable.getPoint(std::get<0>(point), std::get<1>(point)), std::get<2>(point));
+  }
+}
+
+- (void)testPerformanceLoad10kSetPoint
+{
+  std::vector<std::tuple<int, int, int>> points = shuffledSquareWorld(100);
+  std::vector<std::tuple<int, int, int>> *pointsPointer = &points;
+  [self measureBlock:^{
+    for (int i = 0; i < 10; ++i) {
+      DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 64, -1);
+      for (auto& point : *pointsPointer) {
+        denseSectorTable.setPoint(std::get<0>(point), std::get<1>(point), std::get<2>(point));
+      }
+      XCTAssertEqual(denseSectorTable.pointCount(), 10000UL);
+    }
+  }];
+}
+
+- (void)testPerformanceLoad10kSetPoints
+{
+  std::vector<std::tuple<int, int, int>> points = shuffledSquareWorld(100);
+  std::vector<std::tuple<int, int, int>> *pointsPointer = &points;
+  [self measureBlock:^{
+    for (int i = 0; i < 10; ++i) {
+      DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 64, -1);
+      denseSectorTable.setPoints(*pointsPointer);
+      XCTAssertEqual(denseSectorTable.pointCount(), 10000UL);
+    }
+  }];
+}
+
+- (void)testPerformanceLoad100kSetPoint
+{
+  std::vector<std::tuple<int, int, int>> points = shuffledSquareWorld(317);
+  std::vector<std::tuple<int, int, int>> *pointsPointer = &points;
+  [self measureBlock:^{
+    DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 64, -1);
+    for (auto& point : *pointsPointer) {
+      denseSectorTable.setPoint(std::get<0>(point), std::get<1>(point), std::get<2>(point));
+    }
+    XCTAssertEqual(denseSectorTable.pointCount(), 317UL * 317UL);
+  }];
+}
+
+- (void)testPerformanceLoad100kSetPoints
+{
+  std::vector<std::tuple<int, int, int>> points = shuffledSquareWorld(317);
+  std::vector<std::tuple<int, int, int>> *pointsPointer = &points;
+  [self measureBlock:^{
+    DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 64, -1);
+    denseSectorTable.setPoints(*pointsPointer);
+    XCTAssertEqual(denseSectorTable.pointCount(), 317UL * 317UL);
+  }];
+}
+
+- (void)testColumnTable
+{
+  CountingBlockAllocator allocator;
+  {
+    DenseSectorColumnTable<4, uint8_t, int32_t, char> columnTable(0, &allocator);
+    XCTAssertEqual(columnTable.pointCount(), 0UL);
+    XCTAssertEqual(columnTable.getColumn<1>(3, 3), 0);
+
+    columnTable.setPoint(1, 2, 7, -100000, 'a');
+    columnTable.setPoint(-1, -2, 8, 200000, 'b');
+    columnTable.setColumn<2>(5, 5, 'c');
+    XCTAssertEqual(columnTable.pointCount(), 3UL);
+    XCTAssertEqual(columnTable.sectorCount(), 3UL);
+    XCTAssertEqual(columnTable.getColumn<0>(1, 2), 7);
+    XCTAssertEqual(columnTable.getColumn<1>(1, 2), -100000);
+    XCTAssertEqual(columnTable.getColumn<2>(1, 2), 'a');
+    XCTAssertEqual(columnTable.getColumn<1>(-1, -2), 200000);
+    XCTAssertEqual(columnTable.getColumn<0>(5, 5), 0);
+    XCTAssertEqual(columnTable.getColumn<2>(5, 5), 'c');
+    XCTAssertTrue(columnTable.isSet(5, 5));
+    XCTAssertFalse(columnTable.isSet(5, 6));
+
+    columnTable.setColumn<1>(1, 2, 3);
+    XCTAssertEqual(columnTable.getColumn<0>(1, 2), 7);
+    XCTAssertEqual(columnTable.getColumn<1>(1, 2), 3);
+    XCTAssertEqual(columnTable.pointCount(), 3UL);
+
+    size_t sectorCount = 0;
+    size_t pointCount = 0;
+    columnTable.forEachSector([&](const DenseSectorColumnTable<4, uint8_t, int32_t, char>::sector_view& sector) {
+      ++sectorCount;
+      pointCount += sector.pointCount();
+      for (size_t p = 0; p < 16; ++p) {
+        int x = sector.x0() + static_cast<int>(p % 4);
+        int y = sector.y0() + static_cast<int>(p / 4);
+        XCTAssertEqual(sector.isSet(p), columnTable.isSet(x, y));
+        XCTAssertEqual(sector.column<0>()[p], columnTable.getColumn<0>(x, y));
+        XCTAssertEqual(sector.column<1>()[p], columnTable.getColumn<1>(x, y));
+        XCTAssertEqual(sector.column<2>()[p], columnTable.getColumn<2>(x, y));
+      }
+    });
+    XCTAssertEqual(sectorCount, 3UL);
+    XCTAssertEqual(pointCount, 3UL);
+
+    // note: Returns true only if the sector was pruned, as DenseSectorTable does.
+    XCTAssertFalse(columnTable.erasePoint(1, 2));
+    XCTAssertEqual(columnTable.pointCount(), 2UL);
+    XCTAssertFalse(columnTable.erasePoint(1, 2, true));
+    XCTAssertEqual(columnTable.pointCount(), 2UL);
+    XCTAssertEqual(columnTable.getColumn<1>(1, 2), 0);
+    XCTAssertEqual(columnTable.sectorCount(), 3UL);
+    XCTAssertTrue(columnTable.erasePoint(5, 5, true));
+    XCTAssertEqual(columnTable.sectorCount(), 2UL);
+    XCTAssertEqual(columnTable.pointCount(), 1UL);
+    XCTAssertEqual(allocator.allocationCount.load() - allocator.deallocationCount.load(), 2UL);
+  }
+  XCTAssertEqual(allocator.byteCount.load(), 0UL);
+}
+
+- (void)testPerformanceScanSegmentPointers
+{
+  // note: Allocate segments in scrambled order, as a track built up over time would be.
+  std::vector<std::pair<int, int>> points;
+  for (int y = 0; y < scanWorldSize; ++y) {
+    for (int x = 0; x < scanWorldSize; ++x) {
+      points.emplace_back(x, y);
+    }
+  }
+  unsigned int random = 1;
+  for (size_t i = points.size() - 1; i > 0; --i) {
+    random = random * 1103515245 + 12345;
+    std::swap(points[i], points[(random >> 8) % (i + 1)]);
+  }
+  std::vector<std::unique_ptr<ScanSegment>> segments;
+  DenseSectorTable<ScanSegment *, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 1024, nullptr);
+  for (auto& xy : points) {
+    uint8_t typeAndRotation = scanTypeAndRotation(xy.first, xy.second);
+    segments.emplace_back(new ScanSegment(typeAndRotation >> 2, typeAndRotation & 3, xy.first & 1));
+    denseSectorTable.setPoint(xy.first, xy.second, segments.back().get());
+  }
+  DenseSectorTable<ScanSegment *, DenseSectorTableFlatMapBackend, 16> *table = &denseSectorTable;
+  [self measureBlock:^{
+    // note: Count switched segments of one type and rotation.
+    size_t matchCount = 0;
+    for (auto s = table->beginPoint(); s != table->endPoint(); ++s) {
+      ScanSegment *segment = (*s).second;
+      if (segment->segmentType() == 4 && segment->zRotationQuarters() == 1 && segment->switchPathId() == 1) {
+        ++matchCount;
+      }
+    }
+    XCTAssertEqual(matchCount, 10923UL);
+  }];
+}
+
+- (void)testPerformanceScanColumns
+{
+  ScanColumnTable columnTable(1024);
+  for (int y = 0; y < scanWorldSize; ++y) {
+    for (int x = 0; x < scanWorldSize; ++x) {
+      columnTable.setPoint(x, y, scanTypeAndRotation(x, y), static_cast<int8_t>(x & 1), 'a');
+    }
+  }
+  ScanColumnTable *table = &columnTable;
+  [self measureBlock:^{
+    size_t matchCount = 0;
+    table->forEachSector([&matchCount](const ScanColumnTable::sector_view& sector) {
+      const uint8_t *typesAndRotations = sector.column<0>();
+      const int8_t *switchPathIds = sector.column<1>();
+      for (size_t p = 0; p < ScanColumnTable::sectorLength; ++p) {
+        if (typesAndRotations[p] == ((4 << 2) | 1) && switchPathIds[p] == 1) {
+          ++matchCount;
+        }
+      }
+    });
+    XCTAssertEqual(matchCount, 10923UL);
+  }];
+}
+
+- (void)testOccupancyPyramid
+{
+  DenseSectorTableOccupancyPyramid pyramid(16);
+  XCTAssertEqual(pyramid.levelCount(), 15);
+  XCTAssertEqual(pyramid.cellSize(1), 64);
+  int xMin, yMin, xMax, yMax;
+  XCTAssertFalse(pyramid.getBounds(&xMin, &yMin, &xMax, &yMax));
+
+  // note: Compare against a brute-force set of points, including far-flung and negative
+  // coordinates.
+  std::set<std::pair<int, int>> points;
+  unsigned int random = 1;
+  for (int round = 0; round < 4000; ++round) {
+    random = random * 1103515245 + 12345;
+    int x = static_cast<int>((random >> 4) % 400) - 200;
+    int y = static_cast<int>((random >> 12) % 400) - 200;
+    if (round % 500 == 0) {
+      x = (round % 1000 == 0 ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max());
+      y = -(x / 2);
+    }
+    if (points.count(std::make_pair(x, y)) == 0) {
+      if ((random >> 20) % 3 != 0 || round % 500 == 0) {
+        points.emplace(x, y);
+        pyramid.add(x, y);
+      }
+    } else if ((random >> 20) % 3 == 0) {
+      points.erase(std::make_pair(x, y));
+      pyramid.remove(x, y);
+    }
+  }
+  XCTAssertEqual(pyramid.pointCount(), points.size());
+  XCTAssertTrue(pyramid.getBounds(&xMin, &yMin, &xMax, &yMax));
+  XCTAssertEqual(xMin, std::numeric_limits<int>::min());
+  XCTAssertEqual(xMax, std::numeric_limits<int>::max());
+
+  // Remove the far-flung points, and check bounds and cells against brute force.
+  for (auto xy = points.begin(); xy != points.end(); ) {
+    if (xy->first < -200 || xy->first >= 200) {
+      pyramid.remove(xy->first, xy->second);
+      xy = points.erase(xy);
+    } else {
+      ++xy;
+    }
+  }
+  int expectedXMin = std::numeric_limits<int>::max();
+  int expectedYMin = std::numeric_limits<int>::max();
+  int expectedXMax = std::numeric_limits<int>::min();
+  int expectedYMax = std::numeric_limits<int>::min();
+  std::set<std::pair<int, int>> expectedSectors;
+  std::set<std::pair<int, int>> expectedRegions;
+  std::set<std::pair<int, int>> expectedWindowRegions;
+  for (auto& xy : points) {
+    expectedXMin = std::min(expectedXMin, xy.first);
+    expectedYMin = std::min(expectedYMin, xy.second);
+    expectedXMax = std::max(expectedXMax, xy.first);
+    expectedYMax = std::max(expectedYMax, xy.second);
+    expectedSectors.emplace(xy.first >> 4, xy.second >> 4);
+    expectedRegions.emplace((xy.first >> 6) * 64, (xy.second >> 6) * 64);
+    if (xy.first >= -70 && xy.first <= 10 && xy.second >= 0 && xy.second <= 127) {
+      expectedWindowRegions.emplace((xy.first >> 6) * 64, (xy.second >> 6) * 64);
+    }
+  }
+  XCTAssertTrue(pyramid.getBounds(&xMin, &yMin, &xMax, &yMax));
+  XCTAssertEqual(xMin, expectedXMin);
+  XCTAssertEqual(yMin, expectedYMin);
+  XCTAssertEqual(xMax, expectedXMax);
+  XCTAssertEqual(yMax, expectedYMax);
+  XCTAssertEqual(pyramid.occupiedCellCount(0), expectedSectors.size());
+  XCTAssertEqual(pyramid.occupiedCellCount(1), expectedRegions.size());
+  for (int y = -210; y < 210; y += 7) {
+    for (int x = -210; x < 210; x += 7) {
+      XCTAssertEqual(pyramid.cellOccupied(0, x, y), expectedSectors.count(std::make_pair(x >> 4, y >> 4)) != 0);
+      size_t expectedSectorPointCount = 0;
+      for (auto& xy : points) {
+        if ((xy.first >> 4) == (x >> 4) && (xy.second >> 4) == (y >> 4)) {
+          ++expectedSectorPointCount;
+        }
+      }
+      XCTAssertEqual(pyramid.sectorPointCount(x, y), expectedSectorPointCount);
+    }
+  }
+
+  // A window where the region edges don't line up with the window.  (Regions which
+  // intersect the window but whose points are all outside it are still returned.)
+  std::vector<std::pair<int, int>> regions;
+  pyramid.getOccupiedCells(1, -70, 0, 10, 127, &regions);
+  std::set<std::pair<int, int>> windowRegions(regions.begin(), regions.end());
+  XCTAssertEqual(windowRegions.size(), regions.size());
+  for (auto& region : expectedWindowRegions) {
+    XCTAssertTrue(windowRegions.count(region) != 0);
+  }
+  for (auto& region : windowRegions) {
+    XCTAssertTrue(expectedRegions.count(region) != 0);
+    XCTAssertTrue(region.first >= -128 && region.first <= 0 && region.second >= 0 && region.second <= 64);
+  }
+  regions.clear();
+  pyramid.getOccupiedCells(1, std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), &regions);
+  std::set<std::pair<int, int>> allRegions(regions.begin(), regions.end());
+  XCTAssertTrue(allRegions == expectedRegions);
+
+  for (auto& xy : points) {
+    pyramid.remove(xy.first, xy.second);
+  }
+  XCTAssertFalse(pyramid.getBounds(&xMin, &yMin, &xMax, &yMax));
+  for (int level = 0; level < pyramid.levelCount(); ++level) {
+    XCTAssertEqual(pyramid.occupiedCellCount(level), 0UL);
+  }
+}
+
+- (void)testPerformanceBoundsScan1M
+{
+  // note: The alternative to the occupancy pyramid: scan every point.
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 4096, -1);
+  for (int y = 0; y < 1000; ++y) {
+    for (int x = 0; x < 1000; ++x) {
+      denseSectorTable.setPoint(x - 500, y - 500, 1);
+    }
+  }
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> *table = &denseSectorTable;
+  [self measureBlock:^{
+    int xMin = std::numeric_limits<int>::max();
+    int yMin = std::numeric_limits<int>::max();
+    int xMax = std::numeric_limits<int>::min();
+    int yMax = std::numeric_limits<int>::min();
+    for (auto p = table->beginPoint(); p != table->endPoint(); ++p) {
+      std::pair<int, int> xy = (*p).first;
+      xMin = std::min(xMin, xy.first);
+      yMin = std::min(yMin, xy.second);
+      xMax = std::max(xMax, xy.first);
+      yMax = std::max(yMax, xy.second);
+    }
+    XCTAssertEqual(xMin, -500);
+    XCTAssertEqual(yMax, 499);
+  }];
+}
+
+- (void)testPerformanceBoundsPyramid1M
+{
+  DenseSectorTableOccupancyPyramid pyramid(16);
+  for (int y = 0; y < 1000; ++y) {
+    for (int x = 0; x < 1000; ++x) {
+      pyramid.add(x - 500, y - 500);
+    }
+  }
+  DenseSectorTableOccupancyPyramid *pyramidPointer = &pyramid;
+  [self measureBlock:^{
+    // note: Many queries, since each is so fast: bounds, and the occupied 64x64 regions of a
+    // screen-sized window.
+    size_t regionCount = 0;
+    std::vector<std::pair<int, int>> regions;
+    for (int i = 0; i < 1000; ++i) {
+      int xMin, yMin, xMax, yMax;
+      pyramidPointer->getBounds(&xMin, &yMin, &xMax, &yMax);
+      XCTAssertEqual(xMin, -500);
+      regions.clear();
+      pyramidPointer->getOccupiedCells(1, i % 100, -100, i % 100 + 255, 155, &regions);
+      regionCount += regions.size();
+    }
+    XCTAssertGreaterThan(regionCount, 0UL);
+  }];
+}
+
+- (void)testBoundedBackend
+{
+  // note: Compare against the flat map backend, with points inside and outside the bounds.
+  DenseSectorTable<int, DenseSectorTableBoundedBackend> boundedTable(4, -10, -10, 9, 9, -1);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend> expectedTable(4, 16, -1);
+  unsigned int random = 1;
+  for (int round = 0; round < 3000; ++round) {
+    random = random * 1103515245 + 12345;
+    int x = static_cast<int>((random >> 8) % 40) - 20;
+    int y = static_cast<int>((random >> 16) % 40) - 20;
+    if ((random >> 4) % 3 != 0) {
+      boundedTable.setPoint(x, y, round);
+      expectedTable.setPoint(x, y, round);
+    } else {
+      boundedTable.erasePoint(x, y, true);
+      expectedTable.erasePoint(x, y, true);
+    }
+  }
+  XCTAssertEqual(boundedTable.pointCount(), expectedTable.pointCount());
+  XCTAssertEqual(boundedTable.sectorCount(), expectedTable.sectorCount());
+  for (int y = -24; y < 24; ++y) {
+    for (int x = -24; x < 24; ++x) {
+      XCTAssertEqual(boundedTable.getPoint(x, y), expectedTable.getPoint(x, y));
+      XCTAssertEqual(boundedTable.sectorPointCount(x, y), expectedTable.sectorPointCount(x, y));
+    }
+  }
+  std::vector<int> block(48 * 48);
+  std::vector<int> expectedBlock(48 * 48);
+  boundedTable.getBlock(-24, -24, 48, 48, block.data());
+  expectedTable.getBlock(-24, -24, 48, 48, expectedBlock.data());
+  XCTAssertTrue(block == expectedBlock);
+  std::set<std::pair<int, int>> iterated;
+  for (auto p = boundedTable.beginPoint(); p != boundedTable.endPoint(); ++p) {
+    XCTAssertEqual((*p).second, expectedTable.getPoint((*p).first.first, (*p).first.second));
+    iterated.insert((*p).first);
+  }
+  XCTAssertEqual(iterated.size(), expectedTable.pointCount());
+  size_t regionCount = 0;
+  for (auto p = boundedTable.beginRegion(-15, -3, 12, 5); p != boundedTable.endRegion(); ++p) {
+    ++regionCount;
+  }
+  size_t expectedRegionCount = 0;
+  for (auto p = expectedTable.beginRegion(-15, -3, 12, 5); p != expectedTable.endRegion(); ++p) {
+    ++expectedRegionCount;
+  }
+  XCTAssertEqual(regionCount, expectedRegionCount);
+
+  // Erasing sectors through iterators, both inside and outside the bounds.
+  DenseSectorTable<int, DenseSectorTableBoundedBackend>::const_iterator inside = boundedTable.findPoint(0, 0);
+  if (inside == boundedTable.endPoint()) {
+    boundedTable.setPoint(0, 0, 1);
+    expectedTable.setPoint(0, 0, 1);
+    inside = boundedTable.findPoint(0, 0);
+  }
+  XCTAssertTrue(boundedTable.eraseSector(inside));
+  expectedTable.eraseSector(0, 0);
+  boundedTable.setPoint(100, 100, 1);
+  DenseSectorTable<int, DenseSectorTableBoundedBackend>::const_iterator outside = boundedTable.findPoint(100, 100);
+  XCTAssertTrue(outside != boundedTable.endPoint());
+  XCTAssertTrue(boundedTable.eraseSector(outside));
+  XCTAssertEqual(boundedTable.getPoint(100, 100), -1);
+  XCTAssertEqual(boundedTable.pointCount(), expectedTable.pointCount());
+  XCTAssertEqual(boundedTable.sectorCount(), expectedTable.sectorCount());
+
+  // Unbounded construction behaves as a flat map.
+  DenseSectorTable<int, DenseSectorTableBoundedBackend, 16> unboundedTable(16, 64, -1);
+  fillSparseWorld(unboundedTable, 200);
+  XCTAssertEqual(unboundedTable.getPoint(-100, -100), 1);
+  XCTAssertEqual(unboundedTable.getPoint(-99, -100), -1);
+  XCTAssertEqual(unboundedTable.memoryUsage().sectorTableByteCount, 0UL);
+}
+
+- (void)testOccupancyBitmapStencils
+{
+  for (bool simdEnabled : { false, true }) {
+    XCTAssertEqual(countStencilMismatches<8>(simdEnabled), 0UL);
+    XCTAssertEqual(countStencilMismatches<16>(simdEnabled), 0UL);
+    XCTAssertEqual(countStencilMismatches<32>(simdEnabled), 0UL);
+  }
+
+  // note: A lone point, and a pair; then clearing points drops emptied sectors.
+  DenseSectorTableOccupancyBitmap<16> bitmap;
+  bitmap.set(15, 15);
+  bitmap.set(40, 40);
+  bitmap.set(41, 41);
+  DenseSectorTableOccupancyBitmap<16> isolated = bitmap.andNot(bitmap.neighborCountAtLeast(1));
+  XCTAssertEqual(isolated.pointCount(), 1UL);
+  XCTAssertTrue(isolated.isSet(15, 15));
+  XCTAssertEqual(bitmap.dilated().pointCount(), 9UL + 14UL);
+  XCTAssertEqual(bitmap.dilated().sectorCount(), 5UL);
+  bitmap.set(15, 15, false);
+  XCTAssertEqual(bitmap.sectorCount(), 1UL);
+  XCTAssertFalse(bitmap.isSet(15, 15));
+}
+
+- (void)testPerformanceNeighborCountPerPoint
+{
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 4096, -1);
+  fillTrackRowWorld(denseSectorTable, 1024);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> *table = &denseSectorTable;
+  [self measureBlock:^{
+    // note: Points with exactly two neighbors (the middle of each row).
+    size_t matchCount = 0;
+    int block[9];
+    for (auto p = table->beginPoint(); p != table->endPoint(); ++p) {
+      std::pair<int, int> xy = (*p).first;
+      table->getBlock(xy.first - 1, xy.second - 1, 3, 3, block);
+      int neighborCount = 0;
+      for (int b = 0; b < 9; ++b) {
+        if (b != 4 && block[b] != -1) {
+          ++neighborCount;
+        }
+      }
+      if (neighborCount == 2) {
+        ++matchCount;
+      }
+    }
+    XCTAssertEqual(matchCount, 512UL * 1022UL);
+  }];
+}
+
+- (void)testPerformanceNeighborCountStencil
+{
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> denseSectorTable(16, 4096, -1);
+  fillTrackRowWorld(denseSectorTable, 1024);
+  DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> *table = &denseSectorTable;
+  [self measureBlock:^{
+    DenseSectorTableOccupancyBitmap<16> occupied(*table);
+    DenseSectorTableOccupancyBitmap<16> matches = occupied & occupied.neighborCountEquals(2);
+    XCTAssertEqual(matches.pointCount(), 512UL * 1022UL);
+  }];
+}
+
+- (void)testKeyHashQuality
+{
+  // note: Compare collisions in a table twice the key count against the expected number
+  // for a random hash: n - m * (1 - (1 - 1/m)^n).
+  const size_t bucketCount = 8192;
+  double expectedCollisionCount = 4096.0 - static_cast<double>(bucketCount) * (1.0 - pow(1.0 - 1.0 / static_cast<double>(bucketCount), 4096.0));
+  for (int layout = 0; layout < 5; ++layout) {
+    std::vector<std::pair<int, int>> keys = adversarialSectorLayout(layout);
+    size_t collisionCount = countBucketCollisions(keys, bucketCount);
+    XCTAssertLessThan(static_cast<double>(collisionCount), expectedCollisionCount * 1.25);
+  }
+
+  // note: Full-width coordinates matter.
+  DenseSectorTableKeyHash hash;
+  XCTAssertNotEqual(hash(std::make_pair(0, 0)), hash(std::make_pair(65536, 0)));
+  XCTAssertNotEqual(hash(std::make_pair(0, 0)), hash(std::make_pair(0, 65536)));
+  XCTAssertNotEqual(hash(std::make_pair(1, 2)), hash(std::make_pair(2, 1)));
+}
+
+- (void)testPerformanceGetPointAdversarialLayouts
+{
+  // note: One point per sector, in each adversarial layout; then look up every point of
+  // every sector (most unset, as in a neighborhood search).
+  std::vector<std::unique_ptr<DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16>>> tables;
+  for (int layout = 0; layout < 5; ++layout) {
+    tables.emplace_back(new DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16>(16, 64, -1));
+    for (auto& key : adversarialSectorLayout(layout)) {
+      tables.back()->setPoint(key.first * 16, key.second * 16, layout);
+    }
+  }
+  std::vector<std::unique_ptr<DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16>>> *tablesPointer = &tables;
+  [self measureBlock:^{
+    int64_t sum = 0;
+    for (int layout = 0; layout < 5; ++layout) {
+      DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16>& table = *(*tablesPointer)[static_cast<size_t>(layout)];
+      for (auto& key : adversarialSectorLayout(layout)) {
+        for (int p = 0; p < 64; ++p) {
+          sum += table.getPoint(key.first * 16 + p % 8, key.second * 16 + p / 8);
+        }
+      }
+    }
+    XCTAssertEqual(sum, int64_t(4096) * (0 + 1 + 2 + 3 + 4) - int64_t(5 * 4096 * 63));
+  }];
+}
 @end
@@ -0,0 +1,309 @@
+//
+//  FLConnectedComponentsTests.mm
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#import <algorithm>
+#import <random>
+#import <set>
+#import <vector>
+#import <XCTest/XCTest.h>
+
+// note: Only headless headers, so that these tests also run as plain C++; see
+// Portable/run_portable_tests.sh.
+#include "FLConnectedComponents.h"
+
+using namespace std;
+
+@interface FLConnectedComponentsTests : XCTestCase
+
+@end
+
+typedef FLConnectedComponents::Element Element;
+
+/**
+ * A plain adjacency-set graph, as the reference for FLConnectedComponents.
+ */
+struct FLTestGraph
+{
+  vector<bool> present;
+  vector<set<Element>> edges;
+
+  FLTestGraph(size_t elementCount) : present(elementCount, false), edges(elementCount) {}
+
+  void neighbors(Element element, vector<Element> *elementNeighbors) const {
+    elementNeighbors->insert(elementNeighbors->end(), edges[element].begin(), edges[element].end());
+  }
+
+  vector<Element> search(Element element) const {
+    vector<bool> visited(present.size(), false);
+    vector<Element> stack(1, element);
+    vector<Element> component;
+    visited[element] = true;
+    while (!stack.empty()) {
+      Element e = stack.back();
+      stack.pop_back();
+      component.push_back(e);
+      for (Element n : edges[e]) {
+        if (!visited[n]) {
+          visited[n] = true;
+          stack.push_back(n);
+        }
+      }
+    }
+    sort(component.begin(), component.end());
+    return component;
+  }
+};
+
+/**
+ * Builds a layout of rows of track: each row of the square is a chain of elements.  If
+ * linkRows is passed, every tenth column also links each row to the next, so that the
+ * whole layout is one component of elementsPerSide^2 elements.
+ */
+static void
+buildLayout(Element elementsPerSide, bool linkRows, FLTestGraph *graph, FLConnectedComponents *components)
+{
+  for (Element y = 0; y < elementsPerSide; ++y) {
+    for (Element x = 0; x < elementsPerSide; ++x) {
+      Element e = y * elementsPerSide + x;
+      graph->present[e] = true;
+      components->insert(e);
+      if (x > 0) {
+        graph->edges[e].insert(e - 1);
+        graph->edges[e - 1].insert(e);
+        components->unite(e, e - 1);
+      }
+      if (linkRows && y > 0 && x % 10 == 0) {
+        graph->edges[e].insert(e - elementsPerSide);
+        graph->edges[e - elementsPerSide].insert(e);
+        components->unite(e, e - elementsPerSide);
+      }
+    }
+  }
+}
+
+@implementation FLConnectedComponentsTests
+
+- (void)testBasic
+{
+  FLConnectedComponents components;
+  FLTestGraph graph(8);
+  auto neighbors = [&graph](Element e, vector<Element> *n) { graph.neighbors(e, n); };
+  vector<Element> members;
+
+  for (Element e = 0; e < 5; ++e) {
+    components.insert(e);
+  }
+  XCTAssertEqual(components.size(), 5);
+  XCTAssertTrue(components.contains(4));
+  XCTAssertFalse(components.contains(5));
+  components.getComponent(2, neighbors, &members);
+  XCTAssertEqual(members.size(), 1);
+
+  // A chain 0-1-2-3, with 4 on its own.
+  for (Element e = 0; e < 3; ++e) {
+    graph.edges[e].insert(e + 1);
+    graph.edges[e + 1].insert(e);
+    components.unite(e, e + 1);
+  }
+  components.getComponent(3, neighbors, &members);
+  XCTAssertEqual(members.size(), 4);
+  components.getComponent(4, neighbors, &members);
+  XCTAssertEqual(members.size(), 1);
+
+  // Removing the middle splits the chain on the next query.
+  graph.edges[1].erase(2);
+  graph.edges[2].erase(1);
+  graph.edges[2].clear();
+  graph.edges[3].erase(2);
+  components.erase(2);
+  XCTAssertFalse(components.contains(2));
+  components.getComponent(0, neighbors, &members);
+  sort(members.begin(), members.end());
+  XCTAssertTrue((members == vector<Element>{ 0, 1 }));
+  components.getComponent(3, neighbors, &members);
+  XCTAssertTrue((members == vector<Element>{ 3 }));
+
+  // Removing an edge (without removing an element) splits it too, once invalidated.
+  graph.edges[0].erase(1);
+  graph.edges[1].erase(0);
+  components.invalidate(0);
+  components.getComponent(1, neighbors, &members);
+  XCTAssertTrue((members == vector<Element>{ 1 }));
+
+  // Element ids can be reused right away.
+  components.insert(2);
+  components.getComponent(2, neighbors, &members);
+  XCTAssertTrue((members == vector<Element>{ 2 }));
+  XCTAssertEqual(components.size(), 5);
+}
+
+- (void)testMatchesSearch
+{
+  // note: Elements are cells of a small square, with edges only between neighbors, so that
+  // random edits make components that grow, merge, and split.
+  const Element FLSide = 12;
+  const Element FLElementCount = FLSide * FLSide;
+  mt19937 random(21);
+  FLConnectedComponents components;
+  FLTestGraph graph(FLElementCount);
+  auto neighbors = [&graph](Element e, vector<Element> *n) { graph.neighbors(e, n); };
+
+  int mismatchCount = 0;
+  size_t largestComponentSize = 0;
+  vector<Element> members;
+  for (int step = 0; step < 20000; ++step) {
+    Element e = Element(random() % FLElementCount);
+    Element x = e % FLSide;
+    Element y = e / FLSide;
+    Element n = (random() % 2 == 0 ? (x + 1 < FLSide ? e + 1 : e) : (y + 1 < FLSide ? e + FLSide : e));
+    switch (random() % 6) {
+      case 0:
+      case 1:
+        if (!graph.present[e]) {
+          graph.present[e] = true;
+          components.insert(e);
+        }
+        break;
+      case 2:
+        if (graph.present[e]) {
+          for (Element en : graph.edges[e]) {
+            graph.edges[en].erase(e);
+          }
+          graph.edges[e].clear();
+          graph.present[e] = false;
+          components.erase(e);
+        }
+        break;
+      case 3:
+      case 4:
+        if (graph.present[e] && graph.present[n] && n != e) {
+          graph.edges[e].insert(n);
+          graph.edges[n].insert(e);
+          components.unite(e, n);
+        }
+        break;
+      case 5:
+        if (graph.edges[e].erase(n) > 0) {
+          graph.edges[n].erase(e);
+          components.invalidate(e);
+        }
+        break;
+    }
+    if (step % 10 == 0) {
+      Element q = Element(random() % FLElementCount);
+      if (graph.present[q]) {
+        components.getComponent(q, neighbors, &members);
+        sort(members.begin(), members.end());
+        if (members != graph.search(q)) {
+          ++mismatchCount;
+        }
+        largestComponentSize = max(largestComponentSize, members.size());
+      }
+    }
+  }
+  XCTAssertEqual(mismatchCount, 0);
+  XCTAssertGreaterThan(largestComponentSize, 10);
+
+  // And all components at the end.
+  for (Element q = 0; q < FLElementCount; ++q) {
+    if (graph.present[q]) {
+      components.getComponent(q, neighbors, &members);
+      sort(members.begin(), members.end());
+      XCTAssertTrue(members == graph.search(q));
+    }
+  }
+}
+
+- (void)testCompaction
+{
+  const Element FLSide = 64;
+  FLConnectedComponents components;
+  FLTestGraph graph(FLSide * FLSide);
+  auto neighbors = [&graph](Element e, vector<Element> *n) { graph.neighbors(e, n); };
+  buildLayout(FLSide, true, &graph, &components);
+
+  // Remove most of the layout without ever querying it.
+  for (Element e = 0; e < FLSide * FLSide; e += 4) {
+    for (Element r = e; r < e + 3; ++r) {
+      for (Element rn : graph.edges[r]) {
+        graph.edges[rn].erase(r);
+      }
+      graph.edges[r].clear();
+      graph.present[r] = false;
+      components.erase(r);
+    }
+  }
+  XCTAssertTrue(components.needsCompaction());
+  components.rebuildDirty(neighbors);
+  XCTAssertFalse(components.needsCompaction());
+  vector<Element> members;
+  components.getComponent(3, neighbors, &members);
+  XCTAssertEqual(members.size(), 1);
+}
+
+- (void)testPerformanceComponent50k
+{
+  // note: 224^2 is 50176 elements.
+  const Element FLSide = 224;
+  __block FLConnectedComponents components;
+  FLTestGraph graph(FLSide * FLSide);
+  auto neighbors = [&graph](Element e, vector<Element> *n) { graph.neighbors(e, n); };
+  buildLayout(FLSide, true, &graph, &components);
+
+  __block vector<Element> members;
+  [self measureBlock:^{
+    for (int i = 0; i < 100; ++i) {
+      components.getComponent(Element(i * 499) % (FLSide * FLSide), neighbors, &members);
+    }
+  }];
+  XCTAssertEqual(members.size(), FLSide * FLSide);
+}
+
+- (void)testPerformanceComponentSearch50k
+{
+  // note: For comparison with testPerformanceComponent50k: a search per query.
+  const Element FLSide = 224;
+  FLConnectedComponents components;
+  FLTestGraph graph(FLSide * FLSide);
+  buildLayout(FLSide, true, &graph, &components);
+
+  __block vector<Element> members;
+  [self measureBlock:^{
+    for (int i = 0; i < 100; ++i) {
+      members = graph.search(Element(i * 499) % (FLSide * FLSide));
+    }
+  }];
+  XCTAssertEqual(members.size(), FLSide * FLSide);
+}
+
+- (void)testPerformanceEditComponent50k
+{
+  // note: Each row of the layout is its own component; each edit cuts a row in two, and
+  // each query then rebuilds only that row.
+  const Element FLSide = 224;
+  __block FLConnectedComponents components;
+  FLTestGraph graph(FLSide * FLSide);
+  FLTestGraph *graphPointer = &graph;
+  auto neighbors = [&graph](Element e, vector<Element> *n) { graph.neighbors(e, n); };
+  buildLayout(FLSide, false, &graph, &components);
+
+  __block vector<Element> members;
+  __block Element row = 0;
+  [self measureBlock:^{
+    for (int i = 0; i < 20; ++i) {
+      Element e = row * FLSide + 5;
+      graphPointer->edges[e].erase(e + 1);
+      graphPointer->edges[e + 1].erase(e);
+      components.invalidate(e);
+      components.getComponent(e, neighbors, &members);
+      row = (row + 1) % FLSide;
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,181 @@
+//
+//  FLSegmentNodeTests.mm
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <cmath>
+#import <XCTest/XCTest.h>
+
+#import "FLSegmentNode.h"
+
+@interface FLSegmentNodeTests : XCTestCase
+
+@end
+
+// note: The original geometric implementation of FL_getConnectingPath, which compared
+// end points and tangents of the paths themselves.  The segment now uses a static port
+// table instead; this is kept as the oracle for the table.
+static BOOL
+geometricConnectingPath(FLSegmentNode *segmentNode, int *pathId, CGFloat *progress,
+                        CGPoint endPoint, BOOL doRotationCheck, CGFloat forRotationRadians, CGFloat forProgress,
+                        CGFloat scale, BOOL hasSwitch, int switchPathId)
+{
+  const CGFloat FLEndPointComparisonEpsilon = 0.1f;
+  const CGFloat FLTangentComparisonEpsilon = 0.1f;
+  const CGFloat FLProgressComparisonEpsilon = 0.1f;
+  const BOOL forProgressIsZero = (forProgress < FLProgressComparisonEpsilon);
+  const CGFloat FL2Pi = (CGFloat)(M_PI * 2.0);
+
+  BOOL foundOne = NO;
+  int pathCount = [segmentNode pathCount];
+  for (int p = 0; p < pathCount; ++p) {
+    for (int end = 0; end < 2; ++end) {
+      CGPoint endProgressPoint;
+      CGFloat endProgressRotation;
+      [segmentNode getPoint:&endProgressPoint rotation:&endProgressRotation forPath:p progress:(CGFloat)end scale:scale];
+      if (fabs(endPoint.x - endProgressPoint.x) / scale >= FLEndPointComparisonEpsilon
+          || fabs(endPoint.y - endProgressPoint.y) / scale >= FLEndPointComparisonEpsilon) {
+        continue;
+      }
+      if (doRotationCheck) {
+        CGFloat rotationDifference = fabs(fmod(forRotationRadians - endProgressRotation, FL2Pi));
+        BOOL expectOpposite = (forProgressIsZero == (end == 0));
+        BOOL isConnectingRotation;
+        if (expectOpposite) {
+          isConnectingRotation = (rotationDifference > M_PI - FLTangentComparisonEpsilon
+                                  && rotationDifference < M_PI + FLTangentComparisonEpsilon);
+        } else {
+          isConnectingRotation = (rotationDifference < FLTangentComparisonEpsilon
+                                  || rotationDifference > FL2Pi - FLTangentComparisonEpsilon);
+        }
+        if (!isConnectingRotation) {
+          continue;
+        }
+      }
+      if (!hasSwitch || switchPathId == p) {
+        *pathId = p;
+        *progress = (CGFloat)end;
+        return YES;
+      }
+      if (!foundOne) {
+        *pathId = p;
+        *progress = (CGFloat)end;
+        foundOne = YES;
+      }
+      // note: As in the original, a path that connects at its zero end is not checked
+      // again at its one end.
+      break;
+    }
+  }
+  return foundOne;
+}
+
+@implementation FLSegmentNodeTests
+
+- (void)testConnectingPathMatchesGeometry
+{
+  const CGFloat scale = 54.0f;
+  const CGPoint position = CGPointMake(3.0f * scale, -7.0f * scale);
+  const CGFloat endPointOffsets[] = { 0.0f, 0.08f, -0.12f };
+  const CGFloat rotationOffsets[] = { 0.0f, 0.08f, -0.12f };
+  const CGFloat forProgresses[] = { 0.0f, 1.0f };
+
+  int caseCount = 0;
+  int connectingCount = 0;
+  int mismatchCount = 0;
+  for (int segmentType = FLSegmentTypeStraight; segmentType <= FLSegmentTypePixel; ++segmentType) {
+    FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:(FLSegmentType)segmentType];
+    segmentNode.position = position;
+    for (int rotationQuarters = 0; rotationQuarters < 4; ++rotationQuarters) {
+      segmentNode.zRotationQuarters = rotationQuarters;
+      for (int halfX = -2; halfX <= 2; ++halfX) {
+        for (int halfY = -2; halfY <= 2; ++halfY) {
+          for (CGFloat offsetX : endPointOffsets) {
+            for (CGFloat offsetY : endPointOffsets) {
+              CGPoint endPoint = CGPointMake(position.x + (halfX * 0.5f + offsetX) * scale,
+                                             position.y + (halfY * 0.5f + offsetY) * scale);
+              for (int switchCase = 0; switchCase < 3; ++switchCase) {
+                BOOL hasSwitch = (switchCase > 0);
+                int switchPathId = (switchCase == 2 ? 1 : 0);
+
+                int expectedPathId = -1;
+                CGFloat expectedProgress = -1.0f;
+                BOOL expected = geometricConnectingPath(segmentNode, &expectedPathId, &expectedProgress, endPoint, NO, 0.0f, 0.0f, scale, hasSwitch, switchPathId);
+                [segmentNode setSwitchPathId:switchPathId animated:NO];
+                int pathId = -1;
+                CGFloat progress = -1.0f;
+                BOOL actual = [segmentNode getConnectingPath:&pathId progress:&progress forEndPoint:endPoint scale:scale];
+                if ([FLSegmentNode canSwitch:(FLSegmentType)segmentType] == hasSwitch) {
+                  ++caseCount;
+                  if (actual != expected || (actual && (pathId != expectedPathId || progress != expectedProgress))) {
+                    ++mismatchCount;
+                  }
+                }
+
+                for (int quarters = -4; quarters <= 4; ++quarters) {
+                  for (CGFloat rotationOffset : rotationOffsets) {
+                    CGFloat forRotation = (CGFloat)(quarters * M_PI_2) + rotationOffset;
+                    for (CGFloat forProgress : forProgresses) {
+                      expectedPathId = -1;
+                      expectedProgress = -1.0f;
+                      expected = geometricConnectingPath(segmentNode, &expectedPathId, &expectedProgress, endPoint, YES, forRotation, forProgress, scale, hasSwitch, switchPathId);
+                      pathId = -1;
+                      progress = -1.0f;
+                      actual = [segmentNode getConnectingPath:&pathId progress:&progress forEndPoint:endPoint rotation:forRotation progress:forProgress scale:scale hasSwitch:hasSwitch switchPathId:switchPathId];
+                      ++caseCount;
+                      if (expected) {
+                        ++connectingCount;
+                      }
+                      if (actual != expected || (actual && (pathId != expectedPathId || progress != expectedProgress))) {
+                        ++mismatchCount;
+                      }
+                    }
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  XCTAssertGreaterThan(caseCount, connectingCount);
+  XCTAssertGreaterThan(connectingCount, 0);
+  XCTAssertEqual(mismatchCount, 0);
+}
+
+- (void)testPerformanceConnectingPath
+{
+  const CGFloat scale = 54.0f;
+  NSMutableArray *segmentNodes = [NSMutableArray array];
+  for (int segmentType = FLSegmentTypeStraight; segmentType <= FLSegmentTypePixel; ++segmentType) {
+    FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:(FLSegmentType)segmentType];
+    [segmentNodes addObject:segmentNode];
+  }
+
+  [self measureBlock:^{
+    int connectingCount = 0;
+    for (int i = 0; i < 20; ++i) {
+      for (FLSegmentNode *segmentNode in segmentNodes) {
+        for (int halfX = -2; halfX <= 2; ++halfX) {
+          for (int halfY = -2; halfY <= 2; ++halfY) {
+            CGPoint endPoint = CGPointMake(halfX * 0.5f * scale, halfY * 0.5f * scale);
+            for (int quarters = 0; quarters < 4; ++quarters) {
+              if ([segmentNode hasConnectingPathForEndPoint:endPoint rotation:(CGFloat)(quarters * M_PI_2) progress:0.0f scale:scale]) {
+                ++connectingCount;
+              }
+            }
+          }
+        }
+      }
+    }
+    XCTAssertGreaterThan(connectingCount, 0);
+  }];
+}
+
+@end
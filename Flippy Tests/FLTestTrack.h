@@ -0,0 +1,61 @@
+//
+//  FLTestTrack.h
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#ifndef __Flippy__FLTestTrack__
+#define __Flippy__FLTestTrack__
+
+// note: Fixture shared by the track tests.  The segment types are headless, so that
+// headless tests (FLTrackModelTests) can use them without SpriteKit; the segment node
+// helpers are only defined for test files that include FLTrackGrid.h first.
+
+#include <random>
+
+#include "FLSegment.h"
+
+/**
+ * Segment types for random track: a variety of track segments, and a readout (which has
+ * no paths).
+ */
+static const FLSegmentType FLTestTrackSegmentTypes[] = {
+  FLSegmentTypeStraight,
+  FLSegmentTypeCurve,
+  FLSegmentTypeJoinLeft,
+  FLSegmentTypeJoinRight,
+  FLSegmentTypeJogLeft,
+  FLSegmentTypeJogRight,
+  FLSegmentTypeCross,
+  FLSegmentTypePlatformLeft,
+  FLSegmentTypePlatformStartRight,
+  FLSegmentTypeReadoutInput,
+};
+
+static const size_t FLTestTrackSegmentTypeCount = sizeof(FLTestTrackSegmentTypes) / sizeof(FLTestTrackSegmentTypes[0]);
+
+#ifdef __Flippy__FLTrackGrid__
+
+static const CGFloat FLTestSegmentSize = 54.0f;
+
+/**
+ * Creates a segment node of random type, rotation, and switch value, positioned at the
+ * passed grid location (for a grid of FLTestSegmentSize).
+ */
+inline FLSegmentNode *
+newRandomSegmentNode(std::mt19937& random, int gridX, int gridY)
+{
+  FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:FLTestTrackSegmentTypes[random() % FLTestTrackSegmentTypeCount]];
+  segmentNode.position = FLTrackGrid::convert(gridX, gridY, FLTestSegmentSize);
+  segmentNode.zRotationQuarters = int(random() % 4);
+  if ([segmentNode canSwitch]) {
+    [segmentNode setSwitchPathId:int(random() % 2) animated:NO];
+  }
+  return segmentNode;
+}
+
+#endif
+
+#endif /* defined(__Flippy__FLTestTrack__) */
@@ -0,0 +1,302 @@
+//
+//  FLTrackGraphTests.mm
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <random>
+#import <set>
+#import <tuple>
+#import <unordered_map>
+#import <XCTest/XCTest.h>
+
+#include "FLTrackGraph.h"
+#include "FLTrackGrid.h"
+#include "FLTestTrack.h"
+
+using namespace std;
+
+@interface FLTrackGraphTests : XCTestCase
+
+@end
+
+/**
+ * Fills most of a square area of the grid with random segments.
+ */
+static void
+fillRandom(mt19937& random, FLTrackGrid& trackGrid, int gridSize)
+{
+  for (int gridX = -gridSize / 2; gridX < gridSize - gridSize / 2; ++gridX) {
+    for (int gridY = -gridSize / 2; gridY < gridSize - gridSize / 2; ++gridY) {
+      if (random() % 4 == 0) {
+        continue;
+      }
+      FLSegmentNode *segmentNode = newRandomSegmentNode(random, gridX, gridY);
+      if (random() % 8 == 0) {
+        segmentNode.label = char('A' + random() % 26);
+      }
+      trackGrid.set(gridX, gridY, segmentNode);
+    }
+  }
+}
+
+static FLSegmentNode *
+segmentNodeForEdge(const FLTrackGrid& trackGrid, const FLTrackGraph& trackGraph, uint32_t edgeId)
+{
+  const FLTrackGraphSegment& segment = trackGraph.segment(trackGraph.edge(edgeId).segmentId);
+  return trackGrid.get(segment.gridX, segment.gridY);
+}
+
+/**
+ * Gets the vertex (in half-segment units) of the end of a segment path, and the tangent
+ * there in quarters, by asking the segment for the point geometrically.
+ */
+static void
+geometricEnd(FLSegmentNode *segmentNode, int pathId, int progress, int *vertexX, int *vertexY, int *tangentQuarters)
+{
+  CGPoint point;
+  CGFloat rotation;
+  [segmentNode getPoint:&point rotation:&rotation forPath:pathId progress:CGFloat(progress) scale:FLTestSegmentSize];
+  *vertexX = int(floor(point.x / FLTestSegmentSize * 2.0f + 0.5f));
+  *vertexY = int(floor(point.y / FLTestSegmentSize * 2.0f + 0.5f));
+  *tangentQuarters = normalizeRotationQuarters(int(floor(rotation / (CGFloat)M_PI_2 + 0.5f)));
+}
+
+@implementation FLTrackGraphTests
+
+- (void)testEndsMatchGeometry
+{
+  mt19937 random(22);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  fillRandom(random, trackGrid, 16);
+  FLTrackGraph trackGraph;
+  trackGridExportGraph(trackGrid, &trackGraph);
+  XCTAssertEqual(trackGraph.segmentCount(), trackGrid.size());
+
+  // Every path end of every segment is found at the vertex where geometry puts it, and
+  // nothing else is.
+  size_t geometricEndCount = 0;
+  int mismatchCount = 0;
+  set<pair<int, int>> vertices;
+  for (auto s = trackGrid.begin(); s != trackGrid.end(); ++s) {
+    FLSegmentNode *segmentNode = (*s).second;
+    // note: Segments without ports (e.g. readouts) have no track paths.
+    FLSegmentNodePort ports[FLSegmentNodePortsMax];
+    int pathCount = [segmentNode getPorts:ports] / 2;
+    for (int p = 0; p < pathCount; ++p) {
+      for (int progress = 0; progress < 2; ++progress) {
+        ++geometricEndCount;
+        int vertexX;
+        int vertexY;
+        int tangentQuarters;
+        geometricEnd(segmentNode, p, progress, &vertexX, &vertexY, &tangentQuarters);
+        vertices.emplace(vertexX, vertexY);
+        const FLTrackGraphEnd *ends;
+        int endCount = trackGraph.getEnds(vertexX, vertexY, &ends);
+        int foundCount = 0;
+        for (int e = 0; e < endCount; ++e) {
+          if (segmentNodeForEdge(trackGrid, trackGraph, ends[e].edgeId) == segmentNode
+              && trackGraph.edge(ends[e].edgeId).pathId == p
+              && ends[e].progress == progress) {
+            ++foundCount;
+            if (ends[e].tangentQuarters != tangentQuarters) {
+              ++mismatchCount;
+            }
+          }
+        }
+        if (foundCount != 1) {
+          ++mismatchCount;
+        }
+      }
+    }
+  }
+  size_t graphEndCount = 0;
+  for (auto& vertex : vertices) {
+    const FLTrackGraphEnd *ends;
+    graphEndCount += size_t(trackGraph.getEnds(vertex.first, vertex.second, &ends));
+  }
+  XCTAssertEqual(mismatchCount, 0);
+  XCTAssertEqual(graphEndCount, geometricEndCount);
+  XCTAssertEqual(trackGraph.edgeCount() * 2, geometricEndCount);
+}
+
+- (void)testFindConnectingMatchesGeometry
+{
+  mt19937 random(22);
+  int caseCount = 0;
+  int connectingCount = 0;
+  int mismatchCount = 0;
+  for (int round = 0; round < 10; ++round) {
+    FLTrackGrid trackGrid(FLTestSegmentSize);
+    fillRandom(random, trackGrid, 16);
+    FLTrackGraph trackGraph;
+    trackGridExportGraph(trackGrid, &trackGraph);
+
+    // note: Half the rounds read some switch values from an override map, as for
+    // hypothetical switch settings.
+    unordered_map<void *, int> switchPathIds;
+    unordered_map<uint32_t, int> graphSwitchPathIds;
+    if (round % 2 == 1) {
+      for (uint32_t segmentId = 0; segmentId < trackGraph.segmentCount(); ++segmentId) {
+        const FLTrackGraphSegment& segment = trackGraph.segment(segmentId);
+        if (segment.canSwitch() && random() % 2 == 0) {
+          int switchPathId = int(random() % 2);
+          switchPathIds[(__bridge void *)trackGrid.get(segment.gridX, segment.gridY)] = switchPathId;
+          graphSwitchPathIds[segmentId] = switchPathId;
+        }
+      }
+    }
+
+    for (uint32_t edgeId = 0; edgeId < trackGraph.edgeCount(); ++edgeId) {
+      FLSegmentNode *startSegmentNode = segmentNodeForEdge(trackGrid, trackGraph, edgeId);
+      int startPathId = trackGraph.edge(edgeId).pathId;
+      for (int progress = 0; progress < 2; ++progress) {
+        ++caseCount;
+        FLSegmentNode *expectedSegmentNode = nil;
+        int expectedPathId = -1;
+        CGFloat expectedProgress = -1.0f;
+        bool expected = trackGridFindConnectingGeometric(trackGrid, startSegmentNode, startPathId, CGFloat(progress),
+                                                         &expectedSegmentNode, &expectedPathId, &expectedProgress, &switchPathIds);
+        FLTrackGraphEnd connectingEnd;
+        bool actual = trackGraph.findConnecting(edgeId, progress, &connectingEnd, &graphSwitchPathIds);
+        if (expected) {
+          ++connectingCount;
+        }
+        if (actual != expected
+            || (actual && (segmentNodeForEdge(trackGrid, trackGraph, connectingEnd.edgeId) != expectedSegmentNode
+                           || trackGraph.edge(connectingEnd.edgeId).pathId != expectedPathId
+                           || CGFloat(connectingEnd.progress) != expectedProgress))) {
+          ++mismatchCount;
+        }
+      }
+    }
+  }
+  XCTAssertGreaterThan(caseCount, connectingCount);
+  XCTAssertGreaterThan(connectingCount, 100);
+  XCTAssertEqual(mismatchCount, 0);
+}
+
+- (void)testSwitchesMatchGeometry
+{
+  mt19937 random(22);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  fillRandom(random, trackGrid, 16);
+  FLTrackGraph trackGraph;
+  trackGridExportGraph(trackGrid, &trackGraph);
+
+  // note: Geometrically, a switch is where two paths of a switching segment leave the same
+  // point in the same direction.  (Departure is the tangent at progress 0, and opposite
+  // the tangent at progress 1.)
+  set<tuple<int, int, void *, int, int>> expectedSwitches;
+  set<pair<int, int>> vertices;
+  for (auto s = trackGrid.begin(); s != trackGrid.end(); ++s) {
+    FLSegmentNode *segmentNode = (*s).second;
+    FLSegmentNodePort ports[FLSegmentNodePortsMax];
+    int pathCount = [segmentNode getPorts:ports] / 2;
+    for (int p = 0; p < pathCount; ++p) {
+      for (int progress = 0; progress < 2; ++progress) {
+        int vertexX;
+        int vertexY;
+        int tangentQuarters;
+        geometricEnd(segmentNode, p, progress, &vertexX, &vertexY, &tangentQuarters);
+        vertices.emplace(vertexX, vertexY);
+        if (![segmentNode canSwitch]) {
+          continue;
+        }
+        int departureQuarters = (progress == 0 ? tangentQuarters : (tangentQuarters + 2) % 4);
+        for (int op = p + 1; op < pathCount; ++op) {
+          for (int otherProgress = 0; otherProgress < 2; ++otherProgress) {
+            int otherVertexX;
+            int otherVertexY;
+            int otherTangentQuarters;
+            geometricEnd(segmentNode, op, otherProgress, &otherVertexX, &otherVertexY, &otherTangentQuarters);
+            int otherDepartureQuarters = (otherProgress == 0 ? otherTangentQuarters : (otherTangentQuarters + 2) % 4);
+            if (otherVertexX == vertexX && otherVertexY == vertexY && otherDepartureQuarters == departureQuarters) {
+              expectedSwitches.emplace(vertexX, vertexY, (__bridge void *)segmentNode, departureQuarters, segmentNode.switchPathId);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  set<tuple<int, int, void *, int, int>> actualSwitches;
+  for (auto& vertex : vertices) {
+    FLTrackGraphSwitch switches[FLTrackGraph::FLVertexSwitchesMax];
+    int switchCount = trackGraph.getSwitches(vertex.first, vertex.second, switches);
+    for (int s = 0; s < switchCount; ++s) {
+      const FLTrackGraphSegment& segment = trackGraph.segment(switches[s].segmentId);
+      actualSwitches.emplace(vertex.first, vertex.second, (__bridge void *)trackGrid.get(segment.gridX, segment.gridY),
+                             switches[s].departureQuarters, switches[s].switchPathId);
+    }
+  }
+  XCTAssertGreaterThan(expectedSwitches.size(), 5);
+  XCTAssertTrue(actualSwitches == expectedSwitches);
+
+  // And switch values can be changed in the graph.
+  const auto& firstSwitch = *expectedSwitches.begin();
+  FLTrackGraphSwitch switches[FLTrackGraph::FLVertexSwitchesMax];
+  int switchCount = trackGraph.getSwitches(get<0>(firstSwitch), get<1>(firstSwitch), switches);
+  XCTAssertGreaterThan(switchCount, 0);
+  int toggledSwitchPathId = 1 - switches[0].switchPathId;
+  trackGraph.setSwitchPathId(switches[0].segmentId, toggledSwitchPathId);
+  trackGraph.getSwitches(get<0>(firstSwitch), get<1>(firstSwitch), switches);
+  XCTAssertEqual(switches[0].switchPathId, toggledSwitchPathId);
+}
+
+- (void)testConvertBothWays
+{
+  mt19937 random(22);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  fillRandom(random, trackGrid, 16);
+  FLTrackGraph trackGraph;
+  trackGridExportGraph(trackGrid, &trackGraph);
+
+  FLTrackGrid importedTrackGrid(FLTestSegmentSize);
+  trackGridImportGraph(importedTrackGrid, trackGraph);
+  XCTAssertEqual(importedTrackGrid.size(), trackGrid.size());
+  int mismatchCount = 0;
+  for (auto s = trackGrid.begin(); s != trackGrid.end(); ++s) {
+    FLSegmentNode *segmentNode = (*s).second;
+    FLSegmentNode *importedSegmentNode = importedTrackGrid.get((*s).first.first, (*s).first.second);
+    if (!importedSegmentNode
+        || importedSegmentNode.segmentType != segmentNode.segmentType
+        || normalizeRotationQuarters(importedSegmentNode.zRotationQuarters) != normalizeRotationQuarters(segmentNode.zRotationQuarters)
+        || importedSegmentNode.switchPathId != segmentNode.switchPathId
+        || importedSegmentNode.label != segmentNode.label
+        || !CGPointEqualToPoint(importedSegmentNode.position, segmentNode.position)) {
+      ++mismatchCount;
+    }
+  }
+  XCTAssertEqual(mismatchCount, 0);
+
+  // The imported grid's connections match the graph's.
+  FLTrackGraph reexportedTrackGraph;
+  trackGridExportGraph(importedTrackGrid, &reexportedTrackGraph);
+  XCTAssertEqual(reexportedTrackGraph.edgeCount(), trackGraph.edgeCount());
+  for (uint32_t edgeId = 0; edgeId < trackGraph.edgeCount(); ++edgeId) {
+    const FLTrackGraphEdge& edge = trackGraph.edge(edgeId);
+    FLSegmentNode *startSegmentNode = segmentNodeForEdge(importedTrackGrid, trackGraph, edgeId);
+    for (int progress = 0; progress < 2; ++progress) {
+      FLTrackGraphEnd connectingEnd;
+      bool expected = trackGraph.findConnecting(edgeId, progress, &connectingEnd);
+      FLSegmentNode *connectingSegmentNode = nil;
+      int connectingPathId = -1;
+      CGFloat connectingProgress = -1.0f;
+      bool actual = trackGridFindConnecting(importedTrackGrid, startSegmentNode, edge.pathId, CGFloat(progress),
+                                            &connectingSegmentNode, &connectingPathId, &connectingProgress, nullptr);
+      if (actual != expected
+          || (actual && (connectingSegmentNode != segmentNodeForEdge(importedTrackGrid, trackGraph, connectingEnd.edgeId)
+                         || connectingPathId != trackGraph.edge(connectingEnd.edgeId).pathId
+                         || connectingProgress != CGFloat(connectingEnd.progress)))) {
+        ++mismatchCount;
+      }
+    }
+  }
+  XCTAssertEqual(mismatchCount, 0);
+}
+
+@end
@@ -0,0 +1,888 @@
+//
+//  FLTrackGridTests.mm
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <algorithm>
+#import <atomic>
+#import <random>
+#import <set>
+#import <thread>
+#import <tuple>
+#import <unordered_map>
+#import <vector>
+#import <XCTest/XCTest.h>
+
+#include "FLLinks.h"
+#import "FLPath.h"
+#include "FLTrackGrid.h"
+#include "FLTestTrack.h"
+
+using namespace std;
+
+@interface FLTrackGridTests : XCTestCase
+
+@end
+
+/**
+ * Makes a random edit to a (small) area of the grid: set, erase, rotate in place, or flip
+ * in place.
+ */
+static void
+editRandom(mt19937& random, FLTrackGrid& trackGrid, int gridSize)
+{
+  int gridX = int(random() % static_cast<unsigned int>(gridSize)) - gridSize / 2;
+  int gridY = int(random() % static_cast<unsigned int>(gridSize)) - gridSize / 2;
+  FLSegmentNode *segmentNode = trackGrid.get(gridX, gridY);
+  switch (random() % 4) {
+    case 0:
+      trackGrid.set(gridX, gridY, newRandomSegmentNode(random, gridX, gridY));
+      break;
+    case 1:
+      trackGrid.erase(gridX, gridY);
+      break;
+    case 2:
+      if (segmentNode) {
+        segmentNode.zRotationQuarters = (segmentNode.zRotationQuarters + 1) % 4;
+        trackGrid.update(gridX, gridY);
+      }
+      break;
+    case 3:
+      if (segmentNode && [segmentNode canFlip]) {
+        [segmentNode flip:(random() % 2 == 0 ? FLSegmentFlipHorizontal : FLSegmentFlipVertical)];
+        trackGrid.update(gridX, gridY);
+      }
+      break;
+  }
+}
+
+/**
+ * Returns the number of ports in the grid whose connections differ from those in a copy
+ * of the grid with connections rebuilt from scratch.
+ */
+static int
+countConnectionMismatches(const FLTrackGrid& trackGrid, int *connectionCount)
+{
+  FLTrackGrid rebuiltTrackGrid(trackGrid);
+  rebuiltTrackGrid.rebuildConnections();
+
+  int mismatchCount = 0;
+  *connectionCount = 0;
+  for (auto s : trackGrid) {
+    FLSegmentNode *segmentNode = s.second;
+    FLSegmentNodePort ports[FLSegmentNodePortsMax];
+    int portCount = [segmentNode getPorts:ports];
+    for (int p = 0; p < portCount; ++p) {
+      const FLTrackGridConnection *connections;
+      int count;
+      const FLTrackGridConnection *rebuiltConnections;
+      int rebuiltCount;
+      if (!trackGrid.getConnections(s.first.first, s.first.second, ports[p].pathId, ports[p].progress, &connections, &count)
+          || !rebuiltTrackGrid.getConnections(s.first.first, s.first.second, ports[p].pathId, ports[p].progress, &rebuiltConnections, &rebuiltCount)
+          || count != rebuiltCount) {
+        ++mismatchCount;
+        continue;
+      }
+      *connectionCount += count;
+      for (int c = 0; c < count; ++c) {
+        if (connections[c].segmentHandle != rebuiltConnections[c].segmentHandle
+            || connections[c].pathId != rebuiltConnections[c].pathId
+            || connections[c].progress != rebuiltConnections[c].progress) {
+          ++mismatchCount;
+          break;
+        }
+      }
+    }
+  }
+  return mismatchCount;
+}
+
+/**
+ * Returns the segments connected to the passed segment, found by searching the grid's
+ * connections (as a reference for trackGridGetAllConnecting).
+ */
+static set<void *>
+searchAllConnecting(const FLTrackGrid& trackGrid, FLSegmentNode *startSegmentNode)
+{
+  set<void *> visited;
+  vector<FLSegmentNode *> stack(1, startSegmentNode);
+  visited.insert((__bridge void *)startSegmentNode);
+  while (!stack.empty()) {
+    FLSegmentNode *segmentNode = stack.back();
+    stack.pop_back();
+    int gridX;
+    int gridY;
+    trackGrid.convert(segmentNode.position, &gridX, &gridY);
+    FLSegmentNodePort ports[FLSegmentNodePortsMax];
+    int portCount = [segmentNode getPorts:ports];
+    for (int p = 0; p < portCount; ++p) {
+      const FLTrackGridConnection *connections;
+      int connectionCount;
+      if (!trackGrid.getConnections(gridX, gridY, ports[p].pathId, ports[p].progress, &connections, &connectionCount)) {
+        continue;
+      }
+      for (int c = 0; c < connectionCount; ++c) {
+        FLSegmentNode *connectingNode = trackGrid.handleTable().get(connections[c].segmentHandle);
+        if (visited.insert((__bridge void *)connectingNode).second) {
+          stack.push_back(connectingNode);
+        }
+      }
+    }
+  }
+  visited.erase((__bridge void *)startSegmentNode);
+  return visited;
+}
+
+/**
+ * Runs a train from a platform start segment as trackGridGenerateTruthTable does, keeping
+ * switch values in a map (as a reference for FLTrackModel::runTrain).  Gets the end of the
+ * path where the train stopped, and returns false if an infinite loop was detected.
+ */
+static bool
+runTrainReference(const FLTrackGrid& trackGrid, const FLLinks& links, unordered_map<void *, int>& switchPathIds,
+                  FLSegmentNode *platformStartSegmentNode,
+                  FLSegmentNode **stopSegmentNode, int *stopPathId, int *stopProgress)
+{
+  set<tuple<void *, int, int>> previousRunStates;
+  FLSegmentNode *currentSegmentNode = platformStartSegmentNode;
+  int currentPathId = 0;
+  CGFloat currentProgress = 1.0f;
+  bool finished = true;
+  while (true) {
+    int currentDirection = (currentProgress > 0.5f ? FLPathDirectionIncreasing : FLPathDirectionDecreasing);
+    if ([currentSegmentNode canSwitch]
+        && currentDirection != [currentSegmentNode pathDirectionGoingWithSwitchForPath:currentPathId]) {
+      linksSetSwitchPathId(links, currentSegmentNode, currentPathId, &switchPathIds);
+    }
+    if (currentSegmentNode.pathCount > 1
+        && !previousRunStates.emplace((__bridge void *)currentSegmentNode, currentPathId, currentDirection).second) {
+      finished = false;
+      break;
+    }
+    FLSegmentNode *connectingSegmentNode;
+    int connectingPathId;
+    CGFloat connectingProgress;
+    if (!trackGridFindConnecting(trackGrid,
+                                 currentSegmentNode, currentPathId, currentProgress,
+                                 &connectingSegmentNode, &connectingPathId, &connectingProgress,
+                                 &switchPathIds)) {
+      break;
+    }
+    currentSegmentNode = connectingSegmentNode;
+    currentPathId = connectingPathId;
+    currentProgress = (connectingProgress < 0.01f ? 1.0f : 0.0f);
+  }
+  *stopSegmentNode = currentSegmentNode;
+  *stopPathId = currentPathId;
+  *stopProgress = int(currentProgress);
+  return finished;
+}
+
+/**
+ * Finds the closest on-track point by searching every segment in the search square, as
+ * trackGridFindClosestOnTrackPoint did before it pruned by path bounds.
+ */
+static bool
+findClosestFullScan(const FLTrackGrid& trackGrid, CGPoint worldLocation, int gridSearchDistance, CGFloat progressPrecision,
+                    CGFloat *onTrackDistance, FLSegmentNode **onTrackSegment, int *onTrackPathId, CGFloat *onTrackProgress)
+{
+  int gridX;
+  int gridY;
+  trackGrid.convert(worldLocation, &gridX, &gridY);
+  CGFloat segmentSize = trackGrid.segmentSize();
+  FLSegmentNode *closestSegmentNode = nil;
+  CGFloat closestDistance = 0.0f;
+  int blockSize = gridSearchDistance * 2 + 1;
+  vector<FLSegmentNode *> block(static_cast<size_t>(blockSize * blockSize));
+  trackGrid.getBlock(gridX - gridSearchDistance, gridY - gridSearchDistance, blockSize, blockSize, block.data());
+  for (int bx = 0; bx < blockSize; ++bx) {
+    for (int by = 0; by < blockSize; ++by) {
+      FLSegmentNode *segmentNode = block[static_cast<size_t>(by * blockSize + bx)];
+      if (!segmentNode) {
+        continue;
+      }
+      CGFloat distance;
+      [segmentNode getClosestOnTrackPoint:nil distance:&distance rotation:nil path:nil progress:nil
+                         forOffTrackPoint:worldLocation scale:segmentSize precision:(progressPrecision * 10.0f)];
+      if (!closestSegmentNode || distance < closestDistance) {
+        closestSegmentNode = segmentNode;
+        closestDistance = distance;
+      }
+    }
+  }
+  if (!closestSegmentNode) {
+    return false;
+  }
+  *onTrackSegment = closestSegmentNode;
+  [closestSegmentNode getClosestOnTrackPoint:nil distance:onTrackDistance rotation:nil path:onTrackPathId progress:onTrackProgress
+                            forOffTrackPoint:worldLocation scale:segmentSize precision:progressPrecision];
+  return true;
+}
+
+/**
+ * Returns the number of segments which differ (by cell, type, rotation, switch, or label)
+ * between two track models.
+ */
+static int
+countModelMismatches(const FLTrackModel& trackModel, const FLTrackModel& expectedTrackModel)
+{
+  int mismatchCount = (trackModel.size() == expectedTrackModel.size() ? 0 : 1);
+  for (const FLSegment& expectedSegment : expectedTrackModel.segments()) {
+    const FLSegment *segment = trackModel.get(expectedSegment.gridX, expectedSegment.gridY);
+    if (!segment
+        || segment->segmentType != expectedSegment.segmentType
+        || segment->rotationQuarters != expectedSegment.rotationQuarters
+        || segment->switchPathId != expectedSegment.switchPathId
+        || segment->label != expectedSegment.label) {
+      ++mismatchCount;
+    }
+  }
+  return mismatchCount;
+}
+
+@implementation FLTrackGridTests
+
+- (void)testConnectionsMatchRebuild
+{
+  const int FLGridSize = 10;
+  mt19937 random(19);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+
+  int totalConnectionCount = 0;
+  for (int round = 0; round < 100; ++round) {
+    for (int edit = 0; edit < 50; ++edit) {
+      editRandom(random, trackGrid, FLGridSize);
+    }
+    int connectionCount;
+    XCTAssertEqual(countConnectionMismatches(trackGrid, &connectionCount), 0);
+    totalConnectionCount += connectionCount;
+  }
+  // note: Make sure the random track is connected enough to be an interesting test.
+  XCTAssertGreaterThan(totalConnectionCount, 1000);
+}
+
+- (void)testFindConnecting
+{
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+
+  // A straight segment continued on the right by a join, both of whose paths meet it.
+  FLSegmentNode *straightNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeStraight];
+  straightNode.position = trackGrid.convert(0, 0);
+  trackGrid.set(0, 0, straightNode);
+  FLSegmentNode *joinNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeJoinLeft];
+  joinNode.position = trackGrid.convert(1, 0);
+  trackGrid.set(1, 0, joinNode);
+
+  FLSegmentNode *connectingNode = nil;
+  int connectingPathId;
+  CGFloat connectingProgress;
+  XCTAssertTrue(trackGridFindConnecting(trackGrid, straightNode, 0, 1.0f, &connectingNode, &connectingPathId, &connectingProgress, nullptr));
+  XCTAssertEqual(connectingNode, joinNode);
+
+  // The join's switch chooses between its two paths, and a passed switch value overrides it.
+  [joinNode setSwitchPathId:0 animated:NO];
+  XCTAssertTrue(trackGridFindConnecting(trackGrid, straightNode, 0, 1.0f, &connectingNode, &connectingPathId, &connectingProgress, nullptr));
+  XCTAssertEqual(connectingPathId, 0);
+  [joinNode setSwitchPathId:1 animated:NO];
+  XCTAssertTrue(trackGridFindConnecting(trackGrid, straightNode, 0, 1.0f, &connectingNode, &connectingPathId, &connectingProgress, nullptr));
+  XCTAssertEqual(connectingPathId, 1);
+  unordered_map<void *, int> switchPathIds;
+  switchPathIds[(__bridge void *)joinNode] = 0;
+  XCTAssertTrue(trackGridFindConnecting(trackGrid, straightNode, 0, 1.0f, &connectingNode, &connectingPathId, &connectingProgress, &switchPathIds));
+  XCTAssertEqual(connectingPathId, 0);
+
+  // Rotating the join in place disconnects it (once the grid is told).
+  joinNode.zRotationQuarters = 2;
+  trackGrid.update(1, 0);
+  XCTAssertFalse(trackGridFindConnecting(trackGrid, straightNode, 0, 1.0f, &connectingNode, &connectingPathId, &connectingProgress, nullptr));
+
+  // Erasing the straight segment leaves the join with nothing to connect to.
+  joinNode.zRotationQuarters = 0;
+  trackGrid.update(1, 0);
+  trackGrid.erase(0, 0);
+  int connectionCount;
+  XCTAssertEqual(countConnectionMismatches(trackGrid, &connectionCount), 0);
+  XCTAssertEqual(connectionCount, 0);
+}
+
+- (void)testPerformanceFindConnecting
+{
+  const int FLGridSize = 100;
+  mt19937 random(20);
+  __block FLTrackGrid trackGrid(FLTestSegmentSize);
+  for (int gridX = 0; gridX < FLGridSize; ++gridX) {
+    for (int gridY = 0; gridY < FLGridSize; ++gridY) {
+      trackGrid.set(gridX, gridY, newRandomSegmentNode(random, gridX, gridY));
+    }
+  }
+
+  [self measureBlock:^{
+    int connectingCount = 0;
+    for (auto s : trackGrid) {
+      FLSegmentNode *segmentNode = s.second;
+      int pathCount = [segmentNode pathCount];
+      for (int pathId = 0; pathId < pathCount; ++pathId) {
+        for (int progress = 0; progress <= 1; ++progress) {
+          FLSegmentNode *connectingNode;
+          int connectingPathId;
+          CGFloat connectingProgress;
+          if (trackGridFindConnecting(trackGrid, segmentNode, pathId, CGFloat(progress), &connectingNode, &connectingPathId, &connectingProgress, nullptr)) {
+            ++connectingCount;
+          }
+        }
+      }
+    }
+    XCTAssertGreaterThan(connectingCount, 0);
+  }];
+}
+
+- (void)testPerformanceEditConnections
+{
+  const int FLGridSize = 100;
+  __block mt19937 random(21);
+  __block FLTrackGrid trackGrid(FLTestSegmentSize);
+
+  [self measureBlock:^{
+    for (int edit = 0; edit < 20000; ++edit) {
+      editRandom(random, trackGrid, FLGridSize);
+    }
+  }];
+}
+
+- (void)testAllConnecting
+{
+  const int FLGridSize = 10;
+  mt19937 random(22);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+
+  int mismatchCount = 0;
+  size_t largestCount = 0;
+  for (int round = 0; round < 200; ++round) {
+    for (int edit = 0; edit < 20; ++edit) {
+      editRandom(random, trackGrid, FLGridSize);
+    }
+    for (int query = 0; query < 5; ++query) {
+      int gridX = int(random() % static_cast<unsigned int>(FLGridSize)) - FLGridSize / 2;
+      int gridY = int(random() % static_cast<unsigned int>(FLGridSize)) - FLGridSize / 2;
+      FLSegmentNode *segmentNode = trackGrid.get(gridX, gridY);
+      if (!segmentNode) {
+        continue;
+      }
+      set<void *> expected = searchAllConnecting(trackGrid, segmentNode);
+      set<void *> actual;
+      for (FLSegmentNode *connectingNode in trackGridGetAllConnecting(trackGrid, segmentNode)) {
+        actual.insert((__bridge void *)connectingNode);
+      }
+      if (actual != expected) {
+        ++mismatchCount;
+      }
+      largestCount = max(largestCount, actual.size());
+    }
+  }
+  XCTAssertEqual(mismatchCount, 0);
+  XCTAssertGreaterThan(largestCount, 5);
+
+  FLSegmentNode *outsideNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeStraight];
+  XCTAssertEqual([trackGridGetAllConnecting(trackGrid, outsideNode) count], 0);
+}
+
+- (void)testExportModelRunsTrains
+{
+  const int FLGridSize = 8;
+  mt19937 random(23);
+
+  int mismatchCount = 0;
+  int switchedRunCount = 0;
+  for (int round = 0; round < 300; ++round) {
+    FLTrackGrid trackGrid(FLTestSegmentSize);
+    FLLinks links;
+    vector<FLSegmentNode *> switchSegmentNodes;
+    vector<FLSegmentNode *> platformStartSegmentNodes;
+    for (int gridX = -FLGridSize / 2; gridX < FLGridSize / 2; ++gridX) {
+      for (int gridY = -FLGridSize / 2; gridY < FLGridSize / 2; ++gridY) {
+        if (random() % 4 == 0) {
+          continue;
+        }
+        FLSegmentNode *segmentNode = newRandomSegmentNode(random, gridX, gridY);
+        trackGrid.set(gridX, gridY, segmentNode);
+        if ([segmentNode canSwitch]) {
+          switchSegmentNodes.push_back(segmentNode);
+        }
+        if (segmentNode.segmentType == FLSegmentTypePlatformStartRight) {
+          platformStartSegmentNodes.push_back(segmentNode);
+        }
+      }
+    }
+    for (size_t l = 0; l < switchSegmentNodes.size(); ++l) {
+      FLSegmentNode *a = switchSegmentNodes[random() % switchSegmentNodes.size()];
+      FLSegmentNode *b = switchSegmentNodes[random() % switchSegmentNodes.size()];
+      if (a != b) {
+        links.set(a, b, nil);
+      }
+    }
+
+    FLTrackModel trackModel;
+    trackGridExportModel(trackGrid, links, &trackModel);
+    XCTAssertEqual(trackModel.size(), trackGrid.size());
+
+    for (FLSegmentNode *platformStartSegmentNode : platformStartSegmentNodes) {
+      unordered_map<void *, int> switchPathIds;
+      for (FLSegmentNode *segmentNode : switchSegmentNodes) {
+        switchPathIds.emplace((__bridge void *)segmentNode, segmentNode.switchPathId);
+      }
+      FLSegmentNode *stopSegmentNode;
+      int stopPathId;
+      int stopProgress;
+      bool finished = runTrainReference(trackGrid, links, switchPathIds, platformStartSegmentNode, &stopSegmentNode, &stopPathId, &stopProgress);
+
+      FLTrackModel runTrackModel(trackModel);
+      int gridX;
+      int gridY;
+      trackGrid.convert(platformStartSegmentNode.position, &gridX, &gridY);
+      FLTrackModelPosition stopPosition;
+      bool modelFinished = runTrackModel.runTrain(gridX, gridY, &stopPosition);
+
+      int stopGridX;
+      int stopGridY;
+      trackGrid.convert(stopSegmentNode.position, &stopGridX, &stopGridY);
+      bool mismatch = (modelFinished != finished
+                       || stopPosition.gridX != stopGridX
+                       || stopPosition.gridY != stopGridY
+                       || stopPosition.pathId != stopPathId
+                       || stopPosition.progress != stopProgress);
+      bool switched = false;
+      for (FLSegmentNode *segmentNode : switchSegmentNodes) {
+        trackGrid.convert(segmentNode.position, &gridX, &gridY);
+        int switchPathId = switchPathIds[(__bridge void *)segmentNode];
+        if (runTrackModel.get(gridX, gridY)->switchPathId != switchPathId) {
+          mismatch = true;
+        }
+        if (switchPathId != segmentNode.switchPathId) {
+          switched = true;
+        }
+      }
+      if (mismatch) {
+        ++mismatchCount;
+      }
+      if (switched) {
+        ++switchedRunCount;
+      }
+    }
+  }
+  XCTAssertEqual(mismatchCount, 0);
+  // note: Make sure trains trigger switches often enough to be an interesting test.
+  XCTAssertGreaterThan(switchedRunCount, 20);
+}
+
+- (void)testPerformanceAllConnecting50k
+{
+  // note: 224 rows of 224 straight segments: 50176 segments in 224 components.
+  const int FLGridSize = 224;
+  __block FLTrackGrid trackGrid(FLTestSegmentSize);
+  for (int gridY = 0; gridY < FLGridSize; ++gridY) {
+    for (int gridX = 0; gridX < FLGridSize; ++gridX) {
+      FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeStraight];
+      segmentNode.position = trackGrid.convert(gridX, gridY);
+      trackGrid.set(gridX, gridY, segmentNode);
+    }
+  }
+
+  [self measureBlock:^{
+    NSUInteger connectingCount = 0;
+    for (int gridY = 0; gridY < FLGridSize; ++gridY) {
+      // note: Break each row and then select it, so that every query rebuilds a component.
+      int gridX = (gridY * 7) % FLGridSize;
+      FLSegmentNode *segmentNode = trackGrid.get(gridX, gridY);
+      trackGrid.erase(gridX, gridY);
+      trackGrid.set(gridX, gridY, segmentNode);
+      connectingCount += [trackGridGetAllConnecting(trackGrid, trackGrid.get((gridX + 1) % FLGridSize, gridY)) count];
+    }
+    XCTAssertGreaterThan(connectingCount, 0U);
+  }];
+}
+
+- (void)testFindClosestOnTrackPointMatchesFullScan
+{
+  const int FLGridSize = 16;
+  mt19937 random(24);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  for (int gridX = 0; gridX < FLGridSize; ++gridX) {
+    for (int gridY = 0; gridY < FLGridSize; ++gridY) {
+      // note: Leave some holes so that the closest track is sometimes a few cells away.
+      if (random() % 3 != 0) {
+        trackGrid.set(gridX, gridY, newRandomSegmentNode(random, gridX, gridY));
+      }
+    }
+  }
+
+  const CGFloat FLProgressPrecision = 0.01f;
+  const int FLSearchDistances[] = { 0, 1, 2, 5 };
+  int foundCount = 0;
+  for (int i = 0; i < 500; ++i) {
+    // note: Include points outside the track.
+    CGPoint worldLocation = CGPointMake(FLTestSegmentSize * (CGFloat(random() % 2200) / 100.0f - 3.5f),
+                                        FLTestSegmentSize * (CGFloat(random() % 2200) / 100.0f - 3.5f));
+    for (int gridSearchDistance : FLSearchDistances) {
+      CGFloat expectedDistance;
+      FLSegmentNode *expectedSegmentNode;
+      int expectedPathId;
+      CGFloat expectedProgress;
+      bool expectedFound = findClosestFullScan(trackGrid, worldLocation, gridSearchDistance, FLProgressPrecision,
+                                               &expectedDistance, &expectedSegmentNode, &expectedPathId, &expectedProgress);
+      CGFloat distance;
+      CGPoint point;
+      CGFloat rotation;
+      FLSegmentNode *segmentNode;
+      int pathId;
+      CGFloat progress;
+      bool found = trackGridFindClosestOnTrackPoint(trackGrid, worldLocation, gridSearchDistance, FLProgressPrecision,
+                                                    &distance, &point, &rotation, &segmentNode, &pathId, &progress);
+      XCTAssertEqual(found, expectedFound);
+      if (!found || !expectedFound) {
+        continue;
+      }
+      ++foundCount;
+      XCTAssertEqual(segmentNode, expectedSegmentNode);
+      XCTAssertEqual(pathId, expectedPathId);
+      XCTAssertEqual(progress, expectedProgress);
+      XCTAssertEqual(distance, expectedDistance);
+    }
+  }
+  XCTAssertGreaterThan(foundCount, 1000);
+}
+
+- (void)testPerformanceFindClosestOnTrackPoint
+{
+  // note: Dense track and a large search distance, as for a drag far from the track
+  // origin; most segments should be rejected by bounds.
+  const int FLGridSize = 100;
+  const int FLSearchDistance = 20;
+  mt19937 random(25);
+  __block FLTrackGrid trackGrid(FLTestSegmentSize);
+  for (int gridX = 0; gridX < FLGridSize; ++gridX) {
+    for (int gridY = 0; gridY < FLGridSize; ++gridY) {
+      trackGrid.set(gridX, gridY, newRandomSegmentNode(random, gridX, gridY));
+    }
+  }
+  __block vector<CGPoint> worldLocations;
+  for (int i = 0; i < 2000; ++i) {
+    worldLocations.push_back(CGPointMake(FLTestSegmentSize * CGFloat(random() % 10000) / 100.0f,
+                                         FLTestSegmentSize * CGFloat(random() % 10000) / 100.0f));
+  }
+
+  [self measureBlock:^{
+    int foundCount = 0;
+    for (const CGPoint& worldLocation : worldLocations) {
+      CGFloat distance;
+      CGPoint point;
+      CGFloat rotation;
+      FLSegmentNode *segmentNode;
+      int pathId;
+      CGFloat progress;
+      if (trackGridFindClosestOnTrackPoint(trackGrid, worldLocation, FLSearchDistance, 0.01f,
+                                           &distance, &point, &rotation, &segmentNode, &pathId, &progress)) {
+        ++foundCount;
+      }
+    }
+    XCTAssertGreaterThan(foundCount, 0);
+  }];
+}
+
+- (void)testJournalSetAndErase
+{
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  XCTAssertEqual(trackGrid.epoch(), uint64_t(0));
+  vector<pair<int, int>> changedCells;
+  XCTAssertTrue(trackGrid.getChangedCells(0, &changedCells));
+  XCTAssertTrue(changedCells.empty());
+
+  FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeStraight];
+  trackGrid.set(3, -2, segmentNode);
+  uint64_t setEpoch = trackGrid.epoch();
+  XCTAssertEqual(setEpoch, uint64_t(1));
+  XCTAssertEqual(trackGrid.getSectorEpoch(0, -1), setEpoch);
+  XCTAssertEqual(trackGrid.getSectorEpoch(0, 0), uint64_t(0));
+
+  // note: Erasing an empty cell is not an edit, and neither is setting it to nil or
+  // updating it.
+  trackGrid.erase(4, -2);
+  trackGrid.set(4, -2, nil);
+  trackGrid.update(4, -2);
+  trackGrid.set(0, 0, nil);
+  trackGrid.update(0, 0);
+  XCTAssertEqual(trackGrid.epoch(), setEpoch);
+  XCTAssertEqual(trackGrid.getSectorEpoch(0, 0), uint64_t(0));
+  changedCells.clear();
+  XCTAssertTrue(trackGrid.getChangedCells(0, &changedCells));
+  XCTAssertTrue(changedCells == (vector<pair<int, int>>{ {3, -2} }));
+  XCTAssertEqual(trackGrid.size(), 1UL);
+
+  trackGrid.set(20, 0, [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeCurve]);
+  trackGrid.erase(3, -2);
+  XCTAssertEqual(trackGrid.epoch(), setEpoch + 2);
+  XCTAssertEqual(trackGrid.getSectorEpoch(0, -1), setEpoch + 2);
+  XCTAssertEqual(trackGrid.getSectorEpoch(1, 0), setEpoch + 1);
+
+  changedCells.clear();
+  XCTAssertTrue(trackGrid.getChangedCells(0, &changedCells));
+  XCTAssertTrue(changedCells == (vector<pair<int, int>>{ {3, -2}, {20, 0} }));
+  changedCells.clear();
+  XCTAssertTrue(trackGrid.getChangedCells(setEpoch + 1, &changedCells));
+  XCTAssertTrue(changedCells == (vector<pair<int, int>>{ {3, -2} }));
+  changedCells.clear();
+  XCTAssertTrue(trackGrid.getChangedCells(trackGrid.epoch(), &changedCells));
+  XCTAssertTrue(changedCells.empty());
+
+  // note: Rotating in place is journaled by update().
+  FLSegmentNode *curveNode = trackGrid.get(20, 0);
+  curveNode.zRotationQuarters = 1;
+  trackGrid.update(20, 0);
+  XCTAssertEqual(trackGrid.getSectorEpoch(1, 0), trackGrid.epoch());
+}
+
+- (void)testJournalMove
+{
+  // note: Segments are moved (as by the track scene) by erasing them from their old cells
+  // and setting them in their new ones; both cells should be reported.
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeJoinLeft];
+  trackGrid.set(-1, -1, segmentNode);
+  uint64_t beforeMoveEpoch = trackGrid.epoch();
+
+  trackGrid.erase(-1, -1);
+  segmentNode.position = trackGrid.convert(40, 2);
+  trackGrid.set(40, 2, segmentNode);
+
+  vector<pair<int, int>> changedCells;
+  XCTAssertTrue(trackGrid.getChangedCells(beforeMoveEpoch, &changedCells));
+  XCTAssertTrue(changedCells == (vector<pair<int, int>>{ {-1, -1}, {40, 2} }));
+  XCTAssertGreaterThan(trackGrid.getSectorEpoch(-1, -1), beforeMoveEpoch);
+  XCTAssertGreaterThan(trackGrid.getSectorEpoch(2, 0), beforeMoveEpoch);
+  XCTAssertEqual(trackGrid.getSectorEpoch(0, 0), uint64_t(0));
+
+  // note: Snapshots remember the epoch they were taken at.
+  shared_ptr<const FLTrackGridSnapshot> snapshot = trackGrid.snapshot();
+  XCTAssertEqual(snapshot->epoch(), trackGrid.epoch());
+}
+
+- (void)testJournalImport
+{
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  trackGrid.set(0, 0, [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeStraight]);
+  uint64_t beforeImportEpoch = trackGrid.epoch();
+
+  SKNode *parentNode = [SKNode node];
+  set<pair<int, int>> importedCells;
+  for (int i = 0; i < 5; ++i) {
+    FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeCurve];
+    segmentNode.position = trackGrid.convert(i * 10, -i);
+    [parentNode addChild:segmentNode];
+    importedCells.emplace(i * 10, -i);
+  }
+  trackGrid.import(parentNode);
+
+  // note: An import is one edit.
+  XCTAssertEqual(trackGrid.epoch(), beforeImportEpoch + 1);
+  vector<pair<int, int>> changedCells;
+  XCTAssertTrue(trackGrid.getChangedCells(beforeImportEpoch, &changedCells));
+  XCTAssertTrue(set<pair<int, int>>(changedCells.begin(), changedCells.end()) == importedCells);
+  XCTAssertEqual(changedCells.size(), importedCells.size());
+  XCTAssertEqual(trackGrid.getSectorEpoch(2, -1), trackGrid.epoch());
+}
+
+- (void)testImportMatchesSet
+{
+  // note: Import into a grid that already has track, with some imported nodes replacing
+  // existing ones and some landing in the same cell as each other; the result should be
+  // as if each had been set() in order.
+  mt19937 random(12);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  FLTrackGrid expectedTrackGrid(FLTestSegmentSize);
+  for (int gridX = -6; gridX < 6; ++gridX) {
+    for (int gridY = -6; gridY < 6; ++gridY) {
+      if (random() % 2 == 0) {
+        FLSegmentNode *segmentNode = newRandomSegmentNode(random, gridX, gridY);
+        trackGrid.set(gridX, gridY, segmentNode);
+        expectedTrackGrid.set(gridX, gridY, segmentNode);
+      }
+    }
+  }
+  uint64_t beforeImportEpoch = trackGrid.epoch();
+
+  SKNode *parentNode = [SKNode node];
+  set<pair<int, int>> importedCells;
+  for (int i = 0; i < 200; ++i) {
+    int gridX = int(random() % 16) - 8;
+    int gridY = int(random() % 16) - 8;
+    FLSegmentNode *segmentNode = newRandomSegmentNode(random, gridX, gridY);
+    [parentNode addChild:segmentNode];
+    expectedTrackGrid.set(gridX, gridY, segmentNode);
+    importedCells.emplace(gridX, gridY);
+  }
+  trackGrid.import(parentNode);
+
+  XCTAssertEqual(trackGrid.size(), expectedTrackGrid.size());
+  int cellMismatchCount = 0;
+  for (auto s : expectedTrackGrid) {
+    if (trackGrid.get(s.first.first, s.first.second) != s.second) {
+      ++cellMismatchCount;
+    }
+  }
+  XCTAssertEqual(cellMismatchCount, 0);
+
+  int connectionCount;
+  XCTAssertEqual(countConnectionMismatches(trackGrid, &connectionCount), 0);
+  XCTAssertGreaterThan(connectionCount, 0);
+
+  // note: Segment values (for snapshots) are those of the last node set in each cell.
+  FLTrackModel trackModel;
+  trackGrid.snapshot()->exportModel(&trackModel);
+  FLTrackModel expectedTrackModel;
+  expectedTrackGrid.snapshot()->exportModel(&expectedTrackModel);
+  XCTAssertEqual(countModelMismatches(trackModel, expectedTrackModel), 0);
+
+  // note: Components match those rebuilt from scratch.
+  FLTrackGrid rebuiltTrackGrid(trackGrid);
+  rebuiltTrackGrid.rebuildConnections();
+  int componentMismatchCount = 0;
+  for (auto s = trackGrid.begin(); s != trackGrid.end(); ++s) {
+    FLTrackGrid::FLSegmentHandle segmentHandle = trackGrid.getHandle((*s).first.first, (*s).first.second);
+    vector<FLTrackGrid::FLSegmentHandle> component;
+    trackGrid.getComponent(segmentHandle, &component);
+    vector<FLTrackGrid::FLSegmentHandle> rebuiltComponent;
+    rebuiltTrackGrid.getComponent(segmentHandle, &rebuiltComponent);
+    sort(component.begin(), component.end());
+    sort(rebuiltComponent.begin(), rebuiltComponent.end());
+    if (component != rebuiltComponent) {
+      ++componentMismatchCount;
+    }
+  }
+  XCTAssertEqual(componentMismatchCount, 0);
+
+  // note: Each imported cell is journaled once.
+  vector<pair<int, int>> changedCells;
+  XCTAssertTrue(trackGrid.getChangedCells(beforeImportEpoch, &changedCells));
+  XCTAssertTrue(set<pair<int, int>>(changedCells.begin(), changedCells.end()) == importedCells);
+  XCTAssertEqual(changedCells.size(), importedCells.size());
+}
+
+- (void)testJournalOverflow
+{
+  mt19937 random(26);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  trackGrid.set(0, 0, newRandomSegmentNode(random, 0, 0));
+  uint64_t firstEpoch = trackGrid.epoch();
+  for (int i = 0; i < int(FLTrackGrid::FLTrackGridJournalMax); ++i) {
+    trackGrid.set(i % 64, 2, newRandomSegmentNode(random, i % 64, 2));
+  }
+  trackGrid.set(1, 0, newRandomSegmentNode(random, 1, 0));
+
+  // note: Old changes are forgotten, but recent ones can still be found.
+  vector<pair<int, int>> changedCells;
+  XCTAssertFalse(trackGrid.getChangedCells(firstEpoch - 1, &changedCells));
+  XCTAssertTrue(trackGrid.getChangedCells(trackGrid.epoch() - 1, &changedCells));
+  XCTAssertTrue(changedCells == (vector<pair<int, int>>{ {1, 0} }));
+}
+
+- (void)testSnapshot
+{
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  FLLinks links;
+  FLSegmentNode *joinNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeJoinLeft];
+  joinNode.position = trackGrid.convert(0, 0);
+  trackGrid.set(0, 0, joinNode);
+  FLSegmentNode *readoutNode = [[FLSegmentNode alloc] initWithSegmentType:FLSegmentTypeReadoutInput];
+  readoutNode.position = trackGrid.convert(3, 1);
+  readoutNode.label = 'A';
+  trackGrid.set(3, 1, readoutNode);
+  links.set(joinNode, readoutNode, nil);
+
+  shared_ptr<const FLTrackGridSnapshot> snapshot = trackGrid.snapshot(&links);
+
+  // note: Changes after the snapshot, whether by set() or in place, are not seen by it.
+  joinNode.zRotationQuarters = 1;
+  trackGrid.update(0, 0);
+  [readoutNode setSwitchPathId:0 animated:NO];
+  trackGrid.updateSwitchAndLabel(3, 1);
+  trackGrid.erase(3, 1);
+
+  XCTAssertEqual(snapshot->size(), 2UL);
+  FLSegment segment;
+  XCTAssertTrue(snapshot->get(0, 0, &segment));
+  XCTAssertEqual(segment.segmentType, FLSegmentTypeJoinLeft);
+  XCTAssertEqual(segment.rotationQuarters, 0);
+  XCTAssertTrue(snapshot->get(3, 1, &segment));
+  XCTAssertEqual(segment.gridX, 3);
+  XCTAssertEqual(segment.label, 'A');
+  XCTAssertEqual(segment.switchPathId, 1);
+  XCTAssertFalse(snapshot->get(1, 0, &segment));
+
+  FLTrackModel trackModel;
+  snapshot->exportModel(&trackModel);
+  XCTAssertEqual(trackModel.size(), 2UL);
+  XCTAssertTrue(trackModel.hasAnyLinks(3, 1));
+
+  // note: But a new snapshot sees them.
+  shared_ptr<const FLTrackGridSnapshot> newSnapshot = trackGrid.snapshot();
+  XCTAssertTrue(newSnapshot->get(0, 0, &segment));
+  XCTAssertEqual(segment.rotationQuarters, 1);
+  XCTAssertFalse(newSnapshot->get(3, 1, &segment));
+}
+
+- (void)testSnapshotConcurrentEdit
+{
+  // note: Each generation, take a snapshot (along with the model it should match), and
+  // then, while another thread reads the snapshot, edit the grid: set, erase, rotate,
+  // flip, and switch.  The snapshot must always match the grid as it was.
+  const int FLGridSize = 48;
+  mt19937 random(27);
+  FLTrackGrid trackGrid(FLTestSegmentSize);
+  FLLinks links;
+  for (int edit = 0; edit < 4000; ++edit) {
+    editRandom(random, trackGrid, FLGridSize);
+  }
+
+  for (int generation = 0; generation < 30; ++generation) {
+    FLTrackModel expectedTrackModel;
+    trackGridExportModel(trackGrid, links, &expectedTrackModel);
+    shared_ptr<const FLTrackGridSnapshot> snapshot = trackGrid.snapshot();
+    atomic<int> mismatchCount(0);
+    thread reader([&snapshot, &expectedTrackModel, &mismatchCount]() {
+      for (int pass = 0; pass < 4; ++pass) {
+        FLTrackModel trackModel;
+        snapshot->exportModel(&trackModel);
+        mismatchCount += countModelMismatches(trackModel, expectedTrackModel);
+      }
+      // note: Destroy the snapshot here, too, concurrently with writes to the grid.
+      snapshot.reset();
+    });
+    for (int edit = 0; edit < 400; ++edit) {
+      if (random() % 4 == 0) {
+        int gridX = int(random() % static_cast<unsigned int>(FLGridSize)) - FLGridSize / 2;
+        int gridY = int(random() % static_cast<unsigned int>(FLGridSize)) - FLGridSize / 2;
+        FLSegmentNode *segmentNode = trackGrid.get(gridX, gridY);
+        if (segmentNode && [segmentNode canSwitch]) {
+          [segmentNode toggleSwitchPathIdAnimated:NO];
+          trackGrid.updateSwitchAndLabel(gridX, gridY);
+        }
+      } else {
+        editRandom(random, trackGrid, FLGridSize);
+      }
+    }
+    reader.join();
+    XCTAssertEqual(mismatchCount.load(), 0);
+  }
+
+  // note: And the grid's own values stay current.
+  FLTrackModel expectedTrackModel;
+  trackGridExportModel(trackGrid, links, &expectedTrackModel);
+  FLTrackModel trackModel;
+  trackGrid.snapshot()->exportModel(&trackModel);
+  XCTAssertEqual(countModelMismatches(trackModel, expectedTrackModel), 0);
+}
+
+@end
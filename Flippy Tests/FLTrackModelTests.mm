@@ -0,0 +1,256 @@
+//
+//  FLTrackModelTests.mm
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#import <map>
+#import <random>
+#import <set>
+#import <tuple>
+#import <XCTest/XCTest.h>
+
+// note: Only headless headers, so that the track model is tested without SpriteKit.
+#include "FLSegment.h"
+#include "FLTestTrack.h"
+#include "FLTrackGraph.h"
+#include "FLTrackModel.h"
+
+using namespace std;
+
+@interface FLTrackModelTests : XCTestCase
+
+@end
+
+/**
+ * Loads a track from a list of segments (type, location, rotation, and switch path id).
+ */
+static void
+loadTrack(FLTrackModel& trackModel, const vector<tuple<FLSegmentType, int, int, int, int>>& segments)
+{
+  for (const auto& s : segments) {
+    FLSegment segment(get<0>(s), get<1>(s), get<2>(s), get<3>(s));
+    segment.switchPathId = get<4>(s);
+    trackModel.set(segment);
+  }
+}
+
+static set<tuple<int, int, int>>
+portSet(const FLSegment& segment)
+{
+  // note: Compare ports without regard to path numbering or direction.
+  set<tuple<int, int, int>> ports;
+  FLSegmentNodePort segmentPorts[FLSegmentNodePortsMax];
+  int portCount = segment.getPorts(segmentPorts);
+  for (int p = 0; p < portCount; ++p) {
+    const FLSegmentNodePort& port = segmentPorts[p];
+    int departureQuarters = (port.progress == 0 ? port.tangentQuarters : port.tangentQuarters + 2) % 4;
+    ports.emplace(port.halfX, port.halfY, departureQuarters);
+  }
+  return ports;
+}
+
+@implementation FLTrackModelTests
+
+- (void)testSetAndErase
+{
+  mt19937 random(3);
+  FLTrackModel trackModel;
+  map<pair<int, int>, FLSegmentType> expected;
+
+  for (int i = 0; i < 5000; ++i) {
+    int gridX = int(random() % 24) - 12;
+    int gridY = int(random() % 24) - 12;
+    if (random() % 3 == 0) {
+      XCTAssertEqual(trackModel.erase(gridX, gridY), expected.erase(pair<int, int>(gridX, gridY)) == 1);
+    } else {
+      FLSegmentType segmentType = FLTestTrackSegmentTypes[random() % FLTestTrackSegmentTypeCount];
+      trackModel.set(FLSegment(segmentType, gridX, gridY, int(random() % 4)));
+      expected[pair<int, int>(gridX, gridY)] = segmentType;
+    }
+  }
+
+  XCTAssertEqual(trackModel.size(), expected.size());
+  for (const FLSegment& segment : trackModel.segments()) {
+    auto e = expected.find(pair<int, int>(segment.gridX, segment.gridY));
+    XCTAssertTrue(e != expected.end());
+    XCTAssertEqual(e->second, segment.segmentType);
+    XCTAssertEqual(trackModel.get(segment.gridX, segment.gridY), &segment);
+  }
+  for (int gridX = -12; gridX < 12; ++gridX) {
+    for (int gridY = -12; gridY < 12; ++gridY) {
+      XCTAssertEqual(trackModel.get(gridX, gridY) != nullptr, expected.count(pair<int, int>(gridX, gridY)) == 1);
+    }
+  }
+}
+
+- (void)testLinks
+{
+  FLTrackModel trackModel;
+  trackModel.set(FLSegment(FLSegmentTypeJoinLeft, 0, 0));
+  trackModel.set(FLSegment(FLSegmentTypeReadoutInput, 2, 0));
+  trackModel.set(FLSegment(FLSegmentTypeReadoutOutput, 4, 0));
+  trackModel.link(0, 0, 2, 0);
+  trackModel.link(2, 0, 0, 0);
+  trackModel.link(2, 0, 4, 0);
+
+  vector<pair<int, int>> linkedCells;
+  trackModel.getLinks(2, 0, &linkedCells);
+  XCTAssertEqual(linkedCells.size(), 2);
+
+  // note: Propagation is not recursive.
+  trackModel.setSwitchPathId(0, 0, 0);
+  XCTAssertEqual(trackModel.get(0, 0)->switchPathId, 0);
+  XCTAssertEqual(trackModel.get(2, 0)->switchPathId, 0);
+  XCTAssertEqual(trackModel.get(4, 0)->switchPathId, 1);
+
+  trackModel.erase(2, 0);
+  XCTAssertFalse(trackModel.hasAnyLinks(0, 0));
+  XCTAssertFalse(trackModel.hasAnyLinks(4, 0));
+  trackModel.set(FLSegment(FLSegmentTypeReadoutInput, 2, 0));
+  XCTAssertFalse(trackModel.hasAnyLinks(2, 0));
+}
+
+- (void)testFlip
+{
+  for (size_t t = 0; t < FLTestTrackSegmentTypeCount; ++t) {
+    for (int rotationQuarters = 0; rotationQuarters < 4; ++rotationQuarters) {
+      for (int flipDirection = 0; flipDirection < 2; ++flipDirection) {
+        FLSegment segment(FLTestTrackSegmentTypes[t], 0, 0, rotationQuarters);
+        if (!segment.canFlip()) {
+          continue;
+        }
+        set<tuple<int, int, int>> originalPorts = portSet(segment);
+        segment.flip(FLSegmentFlipDirection(flipDirection));
+        // note: Flipping mirrors every port across an axis.
+        set<tuple<int, int, int>> mirroredPorts;
+        for (const auto& port : originalPorts) {
+          int halfX = get<0>(port);
+          int halfY = get<1>(port);
+          int departureQuarters = get<2>(port);
+          if (flipDirection == FLSegmentFlipHorizontal) {
+            mirroredPorts.emplace(-halfX, halfY, (6 - departureQuarters) % 4);
+          } else {
+            mirroredPorts.emplace(halfX, -halfY, (4 - departureQuarters) % 4);
+          }
+        }
+        XCTAssertTrue(portSet(segment) == mirroredPorts);
+        segment.flip(FLSegmentFlipDirection(flipDirection));
+        XCTAssertTrue(portSet(segment) == originalPorts);
+      }
+    }
+  }
+}
+
+- (void)testRunTrainAgainstSwitch
+{
+  // note: Track runs along the top edges of the cells.  The train leaves the platform going
+  // left, and arrives at the join along its straight path, going against the switch.
+  FLTrackModel trackModel;
+  loadTrack(trackModel, {
+    make_tuple(FLSegmentTypePlatformStartRight, 0, 0, 0, 1),
+    make_tuple(FLSegmentTypeStraight, -1, 0, 0, 1),
+    make_tuple(FLSegmentTypeJoinLeft, -2, 0, 0, 0),
+    make_tuple(FLSegmentTypeStraight, -3, 0, 0, 1),
+    make_tuple(FLSegmentTypeReadoutOutput, 0, 3, 0, 0),
+  });
+  trackModel.link(-2, 0, 0, 3);
+
+  FLTrackModel trackModelCopy(trackModel);
+  FLTrackModelPosition stopPosition;
+  XCTAssertTrue(trackModel.runTrain(0, 0, &stopPosition));
+  XCTAssertEqual(stopPosition.gridX, -3);
+  XCTAssertEqual(stopPosition.gridY, 0);
+  XCTAssertEqual(stopPosition.pathId, 0);
+  XCTAssertEqual(stopPosition.progress, 0);
+  XCTAssertEqual(trackModel.get(-2, 0)->switchPathId, 1);
+  XCTAssertEqual(trackModel.get(0, 3)->switchPathId, 1);
+
+  // note: The copy is unaffected.
+  XCTAssertEqual(trackModelCopy.get(-2, 0)->switchPathId, 0);
+  XCTAssertEqual(trackModelCopy.get(0, 3)->switchPathId, 0);
+}
+
+- (void)testRunTrainWithSwitch
+{
+  // note: The train leaves the platform going right, and arrives at the switch point of
+  // the join, where the switch chooses the path.
+  for (int switchPathId = 0; switchPathId < 2; ++switchPathId) {
+    FLTrackModel trackModel;
+    loadTrack(trackModel, {
+      make_tuple(FLSegmentTypePlatformStartLeft, 0, 0, 0, 1),
+      make_tuple(FLSegmentTypeJoinLeft, 1, 0, 0, switchPathId),
+    });
+    FLTrackModelPosition stopPosition;
+    XCTAssertTrue(trackModel.runTrain(0, 0, &stopPosition));
+    XCTAssertEqual(stopPosition.gridX, 1);
+    XCTAssertEqual(stopPosition.gridY, 0);
+    XCTAssertEqual(stopPosition.pathId, switchPathId);
+    XCTAssertEqual(stopPosition.progress, (switchPathId == 0 ? 0 : 1));
+    XCTAssertEqual(trackModel.get(1, 0)->switchPathId, switchPathId);
+  }
+}
+
+- (void)testConnectingMatchesGraph
+{
+  // note: The model searches the cells around a corner, and the graph searches the ends
+  // at a vertex; both must find the same connections.
+  mt19937 random(23);
+  int connectingCount = 0;
+  int mismatchCount = 0;
+  for (int round = 0; round < 10; ++round) {
+    FLTrackModel trackModel;
+    for (int gridX = -8; gridX < 8; ++gridX) {
+      for (int gridY = -8; gridY < 8; ++gridY) {
+        if (random() % 4 == 0) {
+          continue;
+        }
+        FLSegment segment(FLTestTrackSegmentTypes[random() % FLTestTrackSegmentTypeCount], gridX, gridY, int(random() % 4));
+        segment.switchPathId = int(random() % 2);
+        trackModel.set(segment);
+      }
+    }
+    FLTrackGraph trackGraph;
+    for (const FLSegment& segment : trackModel.segments()) {
+      trackGraph.addSegment(segment);
+    }
+    XCTAssertEqual(trackGraph.segmentCount(), trackModel.size());
+
+    for (uint32_t edgeId = 0; edgeId < trackGraph.edgeCount(); ++edgeId) {
+      const FLTrackGraphEdge& edge = trackGraph.edge(edgeId);
+      const FLTrackGraphSegment& segment = trackGraph.segment(edge.segmentId);
+      for (int progress = 0; progress < 2; ++progress) {
+        FLTrackModelPosition fromPosition;
+        fromPosition.gridX = segment.gridX;
+        fromPosition.gridY = segment.gridY;
+        fromPosition.pathId = edge.pathId;
+        fromPosition.progress = progress;
+        FLTrackModelPosition expectedPosition;
+        bool expected = trackModel.findConnecting(fromPosition, &expectedPosition);
+        FLTrackGraphEnd connectingEnd;
+        bool actual = trackGraph.findConnecting(edgeId, progress, &connectingEnd);
+        if (expected) {
+          ++connectingCount;
+        }
+        if (actual != expected) {
+          ++mismatchCount;
+        } else if (actual) {
+          const FLTrackGraphEdge& connectingEdge = trackGraph.edge(connectingEnd.edgeId);
+          const FLTrackGraphSegment& connectingSegment = trackGraph.segment(connectingEdge.segmentId);
+          if (connectingSegment.gridX != expectedPosition.gridX
+              || connectingSegment.gridY != expectedPosition.gridY
+              || connectingEdge.pathId != expectedPosition.pathId
+              || connectingEnd.progress != expectedPosition.progress) {
+            ++mismatchCount;
+          }
+        }
+      }
+    }
+  }
+  XCTAssertGreaterThan(connectingCount, 100);
+  XCTAssertEqual(mismatchCount, 0);
+}
+
+@end
@@ -0,0 +1,60 @@
+//
+//  XCTestPortable.h
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#ifndef __Flippy__XCTestPortable__
+#define __Flippy__XCTestPortable__
+
+// note: Stand-ins for the XCTest assertions used by the headless test files, so that
+// xctest_to_cpp.py can turn them into plain C++ programs; see run_portable_tests.sh.
+// Failures are counted rather than thrown, as XCTest does.
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+static int XCTestPortableFailureCount = 0;
+static const char *XCTestPortableCurrentTest = "";
+
+#define XCTestPortableFail(_description) \
+  do { \
+    std::fprintf(stderr, "%s:%d: %s: failed: %s\n", __FILE__, __LINE__, XCTestPortableCurrentTest, _description); \
+    ++XCTestPortableFailureCount; \
+  } while (0)
+
+#define XCTAssertTrue(_a, ...) do { if (!(_a)) XCTestPortableFail(#_a); } while (0)
+#define XCTAssertFalse(_a, ...) do { if ((_a)) XCTestPortableFail("!(" #_a ")"); } while (0)
+#define XCTAssert(_a, ...) XCTAssertTrue(_a)
+#define XCTAssertEqual(_a, _b, ...) do { if (!((_a) == (_b))) XCTestPortableFail(#_a " == " #_b); } while (0)
+#define XCTAssertNotEqual(_a, _b, ...) do { if ((_a) == (_b)) XCTestPortableFail(#_a " != " #_b); } while (0)
+#define XCTAssertLessThan(_a, _b, ...) do { if (!((_a) < (_b))) XCTestPortableFail(#_a " < " #_b); } while (0)
+#define XCTAssertLessThanOrEqual(_a, _b, ...) do { if (!((_a) <= (_b))) XCTestPortableFail(#_a " <= " #_b); } while (0)
+#define XCTAssertGreaterThan(_a, _b, ...) do { if (!((_a) > (_b))) XCTestPortableFail(#_a " > " #_b); } while (0)
+#define XCTAssertGreaterThanOrEqual(_a, _b, ...) do { if (!((_a) >= (_b))) XCTestPortableFail(#_a " >= " #_b); } while (0)
+#define XCTAssertEqualWithAccuracy(_a, _b, _accuracy, ...) \
+  do { if (!(((_a) - (_b)) <= (_accuracy) && ((_b) - (_a)) <= (_accuracy))) XCTestPortableFail(#_a " == " #_b " (with accuracy)"); } while (0)
+
+#define __block
+
+/**
+ * Runs a measured block a few times and reports the average time, in place of XCTest's
+ * measureBlock:.  (Numbers are only a rough guide; Instruments is still the reference.)
+ */
+inline void
+XCTestPortableMeasureBlock(const std::function<void ()>& block)
+{
+  const int FLIterationCount = 3;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < FLIterationCount; ++i) {
+    block();
+  }
+  auto finish = std::chrono::steady_clock::now();
+  std::fprintf(stderr, "  %s: %.3f ms per iteration\n", XCTestPortableCurrentTest,
+               std::chrono::duration<double, std::milli>(finish - start).count() / FLIterationCount);
+}
+
+#endif /* defined(__Flippy__XCTestPortable__) */
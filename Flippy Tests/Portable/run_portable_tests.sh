@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+#  run_portable_tests.sh
+#  Flippy
+#
+#  Created by Karl Voskuil on 11/25/14.
+#  Copyright (c) 2014 Hilo Games. All rights reserved.
+#
+#  Builds and runs the headless test files (those that depend on no Apple frameworks)
+#  as plain C++ programs, for instance on Linux with libstdc++.  The same files run in
+#  the Xcode test target; this only checks that the code under test is portable, and
+#  that it behaves the same with another compiler and standard library.
+#
+#  usage: run_portable_tests.sh   (CXX and CXXFLAGS are honored)
+
+set -e
+
+PORTABLE_DIR=$(cd "$(dirname "$0")" && pwd)
+TESTS_DIR=$(dirname "$PORTABLE_DIR")
+SOURCE_DIR="$(dirname "$TESTS_DIR")/Flippy"
+BUILD_DIR=$(mktemp -d)
+trap 'rm -rf "$BUILD_DIR"' EXIT
+
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:--O2}
+WARNINGS="-Wall -Wextra -Wshadow -Wsign-conversion -Wno-unused-parameter -Wno-reorder"
+
+# run_test <name> <tests.mm> <extra flags> [<sources>...]
+run_test() {
+  name=$1
+  tests=$2
+  flags=$3
+  shift 3
+  echo "== $name"
+  python3 "$PORTABLE_DIR/xctest_to_cpp.py" "$TESTS_DIR/$tests" "$BUILD_DIR/$name.cpp"
+  $CXX -std=gnu++11 $CXXFLAGS $WARNINGS $flags -I"$SOURCE_DIR" -I"$TESTS_DIR" -I"$PORTABLE_DIR" \
+    -o "$BUILD_DIR/$name" "$BUILD_DIR/$name.cpp" "$@" -lpthread
+  "$BUILD_DIR/$name"
+}
+
+# host_has_avx2: True if the host can run AVX2 code (Linux or macOS).
+host_has_avx2() {
+  grep -qw avx2 /proc/cpuinfo 2>/dev/null || sysctl -n machdep.cpu.leaf7_features 2>/dev/null | grep -qi avx2
+}
+
+# note: The occupancy bitmap stencils have a kernel per lanes type; run the tests once for
+# each path (the default is SSE2 on x86-64), and once more under the sanitizers.
+run_test DenseSectorTableTests DenseSectorTableTests.mm "" "$SOURCE_DIR/DenseSectorTable.cpp"
+run_test DenseSectorTableTestsNoSimd DenseSectorTableTests.mm "-DDENSE_SECTOR_TABLE_NO_SIMD" "$SOURCE_DIR/DenseSectorTable.cpp"
+if host_has_avx2; then
+  run_test DenseSectorTableTestsAvx2 DenseSectorTableTests.mm "-mavx2" "$SOURCE_DIR/DenseSectorTable.cpp"
+else
+  echo "== DenseSectorTableTestsAvx2 skipped: host has no AVX2"
+fi
+run_test DenseSectorTableTestsSanitized DenseSectorTableTests.mm "-O1 -fsanitize=address,undefined -fno-sanitize-recover=undefined" \
+  "$SOURCE_DIR/DenseSectorTable.cpp"
+
+run_test FLConnectedComponentsTests FLConnectedComponentsTests.mm ""
+
+# note: The segment enums are declared through FL_SEGMENT_ENUM, which has a plain C++
+# branch that only builds like this.
+run_test FLTrackModelTests FLTrackModelTests.mm "" "$SOURCE_DIR/FLSegment.cpp" "$SOURCE_DIR/FLTrackGraph.cpp" "$SOURCE_DIR/FLTrackModel.cpp"
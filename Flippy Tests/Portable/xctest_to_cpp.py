@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+#
+#  xctest_to_cpp.py
+#  Flippy
+#
+#  Created by Karl Voskuil on 11/25/14.
+#  Copyright (c) 2014 Hilo Games. All rights reserved.
+#
+#  Converts a headless XCTest file (one whose test methods use only C++ and the XCTest
+#  assertions, and nothing from Apple frameworks) into a plain C++ program which runs
+#  each test and exits nonzero on failure.  See run_portable_tests.sh.
+#
+#  usage: xctest_to_cpp.py <tests.mm> <output.cpp>
+
+import re
+import sys
+
+source = open(sys.argv[1]).read()
+
+source = re.sub(r'#import <(UIKit|XCTest|Foundation)/\w+\.h>\n', '', source)
+source = source.replace('#import ', '#include ')
+source = re.sub(r'@interface \w+ : XCTestCase\s*@end\n', '', source)
+
+implementation = re.search(r'@implementation (\w+)', source)
+if not implementation:
+    sys.exit('%s: no @implementation found' % sys.argv[1])
+testClass = implementation.group(1)
+source = source.replace(implementation.group(0), 'struct %s {' % testClass)
+end = source.rfind('@end')
+source = source[:end] + '};' + source[end + 4:]
+
+testNames = re.findall(r'^- \(void\)(test\w+)', source, flags=re.M)
+source = re.sub(r'^- \(void\)(\w+)', r'void \1()', source, flags=re.M)
+source = source.replace('[self measureBlock:^{', 'XCTestPortableMeasureBlock([&]{')
+source = re.sub(r'^(\s*)\}\];$', r'\1});', source, flags=re.M)
+
+output = '#include "XCTestPortable.h"\n' + source
+output += '\nint main()\n{\n  %s tests;\n' % testClass
+for testName in testNames:
+    output += '  XCTestPortableCurrentTest = "%s";\n' % testName
+    output += '  std::fprintf(stderr, "%s\\n");\n' % testName
+    output += '  tests.%s();\n' % testName
+output += '  std::fprintf(stderr, "%d failures\\n", XCTestPortableFailureCount);\n'
+output += '  return (XCTestPortableFailureCount == 0 ? 0 : 1);\n}\n'
+open(sys.argv[2], 'w').write(output)
@@ -9,616 +9,3531 @@
 #ifndef __Flippy__DenseSectorTable__
 #define __Flippy__DenseSectorTable__
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 #include <unordered_map>
 
+#if !defined(DENSE_SECTOR_TABLE_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define DENSE_SECTOR_TABLE_SIMD_AVX2 1
+#elif !defined(DENSE_SECTOR_TABLE_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define DENSE_SECTOR_TABLE_SIMD_SSE2 1
+#endif
+
 namespace HLCommon {
 
 /**
- Implements an infinite integer-indexed two-dimensional grid as a hash table of sectors;
- each sector is a preallocated block of values (which allows dense data in the sector
- without increased memory usage).
+ Allocates the fixed-size memory blocks which store `DenseSectorTable` sectors.  Passed
+ to the table's constructor; if none is passed, blocks are allocated directly with
+ `posix_memalign()` and `free()`.
 
- ## Missing Sector (Regional) Interface
-
- The sector interface is an important part of this structure.  For example, to conserve
- memory, the owner can get a block of values, write them to disk, erase them from the
- table, and then set them again later on-demand.
+ Each block remembers its allocator, and blocks may be shared between copies of a table
+ (and released on other threads), so an allocator must be thread-safe and must outlive
+ every table (and every copy of a table, and every extracted sector) that uses it.
+*/
+class DenseSectorTableBlockAllocator
+{
+public:
+  virtual ~DenseSectorTableBlockAllocator() {}
+  virtual void *allocate(size_t byteCount, size_t alignment) = 0;
+  virtual void deallocate(void *memory, size_t byteCount) = 0;
+
+  static void *systemAllocate(size_t byteCount, size_t alignment) {
+    void *memory;
+    if (posix_memalign(&memory, alignment, byteCount) != 0) {
+      throw std::bad_alloc();
+    }
+    return memory;
+  }
 
- Buuuuuut . . . you might notice the interface doesn't yet exist, because it doesn't have
- any current users.  Ideas for the design when it is added:
+  static void systemDeallocate(void *memory) {
+    free(memory);
+  }
+};
 
- - Big question is how to identify sectors in the interface.  Right now the table uses
-   "sector coordinates" internally, but that seems unfortunate to expose.  Probably keep
-   using point coordinates to find sector iterators.  That would imply we should reuse
-   `DenseSectorTableIterator` when doing sector operations; it will return point
-   coordinates when dereferenced, which can be used to find the sector again, so good.
-   However, it will be slightly annoying for the user to test sector identity: for
-   instance, point coordinates `(1,2)` and `(1,3)` might refer to the same sector, but
-   `(1,2)` and `(1,4)` might not.
+/**
+ A `DenseSectorTableBlockAllocator` which keeps freed blocks on a free list (one for each
+ block size) and hands them out again, rather than returning them to the system.  Useful
+ when sectors are frequently created and pruned, for instance when a selection of
+ segments is dragged through the world.
 
- - Getting and setting sectors: iterator interface.
+ Retains at most `freeBlockCountMax` free blocks of each size; beyond that, freed blocks
+ are returned to the system.  Thread-safe.
+*/
+class DenseSectorTableBlockPool : public DenseSectorTableBlockAllocator
+{
+public:
 
-   For setting, would need a sector insertion method, and also an iterator option for
-   iterating through the entire sector including unset points.  This, in turn, would
-   obviate the need for returning point coordinates when dereferencing the iterator (which
-   currently feels a little dirty, since those coordinates don't actually exist in the
-   data structure, and so can't be accessed with operator->().
+  explicit DenseSectorTableBlockPool(size_t freeBlockCountMax = 256)
+    : freeBlockCountMax_(freeBlockCountMax), systemAllocationCount_(0), allocationCount_(0) {}
 
-     iterator beginSector(x, y, iterateOnNullValues = false);
-     const_iterator beginSector(x, y, iterateOnNullValues = false);
-     iterator endSector(x, y, iterateOnNullValues = false);
-     const_iterator endSector(x, y, iterateOnNullValues = false);
+  ~DenseSectorTableBlockPool() {
+    for (auto& freeList : freeLists_) {
+      for (void *memory : freeList.second) {
+        systemDeallocate(memory);
+      }
+    }
+  }
 
-     pair<iterator, bool> insertSector(x, y, iterateOnNullValues = false);
+  void *allocate(size_t byteCount, size_t alignment) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++allocationCount_;
+      std::vector<void *>& freeList = freeLists_[byteCount];
+      if (!freeList.empty()) {
+        void *memory = freeList.back();
+        freeList.pop_back();
+        return memory;
+      }
+      ++systemAllocationCount_;
+    }
+    // note: All blocks of a given size are assumed to be allocated with the same
+    // alignment, which is true of blocks allocated by `DenseSectorTable`.
+    return systemAllocate(byteCount, alignment);
+  }
 
- - Erasing sectors: iterator interface and point coordinate interface.
+  void deallocate(void *memory, size_t byteCount) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::vector<void *>& freeList = freeLists_[byteCount];
+      if (freeList.size() < freeBlockCountMax_) {
+        freeList.push_back(memory);
+        return;
+      }
+    }
+    systemDeallocate(memory);
+  }
 
-     void eraseSector(x, y);
-     void eraseSector(const_iterator);
+  /**
+   The number of blocks allocated from the pool.
+  */
+  size_t allocationCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocationCount_;
+  }
 
- - Other non-iterator sector information support (already implemented):
+  /**
+   The number of blocks which the pool had to allocate from the system because no free
+   block was available.
+  */
+  size_t systemAllocationCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return systemAllocationCount_;
+  }
 
-     size_t sectorCount();
-     size_t sectorPointCount(x, y);
-     bool sectorEmpty(x, y);
-     size_t sectorSize();
+  /**
+   The number of blocks currently retained on free lists.
+  */
+  size_t freeBlockCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t freeBlockCount = 0;
+    for (auto& freeList : freeLists_) {
+      freeBlockCount += freeList.second.size();
+    }
+    return freeBlockCount;
+  }
 
- ## Not a QuadTree
+private:
 
- The placeholder implementation for this data struture was just an `unordered_map` of
- `pair<int, int>` => `Value`.  And it had a note: "Make a real quadtree.  Hacked for now."
+  DenseSectorTableBlockPool(const DenseSectorTableBlockPool&) = delete;
+  DenseSectorTableBlockPool& operator=(const DenseSectorTableBlockPool&) = delete;
 
- But this is not a quadtree.  Here's the reasoning:
+  mutable std::mutex mutex_;
+  std::unordered_map<size_t, std::vector<void *>> freeLists_;
+  size_t freeBlockCountMax_;
+  size_t systemAllocationCount_;
+  size_t allocationCount_;
+};
 
- - First, note that application memory is dominated by the SpriteKit side of things, but
-   it is nevertheless good to do memory planning, especially if we're anticipating an
-   infinite grid.
+/**
+ An open-addressing hash map from sector coordinates to sector handles, offered as an
+ alternative to `std::unordered_map` for the `DenseSectorTable` sector table.
+
+ Slots are stored in a single array and hold the key and the mapped value (for the
+ `DenseSectorTable`, a sector handle: a single pointer to the sector's block).  A lookup
+ is a hash, a linear probe through adjacent slots, and then one pointer dereference into
+ the sector block -- compared to a bucket pointer, a node, and then the sector block for
+ `std::unordered_map`.
+
+ Only the subset of the `std::unordered_map` interface used by `DenseSectorTable` is
+ implemented.  Erased slots are marked with tombstones, so erasing doesn't move other
+ slots, and iterators remain valid through an erase (except for the erased one).  As with
+ `std::unordered_map`, insertion may rehash and invalidate all iterators; unlike
+ `std::unordered_map`, a rehash also moves the mapped values.
+*/
+template<typename Key, typename Mapped, typename Hash>
+class DenseSectorTableFlatMap
+{
+public:
 
-   - In the original naive `unordered_map`, I'm counting 40 bytes per segment node: 16
-     bytes for X and Y coordinates; 8 bytes for FLSegmentNode *; 8 bytes for the "next"
-     pointer in the linked list; 8 bytes for the bucket if `max_load_factor` is not more
-     than 1.  (I couldn't quite see those last 8 bytes, but I found the 32 pretty easily
-     running Alloactions instrument.)
+  typedef std::pair<Key, Mapped> value_type;
 
-   - The current arbitrary world size 101x101 means 10,201 maximum nodes; call it 10K.
-     It's not clear how sparse or dense we expect the data to be; the best design should
-     benefit/punish sparse and dense tracks equally.  From this point of view, it would
-     probably be better to pre-allocate a big array as a constant memory requirement
-     (~80KB) rather than having the memory usage increase with track density from empty
-     world (0KB) to a full unordered_map (~400KB).
+private:
 
-   - Test demonstrating relative memory use of FLTrackGrid to application.
+  enum DenseSectorTableFlatMapSlotState : uint8_t {
+    DenseSectorTableFlatMapSlotEmpty = 0,
+    DenseSectorTableFlatMapSlotFull,
+    DenseSectorTableFlatMapSlotErased,
+  };
 
-     - Load a saved sandbox with 0 segments:    58MB (debug) 57MB (release)
+  template <typename QualifiedValueType, typename QualifiedFlatMap>
+  class DenseSectorTableFlatMapIterator : std::iterator<std::forward_iterator_tag, QualifiedValueType>
+  {
+  public:
+    DenseSectorTableFlatMapIterator() : flatMap_(nullptr), slotIndex_(0) {}
+    DenseSectorTableFlatMapIterator(QualifiedFlatMap *flatMap, size_t slotIndex) : flatMap_(flatMap), slotIndex_(slotIndex) {}
+    // note: Allow conversion from iterator to const_iterator.
+    operator DenseSectorTableFlatMapIterator<value_type const, DenseSectorTableFlatMap const>() const {
+      return DenseSectorTableFlatMapIterator<value_type const, DenseSectorTableFlatMap const>(flatMap_, slotIndex_);
+    }
+    DenseSectorTableFlatMapIterator& operator++() {
+      slotIndex_ = flatMap_->nextFullSlot(slotIndex_ + 1);
+      return *this;
+    }
+    QualifiedValueType& operator*() const { return flatMap_->slots_[slotIndex_]; }
+    QualifiedValueType *operator->() const { return &flatMap_->slots_[slotIndex_]; }
+    bool operator==(const DenseSectorTableFlatMapIterator& rhs) const { return slotIndex_ == rhs.slotIndex_ && flatMap_ == rhs.flatMap_; }
+    bool operator!=(const DenseSectorTableFlatMapIterator& rhs) const { return !(*this == rhs); }
+  private:
+    friend class DenseSectorTableFlatMap;
+    QualifiedFlatMap *flatMap_;
+    size_t slotIndex_;
+  };
 
-     - Load a saved sandbox with 800 segments:  61MB (debug) 60MB (release)
+public:
 
-     - Load a saved sandbox with 2400 segments: 68MB (debug) 66MB (release)
+  typedef DenseSectorTableFlatMapIterator<value_type, DenseSectorTableFlatMap> iterator;
+  typedef DenseSectorTableFlatMapIterator<value_type const, DenseSectorTableFlatMap const> const_iterator;
 
-   So with 2,400 segments we'd expect the `unordered_map` to be taking up about 96KB.
-   This is only 1% of the total memory increase.
+  explicit DenseSectorTableFlatMap(size_t initialBucketCount = 0) : size_(0), erasedCount_(0) {
+    size_t slotCount = slotCountForSize(initialBucketCount);
+    slots_.resize(slotCount);
+    slotStates_.resize(slotCount, DenseSectorTableFlatMapSlotEmpty);
+  }
 
- - We'd like to do an infinite grid, in which case we need a data structure that handles
-   sparse data.  In case the memory overhead gets too large, we'd like to be able to
-   persist sectors (regions, cells, blocks) to disk and load them on-demand.
+  /**
+   Rehashes (if necessary) so that `count` entries fit without another rehash.
+  */
+  void reserve(size_t count) {
+    size_t slotCount = slotCountForSize(count);
+    if (slotCount > slots_.size()) {
+      rehash(slotCount);
+    }
+  }
 
-   - A simple `unordered_map` handles sparse data acceptably, but it's hard to picture
-     loading and unloading sectors by doing lookups on individual points in the table.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t bucket_count() const { return slots_.size(); }
 
-   - Common implementations of a quadtree have leaf nodes which are the equivalent of
-     sectors: they hold 1 or 4 or N data points in a certain region; the region is split
-     into four new setors when the number of data points in the leaf node gets too large.
+  iterator begin() { return iterator(this, nextFullSlot(0)); }
+  const_iterator begin() const { return const_iterator(this, nextFullSlot(0)); }
+  iterator end() { return iterator(this, slots_.size()); }
+  const_iterator end() const { return const_iterator(this, slots_.size()); }
 
-   - Considered as collection (or organization) of sectors, then, the quadtree seems
-     directly comparable to other ways of organizing sectors: The sectors could be
-     organized in a list, (quad)tree, or table, just like anything else.  Organizing them
-     in a tree has particular benefits: Trees are ordered, and so better support ranged
-     queries.  And trees support arbitrary precision of coordinates in the sector.  These
-     two considerations are especially potent in combination: It is difficult and
-     inefficient to do a ranged query across data of arbitrary precision using only a
-     lookup table.
+  iterator find(const Key& key) { return iterator(this, findSlot(key)); }
+  const_iterator find(const Key& key) const { return const_iterator(this, findSlot(key)); }
 
-   - For our purposes, though, we have a fixed precision (x and y coordinates are
-     integers), a constant data density expectation (no cities vs. oceans like in
-     geographical data), and little need for ranged queries.
+  std::pair<iterator, bool> emplace(const Key& key, Mapped&& mapped) {
+    size_t slotIndex = findSlot(key);
+    if (slotIndex != slots_.size()) {
+      return std::make_pair(iterator(this, slotIndex), false);
+    }
+    // note: Keep the load (including tombstones) under 3/4.
+    if ((size_ + erasedCount_ + 1) * 4 > slots_.size() * 3) {
+      rehash(size_ * 2 > slots_.size() / 2 ? slots_.size() * 2 : slots_.size());
+    }
+    size_t mask = slots_.size() - 1;
+    slotIndex = hash_(key) & mask;
+    while (slotStates_[slotIndex] == DenseSectorTableFlatMapSlotFull) {
+      slotIndex = (slotIndex + 1) & mask;
+    }
+    if (slotStates_[slotIndex] == DenseSectorTableFlatMapSlotErased) {
+      --erasedCount_;
+    }
+    slots_[slotIndex].first = key;
+    slots_[slotIndex].second = std::move(mapped);
+    slotStates_[slotIndex] = DenseSectorTableFlatMapSlotFull;
+    ++size_;
+    return std::make_pair(iterator(this, slotIndex), true);
+  }
 
-   - So for organization of sectors: A table seems simple and efficient.  For now.
+  iterator erase(const_iterator position) {
+    size_t slotIndex = position.slotIndex_;
+    assert(slotStates_[slotIndex] == DenseSectorTableFlatMapSlotFull);
+    slots_[slotIndex].second = Mapped();
+    slotStates_[slotIndex] = DenseSectorTableFlatMapSlotErased;
+    --size_;
+    ++erasedCount_;
+    return iterator(this, nextFullSlot(slotIndex + 1));
+  }
 
- - How should data be represented in the sector, then?  In quadtree implementations I've
-   reviewed, it's common to keep the data points in a list in each leaf node -- although
-   because of the overall tree shape, and because leaf nodes usually don't hold many data
-   points, the essence of the data representation is tree-like.  Discounting lists, then,
-   which seem to have little advantage over trees, there are three main choices: tree,
-   table, or preallocated block of indexed memory (vector).
+  iterator erase(iterator position) {
+    return erase(const_iterator(position));
+  }
 
-   - If the data is very sparse, tree and table will do better than vector in terms of
-     memory.
+  size_t erase(const Key& key) {
+    size_t slotIndex = findSlot(key);
+    if (slotIndex == slots_.size()) {
+      return 0;
+    }
+    erase(const_iterator(this, slotIndex));
+    return 1;
+  }
 
-   - Again, tree is the best choice to support ordered queries.
+private:
 
-   - Tree and table support iteration/traversal more efficiently than vector, in particular
-     for sparse data.
+  static size_t slotCountForSize(size_t count) {
+    size_t slotCount = 16;
+    while (slotCount * 3 < count * 4) {
+      slotCount *= 2;
+    }
+    return slotCount;
+  }
 
-   - Vector requires the caller provide an explicit "unset" or "null" data value.
+  size_t findSlot(const Key& key) const {
+    size_t mask = slots_.size() - 1;
+    size_t slotIndex = hash_(key) & mask;
+    while (true) {
+      uint8_t slotState = slotStates_[slotIndex];
+      if (slotState == DenseSectorTableFlatMapSlotEmpty) {
+        return slots_.size();
+      }
+      if (slotState == DenseSectorTableFlatMapSlotFull && slots_[slotIndex].first == key) {
+        return slotIndex;
+      }
+      slotIndex = (slotIndex + 1) & mask;
+    }
+  }
 
-   - For all the above reasons, tree and table seem better.  Nevertheless, vector (block
-     of preallocated values) seems the best for the FLTrackGrid application.  The payload
-     value is a 4 byte pointer, and so the overhead of a tree or table is large compared
-     to the data.  Compare to a vector, which preallocates and so won't get worse as the
-     track gets dense: Say we allow viewing (by zooming out) as much as 101x101 segments
-     (our current world maximum); call that a single sector, and we preload the
-     surrounding 8 sectors for zooming and panning; that's still only 734KB.  Again, that
-     compares unfavorably to a tree or table for sparse data, but it is redeemed by the
-     fact that it's constant, and gets no worse as the data gets pathologically dense.
-     (At maximum density, the same 8 sectors of data points might take twice or four times
-     the space in a tree or table.)
+  size_t nextFullSlot(size_t slotIndex) const {
+    size_t slotCount = slots_.size();
+    while (slotIndex < slotCount && slotStates_[slotIndex] != DenseSectorTableFlatMapSlotFull) {
+      ++slotIndex;
+    }
+    return slotIndex;
+  }
 
- - For future thought: The FLTrackGrid and SKNode hierarchy should be synchronized; nodes
-   should be persisted to disk and removed from memory along with FLTrackGrid sectors.
+  void rehash(size_t slotCount) {
+    std::vector<value_type> oldSlots(slotCount);
+    std::vector<uint8_t> oldSlotStates(slotCount, DenseSectorTableFlatMapSlotEmpty);
+    oldSlots.swap(slots_);
+    oldSlotStates.swap(slotStates_);
+    size_t mask = slotCount - 1;
+    for (size_t oldSlotIndex = 0; oldSlotIndex < oldSlots.size(); ++oldSlotIndex) {
+      if (oldSlotStates[oldSlotIndex] != DenseSectorTableFlatMapSlotFull) {
+        continue;
+      }
+      size_t slotIndex = hash_(oldSlots[oldSlotIndex].first) & mask;
+      while (slotStates_[slotIndex] == DenseSectorTableFlatMapSlotFull) {
+        slotIndex = (slotIndex + 1) & mask;
+      }
+      slots_[slotIndex].first = oldSlots[oldSlotIndex].first;
+      slots_[slotIndex].second = std::move(oldSlots[oldSlotIndex].second);
+      slotStates_[slotIndex] = DenseSectorTableFlatMapSlotFull;
+    }
+    erasedCount_ = 0;
+  }
 
-   - Probably this is an interface/protocol: No matter what the data structure, it should
-     implement an interface that supports coordinated "sector loading" between the grid
-     and SKNode hierarchy.
+  std::vector<value_type> slots_;
+  std::vector<uint8_t> slotStates_;
+  size_t size_;
+  size_t erasedCount_;
+  Hash hash_;
+};
 
-   - I've always assumed it's better to track segments in grid location apart from the
-     node tree, but who knows: If they've got a quadtree on node position (or an r-tree on
-     frame, or whatever), then maybe better to ditch this data structure and just use
-     `nodeAtPoint`.
+/**
+ A map from sector coordinates to sector handles for a world of known extent, offered as
+ an alternative to `DenseSectorTableFlatMap` for the `DenseSectorTable` sector table.
+
+ Sectors inside the bounds passed to the constructor are stored in a single array,
+ row-major, and found by offset arithmetic, with no hashing or probing.  Sectors outside
+ the bounds (if any) go to an overflow `DenseSectorTableFlatMap`, so that the bounds are
+ a performance hint rather than a hard limit.  Constructed with a bucket count (as by
+ default in `DenseSectorTable`), there are no bounds, and it behaves as a
+ `DenseSectorTableFlatMap`.
+
+ Iteration visits the array (in row-major order), and then the overflow map.  Iterator
+ invalidation is the same as for `DenseSectorTableFlatMap`.
 */
-template<typename Value>
-class DenseSectorTable
+template<typename Key, typename Mapped, typename Hash>
+class DenseSectorTableBoundedMap
 {
-private:
+public:
 
-  struct DenseSectorTableKeyHash
-  {
-    size_t operator()(const std::pair<int, int>& key) const {
-      size_t h = (size_t)((key.first & 0xFFFF) << 16) | (key.second & 0xFFFF);
-      h = ((h >> 16) ^ h) * 0x45d9f3b;
-      h = ((h >> 16) ^ h) * 0x45d9f3b;
-      h = ((h >> 16) ^ h);
-      return h;
-    }
-  };
+  typedef std::pair<Key, Mapped> value_type;
 
-  typedef std::unordered_map<std::pair<int, int>, std::vector<Value>, DenseSectorTableKeyHash> DenseSectorTableSectorTable;
+private:
 
-  template <typename QualifiedValue, typename QualifiedDenseSectorTable, typename QualifiedDenseSectorTableSectorTableIterator>
-  class DenseSectorTableIterator : std::iterator<std::forward_iterator_tag, QualifiedValue>
+  typedef DenseSectorTableFlatMap<Key, Mapped, Hash> DenseSectorTableBoundedMapOverflow;
+
+  template <typename QualifiedValueType, typename QualifiedBoundedMap, typename QualifiedOverflowIterator>
+  class DenseSectorTableBoundedMapIterator : std::iterator<std::forward_iterator_tag, QualifiedValueType>
   {
   public:
-    DenseSectorTableIterator() {}
-    DenseSectorTableIterator(QualifiedDenseSectorTable *denseSectorTable,
-                             const QualifiedDenseSectorTableSectorTableIterator& sectorIterator,
-                             size_t pointIndexInSector)
-    : denseSectorTable_(denseSectorTable),
-    sectorIterator_(sectorIterator),
-    pointIndexInSector_(pointIndexInSector) {}
-    //~DenseSectorTableIterator();
-    DenseSectorTableIterator(const DenseSectorTableIterator& rhs) {
-      denseSectorTable_ = rhs.denseSectorTable_;
-      sectorIterator_ = rhs.sectorIterator_;
-      pointIndexInSector_ = rhs.pointIndexInSector_;
-    }
+    DenseSectorTableBoundedMapIterator() : boundedMap_(nullptr), slotIndex_(0) {}
+    DenseSectorTableBoundedMapIterator(QualifiedBoundedMap *boundedMap, size_t slotIndex, const QualifiedOverflowIterator& overflowIterator)
+      : boundedMap_(boundedMap), slotIndex_(slotIndex), overflowIterator_(overflowIterator) {}
     // note: Allow conversion from iterator to const_iterator.
-    operator DenseSectorTableIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator>() const {
-      return DenseSectorTableIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator>(denseSectorTable_,
-                                                                                                                                 sectorIterator_,
-                                                                                                                                 pointIndexInSector_);
+    operator DenseSectorTableBoundedMapIterator<value_type const, DenseSectorTableBoundedMap const, typename DenseSectorTableBoundedMapOverflow::const_iterator>() const {
+      return DenseSectorTableBoundedMapIterator<value_type const, DenseSectorTableBoundedMap const, typename DenseSectorTableBoundedMapOverflow::const_iterator>(boundedMap_, slotIndex_, overflowIterator_);
     }
-    DenseSectorTableIterator& operator=(const DenseSectorTableIterator& rhs) {
-      if (this != &rhs) {
-        denseSectorTable_ = rhs.denseSectorTable_;
-        sectorIterator_ = rhs.sectorIterator_;
-        pointIndexInSector_ = rhs.pointIndexInSector_;
+    DenseSectorTableBoundedMapIterator& operator++() {
+      if (slotIndex_ < boundedMap_->slots_.size()) {
+        slotIndex_ = boundedMap_->nextFullSlot(slotIndex_ + 1);
+        if (slotIndex_ == boundedMap_->slots_.size()) {
+          overflowIterator_ = boundedMap_->overflow_.begin();
+        }
+      } else {
+        ++overflowIterator_;
       }
       return *this;
     }
-    DenseSectorTableIterator& operator++() {
-      size_t sectorLength = denseSectorTable_->sectorSize_ * denseSectorTable_->sectorSize_;
-      size_t p = pointIndexInSector_ + 1;
-      while (sectorIterator_ != denseSectorTable_->sectorTable_.end()) {
-        auto& sector = sectorIterator_->second;
-        while (p < sectorLength) {
-          if (sector[p] != denseSectorTable_->nullValue_) {
-            pointIndexInSector_ = p;
-            return *this;
-          }
-          ++p;
-        }
-        ++sectorIterator_;
-        p = 0;
+    QualifiedValueType& operator*() const {
+      return (slotIndex_ < boundedMap_->slots_.size() ? boundedMap_->slots_[slotIndex_] : *overflowIterator_);
+    }
+    QualifiedValueType *operator->() const { return &**this; }
+    bool operator==(const DenseSectorTableBoundedMapIterator& rhs) const {
+      return slotIndex_ == rhs.slotIndex_ && overflowIterator_ == rhs.overflowIterator_ && boundedMap_ == rhs.boundedMap_;
+    }
+    bool operator!=(const DenseSectorTableBoundedMapIterator& rhs) const { return !(*this == rhs); }
+  private:
+    friend class DenseSectorTableBoundedMap;
+    QualifiedBoundedMap *boundedMap_;
+    // note: Slot index into the array, or (if equal to the array size) the overflow iterator
+    // is current.  While in the array, the overflow iterator is the overflow end.
+    size_t slotIndex_;
+    QualifiedOverflowIterator overflowIterator_;
+  };
+
+public:
+
+  typedef DenseSectorTableBoundedMapIterator<value_type, DenseSectorTableBoundedMap, typename DenseSectorTableBoundedMapOverflow::iterator> iterator;
+  typedef DenseSectorTableBoundedMapIterator<value_type const, DenseSectorTableBoundedMap const, typename DenseSectorTableBoundedMapOverflow::const_iterator> const_iterator;
+
+  explicit DenseSectorTableBoundedMap(size_t initialBucketCount = 0)
+    : overflow_(initialBucketCount), xMin_(0), yMin_(0), width_(0), height_(0), arraySize_(0) {}
+
+  /**
+   Bounds are in (sector) key coordinates, inclusive.
+  */
+  DenseSectorTableBoundedMap(int xMin, int yMin, int xMax, int yMax)
+    : overflow_(0), xMin_(xMin), yMin_(yMin), arraySize_(0) {
+    assert(xMax >= xMin && yMax >= yMin);
+    width_ = static_cast<size_t>(static_cast<int64_t>(xMax) - xMin + 1);
+    height_ = static_cast<size_t>(static_cast<int64_t>(yMax) - yMin + 1);
+    slots_.resize(width_ * height_);
+    slotFull_.resize(width_ * height_, 0);
+    for (size_t row = 0; row < height_; ++row) {
+      for (size_t column = 0; column < width_; ++column) {
+        slots_[row * width_ + column].first = Key(static_cast<int>(xMin_ + static_cast<int64_t>(column)),
+                                                  static_cast<int>(yMin_ + static_cast<int64_t>(row)));
       }
-      pointIndexInSector_ = 0;
-      return *this;
     }
-    std::pair<std::pair<int, int>, QualifiedValue&> operator*() {
-      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
-      auto& sector = sectorIterator_->second;
-      assert(pointIndexInSector_ < denseSectorTable_->sectorSize_ * denseSectorTable_->sectorSize_);
-      assert(sector[pointIndexInSector_] != denseSectorTable_->nullValue_);
-      return std::pair<std::pair<int, int>, QualifiedValue&>(denseSectorTable_->getXY(sectorIterator_->first, pointIndexInSector_),
-                                                             sector[pointIndexInSector_]);
+  }
+
+  size_t size() const { return arraySize_ + overflow_.size(); }
+  bool empty() const { return size() == 0; }
+  size_t bucket_count() const { return slots_.size() + overflow_.bucket_count(); }
+
+  iterator begin() { return makeIterator(nextFullSlot(0)); }
+  const_iterator begin() const { return makeIterator(nextFullSlot(0)); }
+  iterator end() { return iterator(this, slots_.size(), overflow_.end()); }
+  const_iterator end() const { return const_iterator(this, slots_.size(), overflow_.end()); }
+
+  iterator find(const Key& key) {
+    size_t slotIndex = boundsSlot(key);
+    if (slotIndex != slots_.size()) {
+      return (slotFull_[slotIndex] ? iterator(this, slotIndex, overflow_.end()) : end());
     }
-    QualifiedValue *operator->() {
-      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
-      auto& sector = sectorIterator_->second;
-      assert(pointIndexInSector_ < denseSectorTable_->sectorSize_ * denseSectorTable_->sectorSize_);
-      assert(sector[pointIndexInSector_] != denseSectorTable_->nullValue_);
-      return &sector[pointIndexInSector_];
+    return iterator(this, slots_.size(), overflow_.find(key));
+  }
+
+  const_iterator find(const Key& key) const {
+    size_t slotIndex = boundsSlot(key);
+    if (slotIndex != slots_.size()) {
+      return (slotFull_[slotIndex] ? const_iterator(this, slotIndex, overflow_.end()) : end());
+    }
+    return const_iterator(this, slots_.size(), overflow_.find(key));
+  }
+
+  /**
+   Returns the mapped value for a key, or null if the key isn't present.  Unlike `find()`,
+   which must build an iterator that can range over both the array and the overflow map,
+   a lookup inside the bounds is one array access and never touches the overflow map.
+  */
+  const Mapped *findMapped(const Key& key) const {
+    size_t slotIndex = boundsSlot(key);
+    if (slotIndex != slots_.size()) {
+      return (slotFull_[slotIndex] ? &slots_[slotIndex].second : nullptr);
+    }
+    if (overflow_.empty()) {
+      return nullptr;
+    }
+    auto o = overflow_.find(key);
+    return (o == overflow_.end() ? nullptr : &o->second);
+  }
+
+  std::pair<iterator, bool> emplace(const Key& key, Mapped&& mapped) {
+    size_t slotIndex = boundsSlot(key);
+    if (slotIndex == slots_.size()) {
+      auto inserted = overflow_.emplace(key, std::move(mapped));
+      return std::make_pair(iterator(this, slots_.size(), inserted.first), inserted.second);
+    }
+    if (slotFull_[slotIndex]) {
+      return std::make_pair(iterator(this, slotIndex, overflow_.end()), false);
+    }
+    slots_[slotIndex].second = std::move(mapped);
+    slotFull_[slotIndex] = 1;
+    ++arraySize_;
+    return std::make_pair(iterator(this, slotIndex, overflow_.end()), true);
+  }
+
+  iterator erase(const_iterator position) {
+    size_t slotIndex = position.slotIndex_;
+    if (slotIndex == slots_.size()) {
+      return iterator(this, slots_.size(), overflow_.erase(position.overflowIterator_));
+    }
+    assert(slotFull_[slotIndex]);
+    slots_[slotIndex].second = Mapped();
+    slotFull_[slotIndex] = 0;
+    --arraySize_;
+    return makeIterator(nextFullSlot(slotIndex + 1));
+  }
+
+  iterator erase(iterator position) {
+    return erase(const_iterator(position));
+  }
+
+  size_t erase(const Key& key) {
+    const_iterator position = static_cast<const DenseSectorTableBoundedMap *>(this)->find(key);
+    if (position == end()) {
+      return 0;
+    }
+    erase(position);
+    return 1;
+  }
+
+  /**
+   Reserves room for `count` entries in the overflow map, if unbounded; entries inside the
+   bounds need no reservation.
+  */
+  void reserve(size_t count) {
+    if (slots_.empty()) {
+      overflow_.reserve(count);
+    }
+  }
+
+private:
+
+  size_t boundsSlot(const Key& key) const {
+    // note: Unsigned comparison catches coordinates on both sides of the bounds.
+    size_t column = static_cast<size_t>(static_cast<int64_t>(key.first) - xMin_);
+    size_t row = static_cast<size_t>(static_cast<int64_t>(key.second) - yMin_);
+    if (column >= width_ || row >= height_) {
+      return slots_.size();
+    }
+    return row * width_ + column;
+  }
+
+  size_t nextFullSlot(size_t slotIndex) const {
+    size_t slotCount = slots_.size();
+    while (slotIndex < slotCount && !slotFull_[slotIndex]) {
+      ++slotIndex;
+    }
+    return slotIndex;
+  }
+
+  iterator makeIterator(size_t slotIndex) {
+    return iterator(this, slotIndex, (slotIndex == slots_.size() ? overflow_.begin() : overflow_.end()));
+  }
+
+  const_iterator makeIterator(size_t slotIndex) const {
+    return const_iterator(this, slotIndex, (slotIndex == slots_.size() ? overflow_.begin() : overflow_.end()));
+  }
+
+  std::vector<value_type> slots_;
+  std::vector<uint8_t> slotFull_;
+  DenseSectorTableBoundedMapOverflow overflow_;
+  int64_t xMin_;
+  int64_t yMin_;
+  size_t width_;
+  size_t height_;
+  size_t arraySize_;
+};
+
+/**
+ Hashes sector coordinates for the sector table.  Both full 32-bit coordinates are packed
+ into one 64-bit word and mixed with the SplitMix64 finalizer, so that every input bit
+ affects the low bits (which the flat map uses to pick a slot): long rails, tracks far
+ from the origin, and sectors a power of two apart all spread like random keys.
+*/
+struct DenseSectorTableKeyHash
+{
+  size_t operator()(const std::pair<int, int>& key) const {
+    uint64_t h = (uint64_t(static_cast<uint32_t>(key.first)) << 32) | static_cast<uint32_t>(key.second);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h = h ^ (h >> 31);
+    return static_cast<size_t>(h);
+  }
+};
+
+/**
+ Selects `std::unordered_map` as the sector table of a `DenseSectorTable`.
+*/
+struct DenseSectorTableUnorderedMapBackend
+{
+  template<typename Key, typename Mapped, typename Hash>
+  struct SectorTable
+  {
+    typedef std::unordered_map<Key, Mapped, Hash> type;
+  };
+};
+
+/**
+ Selects `DenseSectorTableFlatMap` as the sector table of a `DenseSectorTable`.
+*/
+struct DenseSectorTableFlatMapBackend
+{
+  template<typename Key, typename Mapped, typename Hash>
+  struct SectorTable
+  {
+    typedef DenseSectorTableFlatMap<Key, Mapped, Hash> type;
+  };
+};
+
+/**
+ Heap memory used by a `DenseSectorTable`, as reported by `memoryUsage()`, in bytes.
+
+ - `sectorTableByteCount`: Sector table entries stored outside the bucket array (the
+   nodes of a `std::unordered_map`).  Zero for `DenseSectorTableFlatMap`, which keeps its
+   entries in its slot array.
+
+ - `bucketArrayByteCount`: The sector table's bucket array (or, for
+   `DenseSectorTableFlatMap`, its slot array and slot states).
+
+ - `sectorBlockByteCount`: Sector blocks, including headers and bitmaps.  Blocks shared
+   with copies of the table are counted in full by each table.
+*/
+struct DenseSectorTableMemoryUsage
+{
+  DenseSectorTableMemoryUsage() : sectorTableByteCount(0), bucketArrayByteCount(0), sectorBlockByteCount(0) {}
+  size_t totalByteCount() const { return sectorTableByteCount + bucketArrayByteCount + sectorBlockByteCount; }
+  size_t sectorTableByteCount;
+  size_t bucketArrayByteCount;
+  size_t sectorBlockByteCount;
+};
+
+/**
+ Adds the heap memory used by a sector table (but not by the sector blocks it points to)
+ to a `DenseSectorTableMemoryUsage`.  For `std::unordered_map`, node size is estimated
+ from the libc++ layout: a next pointer, a cached hash, and the value.
+*/
+template<typename Key, typename Mapped, typename Hash, typename Pred, typename Allocator>
+void
+DenseSectorTableAddSectorTableMemoryUsage(const std::unordered_map<Key, Mapped, Hash, Pred, Allocator>& sectorTable,
+                                          DenseSectorTableMemoryUsage *memoryUsage)
+{
+  typedef typename std::unordered_map<Key, Mapped, Hash, Pred, Allocator>::value_type value_type;
+  memoryUsage->sectorTableByteCount += sectorTable.size() * (sizeof(void *) + sizeof(size_t) + sizeof(value_type));
+  memoryUsage->bucketArrayByteCount += sectorTable.bucket_count() * sizeof(void *);
+}
+
+template<typename Key, typename Mapped, typename Hash>
+void
+DenseSectorTableAddSectorTableMemoryUsage(const DenseSectorTableFlatMap<Key, Mapped, Hash>& sectorTable,
+                                          DenseSectorTableMemoryUsage *memoryUsage)
+{
+  typedef typename DenseSectorTableFlatMap<Key, Mapped, Hash>::value_type value_type;
+  memoryUsage->bucketArrayByteCount += sectorTable.bucket_count() * (sizeof(value_type) + sizeof(uint8_t));
+}
+
+template<typename Key, typename Mapped, typename Hash>
+void
+DenseSectorTableAddSectorTableMemoryUsage(const DenseSectorTableBoundedMap<Key, Mapped, Hash>& sectorTable,
+                                          DenseSectorTableMemoryUsage *memoryUsage)
+{
+  // note: The array and the overflow map both cost a value and a state byte per slot.
+  typedef typename DenseSectorTableBoundedMap<Key, Mapped, Hash>::value_type value_type;
+  memoryUsage->bucketArrayByteCount += sectorTable.bucket_count() * (sizeof(value_type) + sizeof(uint8_t));
+}
+
+/**
+ Returns the mapped value for a key in a sector table, or null if the key isn't present.
+ Used by `DenseSectorTable` lookups that only read the sector, so that
+ `DenseSectorTableBoundedMap` can answer without building an iterator (see
+ `DenseSectorTableBoundedMap::findMapped()`).
+*/
+template<typename Key, typename Mapped, typename Hash, typename Pred, typename Allocator>
+const Mapped *
+DenseSectorTableFindMapped(const std::unordered_map<Key, Mapped, Hash, Pred, Allocator>& sectorTable, const Key& key)
+{
+  auto s = sectorTable.find(key);
+  return (s == sectorTable.end() ? nullptr : &s->second);
+}
+
+template<typename Key, typename Mapped, typename Hash>
+const Mapped *
+DenseSectorTableFindMapped(const DenseSectorTableFlatMap<Key, Mapped, Hash>& sectorTable, const Key& key)
+{
+  auto s = sectorTable.find(key);
+  return (s == sectorTable.end() ? nullptr : &s->second);
+}
+
+template<typename Key, typename Mapped, typename Hash>
+const Mapped *
+DenseSectorTableFindMapped(const DenseSectorTableBoundedMap<Key, Mapped, Hash>& sectorTable, const Key& key)
+{
+  return sectorTable.findMapped(key);
+}
+
+/**
+ Selects `DenseSectorTableBoundedMap` as the sector table of a `DenseSectorTable`.  Pass
+ the world bounds to the `DenseSectorTable` constructor to get direct indexing.
+*/
+struct DenseSectorTableBoundedBackend
+{
+  template<typename Key, typename Mapped, typename Hash>
+  struct SectorTable
+  {
+    typedef DenseSectorTableBoundedMap<Key, Mapped, Hash> type;
+  };
+};
+
+/**
+ Passed as the `SectorSize` template parameter of `DenseSectorTable` to indicate that the
+ sector size is specified at runtime (in the constructor).
+*/
+static const size_t DenseSectorTableRuntimeSectorSize = 0;
+
+/**
+ Returns the base-2 logarithm of a power of two (or zero).
+*/
+constexpr int
+DenseSectorTableLog2(size_t powerOfTwo)
+{
+  return (powerOfTwo <= 1 ? 0 : 1 + DenseSectorTableLog2(powerOfTwo >> 1));
+}
+
+/**
+ Returns the Morton code (Z-order curve index) of integer coordinates: the bits of `x`
+ and `y` interleaved, with `x` in the even bits.  Coordinates are offset so that the
+ order is the same for negative coordinates as for positive.
+*/
+inline uint64_t
+DenseSectorTableMortonCode(int x, int y)
+{
+  auto spread = [](uint32_t v) {
+    uint64_t b = v;
+    b = (b | (b << 16)) & 0x0000FFFF0000FFFFULL;
+    b = (b | (b << 8)) & 0x00FF00FF00FF00FFULL;
+    b = (b | (b << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    b = (b | (b << 2)) & 0x3333333333333333ULL;
+    b = (b | (b << 1)) & 0x5555555555555555ULL;
+    return b;
+  };
+  return spread(static_cast<uint32_t>(x) ^ 0x80000000U) | (spread(static_cast<uint32_t>(y) ^ 0x80000000U) << 1);
+}
+
+/**
+ Implements an infinite integer-indexed two-dimensional grid as a hash table of sectors;
+ each sector is a preallocated block of values (which allows dense data in the sector
+ without increased memory usage).
+
+ ## Sector (Regional) Interface
+
+ The sector interface is an important part of this structure.  For example, to conserve
+ memory, the owner can get a block of values, write them to disk, erase them from the
+ table, and then set them again later on-demand.
+
+ - Sectors are identified by point coordinates: any point coordinates inside the sector
+   will do.  (Internally the table uses "sector coordinates", but those aren't exposed.)
+   It's slightly annoying for the caller to test sector identity: for instance, point
+   coordinates `(1,2)` and `(1,3)` might refer to the same sector, but `(1,2)` and `(1,4)`
+   might not.
+
+ - Getting and setting sectors: iterator interface.  Sector iterators are the same
+   `DenseSectorTableIterator` used for points, except that they stop at the end of the
+   sector, and optionally they visit every point in the sector including unset points.
+   When visiting unset points, the caller may assign through the iterator to set them.
+   (Assignments through an iterator go through the table at once, as with `operator[]`,
+   so point counts stay right even if the iterator is never advanced; assigning the null
+   value unsets the point, though only `erasePoint()` can prune its sector.)
+
+     iterator beginSector(x, y, iterateOnNullValues = false);
+     const_iterator beginSector(x, y, iterateOnNullValues = false) const;
+     iterator endSector(x, y, iterateOnNullValues = false);
+     const_iterator endSector(x, y, iterateOnNullValues = false) const;
+
+     pair<iterator, bool> insertSector(x, y, iterateOnNullValues = false);
+
+ - Moving sectors: The block of values can be extracted from the table and inserted
+   again later without copying or rehashing the values (like a node handle in the
+   standard containers).  Both operations are constant time.
+
+     bool extractSector(x, y, sector_type *sector);
+     pair<iterator, bool> insertSector(x, y, sector_type&& sector);
+
+ - Erasing sectors: iterator interface and point coordinate interface.
+
+     bool eraseSector(x, y);
+     bool eraseSector(const_iterator&);
+
+ - Getting a block of points: A rectangular window of points (which may span sectors) is
+   copied into a caller-provided row-major array of `width * height` values; unset points
+   are copied as the null value.  Each sector touched by the window is looked up once,
+   rather than once per point.
+
+     void getBlock(x0, y0, width, height, Value *block);
+
+ - Setting points in bulk: Sets a vector of `(x, y, value)` tuples, with the same result
+   as calling `setPoint()` on each in order.  The points are grouped by sector first, so
+   the sector table is reserved once, and each sector is looked up (and allocated,
+   already sparse or dense as its point count requires) once.  Useful for loading.
+
+     void setPoints(const std::vector<std::tuple<int, int, Value>>& points);
+
+ - Iterating over a region: Visits the set points inside a rectangle of point coordinates
+   (bounds inclusive).  Only sectors overlapping the rectangle are visited, and only the
+   rows and columns inside it, so the cost is proportional to the region rather than the
+   whole table.
+
+     region_iterator beginRegion(xMin, yMin, xMax, yMax);
+     const_region_iterator beginRegion(xMin, yMin, xMax, yMax) const;
+     region_iterator endRegion();
+     const_region_iterator endRegion() const;
+
+ - Iterating in Morton order: Point iteration otherwise follows the sector table's
+   bucket order, which has nothing to do with position and may differ between builds and
+   standard libraries.  Morton iteration visits sectors in Z-order of their sector
+   coordinates (so that neighboring sectors tend to be visited close together), and the
+   points in each sector in row-major order.  The order depends only on the set points,
+   so it's reproducible.  Beginning the iteration sorts the sectors, which is
+   `O(n log n)` in the number of sectors.
+
+     morton_iterator beginPointMorton();
+     const_morton_iterator beginPointMorton() const;
+     morton_iterator endPointMorton();
+     const_morton_iterator endPointMorton() const;
+
+ - Other non-iterator sector information:
+
+     size_t sectorCount();
+     size_t sectorPointCount(x, y);
+     bool sectorEmpty(x, y);
+     size_t sectorSize();
+
+ ## Sparse and Dense Sectors
+
+ A sector starts out sparse: its block stores values only for set points, in row-major
+ order, and finds a point's value by counting set bits in the occupancy bitmap before it.
+ Once a sector holds more than `denseFillThreshold()` points (by default an eighth of the
+ sector), it switches to a dense block with a value for every point; when erasing brings
+ it down to half the threshold, it switches back.  So a sector holding a single straight
+ run of track costs a few hundred bytes rather than a few kilobytes, while a crowded
+ sector keeps constant-time access.  Iteration order is the same either way.
+
+ Switching representations moves the values, so iterators dereference to a proxy (for
+ non-const iterators) or are read-only, and assignments through them go through the
+ table; a plain `Value&` into a sector would be invalidated by setting or erasing other
+ points in the same sector.
+
+ ## Block Allocation
+
+ Each sector is stored in one fixed-size block.  By default blocks are allocated from the
+ system, but a `DenseSectorTableBlockAllocator` may be passed to the constructor; in
+ particular, a `DenseSectorTableBlockPool` recycles the blocks of pruned sectors, which
+ avoids allocator churn when sectors are repeatedly created and pruned.
+
+ ## Memory Usage
+
+ `memoryUsage()` reports the bytes used by the sector table, its bucket array, and the
+ sector blocks, so that the hand measurements below (made with the Allocations
+ instrument) can be watched in a running app.  `sectorFillHistogram()` shows how full
+ the sectors are, which is what decides between sparse and dense storage.
+
+ ## Copies
+
+ Copying the table is proportional to the number of sectors, not points: sector blocks
+ are shared between the copies, and a block is copied only when one of the tables writes
+ to it.  The reference counts are atomic, so a copy (a snapshot) may be read on one
+ thread while the original is modified on another.  (Each table by itself is not
+ thread-safe.)  References to values, whether through `operator[]` or through iterators,
+ must not be held across a copy.
+
+ ## Sector Table Backends
+
+ The table of sectors is selected by the second template parameter:
+
+ - `DenseSectorTableUnorderedMapBackend` (default): A `std::unordered_map` of sector
+   handles.  A point lookup follows a bucket pointer, then a node, then the sector block.
+
+ - `DenseSectorTableFlatMapBackend`: A `DenseSectorTableFlatMap`, which is open-addressed
+   with linear probing.  A point lookup probes adjacent slots (holding the sector
+   coordinates and the sector block pointer), and then goes directly to the sector block.
+   Sector blocks are cache-line aligned, with values following the occupancy bitmap.
+
+ - `DenseSectorTableBoundedBackend`: A `DenseSectorTableBoundedMap`.  When the extent of
+   the world is known, pass its bounds to the constructor; sector handles inside the
+   bounds are kept in one array and found by offset arithmetic rather than hashing.
+   (Sectors outside the bounds still work, through a flat map.)
+
+ The public interface is the same, except for the bounded constructor.  Note that the
+ flat maps move sector handles around when they grow, but not sector blocks, so point
+ references remain valid.
+
+ ## Sector Size
+
+ The sector size (the width and height of a sector, in points) is passed to the
+ constructor.  It may also be fixed at compile time by the third template parameter,
+ which must be a power of two; then the conversions between point coordinates and
+ sector coordinates are shifts and masks, rather than divisions and remainders with
+ branches for negative coordinates.  The default `DenseSectorTableRuntimeSectorSize`
+ leaves the sector size to the constructor.
+
+     DenseSectorTable<int> runtimeSized(16, 64, -1);
+     DenseSectorTable<int, DenseSectorTableFlatMapBackend, 16> compileTimeSized(16, 64, -1);
+
+ ## Not a QuadTree
+
+ The placeholder implementation for this data struture was just an `unordered_map` of
+ `pair<int, int>` => `Value`.  And it had a note: "Make a real quadtree.  Hacked for now."
+
+ But this is not a quadtree.  Here's the reasoning:
+
+ - First, note that application memory is dominated by the SpriteKit side of things, but
+   it is nevertheless good to do memory planning, especially if we're anticipating an
+   infinite grid.
+
+   - In the original naive `unordered_map`, I'm counting 40 bytes per segment node: 16
+     bytes for X and Y coordinates; 8 bytes for FLSegmentNode *; 8 bytes for the "next"
+     pointer in the linked list; 8 bytes for the bucket if `max_load_factor` is not more
+     than 1.  (I couldn't quite see those last 8 bytes, but I found the 32 pretty easily
+     running Alloactions instrument.)
+
+   - The current arbitrary world size 101x101 means 10,201 maximum nodes; call it 10K.
+     It's not clear how sparse or dense we expect the data to be; the best design should
+     benefit/punish sparse and dense tracks equally.  From this point of view, it would
+     probably be better to pre-allocate a big array as a constant memory requirement
+     (~80KB) rather than having the memory usage increase with track density from empty
+     world (0KB) to a full unordered_map (~400KB).
+
+   - (Later: `FLTrackGrid` now stores 32-bit segment handles rather than 8-byte
+     FLSegmentNode pointers, so that array would be ~40KB.  Measured per full 16x16
+     sector, including bitmap and block header: 2,176 bytes with pointers, 1,152 bytes
+     with handles.)
+
+   - Test demonstrating relative memory use of FLTrackGrid to application.
+
+     - Load a saved sandbox with 0 segments:    58MB (debug) 57MB (release)
+
+     - Load a saved sandbox with 800 segments:  61MB (debug) 60MB (release)
+
+     - Load a saved sandbox with 2400 segments: 68MB (debug) 66MB (release)
+
+   So with 2,400 segments we'd expect the `unordered_map` to be taking up about 96KB.
+   This is only 1% of the total memory increase.
+
+ - We'd like to do an infinite grid, in which case we need a data structure that handles
+   sparse data.  In case the memory overhead gets too large, we'd like to be able to
+   persist sectors (regions, cells, blocks) to disk and load them on-demand.
+
+   - A simple `unordered_map` handles sparse data acceptably, but it's hard to picture
+     loading and unloading sectors by doing lookups on individual points in the table.
+
+   - Common implementations of a quadtree have leaf nodes which are the equivalent of
+     sectors: they hold 1 or 4 or N data points in a certain region; the region is split
+     into four new setors when the number of data points in the leaf node gets too large.
+
+   - Considered as collection (or organization) of sectors, then, the quadtree seems
+     directly comparable to other ways of organizing sectors: The sectors could be
+     organized in a list, (quad)tree, or table, just like anything else.  Organizing them
+     in a tree has particular benefits: Trees are ordered, and so better support ranged
+     queries.  And trees support arbitrary precision of coordinates in the sector.  These
+     two considerations are especially potent in combination: It is difficult and
+     inefficient to do a ranged query across data of arbitrary precision using only a
+     lookup table.
+
+   - For our purposes, though, we have a fixed precision (x and y coordinates are
+     integers), a constant data density expectation (no cities vs. oceans like in
+     geographical data), and little need for ranged queries.
+
+   - So for organization of sectors: A table seems simple and efficient.  For now.
+
+ - How should data be represented in the sector, then?  In quadtree implementations I've
+   reviewed, it's common to keep the data points in a list in each leaf node -- although
+   because of the overall tree shape, and because leaf nodes usually don't hold many data
+   points, the essence of the data representation is tree-like.  Discounting lists, then,
+   which seem to have little advantage over trees, there are three main choices: tree,
+   table, or preallocated block of indexed memory (vector).
+
+   - If the data is very sparse, tree and table will do better than vector in terms of
+     memory.
+
+   - Again, tree is the best choice to support ordered queries.
+
+   - Tree and table support iteration/traversal more efficiently than vector, in particular
+     for sparse data.
+
+   - Vector requires the caller provide an explicit "unset" or "null" data value.
+
+   - For all the above reasons, tree and table seem better.  Nevertheless, vector (block
+     of preallocated values) seems the best for the FLTrackGrid application.  The payload
+     value is a 4 byte pointer, and so the overhead of a tree or table is large compared
+     to the data.  Compare to a vector, which preallocates and so won't get worse as the
+     track gets dense: Say we allow viewing (by zooming out) as much as 101x101 segments
+     (our current world maximum); call that a single sector, and we preload the
+     surrounding 8 sectors for zooming and panning; that's still only 734KB.  Again, that
+     compares unfavorably to a tree or table for sparse data, but it is redeemed by the
+     fact that it's constant, and gets no worse as the data gets pathologically dense.
+     (At maximum density, the same 8 sectors of data points might take twice or four times
+     the space in a tree or table.)
+
+ - For future thought: The FLTrackGrid and SKNode hierarchy should be synchronized; nodes
+   should be persisted to disk and removed from memory along with FLTrackGrid sectors.
+
+   - Probably this is an interface/protocol: No matter what the data structure, it should
+     implement an interface that supports coordinated "sector loading" between the grid
+     and SKNode hierarchy.
+
+   - I've always assumed it's better to track segments in grid location apart from the
+     node tree, but who knows: If they've got a quadtree on node position (or an r-tree on
+     frame, or whatever), then maybe better to ditch this data structure and just use
+     `nodeAtPoint`.
+*/
+template<typename Value,
+         typename SectorTableBackend = DenseSectorTableUnorderedMapBackend,
+         size_t SectorSize = DenseSectorTableRuntimeSectorSize>
+class DenseSectorTable
+{
+private:
+
+  /**
+   The storage for a single sector, allocated as one cache-aligned block: a small header,
+   then a bitmap of which points are set (that is, not equal to the null value), and then
+   (starting on a cache line) the values.
+
+   The bitmap and a count of set points mean that counting, emptiness checks, and
+   iteration don't have to compare every value in the sector to the null value.
+
+   A block is either dense or sparse:
+
+   - Dense: There is a value for every point in the sector, in row-major order.  Unset
+     points hold the null value.
+
+   - Sparse: There are values only for set points, in row-major order (that is, in the
+     same order as the bits in the bitmap), followed by unused capacity filled with the
+     null value.  The value for a point is found by counting the set bits before it.
+
+   Blocks are reference counted, so that copies of the table can share them; see
+   `DenseSectorTableSector`.
+  */
+  struct DenseSectorTableSectorBlock
+  {
+    static const size_t alignment = 64;
+
+    static size_t occupancyWordCount(size_t sectorLength) { return (sectorLength + 63) / 64; }
+    static size_t valuesOffset(size_t sectorLength) {
+      size_t offset = sizeof(DenseSectorTableSectorBlock) + occupancyWordCount(sectorLength) * sizeof(uint64_t);
+      return (offset + alignment - 1) & ~(alignment - 1);
+    }
+    static size_t byteCount(size_t sectorLength, size_t capacity) { return valuesOffset(sectorLength) + capacity * sizeof(Value); }
+
+    static DenseSectorTableSectorBlock *allocate(DenseSectorTableBlockAllocator *allocator, size_t sectorLength, size_t capacity) {
+      void *memory;
+      if (allocator) {
+        memory = allocator->allocate(byteCount(sectorLength, capacity), alignment);
+      } else {
+        memory = DenseSectorTableBlockAllocator::systemAllocate(byteCount(sectorLength, capacity), alignment);
+      }
+      DenseSectorTableSectorBlock *block = static_cast<DenseSectorTableSectorBlock *>(memory);
+      block->allocator = allocator;
+      block->values = static_cast<Value *>(static_cast<void *>(static_cast<char *>(memory) + valuesOffset(sectorLength)));
+      block->sectorLength = sectorLength;
+      block->capacity = capacity;
+      block->dense = (capacity == sectorLength);
+      block->referenceCount.store(1, std::memory_order_relaxed);
+      return block;
+    }
+
+    /**
+     Creates an empty block: dense if the capacity is the sector length, or else sparse.
+    */
+    static DenseSectorTableSectorBlock *create(DenseSectorTableBlockAllocator *allocator, size_t sectorLength, size_t capacity,
+                                               const Value& nullValue) {
+      DenseSectorTableSectorBlock *block = allocate(allocator, sectorLength, capacity);
+      block->pointCount = 0;
+      for (size_t v = 0; v < capacity; ++v) {
+        new (block->values + v) Value(nullValue);
+      }
+      memset(block->occupancy(), 0, occupancyWordCount(sectorLength) * sizeof(uint64_t));
+      return block;
+    }
+
+    /**
+     Creates a copy of a block, with the same representation.
+    */
+    static DenseSectorTableSectorBlock *create(const DenseSectorTableSectorBlock& source) {
+      DenseSectorTableSectorBlock *block = allocate(source.allocator, source.sectorLength, source.capacity);
+      block->dense = source.dense;
+      block->pointCount = source.pointCount;
+      for (size_t v = 0; v < source.capacity; ++v) {
+        new (block->values + v) Value(source.values[v]);
+      }
+      memcpy(block->occupancy(), source.occupancy(), occupancyWordCount(source.sectorLength) * sizeof(uint64_t));
+      return block;
+    }
+
+    /**
+     Creates a copy of a block with a different representation: dense if the capacity is
+     the sector length, or else sparse (in which case the capacity must be enough for the
+     source's set points).
+    */
+    static DenseSectorTableSectorBlock *create(const DenseSectorTableSectorBlock& source, size_t capacity, const Value& nullValue) {
+      assert(capacity >= source.pointCount);
+      DenseSectorTableSectorBlock *block = create(source.allocator, source.sectorLength, capacity, nullValue);
+      memcpy(block->occupancy(), source.occupancy(), occupancyWordCount(source.sectorLength) * sizeof(uint64_t));
+      block->pointCount = source.pointCount;
+      size_t v = 0;
+      for (size_t p = source.nextSet(0); p < source.sectorLength; p = source.nextSet(p + 1)) {
+        block->values[block->dense ? p : v] = source.values[source.dense ? p : v];
+        ++v;
+      }
+      return block;
+    }
+
+    static void destroy(DenseSectorTableSectorBlock *block) {
+      size_t sectorLength = block->sectorLength;
+      size_t capacity = block->capacity;
+      for (size_t v = 0; v < capacity; ++v) {
+        block->values[v].~Value();
+      }
+      if (block->allocator) {
+        block->allocator->deallocate(block, byteCount(sectorLength, capacity));
+      } else {
+        DenseSectorTableBlockAllocator::systemDeallocate(block);
+      }
+    }
+
+    static void retain(DenseSectorTableSectorBlock *block) {
+      block->referenceCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void release(DenseSectorTableSectorBlock *block) {
+      // note: The last owner destroys the block; acquire the other owners' reads and
+      // writes before doing so.
+      if (block->referenceCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        destroy(block);
+      }
+    }
+
+    bool shared() const { return referenceCount.load(std::memory_order_acquire) != 1; }
+
+    uint64_t *occupancy() { return reinterpret_cast<uint64_t *>(this + 1); }
+    const uint64_t *occupancy() const { return reinterpret_cast<const uint64_t *>(this + 1); }
+
+    bool isSet(size_t pointIndexInSector) const {
+      return (occupancy()[pointIndexInSector >> 6] & (uint64_t(1) << (pointIndexInSector & 63))) != 0;
+    }
+
+    // note: Returns the number of set points before the passed index.
+    size_t rank(size_t pointIndexInSector) const {
+      const uint64_t *words = occupancy();
+      size_t w = pointIndexInSector >> 6;
+      size_t setCount = 0;
+      for (size_t i = 0; i < w; ++i) {
+        setCount += static_cast<size_t>(__builtin_popcountll(words[i]));
+      }
+      uint64_t mask = (uint64_t(1) << (pointIndexInSector & 63)) - 1;
+      return setCount + static_cast<size_t>(__builtin_popcountll(words[w] & mask));
+    }
+
+    // note: Returns the value of a point, which must be set unless the block is dense.
+    Value& value(size_t pointIndexInSector) {
+      assert(dense || isSet(pointIndexInSector));
+      return values[dense ? pointIndexInSector : rank(pointIndexInSector)];
+    }
+
+    const Value& value(size_t pointIndexInSector, const Value& nullValue) const {
+      if (dense) {
+        return values[pointIndexInSector];
+      }
+      return (isSet(pointIndexInSector) ? values[rank(pointIndexInSector)] : nullValue);
+    }
+
+    // note: Returns true if the point changed from unset to set, or vice versa.  Only for
+    // dense blocks; the caller sets the value.
+    bool setOccupied(size_t pointIndexInSector, bool occupied) {
+      uint64_t bit = uint64_t(1) << (pointIndexInSector & 63);
+      uint64_t& word = occupancy()[pointIndexInSector >> 6];
+      if (((word & bit) != 0) == occupied) {
+        return false;
+      }
+      if (occupied) {
+        word |= bit;
+        ++pointCount;
+      } else {
+        word &= ~bit;
+        --pointCount;
+      }
+      return true;
+    }
+
+    // note: Sets an unset point in a sparse block, which must have spare capacity.
+    void insertSparse(size_t pointIndexInSector, const Value& value) {
+      assert(!dense && !isSet(pointIndexInSector) && pointCount < capacity);
+      size_t v = rank(pointIndexInSector);
+      std::move_backward(values + v, values + pointCount, values + pointCount + 1);
+      values[v] = value;
+      occupancy()[pointIndexInSector >> 6] |= (uint64_t(1) << (pointIndexInSector & 63));
+      ++pointCount;
+    }
+
+    // note: Unsets a set point in a sparse block.
+    void eraseSparse(size_t pointIndexInSector, const Value& nullValue) {
+      assert(!dense && isSet(pointIndexInSector));
+      size_t v = rank(pointIndexInSector);
+      std::move(values + v + 1, values + pointCount, values + v);
+      values[pointCount - 1] = nullValue;
+      occupancy()[pointIndexInSector >> 6] &= ~(uint64_t(1) << (pointIndexInSector & 63));
+      --pointCount;
+    }
+
+    // note: Returns the index of the first set point at or after the passed index, or
+    // the sector length if there is none.
+    size_t nextSet(size_t pointIndexInSector) const {
+      if (pointIndexInSector >= sectorLength) {
+        return sectorLength;
+      }
+      const uint64_t *words = occupancy();
+      size_t w = pointIndexInSector >> 6;
+      uint64_t word = words[w] >> (pointIndexInSector & 63);
+      // note: Checking the next bit on its own is redundant, but it lets dense sectors
+      // iterate without a dependency on the count-trailing-zeros result.
+      if ((word & 1) != 0) {
+        return pointIndexInSector;
+      }
+      if (word != 0) {
+        return pointIndexInSector + static_cast<size_t>(__builtin_ctzll(word));
+      }
+      if (pointCount == 0) {
+        return sectorLength;
+      }
+      size_t wordCount = occupancyWordCount(sectorLength);
+      do {
+        ++w;
+        if (w == wordCount) {
+          return sectorLength;
+        }
+        word = words[w];
+      } while (word == 0);
+      return (w << 6) + static_cast<size_t>(__builtin_ctzll(word));
+    }
+
+    Value *values;
+    size_t sectorLength;
+    size_t capacity;
+    size_t pointCount;
+    bool dense;
+    std::atomic<size_t> referenceCount;
+    DenseSectorTableBlockAllocator *allocator;
+  };
+
+  /**
+   A handle owning a single sector's block.  Opaque to the caller, except that it can be
+   moved in and out of the table with `extractSector()` and `insertSector()`.
+
+   Copying a handle shares the block (copy-on-write): the block is copied only when one
+   of the sharing handles is about to write to it.  Table code must get the block
+   through `mutableBlock()` before writing.  Reference counts are atomic, so handles
+   sharing a block may be used on different threads.
+  */
+  class DenseSectorTableSector
+  {
+  public:
+    DenseSectorTableSector() : block_(nullptr) {}
+    DenseSectorTableSector(DenseSectorTableBlockAllocator *allocator, size_t sectorLength, size_t capacity, const Value& nullValue)
+      : block_(DenseSectorTableSectorBlock::create(allocator, sectorLength, capacity, nullValue)) {}
+    DenseSectorTableSector(const DenseSectorTableSector& rhs) : block_(rhs.block_) {
+      if (block_) {
+        DenseSectorTableSectorBlock::retain(block_);
+      }
+    }
+    DenseSectorTableSector(DenseSectorTableSector&& rhs) : block_(rhs.block_) {
+      rhs.block_ = nullptr;
+    }
+    ~DenseSectorTableSector() {
+      if (block_) {
+        DenseSectorTableSectorBlock::release(block_);
+      }
+    }
+    DenseSectorTableSector& operator=(DenseSectorTableSector rhs) {
+      std::swap(block_, rhs.block_);
+      return *this;
+    }
+    bool empty() const { return block_ == nullptr; }
+  private:
+    friend class DenseSectorTable;
+    DenseSectorTableSectorBlock *mutableBlock() {
+      if (block_->shared()) {
+        DenseSectorTableSectorBlock *block = DenseSectorTableSectorBlock::create(*block_);
+        DenseSectorTableSectorBlock::release(block_);
+        block_ = block;
+      }
+      return block_;
+    }
+    void replaceBlock(DenseSectorTableSectorBlock *block) {
+      DenseSectorTableSectorBlock::release(block_);
+      block_ = block;
+    }
+    DenseSectorTableSectorBlock *block_;
+  };
+
+  typedef typename SectorTableBackend::template SectorTable<std::pair<int, int>, DenseSectorTableSector, DenseSectorTableKeyHash>::type DenseSectorTableSectorTable;
+
+  /**
+   Returned (as the value) by dereferencing a non-const iterator: assignment goes through
+   the table at once, so that occupancy and point counts are right whether or not the
+   iterator is ever advanced.
+  */
+  class DenseSectorTableSectorPointReference
+  {
+  public:
+    DenseSectorTableSectorPointReference(DenseSectorTable *denseSectorTable, DenseSectorTableSector *sector, size_t pointIndexInSector)
+      : denseSectorTable_(denseSectorTable), sector_(sector), pointIndexInSector_(pointIndexInSector) {}
+    DenseSectorTableSectorPointReference& operator=(const Value& value) {
+      denseSectorTable_->setPointInSector(*sector_, pointIndexInSector_, value);
+      return *this;
+    }
+    DenseSectorTableSectorPointReference& operator=(const DenseSectorTableSectorPointReference& rhs) {
+      return operator=(static_cast<Value>(rhs));
+    }
+    operator Value() const {
+      return static_cast<const DenseSectorTable *>(denseSectorTable_)->sectorValue(*sector_, pointIndexInSector_);
+    }
+  private:
+    // note: Refer to the sector rather than to the value's storage, since sector storage
+    // changes when sectors switch between sparse and dense (or are copied on write).
+    DenseSectorTable *denseSectorTable_;
+    DenseSectorTableSector *sector_;
+    size_t pointIndexInSector_;
+  };
+
+  DenseSectorTableSectorPointReference pointReference(DenseSectorTableSector& sector, size_t pointIndexInSector) {
+    return DenseSectorTableSectorPointReference(this, &sector, pointIndexInSector);
+  }
+
+  const Value& pointReference(const DenseSectorTableSector& sector, size_t pointIndexInSector) const {
+    return sectorValue(sector, pointIndexInSector);
+  }
+
+  template <typename QualifiedValue, typename QualifiedDenseSectorTable, typename QualifiedDenseSectorTableSectorTableIterator>
+  class DenseSectorTableIterator : std::iterator<std::forward_iterator_tag, QualifiedValue>
+  {
+  public:
+    // note: Non-const iterators yield a DenseSectorTableSectorPointReference, so that
+    // assignments are accounted for immediately.
+    typedef typename std::conditional<std::is_const<QualifiedValue>::value,
+                                      const Value&, DenseSectorTableSectorPointReference>::type reference;
+    DenseSectorTableIterator() {}
+    DenseSectorTableIterator(QualifiedDenseSectorTable *denseSectorTable,
+                             const QualifiedDenseSectorTableSectorTableIterator& sectorIterator,
+                             size_t pointIndexInSector,
+                             bool singleSector = false,
+                             bool iterateOnNullValues = false)
+    : denseSectorTable_(denseSectorTable),
+    sectorIterator_(sectorIterator),
+    pointIndexInSector_(pointIndexInSector),
+    singleSector_(singleSector),
+    iterateOnNullValues_(iterateOnNullValues) {}
+    //~DenseSectorTableIterator();
+    DenseSectorTableIterator(const DenseSectorTableIterator& rhs) {
+      denseSectorTable_ = rhs.denseSectorTable_;
+      sectorIterator_ = rhs.sectorIterator_;
+      pointIndexInSector_ = rhs.pointIndexInSector_;
+      singleSector_ = rhs.singleSector_;
+      iterateOnNullValues_ = rhs.iterateOnNullValues_;
+    }
+    // note: Allow conversion from iterator to const_iterator.
+    operator DenseSectorTableIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator>() const {
+      return DenseSectorTableIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator>(denseSectorTable_,
+                                                                                                                                 sectorIterator_,
+                                                                                                                                 pointIndexInSector_,
+                                                                                                                                 singleSector_,
+                                                                                                                                 iterateOnNullValues_);
+    }
+    DenseSectorTableIterator& operator=(const DenseSectorTableIterator& rhs) {
+      if (this != &rhs) {
+        denseSectorTable_ = rhs.denseSectorTable_;
+        sectorIterator_ = rhs.sectorIterator_;
+        pointIndexInSector_ = rhs.pointIndexInSector_;
+        singleSector_ = rhs.singleSector_;
+        iterateOnNullValues_ = rhs.iterateOnNullValues_;
+      }
+      return *this;
+    }
+    DenseSectorTableIterator& operator++() {
+      size_t sectorLength = denseSectorTable_->sectorLength();
+      if (sectorIterator_ == denseSectorTable_->sectorTable_.end()) {
+        return *this;
+      }
+      size_t p = pointIndexInSector_ + 1;
+      while (true) {
+        auto& sector = sectorIterator_->second;
+        if (!iterateOnNullValues_) {
+          p = sector.block_->nextSet(p);
+        }
+        if (p < sectorLength) {
+          pointIndexInSector_ = p;
+          return *this;
+        }
+        if (singleSector_) {
+          // note: End of sector is represented the same as end of table.
+          sectorIterator_ = denseSectorTable_->sectorTable_.end();
+          break;
+        }
+        ++sectorIterator_;
+        if (sectorIterator_ == denseSectorTable_->sectorTable_.end()) {
+          break;
+        }
+        p = 0;
+      }
+      pointIndexInSector_ = 0;
+      return *this;
+    }
+    std::pair<std::pair<int, int>, reference> operator*() {
+      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
+      auto& sector = sectorIterator_->second;
+      assert(pointIndexInSector_ < denseSectorTable_->sectorLength());
+      assert(iterateOnNullValues_ || sector.block_->isSet(pointIndexInSector_));
+      return std::pair<std::pair<int, int>, reference>(denseSectorTable_->getXY(sectorIterator_->first, pointIndexInSector_),
+                                                       denseSectorTable_->pointReference(sector, pointIndexInSector_));
+    }
+    // note: Read-only, even for a non-const iterator; assign through operator*().
+    const Value *operator->() const {
+      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
+      const auto& sector = sectorIterator_->second;
+      assert(pointIndexInSector_ < denseSectorTable_->sectorLength());
+      assert(iterateOnNullValues_ || sector.block_->isSet(pointIndexInSector_));
+      return &static_cast<const DenseSectorTable *>(denseSectorTable_)->sectorValue(sector, pointIndexInSector_);
+    }
+    bool operator==(const DenseSectorTableIterator& rhs) const {
+      // note: End iterator is always represented with pointIndexInSector == 0.  End of sector
+      // is the same as end of table, so that endSector() need not know what comes next.
+      return denseSectorTable_ == rhs.denseSectorTable_
+        && sectorIterator_ == rhs.sectorIterator_
+        && pointIndexInSector_ == rhs.pointIndexInSector_;
+    }
+    bool operator!=(const DenseSectorTableIterator& rhs) const { return !(*this == rhs); }
+  private:
+    friend class DenseSectorTable;
+    QualifiedDenseSectorTable *denseSectorTable_;
+    QualifiedDenseSectorTableSectorTableIterator sectorIterator_;
+    size_t pointIndexInSector_;
+    bool singleSector_;
+    bool iterateOnNullValues_;
+  };
+
+  /**
+   Iterates over the set points inside a rectangle of point coordinates (inclusive).
+
+   Sectors overlapping the rectangle are looked up by sector coordinates, so the cost is
+   proportional to the size of the region rather than the size of the table -- unless
+   the region overlaps more potential sectors than the table has, in which case the
+   table's sectors are scanned instead.  Within a sector, only the rows and columns
+   inside the rectangle are visited.
+
+   As with `DenseSectorTableIterator`, assignments through the iterator go through the
+   table at once.
+  */
+  template <typename QualifiedValue, typename QualifiedDenseSectorTable, typename QualifiedDenseSectorTableSectorTableIterator>
+  class DenseSectorTableRegionIterator : std::iterator<std::forward_iterator_tag, QualifiedValue>
+  {
+  public:
+    typedef typename std::conditional<std::is_const<QualifiedValue>::value,
+                                      const Value&, DenseSectorTableSectorPointReference>::type reference;
+    DenseSectorTableRegionIterator() {}
+    DenseSectorTableRegionIterator(QualifiedDenseSectorTable *denseSectorTable,
+                                   const QualifiedDenseSectorTableSectorTableIterator& sectorIterator)
+    : denseSectorTable_(denseSectorTable),
+    sectorIterator_(sectorIterator),
+    pointIndexInSector_(0),
+    scanTable_(false),
+    xMin_(0), yMin_(0), xMax_(-1), yMax_(-1),
+    sectorCoordinates_(0, 0), sectorMin_(0, 0), sectorMax_(-1, -1),
+    sectorXMin_(0), sectorXMax_(0), sectorYMax_(0) {}
+    DenseSectorTableRegionIterator(QualifiedDenseSectorTable *denseSectorTable, int xMin, int yMin, int xMax, int yMax)
+    : denseSectorTable_(denseSectorTable),
+    sectorIterator_(denseSectorTable->sectorTable_.end()),
+    pointIndexInSector_(0),
+    scanTable_(false),
+    xMin_(xMin), yMin_(yMin), xMax_(xMax), yMax_(yMax),
+    sectorXMin_(0), sectorXMax_(0), sectorYMax_(0) {
+      if (xMax < xMin || yMax < yMin) {
+        return;
+      }
+      sectorMin_ = denseSectorTable_->getSectorCoordinatesInTable(xMin, yMin);
+      sectorMax_ = denseSectorTable_->getSectorCoordinatesInTable(xMax, yMax);
+      int64_t regionSectorCount = (static_cast<int64_t>(sectorMax_.first) - sectorMin_.first + 1)
+        * (static_cast<int64_t>(sectorMax_.second) - sectorMin_.second + 1);
+      scanTable_ = (regionSectorCount > static_cast<int64_t>(denseSectorTable_->sectorTable_.size()));
+      if (scanTable_) {
+        // note: An empty table (for instance, after pruneSectors()) has no sector to
+        // start from; nextSector() must not be called with the end iterator.
+        sectorIterator_ = denseSectorTable_->sectorTable_.begin();
+        if (sectorIterator_ == denseSectorTable_->sectorTable_.end()) {
+          pointIndexInSector_ = 0;
+          return;
+        }
+        if (enterSector()) {
+          return;
+        }
+      } else {
+        sectorCoordinates_ = std::make_pair(sectorMin_.first - 1, sectorMin_.second);
+      }
+      nextSector();
+    }
+    // note: Allow conversion from region_iterator to const_region_iterator.
+    operator DenseSectorTableRegionIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator>() const {
+      DenseSectorTableRegionIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator> i(denseSectorTable_, sectorIterator_);
+      i.pointIndexInSector_ = pointIndexInSector_;
+      i.scanTable_ = scanTable_;
+      i.xMin_ = xMin_;
+      i.yMin_ = yMin_;
+      i.xMax_ = xMax_;
+      i.yMax_ = yMax_;
+      i.sectorCoordinates_ = sectorCoordinates_;
+      i.sectorMin_ = sectorMin_;
+      i.sectorMax_ = sectorMax_;
+      i.sectorXMin_ = sectorXMin_;
+      i.sectorXMax_ = sectorXMax_;
+      i.sectorYMax_ = sectorYMax_;
+      return i;
+    }
+    DenseSectorTableRegionIterator& operator++() {
+      if (sectorIterator_ == denseSectorTable_->sectorTable_.end()) {
+        return *this;
+      }
+      if (!seekInSector(pointIndexInSector_ + 1)) {
+        nextSector();
+      }
+      return *this;
+    }
+    std::pair<std::pair<int, int>, reference> operator*() {
+      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
+      return std::pair<std::pair<int, int>, reference>(denseSectorTable_->getXY(sectorIterator_->first, pointIndexInSector_),
+                                                       denseSectorTable_->pointReference(sectorIterator_->second, pointIndexInSector_));
+    }
+    // note: Read-only, even for a non-const iterator; assign through operator*().
+    const Value *operator->() const {
+      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
+      return &static_cast<const DenseSectorTable *>(denseSectorTable_)->sectorValue(sectorIterator_->second, pointIndexInSector_);
+    }
+    bool operator==(const DenseSectorTableRegionIterator& rhs) const {
+      // note: As with DenseSectorTableIterator, the end iterator is represented with
+      // pointIndexInSector == 0, so that endRegion() need not know the region.
+      return denseSectorTable_ == rhs.denseSectorTable_
+        && sectorIterator_ == rhs.sectorIterator_
+        && pointIndexInSector_ == rhs.pointIndexInSector_;
+    }
+    bool operator!=(const DenseSectorTableRegionIterator& rhs) const { return !(*this == rhs); }
+  private:
+    friend class DenseSectorTable;
+    template <typename, typename, typename> friend class DenseSectorTableRegionIterator;
+    void nextSector() {
+      auto end = denseSectorTable_->sectorTable_.end();
+      while (true) {
+        if (scanTable_) {
+          ++sectorIterator_;
+          if (sectorIterator_ == end) {
+            break;
+          }
+        } else {
+          if (++sectorCoordinates_.first > sectorMax_.first) {
+            sectorCoordinates_.first = sectorMin_.first;
+            if (++sectorCoordinates_.second > sectorMax_.second) {
+              sectorIterator_ = end;
+              break;
+            }
+          }
+          sectorIterator_ = denseSectorTable_->sectorTable_.find(sectorCoordinates_);
+          if (sectorIterator_ == end) {
+            continue;
+          }
+        }
+        if (enterSector()) {
+          return;
+        }
+      }
+      pointIndexInSector_ = 0;
+    }
+    bool enterSector() {
+      const std::pair<int, int>& sectorCoordinates = sectorIterator_->first;
+      if (sectorCoordinates.first < sectorMin_.first || sectorCoordinates.first > sectorMax_.first
+          || sectorCoordinates.second < sectorMin_.second || sectorCoordinates.second > sectorMax_.second) {
+        return false;
+      }
+      // note: Clip the region to the sector, in point indexes relative to the sector.
+      int sectorSize = static_cast<int>(denseSectorTable_->sectorSize());
+      std::pair<int, int> sectorOrigin = denseSectorTable_->getXY(sectorCoordinates, 0);
+      sectorXMin_ = static_cast<size_t>(std::max(xMin_ - sectorOrigin.first, 0));
+      sectorXMax_ = static_cast<size_t>(std::min(xMax_ - sectorOrigin.first, sectorSize - 1));
+      size_t sectorYMin = static_cast<size_t>(std::max(yMin_ - sectorOrigin.second, 0));
+      sectorYMax_ = static_cast<size_t>(std::min(yMax_ - sectorOrigin.second, sectorSize - 1));
+      return seekInSector(sectorYMin * static_cast<size_t>(sectorSize) + sectorXMin_);
+    }
+    bool seekInSector(size_t p) {
+      size_t sectorSize = denseSectorTable_->sectorSize();
+      const DenseSectorTableSectorBlock *block = sectorIterator_->second.block_;
+      while (true) {
+        p = block->nextSet(p);
+        size_t row = p / sectorSize;
+        if (row > sectorYMax_) {
+          return false;
+        }
+        size_t column = p % sectorSize;
+        if (column < sectorXMin_) {
+          p = row * sectorSize + sectorXMin_;
+        } else if (column > sectorXMax_) {
+          p = (row + 1) * sectorSize + sectorXMin_;
+        } else {
+          pointIndexInSector_ = p;
+          return true;
+        }
+      }
+    }
+    QualifiedDenseSectorTable *denseSectorTable_;
+    QualifiedDenseSectorTableSectorTableIterator sectorIterator_;
+    size_t pointIndexInSector_;
+    bool scanTable_;
+    int xMin_;
+    int yMin_;
+    int xMax_;
+    int yMax_;
+    std::pair<int, int> sectorCoordinates_;
+    std::pair<int, int> sectorMin_;
+    std::pair<int, int> sectorMax_;
+    size_t sectorXMin_;
+    size_t sectorXMax_;
+    size_t sectorYMax_;
+  };
+
+  template <typename QualifiedValue, typename QualifiedDenseSectorTable, typename QualifiedDenseSectorTableSectorTableIterator>
+  class DenseSectorTableMortonIterator : std::iterator<std::forward_iterator_tag, QualifiedValue>
+  {
+  public:
+    typedef typename std::conditional<std::is_const<QualifiedValue>::value,
+                                      const Value&, DenseSectorTableSectorPointReference>::type reference;
+    DenseSectorTableMortonIterator() {}
+    DenseSectorTableMortonIterator(QualifiedDenseSectorTable *denseSectorTable,
+                                   const QualifiedDenseSectorTableSectorTableIterator& sectorIterator)
+    : denseSectorTable_(denseSectorTable),
+    sectorIterator_(sectorIterator),
+    pointIndexInSector_(0),
+    sectorOrderIndex_(0) {}
+    DenseSectorTableMortonIterator(QualifiedDenseSectorTable *denseSectorTable,
+                                   const std::shared_ptr<const std::vector<std::pair<int, int>>>& sectorOrder)
+    : denseSectorTable_(denseSectorTable),
+    sectorIterator_(denseSectorTable->sectorTable_.end()),
+    pointIndexInSector_(0),
+    sectorOrder_(sectorOrder),
+    sectorOrderIndex_(0) {
+      enterSector();
+    }
+    // note: Allow conversion from morton_iterator to const_morton_iterator.
+    operator DenseSectorTableMortonIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator>() const {
+      DenseSectorTableMortonIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator> i(denseSectorTable_, sectorIterator_);
+      i.pointIndexInSector_ = pointIndexInSector_;
+      i.sectorOrder_ = sectorOrder_;
+      i.sectorOrderIndex_ = sectorOrderIndex_;
+      return i;
+    }
+    DenseSectorTableMortonIterator& operator++() {
+      if (sectorIterator_ == denseSectorTable_->sectorTable_.end()) {
+        return *this;
+      }
+      size_t p = sectorIterator_->second.block_->nextSet(pointIndexInSector_ + 1);
+      if (p < denseSectorTable_->sectorLength()) {
+        pointIndexInSector_ = p;
+        return *this;
+      }
+      ++sectorOrderIndex_;
+      enterSector();
+      return *this;
+    }
+    std::pair<std::pair<int, int>, reference> operator*() {
+      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
+      return std::pair<std::pair<int, int>, reference>(denseSectorTable_->getXY(sectorIterator_->first, pointIndexInSector_),
+                                                       denseSectorTable_->pointReference(sectorIterator_->second, pointIndexInSector_));
+    }
+    // note: Read-only, even for a non-const iterator; assign through operator*().
+    const Value *operator->() const {
+      assert(sectorIterator_ != denseSectorTable_->sectorTable_.end());
+      return &static_cast<const DenseSectorTable *>(denseSectorTable_)->sectorValue(sectorIterator_->second, pointIndexInSector_);
+    }
+    bool operator==(const DenseSectorTableMortonIterator& rhs) const {
+      // note: As with DenseSectorTableIterator, the end iterator is represented with
+      // pointIndexInSector == 0, so that endPointMorton() need not sort the sectors.
+      return denseSectorTable_ == rhs.denseSectorTable_
+        && sectorIterator_ == rhs.sectorIterator_
+        && pointIndexInSector_ == rhs.pointIndexInSector_;
+    }
+    bool operator!=(const DenseSectorTableMortonIterator& rhs) const { return !(*this == rhs); }
+  private:
+    friend class DenseSectorTable;
+    template <typename, typename, typename> friend class DenseSectorTableMortonIterator;
+    void enterSector() {
+      // note: Sectors are looked up by coordinates as they are entered, so the iterator
+      // holds no sector table iterators other than the current one.
+      auto end = denseSectorTable_->sectorTable_.end();
+      while (sectorOrderIndex_ < sectorOrder_->size()) {
+        sectorIterator_ = denseSectorTable_->sectorTable_.find((*sectorOrder_)[sectorOrderIndex_]);
+        if (sectorIterator_ != end) {
+          size_t p = sectorIterator_->second.block_->nextSet(0);
+          if (p < denseSectorTable_->sectorLength()) {
+            pointIndexInSector_ = p;
+            return;
+          }
+        }
+        ++sectorOrderIndex_;
+      }
+      sectorIterator_ = end;
+      pointIndexInSector_ = 0;
+      sectorOrder_.reset();
+      sectorOrderIndex_ = 0;
+    }
+    QualifiedDenseSectorTable *denseSectorTable_;
+    QualifiedDenseSectorTableSectorTableIterator sectorIterator_;
+    size_t pointIndexInSector_;
+    std::shared_ptr<const std::vector<std::pair<int, int>>> sectorOrder_;
+    size_t sectorOrderIndex_;
+  };
+
+  static_assert((SectorSize & (SectorSize - 1)) == 0, "SectorSize must be a power of two.");
+  static const int sectorSizeShift = DenseSectorTableLog2(SectorSize);
+  static const int sectorSizeMask = static_cast<int>(SectorSize) - 1;
+
+  // note: When the sector size is a template parameter, the coordinate conversions are
+  // arithmetic shifts and masks, which floor toward negative infinity without branching.
+  // (The runtime branch is discarded at compile time, and vice versa.)
+
+  inline size_t sectorLength() const {
+    return (SectorSize != DenseSectorTableRuntimeSectorSize ? SectorSize * SectorSize : sectorSize_ * sectorSize_);
+  }
+
+  inline std::pair<int, int> getSectorCoordinatesInTable(int x, int y) const {
+    if (SectorSize != DenseSectorTableRuntimeSectorSize) {
+      return std::make_pair(x >> sectorSizeShift, y >> sectorSizeShift);
+    }
+    return std::make_pair((x >= 0 ? x / static_cast<int>(sectorSize_) : (x + 1) / static_cast<int>(sectorSize_) - 1),
+                          (y >= 0 ? y / static_cast<int>(sectorSize_) : (y + 1) / static_cast<int>(sectorSize_) - 1));
+  }
+
+  inline size_t getPointIndexInSector(int x, int y) const {
+    if (SectorSize != DenseSectorTableRuntimeSectorSize) {
+      return static_cast<size_t>(((y & sectorSizeMask) << sectorSizeShift) | (x & sectorSizeMask));
+    }
+    return static_cast<size_t>((y >= 0 ? y % static_cast<int>(sectorSize_) : static_cast<int>(sectorSize_) + (y + 1) % static_cast<int>(sectorSize_) - 1) * static_cast<int>(sectorSize_)
+                               + (x >= 0 ? x % static_cast<int>(sectorSize_) : static_cast<int>(sectorSize_) + (x + 1) % static_cast<int>(sectorSize_) - 1));
+  }
+
+  inline std::pair<int, int> getXY(const std::pair<int, int>& sectorCoordinatesInTable,
+                                   size_t pointIndexInSector) const {
+    if (SectorSize != DenseSectorTableRuntimeSectorSize) {
+      // note: Multiply rather than shift, since left-shifting a negative value is undefined.
+      return std::make_pair(sectorCoordinatesInTable.first * static_cast<int>(SectorSize)
+                            + (static_cast<int>(pointIndexInSector) & sectorSizeMask),
+                            sectorCoordinatesInTable.second * static_cast<int>(SectorSize)
+                            + (static_cast<int>(pointIndexInSector) >> sectorSizeShift));
+    }
+    return std::make_pair(sectorCoordinatesInTable.first * static_cast<int>(sectorSize_)
+                          + static_cast<int>(pointIndexInSector) % static_cast<int>(sectorSize_),
+                          sectorCoordinatesInTable.second * static_cast<int>(sectorSize_)
+                          + static_cast<int>(pointIndexInSector) / static_cast<int>(sectorSize_));
+  }
+
+  /**
+   Returned by `operator[]`: assignment goes through the table so that set points are
+   accounted for.
+  */
+  class DenseSectorTablePointReference
+  {
+  public:
+    DenseSectorTablePointReference(DenseSectorTable *denseSectorTable, int x, int y)
+      : denseSectorTable_(denseSectorTable), x_(x), y_(y) {}
+    DenseSectorTablePointReference& operator=(const Value& value) {
+      denseSectorTable_->setPoint(x_, y_, value);
+      return *this;
+    }
+    DenseSectorTablePointReference& operator=(const DenseSectorTablePointReference& rhs) {
+      return operator=(static_cast<Value>(rhs));
+    }
+    operator Value() const { return denseSectorTable_->getPoint(x_, y_); }
+  private:
+    // note: Refer to the point by coordinates rather than to its storage, since sector
+    // storage changes when sectors switch between sparse and dense (or are copied on
+    // write).
+    DenseSectorTable *denseSectorTable_;
+    int x_;
+    int y_;
+  };
+
+  inline size_t sparseCapacity() const {
+    // note: A sparse block as large as a dense block would be pointless.
+    return std::min(denseFillThreshold_, sectorLength());
+  }
+
+  inline Value& sectorValue(DenseSectorTableSector& sector, size_t pointIndexInSector) {
+    return sector.mutableBlock()->value(pointIndexInSector);
+  }
+
+  inline const Value& sectorValue(const DenseSectorTableSector& sector, size_t pointIndexInSector) const {
+    return sector.block_->value(pointIndexInSector, nullValue_);
+  }
+
+  void densifySector(DenseSectorTableSector& sector) {
+    if (!sector.block_->dense) {
+      sector.replaceBlock(DenseSectorTableSectorBlock::create(*sector.block_, sectorLength(), nullValue_));
+    }
+  }
+
+  void sparsifySector(DenseSectorTableSector& sector) {
+    size_t capacity = sparseCapacity();
+    if (sector.block_->dense && capacity < sectorLength() && sector.block_->pointCount <= capacity) {
+      sector.replaceBlock(DenseSectorTableSectorBlock::create(*sector.block_, capacity, nullValue_));
+    }
+  }
+
+  void setPointInSector(DenseSectorTableSector& sector, size_t pointIndexInSector, const Value& value) {
+    DenseSectorTableSectorBlock *block = sector.mutableBlock();
+    bool occupied = (value != nullValue_);
+    if (block->dense) {
+      block->values[pointIndexInSector] = value;
+      if (block->setOccupied(pointIndexInSector, occupied)) {
+        if (occupied) {
+          ++pointCount_;
+        } else {
+          --pointCount_;
+          // note: Switch back to sparse at half the threshold, so that a sector hovering
+          // around the threshold doesn't switch back and forth.  Leave empty sectors
+          // alone, since they're likely to be pruned.
+          if (block->pointCount != 0 && block->pointCount <= denseFillThreshold_ / 2) {
+            sparsifySector(sector);
+          }
+        }
+      }
+      return;
+    }
+    if (block->isSet(pointIndexInSector)) {
+      if (occupied) {
+        block->value(pointIndexInSector) = value;
+      } else {
+        block->eraseSparse(pointIndexInSector, nullValue_);
+        --pointCount_;
+      }
+      return;
+    }
+    if (!occupied) {
+      return;
+    }
+    if (block->pointCount == block->capacity) {
+      densifySector(sector);
+      block = sector.block_;
+      block->values[pointIndexInSector] = value;
+      block->setOccupied(pointIndexInSector, true);
+    } else {
+      block->insertSparse(pointIndexInSector, value);
+    }
+    ++pointCount_;
+  }
+
+  std::pair<typename DenseSectorTableSectorTable::iterator, bool> findOrCreateSector(const std::pair<int, int>& sectorCoordinates,
+                                                                                     size_t pointCountHint = 0) {
+    // note: Look before emplacing, since emplace() constructs (and allocates) the sector
+    // before discovering that it already exists.
+    auto s = sectorTable_.find(sectorCoordinates);
+    if (s != sectorTable_.end()) {
+      return std::make_pair(s, false);
+    }
+    size_t capacity = (denseFillThreshold_ == 0 || pointCountHint > denseFillThreshold_ ? sectorLength() : sparseCapacity());
+    return sectorTable_.emplace(sectorCoordinates, DenseSectorTableSector(allocator_, sectorLength(), capacity, nullValue_));
+  }
+
+  std::shared_ptr<const std::vector<std::pair<int, int>>> getSectorMortonOrder() const {
+    std::vector<std::pair<uint64_t, std::pair<int, int>>> mortonSectors;
+    mortonSectors.reserve(sectorTable_.size());
+    for (auto& s : sectorTable_) {
+      mortonSectors.emplace_back(DenseSectorTableMortonCode(s.first.first, s.first.second), s.first);
+    }
+    std::sort(mortonSectors.begin(), mortonSectors.end());
+    std::shared_ptr<std::vector<std::pair<int, int>>> sectorOrder = std::make_shared<std::vector<std::pair<int, int>>>();
+    sectorOrder->reserve(mortonSectors.size());
+    for (auto& mortonSector : mortonSectors) {
+      sectorOrder->push_back(mortonSector.second);
+    }
+    return sectorOrder;
+  }
+
+public:
+
+  typedef DenseSectorTableIterator<Value, DenseSectorTable, typename DenseSectorTableSectorTable::iterator> iterator;
+  typedef DenseSectorTableIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator> const_iterator;
+  typedef DenseSectorTableRegionIterator<Value, DenseSectorTable, typename DenseSectorTableSectorTable::iterator> region_iterator;
+  typedef DenseSectorTableRegionIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator> const_region_iterator;
+  typedef DenseSectorTableMortonIterator<Value, DenseSectorTable, typename DenseSectorTableSectorTable::iterator> morton_iterator;
+  typedef DenseSectorTableMortonIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator> const_morton_iterator;
+  typedef DenseSectorTableSector sector_type;
+
+  /**
+   Constructs an empty table.  If the sector size is a template parameter, then the
+   `sectorSize` passed here must match it.  Sector blocks are allocated from the passed
+   allocator, if any; see `DenseSectorTableBlockAllocator`.
+  */
+  DenseSectorTable(size_t sectorSize, size_t initialSectorCount, const Value& nullValue,
+                   DenseSectorTableBlockAllocator *allocator = nullptr)
+    : sectorSize_(sectorSize), sectorTable_(initialSectorCount), nullValue_(nullValue), pointCount_(0), allocator_(allocator) {
+    assert(SectorSize == DenseSectorTableRuntimeSectorSize || sectorSize == SectorSize);
+    denseFillThreshold_ = sectorLength() / 8;
+  }
+
+  /**
+   Constructs an empty table for a world of known extent (in point coordinates,
+   inclusive).  Only for `DenseSectorTableBoundedBackend`; see "Sector Table Backends".
+  */
+  DenseSectorTable(size_t sectorSize, int xMin, int yMin, int xMax, int yMax, const Value& nullValue,
+                   DenseSectorTableBlockAllocator *allocator = nullptr)
+    : sectorSize_(sectorSize),
+      sectorTable_(getSectorCoordinatesInTable(xMin, yMin).first, getSectorCoordinatesInTable(xMin, yMin).second,
+                   getSectorCoordinatesInTable(xMax, yMax).first, getSectorCoordinatesInTable(xMax, yMax).second),
+      nullValue_(nullValue), pointCount_(0), allocator_(allocator) {
+    assert(SectorSize == DenseSectorTableRuntimeSectorSize || sectorSize == SectorSize);
+    denseFillThreshold_ = sectorLength() / 8;
+  }
+
+  /**
+   Sectors holding more than this many points are stored densely, and sectors holding
+   this many or fewer are stored sparsely; see "Sparse and Dense Sectors".  Zero makes
+   all sectors dense.  Changing the threshold affects sectors as they are next modified.
+  */
+  size_t denseFillThreshold() const { return denseFillThreshold_; }
+  void setDenseFillThreshold(size_t denseFillThreshold) { denseFillThreshold_ = denseFillThreshold; }
+
+  size_t sectorSize() const { return (SectorSize != DenseSectorTableRuntimeSectorSize ? SectorSize : sectorSize_); }
+
+  size_t pointCount() const;
+  size_t sectorCount() const;
+  size_t sectorPointCount(int x, int y) const;
+  bool sectorEmpty(int x, int y) const;
+
+  /**
+   Returns the heap memory used by the table; see `DenseSectorTableMemoryUsage`.  Walks
+   the sector table, so it's linear in the number of sectors.
+  */
+  DenseSectorTableMemoryUsage memoryUsage() const;
+
+  /**
+   Returns a histogram of sector fill: the element at index `n` is the number of sectors
+   in the table holding exactly `n` points (so there are `sectorSize()^2 + 1` elements).
+   Sectors which are empty but not yet pruned are counted at index zero.
+  */
+  std::vector<size_t> sectorFillHistogram() const;
+
+  /**
+   Calls `visitor(sectorX, sectorY, occupancy)` for each sector in the table, where the
+   sector's first point is `(sectorX * sectorSize(), sectorY * sectorSize())` and
+   `occupancy` is its bitmap of set points (row-major, packed into 64-bit words).  See
+   `DenseSectorTableOccupancyBitmap`.
+  */
+  template<typename Visitor>
+  void forEachSectorOccupancy(Visitor visitor) const;
+
+  Value getPoint(int x, int y) const;
+  void getBlock(int x0, int y0, int width, int height, Value *block) const;
+  void setPoint(int x, int y, const Value& value);
+  void setPoints(const std::vector<std::tuple<int, int, Value>>& points);
+  DenseSectorTablePointReference operator[](std::pair<int, int> xy);
+
+  size_t pruneSectors();
+  bool pruneSector(int x, int y);
+
+  iterator beginPoint();
+  const_iterator beginPoint() const;
+  iterator endPoint();
+  const_iterator endPoint() const;
+  iterator findPoint(int x, int y);
+  const_iterator findPoint(int x, int y) const;
+
+  region_iterator beginRegion(int xMin, int yMin, int xMax, int yMax);
+  const_region_iterator beginRegion(int xMin, int yMin, int xMax, int yMax) const;
+  region_iterator endRegion();
+  const_region_iterator endRegion() const;
+
+  morton_iterator beginPointMorton();
+  const_morton_iterator beginPointMorton() const;
+  morton_iterator endPointMorton();
+  const_morton_iterator endPointMorton() const;
+
+  /**
+   Erases a point (setting it to the null value).  If `pruneSector` and the sector is left
+   empty, then the sector is erased, too.  Returns true if the sector was erased.
+  */
+  bool erasePoint(int x, int y, bool pruneSector = false);
+  bool erasePoint(const_iterator& position, bool pruneSector = false);
+
+  iterator beginSector(int x, int y, bool iterateOnNullValues = false);
+  const_iterator beginSector(int x, int y, bool iterateOnNullValues = false) const;
+  iterator endSector(int x, int y, bool iterateOnNullValues = false);
+  const_iterator endSector(int x, int y, bool iterateOnNullValues = false) const;
+
+  std::pair<iterator, bool> insertSector(int x, int y, bool iterateOnNullValues = false);
+  std::pair<iterator, bool> insertSector(int x, int y, sector_type&& sector, bool iterateOnNullValues = false);
+  bool extractSector(int x, int y, sector_type *sector);
+
+  bool eraseSector(int x, int y);
+  bool eraseSector(const_iterator& position);
+
+private:
+
+  size_t sectorSize_;
+  Value nullValue_;
+  DenseSectorTableSectorTable sectorTable_;
+  size_t pointCount_;
+  DenseSectorTableBlockAllocator *allocator_;
+  size_t denseFillThreshold_;
+};
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+Value
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::getPoint(int x, int y) const
+{
+  const DenseSectorTableSector *sector = DenseSectorTableFindMapped(sectorTable_, getSectorCoordinatesInTable(x, y));
+  if (sector) {
+    return sector->block_->value(getPointIndexInSector(x, y), nullValue_);
+  }
+  return nullValue_;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+void
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::getBlock(int x0, int y0, int width, int height, Value *block) const
+{
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  int x1 = x0 + width - 1;
+  int y1 = y0 + height - 1;
+  int sectorWidth = static_cast<int>(sectorSize());
+  std::pair<int, int> sectorMin = getSectorCoordinatesInTable(x0, y0);
+  std::pair<int, int> sectorMax = getSectorCoordinatesInTable(x1, y1);
+  for (int sy = sectorMin.second; sy <= sectorMax.second; ++sy) {
+    for (int sx = sectorMin.first; sx <= sectorMax.first; ++sx) {
+      std::pair<int, int> sectorCoordinates(sx, sy);
+      // note: Clip the window to this sector.
+      std::pair<int, int> sectorOrigin = getXY(sectorCoordinates, 0);
+      int clipX0 = std::max(x0, sectorOrigin.first);
+      int clipX1 = std::min(x1, sectorOrigin.first + sectorWidth - 1);
+      int clipY0 = std::max(y0, sectorOrigin.second);
+      int clipY1 = std::min(y1, sectorOrigin.second + sectorWidth - 1);
+      size_t clipWidth = static_cast<size_t>(clipX1 - clipX0 + 1);
+      const DenseSectorTableSector *sector = DenseSectorTableFindMapped(sectorTable_, sectorCoordinates);
+      for (int y = clipY0; y <= clipY1; ++y) {
+        Value *blockRow = block + static_cast<size_t>((y - y0) * width + (clipX0 - x0));
+        if (!sector) {
+          std::fill_n(blockRow, clipWidth, nullValue_);
+        } else if (sector->block_->dense) {
+          const Value *sectorRow = sector->block_->values + getPointIndexInSector(clipX0, y);
+          std::copy(sectorRow, sectorRow + clipWidth, blockRow);
+        } else {
+          // note: Sparse values are stored in row-major order, so the set points in the row
+          // are consecutive starting from the rank of the first point in the row.
+          const DenseSectorTableSectorBlock *sectorBlock = sector->block_;
+          std::fill_n(blockRow, clipWidth, nullValue_);
+          size_t rowStart = getPointIndexInSector(clipX0, y);
+          size_t v = sectorBlock->rank(rowStart);
+          for (size_t p = sectorBlock->nextSet(rowStart); p < rowStart + clipWidth; p = sectorBlock->nextSet(p + 1)) {
+            blockRow[p - rowStart] = sectorBlock->values[v];
+            ++v;
+          }
+        }
+      }
+    }
+  }
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+void
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::setPoint(int x, int y, const Value& value)
+{
+  DenseSectorTableSector& sector = findOrCreateSector(getSectorCoordinatesInTable(x, y)).first->second;
+  setPointInSector(sector, getPointIndexInSector(x, y), value);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+void
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::setPoints(const std::vector<std::tuple<int, int, Value>>& points)
+{
+  if (points.empty()) {
+    return;
+  }
+
+  // note: Order the points by sector, keeping input order within each sector (so that
+  // the last of several values for the same point wins, as with setPoint()).  Usually the
+  // points are loaded from a bounded area, and a counting sort over the bounding rectangle
+  // of sectors is linear; otherwise, fall back to a comparison sort.
+  std::vector<std::pair<int, int>> sectorCoordinates;
+  sectorCoordinates.reserve(points.size());
+  std::pair<int, int> sectorMin(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+  std::pair<int, int> sectorMax(std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+  for (auto& point : points) {
+    std::pair<int, int> sc = getSectorCoordinatesInTable(std::get<0>(point), std::get<1>(point));
+    sectorMin.first = std::min(sectorMin.first, sc.first);
+    sectorMin.second = std::min(sectorMin.second, sc.second);
+    sectorMax.first = std::max(sectorMax.first, sc.first);
+    sectorMax.second = std::max(sectorMax.second, sc.second);
+    sectorCoordinates.push_back(sc);
+  }
+  std::vector<size_t> order(points.size());
+  uint64_t boundsWidth = static_cast<uint64_t>(static_cast<int64_t>(sectorMax.first) - sectorMin.first + 1);
+  uint64_t boundsHeight = static_cast<uint64_t>(static_cast<int64_t>(sectorMax.second) - sectorMin.second + 1);
+  if (boundsWidth * boundsHeight <= points.size() * 4 + 1024) {
+    auto boundsIndex = [&](const std::pair<int, int>& sc) {
+      return static_cast<size_t>(static_cast<uint64_t>(static_cast<int64_t>(sc.second) - sectorMin.second) * boundsWidth
+                                 + static_cast<uint64_t>(static_cast<int64_t>(sc.first) - sectorMin.first));
+    };
+    std::vector<size_t> boundsStarts(static_cast<size_t>(boundsWidth * boundsHeight) + 1, 0);
+    for (auto& sc : sectorCoordinates) {
+      ++boundsStarts[boundsIndex(sc) + 1];
+    }
+    for (size_t b = 1; b < boundsStarts.size(); ++b) {
+      boundsStarts[b] += boundsStarts[b - 1];
+    }
+    for (size_t i = 0; i < points.size(); ++i) {
+      order[boundsStarts[boundsIndex(sectorCoordinates[i])]++] = i;
+    }
+  } else {
+    for (size_t i = 0; i < points.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sectorCoordinates](size_t a, size_t b) {
+      return sectorCoordinates[a] < sectorCoordinates[b];
+    });
+  }
+
+  size_t sectorCount = 1;
+  for (size_t o = 1; o < order.size(); ++o) {
+    if (sectorCoordinates[order[o]] != sectorCoordinates[order[o - 1]]) {
+      ++sectorCount;
+    }
+  }
+  sectorTable_.reserve(sectorTable_.size() + sectorCount);
+
+  size_t groupBegin = 0;
+  while (groupBegin < order.size()) {
+    const std::pair<int, int>& groupSectorCoordinates = sectorCoordinates[order[groupBegin]];
+    size_t groupEnd = groupBegin + 1;
+    size_t setCount = (std::get<2>(points[order[groupBegin]]) != nullValue_ ? 1 : 0);
+    while (groupEnd < order.size() && sectorCoordinates[order[groupEnd]] == groupSectorCoordinates) {
+      if (std::get<2>(points[order[groupEnd]]) != nullValue_) {
+        ++setCount;
+      }
+      ++groupEnd;
+    }
+    // note: The count of values is only a hint for choosing a sparse or dense block, since
+    // some may be for the same point.
+    DenseSectorTableSector& sector = findOrCreateSector(groupSectorCoordinates, setCount).first->second;
+    for (size_t o = groupBegin; o < groupEnd; ++o) {
+      auto& point = points[order[o]];
+      setPointInSector(sector, getPointIndexInSector(std::get<0>(point), std::get<1>(point)), std::get<2>(point));
+    }
+    groupBegin = groupEnd;
+  }
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::DenseSectorTablePointReference
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::operator[](std::pair<int, int> xy)
+{
+  findOrCreateSector(getSectorCoordinatesInTable(xy.first, xy.second));
+  return DenseSectorTablePointReference(this, xy.first, xy.second);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::region_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginRegion(int xMin, int yMin, int xMax, int yMax)
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::region_iterator(this, xMin, yMin, xMax, yMax);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_region_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginRegion(int xMin, int yMin, int xMax, int yMax) const
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_region_iterator(this, xMin, yMin, xMax, yMax);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::region_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endRegion()
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::region_iterator(this, sectorTable_.end());
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_region_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endRegion() const
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_region_iterator(this, sectorTable_.end());
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::morton_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginPointMorton()
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::morton_iterator(this, getSectorMortonOrder());
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_morton_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginPointMorton() const
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_morton_iterator(this, getSectorMortonOrder());
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::morton_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endPointMorton()
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::morton_iterator(this, sectorTable_.end());
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_morton_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endPointMorton() const
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_morton_iterator(this, sectorTable_.end());
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+bool
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::erasePoint(int x, int y, bool pruneSector)
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s != sectorTable_.end()) {
+    DenseSectorTableSector& sector = s->second;
+    setPointInSector(sector, getPointIndexInSector(x, y), nullValue_);
+    if (pruneSector && sector.block_->pointCount == 0) {
+      sectorTable_.erase(s);
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+bool
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::erasePoint(typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator& position, bool pruneSector)
+{
+  if (position.denseSectorTable_ != this) {
+    return false;
+  }
+  if (position.sectorIterator_ == sectorTable_.end()) {
+    return false;
+  }
+
+  // note: The const_iterator holds an iterator into the sectorTable_, and we'd like to
+  // use it to do the work here.  But, of course, it's const.  So we have to make our own
+  // non-const sectorTable_ iterator by doing a lookup.
+  const std::pair<int, int>& sectorCoordinates = position.sectorIterator_->first;
+  auto s = sectorTable_.find(sectorCoordinates);
+  assert(s != sectorTable_.end());
+
+  DenseSectorTableSector& sector = s->second;
+  assert(position.pointIndexInSector_ < sectorLength());
+  setPointInSector(sector, position.pointIndexInSector_, nullValue_);
+
+  if (pruneSector && sector.block_->pointCount == 0) {
+    sectorTable_.erase(s);
+    return true;
+  }
+  return false;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+size_t
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::pointCount() const
+{
+  return pointCount_;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+size_t
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::sectorCount() const
+{
+  return sectorTable_.size();
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+DenseSectorTableMemoryUsage
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::memoryUsage() const
+{
+  DenseSectorTableMemoryUsage memoryUsage;
+  DenseSectorTableAddSectorTableMemoryUsage(sectorTable_, &memoryUsage);
+  for (auto& s : sectorTable_) {
+    const DenseSectorTableSectorBlock *block = s.second.block_;
+    memoryUsage.sectorBlockByteCount += DenseSectorTableSectorBlock::byteCount(block->sectorLength, block->capacity);
+  }
+  return memoryUsage;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+std::vector<size_t>
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::sectorFillHistogram() const
+{
+  std::vector<size_t> histogram(sectorLength() + 1, 0);
+  for (auto& s : sectorTable_) {
+    ++histogram[s.second.block_->pointCount];
+  }
+  return histogram;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+template<typename Visitor>
+void
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::forEachSectorOccupancy(Visitor visitor) const
+{
+  for (auto& s : sectorTable_) {
+    if (!s.second.empty()) {
+      visitor(s.first.first, s.first.second, static_cast<const uint64_t *>(s.second.block_->occupancy()));
+    }
+  }
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+size_t
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::sectorPointCount(int x, int y) const
+{
+  const DenseSectorTableSector *sector = DenseSectorTableFindMapped(sectorTable_, getSectorCoordinatesInTable(x, y));
+  if (!sector) {
+    return 0;
+  }
+  return sector->block_->pointCount;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+bool
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::sectorEmpty(int x, int y) const
+{
+  const DenseSectorTableSector *sector = DenseSectorTableFindMapped(sectorTable_, getSectorCoordinatesInTable(x, y));
+  if (!sector) {
+    return true;
+  }
+  return sector->block_->pointCount == 0;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+size_t
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::pruneSectors()
+{
+  size_t pruneSectorCount = 0;
+  auto s = sectorTable_.begin();
+  while (s != sectorTable_.end()) {
+    if (s->second.block_->pointCount == 0) {
+      s = sectorTable_.erase(s);
+      ++pruneSectorCount;
+    } else {
+      ++s;
+    }
+  }
+  return pruneSectorCount;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+bool
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::pruneSector(int x, int y)
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s == sectorTable_.end()) {
+    return false;
+  }
+  if (s->second.block_->pointCount != 0) {
+    return false;
+  }
+  sectorTable_.erase(s);
+  return true;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginPoint()
+{
+  for (auto s = sectorTable_.begin(); s != sectorTable_.end(); ++s) {
+    if (s->second.block_->pointCount != 0) {
+      return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, s, s->second.block_->nextSet(0));
+    }
+  }
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, sectorTable_.end(), 0);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginPoint() const
+{
+  for (auto s = sectorTable_.begin(); s != sectorTable_.end(); ++s) {
+    if (s->second.block_->pointCount != 0) {
+      return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, s, s->second.block_->nextSet(0));
+    }
+  }
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, sectorTable_.end(), 0);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endPoint()
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, sectorTable_.end(), 0);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endPoint() const
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, sectorTable_.end(), 0);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::findPoint(int x, int y)
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s == sectorTable_.end()) {
+    return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, s, 0);
+  }
+  auto& sector = s->second;
+  size_t p = getPointIndexInSector(x, y);
+  assert(p < sectorLength());
+  if (!sector.block_->isSet(p)) {
+    return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, sectorTable_.end(), 0);
+  }
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, s, p);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::findPoint(int x, int y) const
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s == sectorTable_.end()) {
+    return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, s, 0);
+  }
+  auto& sector = s->second;
+  size_t p = getPointIndexInSector(x, y);
+  assert(p < sectorLength());
+  if (!sector.block_->isSet(p)) {
+    return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, sectorTable_.end(), 0);
+  }
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, s, p);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginSector(int x, int y, bool iterateOnNullValues)
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s == sectorTable_.end()) {
+    return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, s, 0, true, iterateOnNullValues);
+  }
+  // note: Assignments to unset points through the iterator go through setPointInSector(),
+  // so a sparse sector need not be made dense first.
+  typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator i(this, s, 0, true, iterateOnNullValues);
+  if (!iterateOnNullValues) {
+    i.pointIndexInSector_ = s->second.block_->nextSet(0);
+    if (i.pointIndexInSector_ == sectorLength()) {
+      i.sectorIterator_ = sectorTable_.end();
+      i.pointIndexInSector_ = 0;
+    }
+  }
+  return i;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::beginSector(int x, int y, bool iterateOnNullValues) const
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s == sectorTable_.end()) {
+    return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, s, 0, true, iterateOnNullValues);
+  }
+  typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator i(this, s, 0, true, iterateOnNullValues);
+  if (!iterateOnNullValues) {
+    i.pointIndexInSector_ = s->second.block_->nextSet(0);
+    if (i.pointIndexInSector_ == sectorLength()) {
+      i.sectorIterator_ = sectorTable_.end();
+      i.pointIndexInSector_ = 0;
+    }
+  }
+  return i;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endSector(int x, int y, bool iterateOnNullValues)
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator(this, sectorTable_.end(), 0, true, iterateOnNullValues);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::endSector(int x, int y, bool iterateOnNullValues) const
+{
+  return typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator(this, sectorTable_.end(), 0, true, iterateOnNullValues);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+std::pair<typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator, bool>
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::insertSector(int x, int y, bool iterateOnNullValues)
+{
+  bool inserted = findOrCreateSector(getSectorCoordinatesInTable(x, y)).second;
+  return std::make_pair(beginSector(x, y, iterateOnNullValues), inserted);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+std::pair<typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::iterator, bool>
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::insertSector(int x, int y, sector_type&& sector, bool iterateOnNullValues)
+{
+  // note: As with the standard containers, a sector is only moved from if it is
+  // actually inserted.
+  assert(sector.block_ && sector.block_->sectorLength == sectorLength());
+  std::pair<int, int> sectorCoordinates = getSectorCoordinatesInTable(x, y);
+  bool inserted = false;
+  if (sectorTable_.find(sectorCoordinates) == sectorTable_.end()) {
+    pointCount_ += sector.block_->pointCount;
+    sectorTable_.emplace(sectorCoordinates, std::move(sector));
+    inserted = true;
+  }
+  return std::make_pair(beginSector(x, y, iterateOnNullValues), inserted);
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+bool
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::extractSector(int x, int y, sector_type *sector)
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s == sectorTable_.end()) {
+    return false;
+  }
+  pointCount_ -= s->second.block_->pointCount;
+  *sector = std::move(s->second);
+  sectorTable_.erase(s);
+  return true;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+bool
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::eraseSector(int x, int y)
+{
+  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+  if (s == sectorTable_.end()) {
+    return false;
+  }
+  pointCount_ -= s->second.block_->pointCount;
+  sectorTable_.erase(s);
+  return true;
+}
+
+template<typename Value, typename SectorTableBackend, size_t SectorSize>
+bool
+DenseSectorTable<Value, SectorTableBackend, SectorSize>::eraseSector(typename DenseSectorTable<Value, SectorTableBackend, SectorSize>::const_iterator& position)
+{
+  if (position.denseSectorTable_ != this) {
+    return false;
+  }
+  if (position.sectorIterator_ == sectorTable_.end()) {
+    return false;
+  }
+  pointCount_ -= position.sectorIterator_->second.block_->pointCount;
+  sectorTable_.erase(position.sectorIterator_);
+  position = endPoint();
+  return true;
+}
+
+/**
+ A variant of `DenseSectorTable` which stores several values (columns) for each point, each
+ column in its own array in the sector block: a structure of arrays rather than an array
+ of structures.
+
+     DenseSectorColumnTable<16, uint8_t, int8_t, char> columnTable;
+     columnTable.setPoint(3, 4, typeAndRotation, switchPathId, label);
+     int8_t switchPathId = columnTable.getColumn<1>(3, 4);
+
+ Code which scans the grid for one or two properties (say, the segment type) can then read
+ a contiguous array of bytes per sector, rather than calling through an object pointer for
+ each point:
+
+     columnTable.forEachSector([](const DenseSectorColumnTable<16, uint8_t, int8_t, char>::sector_view& sector) {
+       const uint8_t *typesAndRotations = sector.column<0>();
+       ...
+     });
+
+ Columns must be trivially copyable (and are stored with `memcpy`); unset points read as
+ value-initialized (zero).  A sector block is a header, an occupancy bitmap, and then the
+ column arrays, each starting on a cache line; blocks are always dense, and are allocated
+ from a `DenseSectorTableBlockAllocator` if one is passed to the constructor.  The sector
+ size is a compile-time power of two.
+
+ For now this is a simpler structure than `DenseSectorTable`: the sector table is a
+ `DenseSectorTableFlatMap`, and there are no iterators (only `forEachSector()`), no sparse
+ sectors, and no copies.
+*/
+template<size_t SectorSize, typename... Columns>
+class DenseSectorColumnTable
+{
+public:
+
+  static_assert(sizeof...(Columns) > 0, "DenseSectorColumnTable must have at least one column.");
+  static_assert(SectorSize > 0 && (SectorSize & (SectorSize - 1)) == 0, "DenseSectorColumnTable sector size must be a power of two.");
+
+  template<size_t Column>
+  using column_type = typename std::tuple_element<Column, std::tuple<Columns...>>::type;
+
+  static const size_t columnCount = sizeof...(Columns);
+  static const size_t sectorLength = SectorSize * SectorSize;
+
+private:
+
+  static const size_t blockAlignment = 64;
+  static const int sectorSizeShift = DenseSectorTableLog2(SectorSize);
+  static const int sectorSizeMask = static_cast<int>(SectorSize) - 1;
+
+  struct DenseSectorColumnTableSectorHeader
+  {
+    size_t pointCount;
+    uint64_t occupancy[(sectorLength + 63) / 64];
+  };
+
+public:
+
+  /**
+   A read-only view of one sector, passed to `forEachSector()`.  Point index `p` in the
+   sector is at `(x0 + p % SectorSize, y0 + p / SectorSize)`.
+  */
+  class DenseSectorColumnTableSectorView
+  {
+  public:
+    int x0() const { return x0_; }
+    int y0() const { return y0_; }
+    size_t pointCount() const { return block_->pointCount; }
+    bool isSet(size_t pointIndexInSector) const {
+      return (block_->occupancy[pointIndexInSector >> 6] & (uint64_t(1) << (pointIndexInSector & 63))) != 0;
+    }
+    const uint64_t *occupancy() const { return block_->occupancy; }
+    template<size_t Column>
+    const column_type<Column> *column() const { return columnTable_->template column<Column>(block_); }
+  private:
+    friend class DenseSectorColumnTable;
+    DenseSectorColumnTableSectorView(const DenseSectorColumnTable *columnTable, int x0, int y0, const void *block)
+      : columnTable_(columnTable), x0_(x0), y0_(y0), block_(static_cast<const DenseSectorColumnTableSectorHeader *>(block)) {}
+    const DenseSectorColumnTable *columnTable_;
+    int x0_;
+    int y0_;
+    const DenseSectorColumnTableSectorHeader *block_;
+  };
+
+  typedef DenseSectorColumnTableSectorView sector_view;
+
+  explicit DenseSectorColumnTable(size_t initialSectorCount = 0, DenseSectorTableBlockAllocator *allocator = nullptr)
+    : sectorTable_(initialSectorCount), pointCount_(0), allocator_(allocator) {
+    size_t columnSizes[] = { sizeof(Columns)... };
+    size_t offset = sizeof(DenseSectorColumnTableSectorHeader);
+    for (size_t c = 0; c < columnCount; ++c) {
+      offset = (offset + blockAlignment - 1) & ~(blockAlignment - 1);
+      columnOffsets_[c] = offset;
+      offset += columnSizes[c] * sectorLength;
+    }
+    blockByteCount_ = (offset + blockAlignment - 1) & ~(blockAlignment - 1);
+  }
+
+  ~DenseSectorColumnTable() {
+    for (auto& s : sectorTable_) {
+      deallocateBlock(s.second);
+    }
+  }
+
+  size_t sectorSize() const { return SectorSize; }
+  size_t pointCount() const { return pointCount_; }
+  size_t sectorCount() const { return sectorTable_.size(); }
+
+  bool isSet(int x, int y) const {
+    auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+    return s != sectorTable_.end() && blockIsSet(s->second, getPointIndexInSector(x, y));
+  }
+
+  template<size_t Column>
+  column_type<Column> getColumn(int x, int y) const {
+    auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+    if (s == sectorTable_.end()) {
+      return column_type<Column>();
+    }
+    return column<Column>(s->second)[getPointIndexInSector(x, y)];
+  }
+
+  /**
+   Sets a point, with a value for every column.
+  */
+  void setPoint(int x, int y, const Columns&... values) {
+    void *block = findOrCreateSector(getSectorCoordinatesInTable(x, y));
+    size_t p = getPointIndexInSector(x, y);
+    size_t c = 0;
+    int expand[] = { (storeColumn(block, c++, p, values), 0)... };
+    (void)expand;
+    setOccupied(block, p);
+  }
+
+  /**
+   Sets one column of a point.  If the point was not set, then it becomes set, with the
+   other columns zero.
+  */
+  template<size_t Column>
+  void setColumn(int x, int y, const column_type<Column>& value) {
+    void *block = findOrCreateSector(getSectorCoordinatesInTable(x, y));
+    size_t p = getPointIndexInSector(x, y);
+    column<Column>(block)[p] = value;
+    setOccupied(block, p);
+  }
+
+  /**
+   Erases a point (zeroing its columns).  If `pruneSector` and the sector is left empty,
+   then the sector is erased, too.  As with `DenseSectorTable::erasePoint()`, returns
+   true if the sector was erased.
+  */
+  bool erasePoint(int x, int y, bool pruneSector = false) {
+    auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
+    if (s == sectorTable_.end()) {
+      return false;
+    }
+    size_t p = getPointIndexInSector(x, y);
+    DenseSectorColumnTableSectorHeader *header = static_cast<DenseSectorColumnTableSectorHeader *>(s->second);
+    if (!blockIsSet(header, p)) {
+      return false;
+    }
+    size_t columnSizes[] = { sizeof(Columns)... };
+    for (size_t c = 0; c < columnCount; ++c) {
+      memset(static_cast<char *>(s->second) + columnOffsets_[c] + p * columnSizes[c], 0, columnSizes[c]);
+    }
+    header->occupancy[p >> 6] &= ~(uint64_t(1) << (p & 63));
+    --header->pointCount;
+    --pointCount_;
+    if (pruneSector && header->pointCount == 0) {
+      deallocateBlock(s->second);
+      sectorTable_.erase(s);
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   Calls `function(const sector_view&)` for each sector in the table, in sector table
+   order.  The table must not be modified during the call.
+  */
+  template<typename Function>
+  void forEachSector(Function function) const {
+    for (auto& s : sectorTable_) {
+      function(sector_view(this, s.first.first * static_cast<int>(SectorSize), s.first.second * static_cast<int>(SectorSize), s.second));
+    }
+  }
+
+private:
+
+  DenseSectorColumnTable(const DenseSectorColumnTable&) = delete;
+  DenseSectorColumnTable& operator=(const DenseSectorColumnTable&) = delete;
+
+  static std::pair<int, int> getSectorCoordinatesInTable(int x, int y) {
+    return std::make_pair(x >> sectorSizeShift, y >> sectorSizeShift);
+  }
+
+  static size_t getPointIndexInSector(int x, int y) {
+    return static_cast<size_t>(((y & sectorSizeMask) << sectorSizeShift) | (x & sectorSizeMask));
+  }
+
+  static bool blockIsSet(const void *block, size_t pointIndexInSector) {
+    const DenseSectorColumnTableSectorHeader *header = static_cast<const DenseSectorColumnTableSectorHeader *>(block);
+    return (header->occupancy[pointIndexInSector >> 6] & (uint64_t(1) << (pointIndexInSector & 63))) != 0;
+  }
+
+  template<size_t Column>
+  column_type<Column> *column(void *block) const {
+    return static_cast<column_type<Column> *>(static_cast<void *>(static_cast<char *>(block) + columnOffsets_[Column]));
+  }
+
+  template<size_t Column>
+  const column_type<Column> *column(const void *block) const {
+    return static_cast<const column_type<Column> *>(static_cast<const void *>(static_cast<const char *>(block) + columnOffsets_[Column]));
+  }
+
+  template<typename ColumnValue>
+  void storeColumn(void *block, size_t c, size_t pointIndexInSector, const ColumnValue& value) {
+    memcpy(static_cast<char *>(block) + columnOffsets_[c] + pointIndexInSector * sizeof(ColumnValue), &value, sizeof(ColumnValue));
+  }
+
+  void setOccupied(void *block, size_t pointIndexInSector) {
+    DenseSectorColumnTableSectorHeader *header = static_cast<DenseSectorColumnTableSectorHeader *>(block);
+    uint64_t bit = uint64_t(1) << (pointIndexInSector & 63);
+    if ((header->occupancy[pointIndexInSector >> 6] & bit) == 0) {
+      header->occupancy[pointIndexInSector >> 6] |= bit;
+      ++header->pointCount;
+      ++pointCount_;
+    }
+  }
+
+  void *findOrCreateSector(const std::pair<int, int>& sectorCoordinates) {
+    auto s = sectorTable_.find(sectorCoordinates);
+    if (s != sectorTable_.end()) {
+      return s->second;
+    }
+    // note: The sector table may throw as it grows; until the block is stored, it is
+    // owned here, so that it goes back to the allocator instead of leaking.
+    std::unique_ptr<void, DenseSectorColumnTableBlockDeleter> block(allocateBlock(), DenseSectorColumnTableBlockDeleter(this));
+    memset(block.get(), 0, blockByteCount_);
+    sectorTable_.emplace(sectorCoordinates, block.get());
+    return block.release();
+  }
+
+  struct DenseSectorColumnTableBlockDeleter
+  {
+    explicit DenseSectorColumnTableBlockDeleter(DenseSectorColumnTable *columnTable_) : columnTable(columnTable_) {}
+    void operator()(void *block) const { columnTable->deallocateBlock(block); }
+    DenseSectorColumnTable *columnTable;
+  };
+
+  void *allocateBlock() {
+    if (allocator_) {
+      return allocator_->allocate(blockByteCount_, blockAlignment);
+    }
+    return DenseSectorTableBlockAllocator::systemAllocate(blockByteCount_, blockAlignment);
+  }
+
+  void deallocateBlock(void *block) {
+    if (allocator_) {
+      allocator_->deallocate(block, blockByteCount_);
+    } else {
+      DenseSectorTableBlockAllocator::systemDeallocate(block);
+    }
+  }
+
+  DenseSectorTableFlatMap<std::pair<int, int>, void *, DenseSectorTableKeyHash> sectorTable_;
+  size_t pointCount_;
+  DenseSectorTableBlockAllocator *allocator_;
+  size_t columnOffsets_[sizeof...(Columns)];
+  size_t blockByteCount_;
+};
+
+/**
+ Maintains coarse occupancy counts for points in an infinite integer grid, so that
+ questions like "which 64x64 regions contain anything?" and "what is the bounding box of
+ everything?" don't need a full scan.  The owner calls `add()` when a point becomes set
+ and `remove()` when it becomes unset (typically alongside a `DenseSectorTable`).
+
+ Counts are kept in a pyramid of levels.  Level 0 cells are sectors (of the passed sector
+ size) and hold point counts; each cell of level `l + 1` covers 4x4 cells of level `l` and
+ holds the number of those cells which are occupied.  The top level covers the whole
+ integer range.  Only occupied cells are stored, each level in a hash map, and an add or
+ remove propagates upward only while a cell changes between empty and occupied -- so
+ updates are usually a single hash map update, and never more than one per level.
+
+ The exact bounding box is kept separately, as ordered counts of points in each occupied
+ column and row, so it costs `O(log n)` to update and constant time to query.
+*/
+class DenseSectorTableOccupancyPyramid
+{
+public:
+
+  static const int levelShift = 2;
+
+  explicit DenseSectorTableOccupancyPyramid(size_t sectorSize) : pointCount_(0) {
+    assert(sectorSize > 0 && (sectorSize & (sectorSize - 1)) == 0);
+    sectorSizeShift_ = DenseSectorTableLog2(sectorSize);
+    levelCount_ = 1;
+    while (cellSizeShift(levelCount_ - 1) < 32) {
+      ++levelCount_;
+    }
+    levels_.resize(static_cast<size_t>(levelCount_));
+  }
+
+  size_t pointCount() const { return pointCount_; }
+
+  /**
+   The number of levels; the last covers the whole integer range in (at most) four cells.
+  */
+  int levelCount() const { return levelCount_; }
+
+  /**
+   The width and height of a cell at the passed level, in points.  (For levels near the
+   top, this does not fit in an `int`.)
+  */
+  int64_t cellSize(int level) const { return int64_t(1) << cellSizeShift(level); }
+
+  void add(int x, int y) {
+    ++pointCount_;
+    ++columnCounts_[x];
+    ++rowCounts_[y];
+    for (int level = 0; level < levelCount_; ++level) {
+      auto inserted = levels_[static_cast<size_t>(level)].emplace(getCellCoordinates(level, x, y), 0);
+      if (++inserted.first->second != 1) {
+        break;
+      }
     }
-    bool operator==(const DenseSectorTableIterator& rhs) const {
-      // note: End iterator is always represented with pointIndexInSector == 0.
-      return denseSectorTable_ == rhs.denseSectorTable_
-        && sectorIterator_ == rhs.sectorIterator_
-        && pointIndexInSector_ == rhs.pointIndexInSector_;
+  }
+
+  void remove(int x, int y) {
+    assert(pointCount_ > 0);
+    --pointCount_;
+    removeCount(&columnCounts_, x);
+    removeCount(&rowCounts_, y);
+    for (int level = 0; level < levelCount_; ++level) {
+      DenseSectorTableOccupancyPyramidLevel& cells = levels_[static_cast<size_t>(level)];
+      auto c = cells.find(getCellCoordinates(level, x, y));
+      assert(c != cells.end());
+      if (--c->second != 0) {
+        break;
+      }
+      cells.erase(c);
     }
-    bool operator!=(const DenseSectorTableIterator& rhs) const { return !(*this == rhs); }
-  private:
-    friend class DenseSectorTable;
-    QualifiedDenseSectorTable *denseSectorTable_;
-    QualifiedDenseSectorTableSectorTableIterator sectorIterator_;
-    size_t pointIndexInSector_;
-  };
+  }
 
-  inline std::pair<int, int> getSectorCoordinatesInTable(int x, int y) const {
-    return std::make_pair((x >= 0 ? x / static_cast<int>(sectorSize_) : (x + 1) / static_cast<int>(sectorSize_) - 1),
-                          (y >= 0 ? y / static_cast<int>(sectorSize_) : (y + 1) / static_cast<int>(sectorSize_) - 1));
+  void clear() {
+    pointCount_ = 0;
+    columnCounts_.clear();
+    rowCounts_.clear();
+    for (auto& cells : levels_) {
+      cells = DenseSectorTableOccupancyPyramidLevel();
+    }
   }
 
-  inline int getSectorCoordinateInTable(int i) const {
-    return (i >= 0 ? i / static_cast<int>(sectorSize_) : (i + 1) / static_cast<int>(sectorSize_) - 1);
+  /**
+   Returns the number of points in the sector containing the passed point.
+  */
+  size_t sectorPointCount(int x, int y) const {
+    auto c = levels_[0].find(getCellCoordinates(0, x, y));
+    return (c != levels_[0].end() ? c->second : 0);
   }
 
-  inline size_t getPointIndexInSector(int x, int y) const {
-    return static_cast<size_t>((y >= 0 ? y % static_cast<int>(sectorSize_) : static_cast<int>(sectorSize_) + (y + 1) % static_cast<int>(sectorSize_) - 1) * static_cast<int>(sectorSize_)
-                               + (x >= 0 ? x % static_cast<int>(sectorSize_) : static_cast<int>(sectorSize_) + (x + 1) % static_cast<int>(sectorSize_) - 1));
+  /**
+   Returns true if the cell at the passed level containing the passed point is occupied.
+  */
+  bool cellOccupied(int level, int x, int y) const {
+    const DenseSectorTableOccupancyPyramidLevel& cells = levels_[static_cast<size_t>(level)];
+    return cells.find(getCellCoordinates(level, x, y)) != cells.end();
   }
 
-  inline std::pair<int, int> getXY(const std::pair<int, int>& sectorCoordinatesInTable,
-                                   size_t pointIndexInSector) const {
-    return std::make_pair(sectorCoordinatesInTable.first * static_cast<int>(sectorSize_)
-                          + static_cast<int>(pointIndexInSector) % static_cast<int>(sectorSize_),
-                          sectorCoordinatesInTable.second * static_cast<int>(sectorSize_)
-                          + static_cast<int>(pointIndexInSector) / static_cast<int>(sectorSize_));
+  /**
+   Returns the number of occupied cells at the passed level.
+  */
+  size_t occupiedCellCount(int level) const { return levels_[static_cast<size_t>(level)].size(); }
+
+  /**
+   Appends to `cells` the origin (the minimum point coordinates) of each occupied cell at
+   the passed level which intersects the passed rectangle (bounds inclusive).  Descends
+   from the top of the pyramid, visiting only occupied cells, so the cost is proportional
+   to the number of results times the number of levels, rather than to the size of the
+   rectangle.  Results are in no particular order.  The level's cell size must fit in an
+   `int`.
+  */
+  void getOccupiedCells(int level, int xMin, int yMin, int xMax, int yMax, std::vector<std::pair<int, int>> *cells) const {
+    assert(cellSizeShift(level) < 31);
+    if (xMax < xMin || yMax < yMin) {
+      return;
+    }
+    int top = levelCount_ - 1;
+    for (auto& c : levels_[static_cast<size_t>(top)]) {
+      if (cellIntersects(top, c.first, xMin, yMin, xMax, yMax)) {
+        collectOccupiedCells(top, c.first, level, xMin, yMin, xMax, yMax, cells);
+      }
+    }
   }
 
-public:
+  /**
+   Gets the bounding box of all points (bounds inclusive).  Returns false if there are no
+   points.
+  */
+  bool getBounds(int *xMin, int *yMin, int *xMax, int *yMax) const {
+    if (pointCount_ == 0) {
+      return false;
+    }
+    *xMin = columnCounts_.begin()->first;
+    *xMax = columnCounts_.rbegin()->first;
+    *yMin = rowCounts_.begin()->first;
+    *yMax = rowCounts_.rbegin()->first;
+    return true;
+  }
 
-  typedef DenseSectorTableIterator<Value, DenseSectorTable, typename DenseSectorTableSectorTable::iterator> iterator;
-  typedef DenseSectorTableIterator<Value const, DenseSectorTable const, typename DenseSectorTableSectorTable::const_iterator> const_iterator;
+private:
 
-  DenseSectorTable(size_t sectorSize, size_t initialSectorCount, const Value& nullValue)
-    : sectorSize_(sectorSize), sectorTable_(initialSectorCount), nullValue_(nullValue) {}
+  typedef DenseSectorTableFlatMap<std::pair<int, int>, size_t, DenseSectorTableKeyHash> DenseSectorTableOccupancyPyramidLevel;
 
-  size_t sectorSize() const { return sectorSize_; }
+  int cellSizeShift(int level) const { return sectorSizeShift_ + level * levelShift; }
 
-  size_t pointCount() const;
-  size_t sectorCount() const;
-  size_t sectorPointCount(int x, int y) const;
-  bool sectorEmpty(int x, int y) const;
+  std::pair<int, int> getCellCoordinates(int level, int x, int y) const {
+    int shift = cellSizeShift(level);
+    return std::make_pair(static_cast<int>(static_cast<int64_t>(x) >> shift), static_cast<int>(static_cast<int64_t>(y) >> shift));
+  }
 
-  Value getPoint(int x, int y) const;
-  void setPoint(int x, int y, const Value& value);
-  Value& operator[](std::pair<int, int> xy);
+  bool cellIntersects(int level, const std::pair<int, int>& cellCoordinates, int xMin, int yMin, int xMax, int yMax) const {
+    int shift = cellSizeShift(level);
+    int64_t cellXMin = static_cast<int64_t>(cellCoordinates.first) * (int64_t(1) << shift);
+    int64_t cellYMin = static_cast<int64_t>(cellCoordinates.second) * (int64_t(1) << shift);
+    int64_t cellSizeMinusOne = (int64_t(1) << shift) - 1;
+    return cellXMin <= xMax && cellXMin + cellSizeMinusOne >= xMin
+      && cellYMin <= yMax && cellYMin + cellSizeMinusOne >= yMin;
+  }
 
-  size_t pruneSectors();
-  bool pruneSector(int x, int y);
+  void collectOccupiedCells(int level, const std::pair<int, int>& cellCoordinates,
+                            int targetLevel, int xMin, int yMin, int xMax, int yMax,
+                            std::vector<std::pair<int, int>> *cells) const {
+    if (level == targetLevel) {
+      int shift = cellSizeShift(level);
+      cells->emplace_back(static_cast<int>(static_cast<int64_t>(cellCoordinates.first) * (int64_t(1) << shift)),
+                          static_cast<int>(static_cast<int64_t>(cellCoordinates.second) * (int64_t(1) << shift)));
+      return;
+    }
+    int childLevel = level - 1;
+    const DenseSectorTableOccupancyPyramidLevel& children = levels_[static_cast<size_t>(childLevel)];
+    const int childrenPerSide = 1 << levelShift;
+    for (int cy = 0; cy < childrenPerSide; ++cy) {
+      for (int cx = 0; cx < childrenPerSide; ++cx) {
+        std::pair<int, int> childCoordinates(cellCoordinates.first * childrenPerSide + cx, cellCoordinates.second * childrenPerSide + cy);
+        if (cellIntersects(childLevel, childCoordinates, xMin, yMin, xMax, yMax)
+            && children.find(childCoordinates) != children.end()) {
+          collectOccupiedCells(childLevel, childCoordinates, targetLevel, xMin, yMin, xMax, yMax, cells);
+        }
+      }
+    }
+  }
 
-  iterator beginPoint();
-  const_iterator beginPoint() const;
-  iterator endPoint();
-  const_iterator endPoint() const;
-  iterator findPoint(int x, int y);
-  const_iterator findPoint(int x, int y) const;
+  static void removeCount(std::map<int, size_t> *counts, int key) {
+    auto c = counts->find(key);
+    assert(c != counts->end());
+    if (--c->second == 0) {
+      counts->erase(c);
+    }
+  }
 
-  bool erasePoint(int x, int y, bool pruneSector = false);
-  bool erasePoint(const_iterator& position, bool pruneSector = false);
+  int sectorSizeShift_;
+  int levelCount_;
+  size_t pointCount_;
+  std::vector<DenseSectorTableOccupancyPyramidLevel> levels_;
+  std::map<int, size_t> columnCounts_;
+  std::map<int, size_t> rowCounts_;
+};
 
-private:
+/**
+ Vector lanes for the word-parallel kernels of `DenseSectorTableOccupancyBitmap`: a vector
+ type holding `width` 64-bit words, with loads, stores, bitwise operations, and per-word
+ shifts.  The scalar lanes are always available; `DenseSectorTableSimdLanes` is AVX2 or
+ SSE2 where the compiler targets them (and `DENSE_SECTOR_TABLE_NO_SIMD` is not defined),
+ or else scalar.
+*/
+struct DenseSectorTableScalarLanes
+{
+  typedef uint64_t vector_type;
+  static const size_t width = 1;
+  static const char *name() { return "scalar"; }
+  static vector_type load(const uint64_t *words) { return *words; }
+  static void store(uint64_t *words, vector_type v) { *words = v; }
+  static vector_type broadcast(uint64_t word) { return word; }
+  static vector_type bitAnd(vector_type a, vector_type b) { return a & b; }
+  static vector_type bitOr(vector_type a, vector_type b) { return a | b; }
+  static vector_type bitXor(vector_type a, vector_type b) { return a ^ b; }
+  static vector_type bitAndNot(vector_type a, vector_type b) { return a & ~b; }
+  static vector_type shiftLeft(vector_type v, int count) { return v << count; }
+  static vector_type shiftRight(vector_type v, int count) { return v >> count; }
+};
 
-  size_t sectorSize_;
-  Value nullValue_;
-  DenseSectorTableSectorTable sectorTable_;
+#if defined(DENSE_SECTOR_TABLE_SIMD_SSE2) || defined(DENSE_SECTOR_TABLE_SIMD_AVX2)
+struct DenseSectorTableSse2Lanes
+{
+  typedef __m128i vector_type;
+  static const size_t width = 2;
+  static const char *name() { return "sse2"; }
+  static vector_type load(const uint64_t *words) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(words)); }
+  static void store(uint64_t *words, vector_type v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(words), v); }
+  static vector_type broadcast(uint64_t word) { return _mm_set1_epi64x(static_cast<long long>(word)); }
+  static vector_type bitAnd(vector_type a, vector_type b) { return _mm_and_si128(a, b); }
+  static vector_type bitOr(vector_type a, vector_type b) { return _mm_or_si128(a, b); }
+  static vector_type bitXor(vector_type a, vector_type b) { return _mm_xor_si128(a, b); }
+  static vector_type bitAndNot(vector_type a, vector_type b) { return _mm_andnot_si128(b, a); }
+  static vector_type shiftLeft(vector_type v, int count) { return _mm_sll_epi64(v, _mm_cvtsi32_si128(count)); }
+  static vector_type shiftRight(vector_type v, int count) { return _mm_srl_epi64(v, _mm_cvtsi32_si128(count)); }
 };
+#endif
 
-template<typename Value>
-Value
-DenseSectorTable<Value>::getPoint(int x, int y) const
+#if defined(DENSE_SECTOR_TABLE_SIMD_AVX2)
+struct DenseSectorTableAvx2Lanes
 {
-  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
-  if (s != sectorTable_.end()) {
-    const std::vector<Value>& sector = s->second;
-    const Value& point = sector[getPointIndexInSector(x, y)];
-    if (point != nullValue_) {
-      return sector[getPointIndexInSector(x, y)];
-    }
-  }
-  return nullValue_;
-}
+  typedef __m256i vector_type;
+  static const size_t width = 4;
+  static const char *name() { return "avx2"; }
+  static vector_type load(const uint64_t *words) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words)); }
+  static void store(uint64_t *words, vector_type v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(words), v); }
+  static vector_type broadcast(uint64_t word) { return _mm256_set1_epi64x(static_cast<long long>(word)); }
+  static vector_type bitAnd(vector_type a, vector_type b) { return _mm256_and_si256(a, b); }
+  static vector_type bitOr(vector_type a, vector_type b) { return _mm256_or_si256(a, b); }
+  static vector_type bitXor(vector_type a, vector_type b) { return _mm256_xor_si256(a, b); }
+  static vector_type bitAndNot(vector_type a, vector_type b) { return _mm256_andnot_si256(b, a); }
+  static vector_type shiftLeft(vector_type v, int count) { return _mm256_sll_epi64(v, _mm_cvtsi32_si128(count)); }
+  static vector_type shiftRight(vector_type v, int count) { return _mm256_srl_epi64(v, _mm_cvtsi32_si128(count)); }
+};
+typedef DenseSectorTableAvx2Lanes DenseSectorTableSimdLanes;
+#elif defined(DENSE_SECTOR_TABLE_SIMD_SSE2)
+typedef DenseSectorTableSse2Lanes DenseSectorTableSimdLanes;
+#else
+typedef DenseSectorTableScalarLanes DenseSectorTableSimdLanes;
+#endif
 
-template<typename Value>
-void
-DenseSectorTable<Value>::setPoint(int x, int y, const Value& value)
+/**
+ Word operations for `DenseSectorTableOccupancyBitmap` kernels: each combines a word (or
+ vector of words) from each of two inputs.
+*/
+struct DenseSectorTableAndOp
 {
-  auto emplacement = sectorTable_.emplace(std::piecewise_construct,
-                                          std::forward_as_tuple(getSectorCoordinateInTable(x),
-                                                                getSectorCoordinateInTable(y)),
-                                          std::forward_as_tuple(sectorSize_ * sectorSize_, nullValue_));
-  std::vector<Value>& sector = emplacement.first->second;
-  Value& point = sector[getPointIndexInSector(x, y)];
-  point = value;
-}
+  template<typename Lanes>
+  typename Lanes::vector_type apply(typename Lanes::vector_type a, typename Lanes::vector_type b) const { return Lanes::bitAnd(a, b); }
+};
 
-template<typename Value>
-Value&
-DenseSectorTable<Value>::operator[](std::pair<int, int> xy)
+struct DenseSectorTableOrOp
 {
-  auto emplacement = sectorTable_.emplace(std::piecewise_construct,
-                                          std::forward_as_tuple(getSectorCoordinateInTable(xy.first),
-                                                                getSectorCoordinateInTable(xy.second)),
-                                          std::forward_as_tuple(sectorSize_ * sectorSize_, nullValue_));
-  std::vector<Value>& sector = emplacement.first->second;
-  return sector[getPointIndexInSector(xy.first, xy.second)];
-}
+  template<typename Lanes>
+  typename Lanes::vector_type apply(typename Lanes::vector_type a, typename Lanes::vector_type b) const { return Lanes::bitOr(a, b); }
+};
 
-template<typename Value>
-bool
-DenseSectorTable<Value>::erasePoint(int x, int y, bool pruneSector)
+struct DenseSectorTableXorOp
 {
-  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
-  if (s != sectorTable_.end()) {
+  template<typename Lanes>
+  typename Lanes::vector_type apply(typename Lanes::vector_type a, typename Lanes::vector_type b) const { return Lanes::bitXor(a, b); }
+};
 
-    std::vector<Value>& sector = s->second;
-    Value& point = sector[getPointIndexInSector(x, y)];
-    point = nullValue_;
+struct DenseSectorTableAndNotOp
+{
+  template<typename Lanes>
+  typename Lanes::vector_type apply(typename Lanes::vector_type a, typename Lanes::vector_type b) const { return Lanes::bitAndNot(a, b); }
+};
 
-    if (pruneSector) {
-      size_t sectorLength = sectorSize_ * sectorSize_;
-      bool sectorEmpty = true;
-      for (size_t p = 0; p < sectorLength; ++p) {
-        if (sector[p] != nullValue_) {
-          sectorEmpty = false;
-          break;
-        }
-      }
-      if (sectorEmpty) {
-        sectorTable_.erase(s);
-        return true;
-      }
+/**
+ `((a << aShift) & aMask) | ((b >> bShift) & bMask)`, or with the shift directions
+ reversed: shifts the bits of `a` by whole rows or columns, and brings in carries from
+ the neighboring sector's words `b`.
+*/
+struct DenseSectorTableShiftMergeOp
+{
+  DenseSectorTableShiftMergeOp(bool shiftLeft, int aShift, uint64_t aMask, int bShift, uint64_t bMask)
+    : shiftLeft_(shiftLeft), aShift_(aShift), aMask_(aMask), bShift_(bShift), bMask_(bMask) {}
+  template<typename Lanes>
+  typename Lanes::vector_type apply(typename Lanes::vector_type a, typename Lanes::vector_type b) const {
+    if (shiftLeft_) {
+      return Lanes::bitOr(Lanes::bitAnd(Lanes::shiftLeft(a, aShift_), Lanes::broadcast(aMask_)),
+                          Lanes::bitAnd(Lanes::shiftRight(b, bShift_), Lanes::broadcast(bMask_)));
     }
+    return Lanes::bitOr(Lanes::bitAnd(Lanes::shiftRight(a, aShift_), Lanes::broadcast(aMask_)),
+                        Lanes::bitAnd(Lanes::shiftLeft(b, bShift_), Lanes::broadcast(bMask_)));
   }
-  return false;
-}
+private:
+  bool shiftLeft_;
+  int aShift_;
+  uint64_t aMask_;
+  int bShift_;
+  uint64_t bMask_;
+};
 
-template<typename Value>
-bool
-DenseSectorTable<Value>::erasePoint(typename DenseSectorTable<Value>::const_iterator& position, bool pruneSector)
+/**
+ A copy of the occupancy (set or unset) of every point in a `DenseSectorTable`, for
+ whole-grid neighborhood logic without per-point lookups: finding isolated points, points
+ with exactly one neighbor, or unset points adjacent to anything.
+
+     DenseSectorTableOccupancyBitmap<16> occupied(table);
+     auto isolated = occupied.andNot(occupied.neighborCountAtLeast(1));
+     isolated.forEachSetPoint([](int x, int y) { ... });
+
+ The bitmap is sparse, by sector, and each sector's bits are stored exactly as in the
+ table's sector blocks: row-major, `SectorSize` bits per row, packed into 64-bit words.
+ So a copy from the table is a `memcpy` per sector, and every operation is a handful of
+ bitwise operations on whole words -- including shifts by a row or column, where the bits
+ which cross a sector edge are carried in from the neighboring sector's words.  Those
+ word operations run on `DenseSectorTableSimdLanes` (four words at a time with AVX2; two
+ with SSE2) unless `setSimdEnabled(false)`, in which case they run one word at a time.
+
+ The sector size must be 8, 16, or 32 (so that rows don't straddle words).  Operations
+ return new bitmaps, which omit empty sectors.
+*/
+template<size_t SectorSize>
+class DenseSectorTableOccupancyBitmap
 {
-  if (position.denseSectorTable_ != this) {
-    return false;
+public:
+
+  static_assert(SectorSize == 8 || SectorSize == 16 || SectorSize == 32, "DenseSectorTableOccupancyBitmap sector size must be 8, 16, or 32.");
+
+  static const size_t sectorLength = SectorSize * SectorSize;
+  static const size_t wordCount = sectorLength / 64;
+
+  DenseSectorTableOccupancyBitmap() : simdEnabled_(true) {}
+
+  /**
+   Copies the occupancy of a `DenseSectorTable` (or anything else with a compatible
+   `sectorSize()` and `forEachSectorOccupancy()`).
+  */
+  template<typename Table>
+  explicit DenseSectorTableOccupancyBitmap(const Table& table) : simdEnabled_(true) {
+    assert(table.sectorSize() == SectorSize);
+    table.forEachSectorOccupancy([this](int sectorX, int sectorY, const uint64_t *occupancy) {
+      if (!DenseSectorTableOccupancyBitmap::sectorEmpty(occupancy)) {
+        auto inserted = sectors_.emplace(std::make_pair(sectorX, sectorY), DenseSectorTableOccupancyBitmapSector());
+        memcpy(inserted.first->second.words, occupancy, sizeof(inserted.first->second.words));
+      }
+    });
   }
-  if (position.sectorIterator_ == sectorTable_.end()) {
-    return false;
+
+  /**
+   Whether word operations use `DenseSectorTableSimdLanes` (the default) or scalar lanes.
+   Results are the same either way; bitmaps returned by operations inherit the setting.
+  */
+  bool simdEnabled() const { return simdEnabled_; }
+  void setSimdEnabled(bool simdEnabled) { simdEnabled_ = simdEnabled; }
+
+  size_t sectorCount() const { return sectors_.size(); }
+  bool empty() const { return sectors_.empty(); }
+
+  size_t pointCount() const {
+    size_t pointCount = 0;
+    for (auto& s : sectors_) {
+      for (size_t w = 0; w < wordCount; ++w) {
+        pointCount += static_cast<size_t>(__builtin_popcountll(s.second.words[w]));
+      }
+    }
+    return pointCount;
   }
 
-  // note: The const_iterator holds an iterator into the sectorTable_, and we'd like to
-  // use it to do the work here.  But, of course, it's const.  So we have to make our own
-  // non-const sectorTable_ iterator by doing a lookup.
-  const std::pair<int, int>& sectorCoordinates = position.sectorIterator_->first;
-  auto s = sectorTable_.find(sectorCoordinates);
-  assert(s != sectorTable_.end());
+  bool isSet(int x, int y) const {
+    auto s = sectors_.find(getSectorCoordinates(x, y));
+    if (s == sectors_.end()) {
+      return false;
+    }
+    size_t p = getPointIndexInSector(x, y);
+    return (s->second.words[p >> 6] & (uint64_t(1) << (p & 63))) != 0;
+  }
 
-  std::vector<Value>& sector = s->second;
-  assert(position.pointIndexInSector_ < sectorSize_ * sectorSize_);
-  Value& point = sector[position.pointIndexInSector_];
-  point = nullValue_;
-
-  if (pruneSector) {
-    size_t sectorLength = sectorSize_ * sectorSize_;
-    bool sectorEmpty = true;
-    for (size_t p = 0; p < sectorLength; ++p) {
-      if (sector[p] != nullValue_) {
-        sectorEmpty = false;
-        break;
-      }
+  void set(int x, int y, bool occupied = true) {
+    std::pair<int, int> sectorCoordinates = getSectorCoordinates(x, y);
+    size_t p = getPointIndexInSector(x, y);
+    uint64_t bit = uint64_t(1) << (p & 63);
+    if (occupied) {
+      sectors_.emplace(sectorCoordinates, DenseSectorTableOccupancyBitmapSector()).first->second.words[p >> 6] |= bit;
+      return;
     }
-    if (sectorEmpty) {
-      sectorTable_.erase(s);
-      return true;
+    auto s = sectors_.find(sectorCoordinates);
+    if (s != sectors_.end()) {
+      s->second.words[p >> 6] &= ~bit;
+      if (sectorEmpty(s->second.words)) {
+        sectors_.erase(s);
+      }
     }
   }
-  return false;
-}
 
-template<typename Value>
-size_t
-DenseSectorTable<Value>::pointCount() const
-{
-  size_t pointCount = 0;
-  size_t sectorLength = sectorSize_ * sectorSize_;
-  for (auto s = sectorTable_.begin(); s != sectorTable_.end(); ++s) {
-    const std::vector<Value>& sector = s->second;
-    for (size_t p = 0; p < sectorLength; ++p) {
-      if (sector[p] != nullValue_) {
-        ++pointCount;
+  /**
+   Calls `visitor(x, y)` for each set point, sector by sector (in no particular order)
+   and row-major within each sector.
+  */
+  template<typename Visitor>
+  void forEachSetPoint(Visitor visitor) const {
+    for (auto& s : sectors_) {
+      int x0 = s.first.first * static_cast<int>(SectorSize);
+      int y0 = s.first.second * static_cast<int>(SectorSize);
+      for (size_t w = 0; w < wordCount; ++w) {
+        uint64_t word = s.second.words[w];
+        while (word != 0) {
+          size_t p = (w << 6) + static_cast<size_t>(__builtin_ctzll(word));
+          visitor(x0 + static_cast<int>(p % SectorSize), y0 + static_cast<int>(p / SectorSize));
+          word &= word - 1;
+        }
       }
     }
   }
-  return pointCount;
-}
 
-template<typename Value>
-size_t
-DenseSectorTable<Value>::sectorCount() const
-{
-  return sectorTable_.size();
-}
+  DenseSectorTableOccupancyBitmap operator&(const DenseSectorTableOccupancyBitmap& rhs) const { return combine(DenseSectorTableAndOp(), rhs, false); }
+  DenseSectorTableOccupancyBitmap operator|(const DenseSectorTableOccupancyBitmap& rhs) const { return combine(DenseSectorTableOrOp(), rhs, true); }
+  DenseSectorTableOccupancyBitmap operator^(const DenseSectorTableOccupancyBitmap& rhs) const { return combine(DenseSectorTableXorOp(), rhs, true); }
+
+  /**
+   Points set in this bitmap but not in the passed one.
+  */
+  DenseSectorTableOccupancyBitmap andNot(const DenseSectorTableOccupancyBitmap& rhs) const { return combine(DenseSectorTableAndNotOp(), rhs, false); }
+
+  /**
+   Moves every set point by `(dx, dy)`, each of which must be -1, 0, or 1.
+  */
+  DenseSectorTableOccupancyBitmap shifted(int dx, int dy) const {
+    assert(dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1);
+    if (dx == 0) {
+      return shiftedRows(dy);
+    }
+    return shiftedColumns(dx).shiftedRows(dy);
+  }
 
-template<typename Value>
-size_t
-DenseSectorTable<Value>::sectorPointCount(int x, int y) const
-{
-  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
-  if (s == sectorTable_.end()) {
-    return 0;
+  /**
+   Sets every point which is set or has a set point among its eight neighbors.
+  */
+  DenseSectorTableOccupancyBitmap dilated() const {
+    DenseSectorTableOccupancyBitmap rows = *this | shiftedColumns(1) | shiftedColumns(-1);
+    return rows | rows.shiftedRows(1) | rows.shiftedRows(-1);
   }
-  size_t sectorLength = sectorSize_ * sectorSize_;
-  const std::vector<Value>& sector = s->second;
-  size_t sectorPointCount = 0;
-  for (size_t p = 0; p < sectorLength; ++p) {
-    if (sector[p] != nullValue_) {
-      ++sectorPointCount;
-    }
+
+  /**
+   Sets every point (set or not) with exactly `count` set points among its eight
+   neighbors.  A count of zero matches only set points (that is, isolated points), since
+   the unset points with no neighbors are unbounded.
+  */
+  DenseSectorTableOccupancyBitmap neighborCountEquals(int count) const { return neighborCountInRange(count, count); }
+
+  /**
+   Sets every point (set or not) with at least `count` set points among its eight
+   neighbors.  A count of zero matches set points and their neighbors (as `dilated()`).
+  */
+  DenseSectorTableOccupancyBitmap neighborCountAtLeast(int count) const { return neighborCountInRange(count, 8); }
+
+private:
+
+  static const int sectorSizeShift = DenseSectorTableLog2(SectorSize);
+  static const int sectorSizeMask = static_cast<int>(SectorSize) - 1;
+
+  struct DenseSectorTableOccupancyBitmapSector
+  {
+    DenseSectorTableOccupancyBitmapSector() { memset(words, 0, sizeof(words)); }
+    uint64_t words[wordCount];
+  };
+
+  typedef DenseSectorTableFlatMap<std::pair<int, int>, DenseSectorTableOccupancyBitmapSector, DenseSectorTableKeyHash> DenseSectorTableOccupancyBitmapSectors;
+
+  static std::pair<int, int> getSectorCoordinates(int x, int y) {
+    return std::make_pair(x >> sectorSizeShift, y >> sectorSizeShift);
   }
-  return sectorPointCount;
-}
 
-template<typename Value>
-bool
-DenseSectorTable<Value>::sectorEmpty(int x, int y) const
-{
-  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
-  if (s == sectorTable_.end()) {
-    return true;
+  static size_t getPointIndexInSector(int x, int y) {
+    return static_cast<size_t>(((y & sectorSizeMask) << sectorSizeShift) | (x & sectorSizeMask));
   }
-  size_t sectorLength = sectorSize_ * sectorSize_;
-  const std::vector<Value>& sector = s->second;
-  for (size_t p = 0; p < sectorLength; ++p) {
-    if (sector[p] != nullValue_) {
-      return false;
+
+  static bool sectorEmpty(const uint64_t *words) {
+    uint64_t any = 0;
+    for (size_t w = 0; w < wordCount; ++w) {
+      any |= words[w];
     }
+    return any == 0;
   }
-  return true;
-}
 
-template<typename Value>
-size_t
-DenseSectorTable<Value>::pruneSectors()
-{
-  size_t pruneSectorCount = 0;
-  size_t sectorLength = sectorSize_ * sectorSize_;
-  auto s = sectorTable_.begin();
-  while (s != sectorTable_.end()) {
-    std::vector<Value>& sector = s->second;
-    bool sectorEmpty = true;
-    for (size_t p = 0; p < sectorLength; ++p) {
-      if (sector[p] != nullValue_) {
-        sectorEmpty = false;
-        break;
-      }
+  // note: The bits of one column in every row of a word.
+  static uint64_t columnMask(size_t column) {
+    uint64_t mask = 0;
+    for (size_t r = 0; r < 64 / SectorSize; ++r) {
+      mask |= uint64_t(1) << (r * SectorSize + column);
     }
-    if (sectorEmpty) {
-      s = sectorTable_.erase(s);
-      ++pruneSectorCount;
-    } else {
-      ++s;
+    return mask;
+  }
+
+  static const uint64_t *zeroWords() {
+    static const uint64_t words[wordCount] = {};
+    return words;
+  }
+
+  const uint64_t *findWords(std::pair<int, int> sectorCoordinates) const {
+    auto s = sectors_.find(sectorCoordinates);
+    return (s == sectors_.end() ? zeroWords() : s->second.words);
+  }
+
+  template<typename Lanes, typename Op>
+  static void applyWords(const Op& op, uint64_t *result, const uint64_t *a, const uint64_t *b) {
+    const size_t vectorWordCount = wordCount - wordCount % Lanes::width;
+    for (size_t w = 0; w < vectorWordCount; w += Lanes::width) {
+      Lanes::store(result + w, op.template apply<Lanes>(Lanes::load(a + w), Lanes::load(b + w)));
+    }
+    for (size_t w = vectorWordCount; w < wordCount; ++w) {
+      result[w] = op.template apply<DenseSectorTableScalarLanes>(a[w], b[w]);
     }
   }
-  return pruneSectorCount;
-}
 
-template<typename Value>
-bool
-DenseSectorTable<Value>::pruneSector(int x, int y)
-{
-  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
-  if (s == sectorTable_.end()) {
-    return false;
+  template<typename Op>
+  void apply(const Op& op, uint64_t *result, const uint64_t *a, const uint64_t *b) const {
+    if (simdEnabled_) {
+      applyWords<DenseSectorTableSimdLanes>(op, result, a, b);
+    } else {
+      applyWords<DenseSectorTableScalarLanes>(op, result, a, b);
+    }
   }
-  size_t sectorLength = sectorSize_ * sectorSize_;
-  std::vector<Value>& sector = s->second;
-  for (size_t p = 0; p < sectorLength; ++p) {
-    if (sector[p] != nullValue_) {
-      return false;
+
+  // note: Stores a result sector unless it's empty.
+  void insertSector(std::pair<int, int> sectorCoordinates, const DenseSectorTableOccupancyBitmapSector& sector) {
+    if (!sectorEmpty(sector.words)) {
+      sectors_.emplace(sectorCoordinates, DenseSectorTableOccupancyBitmapSector(sector));
     }
   }
-  sectorTable_.erase(s);
-  return true;
-}
 
-template<typename Value>
-typename DenseSectorTable<Value>::iterator
-DenseSectorTable<Value>::beginPoint()
-{
-  size_t sectorLength = sectorSize_ * sectorSize_;
-  for (auto s = sectorTable_.begin(); s != sectorTable_.end(); ++s) {
-    std::vector<Value>& sector = s->second;
-    for (size_t p = 0; p < sectorLength; ++p) {
-      if (sector[p] != nullValue_) {
-        return typename DenseSectorTable<Value>::iterator(this, s, p);
+  template<typename Op>
+  DenseSectorTableOccupancyBitmap combine(const Op& op, const DenseSectorTableOccupancyBitmap& rhs, bool includeRhsOnly) const {
+    DenseSectorTableOccupancyBitmap result;
+    result.simdEnabled_ = simdEnabled_;
+    DenseSectorTableOccupancyBitmapSector sector;
+    for (auto& s : sectors_) {
+      apply(op, sector.words, s.second.words, rhs.findWords(s.first));
+      result.insertSector(s.first, sector);
+    }
+    if (includeRhsOnly) {
+      for (auto& s : rhs.sectors_) {
+        if (sectors_.find(s.first) == sectors_.end()) {
+          apply(op, sector.words, zeroWords(), s.second.words);
+          result.insertSector(s.first, sector);
+        }
       }
     }
+    return result;
   }
-  return typename DenseSectorTable<Value>::iterator(this, sectorTable_.end(), 0);
-}
 
-template<typename Value>
-typename DenseSectorTable<Value>::const_iterator
-DenseSectorTable<Value>::beginPoint() const
-{
-  size_t sectorLength = sectorSize_ * sectorSize_;
-  for (auto s = sectorTable_.begin(); s != sectorTable_.end(); ++s) {
-    const std::vector<Value>& sector = s->second;
-    for (size_t p = 0; p < sectorLength; ++p) {
-      if (sector[p] != nullValue_) {
-        return typename DenseSectorTable<Value>::const_iterator(this, s, p);
+  // note: Calls computeSector(result, sectorCoordinates) for each sector of the result of a
+  // shift by (dx, dy) sectors or less: each sector of this bitmap, and its neighbor in the
+  // direction of the shift.
+  template<typename ComputeSector>
+  DenseSectorTableOccupancyBitmap shiftedSectors(int dx, int dy, ComputeSector computeSector) const {
+    DenseSectorTableOccupancyBitmap result;
+    result.simdEnabled_ = simdEnabled_;
+    for (auto& s : sectors_) {
+      std::pair<int, int> neighborCoordinates(s.first.first + dx, s.first.second + dy);
+      computeSector(&result, s.first);
+      if (sectors_.find(neighborCoordinates) == sectors_.end()) {
+        computeSector(&result, neighborCoordinates);
       }
     }
+    return result;
   }
-  return typename DenseSectorTable<Value>::const_iterator(this, sectorTable_.end(), 0);
-}
-
-template<typename Value>
-typename DenseSectorTable<Value>::iterator
-DenseSectorTable<Value>::endPoint()
-{
-  return typename DenseSectorTable<Value>::iterator(this, sectorTable_.end(), 0);
-}
 
-template<typename Value>
-typename DenseSectorTable<Value>::const_iterator
-DenseSectorTable<Value>::endPoint() const
-{
-  return typename DenseSectorTable<Value>::const_iterator(this, sectorTable_.end(), 0);
-}
-
-template<typename Value>
-typename DenseSectorTable<Value>::iterator
-DenseSectorTable<Value>::findPoint(int x, int y)
-{
-  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
-  if (s == sectorTable_.end()) {
-    return typename DenseSectorTable<Value>::iterator(this, s, 0);
-  }
-  auto& sector = s->second;
-  size_t p = getPointIndexInSector(x, y);
-  assert(p < sectorSize_ * sectorSize_);
-  if (sector[p] == nullValue_) {
-    return typename DenseSectorTable<Value>::iterator(this, sectorTable_.end(), 0);
+  DenseSectorTableOccupancyBitmap shiftedColumns(int dx) const {
+    if (dx == 0) {
+      return *this;
+    }
+    const int lastColumn = static_cast<int>(SectorSize) - 1;
+    // note: Columns move within each row of each word; the column which leaves a sector
+    // enters its neighbor at the opposite edge.
+    DenseSectorTableShiftMergeOp op = (dx > 0
+                                       ? DenseSectorTableShiftMergeOp(true, 1, ~columnMask(0), lastColumn, columnMask(0))
+                                       : DenseSectorTableShiftMergeOp(false, 1, ~columnMask(SectorSize - 1), lastColumn, columnMask(SectorSize - 1)));
+    return shiftedSectors(dx, 0, [this, dx, &op](DenseSectorTableOccupancyBitmap *result, std::pair<int, int> sectorCoordinates) {
+      DenseSectorTableOccupancyBitmapSector sector;
+      this->apply(op, sector.words, this->findWords(sectorCoordinates),
+                  this->findWords(std::make_pair(sectorCoordinates.first - dx, sectorCoordinates.second)));
+      result->insertSector(sectorCoordinates, sector);
+    });
   }
-  return typename DenseSectorTable<Value>::iterator(this, s, p);
-}
 
-template<typename Value>
-typename DenseSectorTable<Value>::const_iterator
-DenseSectorTable<Value>::findPoint(int x, int y) const
-{
-  auto s = sectorTable_.find(getSectorCoordinatesInTable(x, y));
-  if (s == sectorTable_.end()) {
-    return typename DenseSectorTable<Value>::const_iterator(this, s, 0);
+  DenseSectorTableOccupancyBitmap shiftedRows(int dy) const {
+    if (dy == 0) {
+      return *this;
+    }
+    const int rowBits = static_cast<int>(SectorSize);
+    // note: Rows move by whole rows within the sector's bits, so each word takes the rows
+    // shifted out of the word before or after it; the carry operand is those words, offset
+    // by one, with the neighboring sector's nearest word at the end.
+    DenseSectorTableShiftMergeOp op = (dy > 0
+                                       ? DenseSectorTableShiftMergeOp(true, rowBits, ~uint64_t(0), 64 - rowBits, ~uint64_t(0))
+                                       : DenseSectorTableShiftMergeOp(false, rowBits, ~uint64_t(0), 64 - rowBits, ~uint64_t(0)));
+    return shiftedSectors(0, dy, [this, dy, &op](DenseSectorTableOccupancyBitmap *result, std::pair<int, int> sectorCoordinates) {
+      const uint64_t *words = this->findWords(sectorCoordinates);
+      const uint64_t *neighborWords = this->findWords(std::make_pair(sectorCoordinates.first, sectorCoordinates.second - dy));
+      uint64_t carryWords[wordCount];
+      if (dy > 0) {
+        carryWords[0] = neighborWords[wordCount - 1];
+        for (size_t w = 1; w < wordCount; ++w) {
+          carryWords[w] = words[w - 1];
+        }
+      } else {
+        for (size_t w = 0; w + 1 < wordCount; ++w) {
+          carryWords[w] = words[w + 1];
+        }
+        carryWords[wordCount - 1] = neighborWords[0];
+      }
+      DenseSectorTableOccupancyBitmapSector sector;
+      this->apply(op, sector.words, words, carryWords);
+      result->insertSector(sectorCoordinates, sector);
+    });
   }
-  auto& sector = s->second;
-  size_t p = getPointIndexInSector(x, y);
-  assert(p < sectorSize_ * sectorSize_);
-  if (sector[p] == nullValue_) {
-    return typename DenseSectorTable<Value>::const_iterator(this, sectorTable_.end(), 0);
+
+  // note: Counts neighbors with a bit-sliced adder: four bitmaps ("planes") hold the bits
+  // of each point's count, and each of the eight shifted copies of the bitmap is added in
+  // with word operations.
+  DenseSectorTableOccupancyBitmap neighborCountInRange(int minCount, int maxCount) const {
+    assert(minCount >= 0 && minCount <= maxCount && maxCount <= 8);
+    DenseSectorTableOccupancyBitmap left = shiftedColumns(1);
+    DenseSectorTableOccupancyBitmap right = shiftedColumns(-1);
+    const DenseSectorTableOccupancyBitmap *columns[3] = { &left, this, &right };
+    std::vector<DenseSectorTableOccupancyBitmap> neighbors;
+    neighbors.reserve(8);
+    for (const DenseSectorTableOccupancyBitmap *c : columns) {
+      neighbors.push_back(c->shiftedRows(1));
+      neighbors.push_back(c->shiftedRows(-1));
+      if (c != this) {
+        neighbors.push_back(*c);
+      }
+    }
+    DenseSectorTableOccupancyBitmap result;
+    result.simdEnabled_ = simdEnabled_;
+    DenseSectorTableOccupancyBitmap visited;
+    for (auto& n : neighbors) {
+      for (auto& s : n.sectors_) {
+        if (visited.sectors_.find(s.first) != visited.sectors_.end()) {
+          continue;
+        }
+        visited.sectors_.emplace(s.first, DenseSectorTableOccupancyBitmapSector());
+        DenseSectorTableOccupancyBitmapSector planes[4];
+        DenseSectorTableOccupancyBitmapSector carry;
+        DenseSectorTableOccupancyBitmapSector nextCarry;
+        for (auto& addend : neighbors) {
+          memcpy(carry.words, addend.findWords(s.first), sizeof(carry.words));
+          for (auto& plane : planes) {
+            apply(DenseSectorTableAndOp(), nextCarry.words, plane.words, carry.words);
+            apply(DenseSectorTableXorOp(), plane.words, plane.words, carry.words);
+            std::swap(carry, nextCarry);
+          }
+        }
+        DenseSectorTableOccupancyBitmapSector sector;
+        for (int count = minCount; count <= maxCount; ++count) {
+          DenseSectorTableOccupancyBitmapSector match;
+          memset(match.words, 0xFF, sizeof(match.words));
+          for (int b = 0; b < 4; ++b) {
+            if ((count >> b) & 1) {
+              apply(DenseSectorTableAndOp(), match.words, match.words, planes[b].words);
+            } else {
+              apply(DenseSectorTableAndNotOp(), match.words, match.words, planes[b].words);
+            }
+          }
+          if (count == 0) {
+            apply(DenseSectorTableAndOp(), match.words, match.words, findWords(s.first));
+          }
+          apply(DenseSectorTableOrOp(), sector.words, sector.words, match.words);
+        }
+        result.insertSector(s.first, sector);
+      }
+    }
+    return result;
   }
-  return typename DenseSectorTable<Value>::const_iterator(this, s, p);
-}
+
+  DenseSectorTableOccupancyBitmapSectors sectors_;
+  bool simdEnabled_;
+};
 
 } /* namespace HLCommon */
 
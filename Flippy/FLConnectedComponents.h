@@ -0,0 +1,267 @@
+//
+//  FLConnectedComponents.h
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#ifndef __Flippy__FLConnectedComponents__
+#define __Flippy__FLConnectedComponents__
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * Tracks the connected components of a graph whose nodes ("elements") are small integer
+ * ids, like segment handles, using a union-find (disjoint set) structure.
+ *
+ * Adding an element or an edge is (nearly) constant time: the caller inserts the element
+ * and unites it with each of its neighbors.  Removing an element or an edge can split a
+ * component, which union-find can't do; instead, the component is marked dirty, and it is
+ * rebuilt the next time it is queried.  To rebuild it, the caller passes a neighbors
+ * function to getComponent(), which is called for each remaining member of the component
+ * and fills a vector with that member's current neighbors.  Only the dirty component is
+ * rebuilt, and any number of removals from it are handled by a single rebuild.
+ *
+ * The caller must keep the structure consistent with the graph: every edge added must be
+ * passed to unite(), and every element which loses an edge (but remains) must be passed to
+ * invalidate().
+ *
+ * Each component keeps a circular list of its members, so that members can be listed in
+ * time proportional to the size of the component.  Removed elements stay in their
+ * component's parent tree and member list (as tombstones) until it is rebuilt, so their
+ * element ids can be reused right away.
+ */
+class FLConnectedComponents
+{
+public:
+
+  typedef uint32_t Element;
+
+  FLConnectedComponents() : slots_(1), elementCount_(0), tombstoneCount_(0) {}
+
+  bool contains(Element element) const {
+    return element < slotIndexes_.size() && slotIndexes_[element] != FLSlotIndexNull;
+  }
+
+  size_t size() const { return elementCount_; }
+
+  /**
+   * Adds an element as a component of its own.  No-op if the element is already present.
+   */
+  void insert(Element element) {
+    if (contains(element)) {
+      return;
+    }
+    if (element >= slotIndexes_.size()) {
+      slotIndexes_.resize(element + 1, uint32_t(FLSlotIndexNull));
+    }
+    uint32_t s;
+    if (freeSlotIndexes_.empty()) {
+      s = static_cast<uint32_t>(slots_.size());
+      slots_.emplace_back();
+    } else {
+      s = freeSlotIndexes_.back();
+      freeSlotIndexes_.pop_back();
+    }
+    FLSlot& slot = slots_[s];
+    slot.parent = s;
+    slot.next = s;
+    slot.size = 1;
+    slot.element = element;
+    slot.live = true;
+    slot.dirty = false;
+    slotIndexes_[element] = s;
+    ++elementCount_;
+  }
+
+  /**
+   * Records an edge between two (present) elements, merging their components.
+   */
+  void unite(Element a, Element b) {
+    assert(contains(a) && contains(b));
+    uint32_t rootA = findRoot(slotIndexes_[a]);
+    uint32_t rootB = findRoot(slotIndexes_[b]);
+    if (rootA == rootB) {
+      return;
+    }
+    // note: Union by size; splicing the two circular member lists is a swap.
+    if (slots_[rootA].size < slots_[rootB].size) {
+      std::swap(rootA, rootB);
+    }
+    FLSlot& slotA = slots_[rootA];
+    FLSlot& slotB = slots_[rootB];
+    slotB.parent = rootA;
+    slotA.size += slotB.size;
+    slotA.dirty = slotA.dirty || slotB.dirty;
+    std::swap(slotA.next, slotB.next);
+  }
+
+  /**
+   * Removes an element (and so all its edges).  No-op if the element isn't present.
+   */
+  void erase(Element element) {
+    if (!contains(element)) {
+      return;
+    }
+    uint32_t s = slotIndexes_[element];
+    uint32_t root = findRoot(s);
+    slotIndexes_[element] = FLSlotIndexNull;
+    --elementCount_;
+    if (slots_[root].size == 1) {
+      // note: The only member of its component; nothing else refers to it.
+      freeSlot(s);
+      return;
+    }
+    slots_[s].live = false;
+    slots_[root].dirty = true;
+    ++tombstoneCount_;
+  }
+
+  /**
+   * Notes that some edge of a (present) element has been removed, so that its component
+   * might have split.
+   */
+  void invalidate(Element element) {
+    assert(contains(element));
+    slots_[findRoot(slotIndexes_[element])].dirty = true;
+  }
+
+  void clear() {
+    slots_.resize(1);
+    slotIndexes_.clear();
+    freeSlotIndexes_.clear();
+    elementCount_ = 0;
+    tombstoneCount_ = 0;
+  }
+
+  /**
+   * Gets the members (including the passed element) of the component containing the
+   * passed (present) element, rebuilding the component first if it is dirty.  The
+   * neighbors function is called as neighbors(Element, std::vector<Element> *) to get the
+   * current neighbors of an element for a rebuild.
+   */
+  template<typename NeighborsFunction>
+  void getComponent(Element element, NeighborsFunction neighbors, std::vector<Element> *members) {
+    assert(contains(element));
+    uint32_t root = findRoot(slotIndexes_[element]);
+    if (slots_[root].dirty) {
+      rebuild(root, neighbors);
+      root = findRoot(slotIndexes_[element]);
+    }
+    members->clear();
+    members->reserve(slots_[root].size);
+    uint32_t s = root;
+    do {
+      if (slots_[s].live) {
+        members->push_back(slots_[s].element);
+      }
+      s = slots_[s].next;
+    } while (s != root);
+  }
+
+  /**
+   * Returns true if removed elements awaiting a rebuild outnumber present ones; the caller
+   * may then want to call rebuildDirty() to reclaim their memory.
+   */
+  bool needsCompaction() const {
+    return tombstoneCount_ > FLCompactionTombstoneMin && tombstoneCount_ > elementCount_;
+  }
+
+  /**
+   * Rebuilds all dirty components.
+   */
+  template<typename NeighborsFunction>
+  void rebuildDirty(NeighborsFunction neighbors) {
+    // note: Collect roots first, since rebuilding changes the parent trees.
+    std::vector<uint32_t> dirtyRoots;
+    for (uint32_t s = 1; s < slots_.size(); ++s) {
+      if (slots_[s].parent == s && slots_[s].dirty) {
+        dirtyRoots.push_back(s);
+      }
+    }
+    for (uint32_t root : dirtyRoots) {
+      rebuild(root, neighbors);
+    }
+  }
+
+private:
+
+  static const uint32_t FLSlotIndexNull = 0;
+  static const size_t FLCompactionTombstoneMin = 1024;
+
+  struct FLSlot
+  {
+    uint32_t parent;
+    uint32_t next;
+    uint32_t size;
+    Element element;
+    bool live;
+    bool dirty;
+  };
+
+  uint32_t findRoot(uint32_t s) {
+    // note: Path halving.
+    while (slots_[s].parent != s) {
+      slots_[s].parent = slots_[slots_[s].parent].parent;
+      s = slots_[s].parent;
+    }
+    return s;
+  }
+
+  void freeSlot(uint32_t s) {
+    // note: Free slots must not look like dirty roots to rebuildDirty().
+    slots_[s].live = false;
+    slots_[s].dirty = false;
+    freeSlotIndexes_.push_back(s);
+  }
+
+  template<typename NeighborsFunction>
+  void rebuild(uint32_t root, NeighborsFunction neighbors) {
+    // Split the component into its live members, freeing tombstones.
+    std::vector<Element> members;
+    members.reserve(slots_[root].size);
+    uint32_t s = root;
+    do {
+      uint32_t next = slots_[s].next;
+      if (slots_[s].live) {
+        members.push_back(slots_[s].element);
+      } else {
+        freeSlot(s);
+        --tombstoneCount_;
+      }
+      s = next;
+    } while (s != root);
+    for (Element member : members) {
+      uint32_t m = slotIndexes_[member];
+      FLSlot& slot = slots_[m];
+      slot.parent = m;
+      slot.next = m;
+      slot.size = 1;
+      slot.dirty = false;
+    }
+
+    // Unite members according to their current edges.
+    std::vector<Element> memberNeighbors;
+    for (Element member : members) {
+      memberNeighbors.clear();
+      neighbors(member, &memberNeighbors);
+      for (Element memberNeighbor : memberNeighbors) {
+        if (contains(memberNeighbor)) {
+          unite(member, memberNeighbor);
+        }
+      }
+    }
+  }
+
+  std::vector<FLSlot> slots_;
+  std::vector<uint32_t> slotIndexes_;
+  std::vector<uint32_t> freeSlotIndexes_;
+  size_t elementCount_;
+  size_t tombstoneCount_;
+};
+
+#endif /* defined(__Flippy__FLConnectedComponents__) */
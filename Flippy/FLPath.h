@@ -85,6 +85,9 @@ public:
   static CGFloat getLength(FLPathType pathType);
   CGFloat getLength() const { return FLPath::getLength(pathType_); }
   CGFloat getClosestOnPathPoint(CGPoint *onPathPoint, CGFloat *onPathProgress, CGPoint offPathPoint, CGFloat progressPrecision) const;
+  // note: A rectangle containing the path: for cubic paths, the bounds of the control
+  // points (which contain the curve), so not necessarily tight.
+  CGRect getBounds() const;
 private:
   CGPoint getPointLinear(CGFloat progress) const;
   CGPoint getPointCubic(CGFloat progress) const;
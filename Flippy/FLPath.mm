@@ -242,6 +242,37 @@ FLPath::getClosestOnPathPoint(CGPoint *onPathPoint, CGFloat *onPathProgress, CGP
   return 0.0f;
 }
 
+CGRect
+FLPath::getBounds() const
+{
+  int pointCount;
+  switch (pathType_) {
+    case FLPathTypeStraight:
+    case FLPathTypeHalfLeft:
+    case FLPathTypeHalfRight:
+      pointCount = 2;
+      break;
+    case FLPathTypeCurve:
+    case FLPathTypeJogLeft:
+    case FLPathTypeJogRight:
+      pointCount = 4;
+      break;
+    default:
+      return CGRectNull;
+  }
+  CGFloat minX = points_[0].x;
+  CGFloat maxX = points_[0].x;
+  CGFloat minY = points_[0].y;
+  CGFloat maxY = points_[0].y;
+  for (int p = 1; p < pointCount; ++p) {
+    minX = fmin(minX, points_[p].x);
+    maxX = fmax(maxX, points_[p].x);
+    minY = fmin(minY, points_[p].y);
+    maxY = fmax(maxY, points_[p].y);
+  }
+  return CGRectMake(minX, minY, maxX - minX, maxY - minY);
+}
+
 CGFloat
 FLPath::getLength(FLPathType pathType)
 {
@@ -0,0 +1,336 @@
+//
+//  FLSegment.cpp
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#include "FLSegment.h"
+
+// note: The connection ports of each segment type at each rotation: the ends of its paths,
+// listed in path order (and for each path, progress 0 then progress 1).  Each port gives its
+// location in half-segment units relative to the segment center (so corners are (+/-1,
+// +/-1), and edge midpoints have a zero), and the direction of the path's tangent there, in
+// quarters.  These are the values that FLPath::getPoint() and FLPath::getTangent() return
+// at the path ends, precomputed so that connections can be found by integer comparison;
+// see segmentGetPorts().  Must be kept in sync with FLSegmentNode's paths (which is checked
+// by FLSegmentNodeTests).
+struct FLSegmentNodePorts
+{
+  int portCount;
+  FLSegmentNodePort ports[FLSegmentNodePortsMax];
+};
+
+static const int FLSegmentNodePortsTypeCount = FLSegmentTypePixel + 1;
+
+static const FLSegmentNodePorts FLSegmentNodePortTable[FLSegmentNodePortsTypeCount][4] = {
+  // FLSegmentTypeNone
+  {
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+  },
+  // FLSegmentTypeStraight
+  {
+    { 2, { { 0, 0, -1,  1, 0 }, { 0, 1,  1,  1, 0 } } },
+    { 2, { { 0, 0, -1, -1, 1 }, { 0, 1, -1,  1, 1 } } },
+    { 2, { { 0, 0,  1, -1, 2 }, { 0, 1, -1, -1, 2 } } },
+    { 2, { { 0, 0,  1,  1, 3 }, { 0, 1,  1, -1, 3 } } },
+  },
+  // FLSegmentTypeCurve
+  {
+    { 2, { { 0, 0,  1, -1, 1 }, { 0, 1, -1,  1, 2 } } },
+    { 2, { { 0, 0,  1,  1, 2 }, { 0, 1, -1, -1, 3 } } },
+    { 2, { { 0, 0, -1,  1, 3 }, { 0, 1,  1, -1, 0 } } },
+    { 2, { { 0, 0, -1, -1, 0 }, { 0, 1,  1,  1, 1 } } },
+  },
+  // FLSegmentTypeJoinLeft
+  {
+    { 4, { { 0, 0,  1, -1, 1 }, { 0, 1, -1,  1, 2 }, { 1, 0, -1,  1, 0 }, { 1, 1,  1,  1, 0 } } },
+    { 4, { { 0, 0,  1,  1, 2 }, { 0, 1, -1, -1, 3 }, { 1, 0, -1, -1, 1 }, { 1, 1, -1,  1, 1 } } },
+    { 4, { { 0, 0, -1,  1, 3 }, { 0, 1,  1, -1, 0 }, { 1, 0,  1, -1, 2 }, { 1, 1, -1, -1, 2 } } },
+    { 4, { { 0, 0, -1, -1, 0 }, { 0, 1,  1,  1, 1 }, { 1, 0,  1,  1, 3 }, { 1, 1,  1, -1, 3 } } },
+  },
+  // FLSegmentTypeJoinRight
+  {
+    { 4, { { 0, 0,  1,  1, 2 }, { 0, 1, -1, -1, 3 }, { 1, 0, -1,  1, 0 }, { 1, 1,  1,  1, 0 } } },
+    { 4, { { 0, 0, -1,  1, 3 }, { 0, 1,  1, -1, 0 }, { 1, 0, -1, -1, 1 }, { 1, 1, -1,  1, 1 } } },
+    { 4, { { 0, 0, -1, -1, 0 }, { 0, 1,  1,  1, 1 }, { 1, 0,  1, -1, 2 }, { 1, 1, -1, -1, 2 } } },
+    { 4, { { 0, 0,  1, -1, 1 }, { 0, 1, -1,  1, 2 }, { 1, 0,  1,  1, 3 }, { 1, 1,  1, -1, 3 } } },
+  },
+  // FLSegmentTypeJogLeft
+  {
+    { 2, { { 0, 0, -1, -1, 0 }, { 0, 1,  1,  1, 0 } } },
+    { 2, { { 0, 0,  1, -1, 1 }, { 0, 1, -1,  1, 1 } } },
+    { 2, { { 0, 0, -1, -1, 0 }, { 0, 1,  1,  1, 0 } } },
+    { 2, { { 0, 0,  1, -1, 1 }, { 0, 1, -1,  1, 1 } } },
+  },
+  // FLSegmentTypeJogRight
+  {
+    { 2, { { 0, 0, -1,  1, 0 }, { 0, 1,  1, -1, 0 } } },
+    { 2, { { 0, 0, -1, -1, 1 }, { 0, 1,  1,  1, 1 } } },
+    { 2, { { 0, 0, -1,  1, 0 }, { 0, 1,  1, -1, 0 } } },
+    { 2, { { 0, 0, -1, -1, 1 }, { 0, 1,  1,  1, 1 } } },
+  },
+  // FLSegmentTypeCross
+  {
+    { 4, { { 0, 0, -1, -1, 0 }, { 0, 1,  1,  1, 0 }, { 1, 0, -1,  1, 0 }, { 1, 1,  1, -1, 0 } } },
+    { 4, { { 0, 0,  1, -1, 1 }, { 0, 1, -1,  1, 1 }, { 1, 0, -1, -1, 1 }, { 1, 1,  1,  1, 1 } } },
+    { 4, { { 0, 0, -1, -1, 0 }, { 0, 1,  1,  1, 0 }, { 1, 0, -1,  1, 0 }, { 1, 1,  1, -1, 0 } } },
+    { 4, { { 0, 0,  1, -1, 1 }, { 0, 1, -1,  1, 1 }, { 1, 0, -1, -1, 1 }, { 1, 1,  1,  1, 1 } } },
+  },
+  // FLSegmentTypePlatformLeft
+  {
+    { 2, { { 0, 0,  0,  1, 0 }, { 0, 1,  1,  1, 0 } } },
+    { 2, { { 0, 0, -1,  0, 1 }, { 0, 1, -1,  1, 1 } } },
+    { 2, { { 0, 0,  0, -1, 2 }, { 0, 1, -1, -1, 2 } } },
+    { 2, { { 0, 0,  1,  0, 3 }, { 0, 1,  1, -1, 3 } } },
+  },
+  // FLSegmentTypePlatformStartLeft
+  {
+    { 2, { { 0, 0,  0,  1, 0 }, { 0, 1,  1,  1, 0 } } },
+    { 2, { { 0, 0, -1,  0, 1 }, { 0, 1, -1,  1, 1 } } },
+    { 2, { { 0, 0,  0, -1, 2 }, { 0, 1, -1, -1, 2 } } },
+    { 2, { { 0, 0,  1,  0, 3 }, { 0, 1,  1, -1, 3 } } },
+  },
+  // FLSegmentTypeReadoutInput
+  {
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+  },
+  // FLSegmentTypeReadoutOutput
+  {
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+  },
+  // FLSegmentTypePlatformRight
+  {
+    { 2, { { 0, 0,  0,  1, 2 }, { 0, 1, -1,  1, 2 } } },
+    { 2, { { 0, 0, -1,  0, 3 }, { 0, 1, -1, -1, 3 } } },
+    { 2, { { 0, 0,  0, -1, 0 }, { 0, 1,  1, -1, 0 } } },
+    { 2, { { 0, 0,  1,  0, 1 }, { 0, 1,  1,  1, 1 } } },
+  },
+  // FLSegmentTypePlatformStartRight
+  {
+    { 2, { { 0, 0,  0,  1, 2 }, { 0, 1, -1,  1, 2 } } },
+    { 2, { { 0, 0, -1,  0, 3 }, { 0, 1, -1, -1, 3 } } },
+    { 2, { { 0, 0,  0, -1, 0 }, { 0, 1,  1, -1, 0 } } },
+    { 2, { { 0, 0,  1,  0, 1 }, { 0, 1,  1,  1, 1 } } },
+  },
+  // FLSegmentTypePixel
+  {
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+    { 0, { } },
+  },
+};
+
+static inline int
+FL_normalizeRotationQuarters(int rotationQuarters)
+{
+  rotationQuarters %= 4;
+  if (rotationQuarters < 0) {
+    rotationQuarters += 4;
+  }
+  return rotationQuarters;
+}
+
+int
+segmentGetConnectingPorts(const FLSegmentNodePort& fromPort, int cornerHalfX, int cornerHalfY,
+                          int gridX, int gridY, const FLSegmentNodePort *ports, int portCount,
+                          int *connectingPortIndexes)
+{
+  int connectingCount = 0;
+  int connectedPathId = -1;
+  for (int p = 0; p < portCount; ++p) {
+    const FLSegmentNodePort& port = ports[p];
+    if (port.pathId == connectedPathId
+        || gridX * 2 + port.halfX != cornerHalfX
+        || gridY * 2 + port.halfY != cornerHalfY
+        || !segmentPortsConnect(fromPort, port)) {
+      continue;
+    }
+    connectingPortIndexes[connectingCount] = p;
+    ++connectingCount;
+    connectedPathId = port.pathId;
+  }
+  return connectingCount;
+}
+
+bool
+segmentTypeIsValid(FLSegmentType segmentType)
+{
+  return segmentType > FLSegmentTypeNone && segmentType < FLSegmentNodePortsTypeCount;
+}
+
+int
+segmentPathCount(FLSegmentType segmentType)
+{
+  switch (segmentType) {
+    case FLSegmentTypeStraight:
+    case FLSegmentTypeCurve:
+    case FLSegmentTypeJogLeft:
+    case FLSegmentTypeJogRight:
+    case FLSegmentTypePlatformLeft:
+    case FLSegmentTypePlatformRight:
+    case FLSegmentTypePlatformStartLeft:
+    case FLSegmentTypePlatformStartRight:
+      return 1;
+    case FLSegmentTypeJoinLeft:
+    case FLSegmentTypeJoinRight:
+    case FLSegmentTypeCross:
+      return 2;
+    case FLSegmentTypeReadoutInput:
+    case FLSegmentTypeReadoutOutput:
+    case FLSegmentTypePixel:
+    case FLSegmentTypeNone:
+    default:
+      return 0;
+  }
+}
+
+int
+segmentGetPorts(FLSegmentType segmentType, int rotationQuarters, FLSegmentNodePort *ports)
+{
+  if (!segmentTypeIsValid(segmentType)) {
+    return 0;
+  }
+  const FLSegmentNodePorts& segmentPorts = FLSegmentNodePortTable[segmentType][FL_normalizeRotationQuarters(rotationQuarters)];
+  for (int p = 0; p < segmentPorts.portCount; ++p) {
+    ports[p] = segmentPorts.ports[p];
+  }
+  return segmentPorts.portCount;
+}
+
+bool
+segmentCanSwitch(FLSegmentType segmentType)
+{
+  return segmentType == FLSegmentTypeJoinLeft
+    || segmentType == FLSegmentTypeJoinRight
+    || segmentType == FLSegmentTypeReadoutInput
+    || segmentType == FLSegmentTypeReadoutOutput
+    || segmentType == FLSegmentTypePixel;
+}
+
+bool
+segmentDoesSwitch(FLSegmentType segmentType)
+{
+  return segmentType == FLSegmentTypeJoinLeft || segmentType == FLSegmentTypeJoinRight;
+}
+
+int
+segmentSwitchProgress(FLSegmentType segmentType, int pathId)
+{
+  // note: For a left join, the curve (path 0) ends at the switch, and the straight (path
+  // 1) starts there; a right join is the other way around.
+  switch (segmentType) {
+    case FLSegmentTypeJoinLeft:
+      if (pathId == 0) {
+        return 1;
+      } else if (pathId == 1) {
+        return 0;
+      }
+      break;
+    case FLSegmentTypeJoinRight:
+      if (pathId == 0) {
+        return 0;
+      } else if (pathId == 1) {
+        return 1;
+      }
+      break;
+    default:
+      break;
+  }
+  return -1;
+}
+
+bool
+segmentCanFlip(FLSegmentType segmentType)
+{
+  // note: For now, determine canFlip based only on segmentType and not orientation (e.g. for
+  // a straight segment at rotation 0, a horizontal flip won't actually change anything, and
+  // so could be disallowed).  Keeping flippability separate from orientation makes things
+  // easier for our current callers, because then they don't have to keep checking back at
+  // each rotation change.
+  return (segmentType != FLSegmentTypeReadoutInput && segmentType != FLSegmentTypeReadoutOutput);
+}
+
+bool
+segmentFlip(FLSegmentType *segmentType, int *rotationQuarters, FLSegmentFlipDirection flipDirection)
+{
+  // note: Segments with a "handedness" flip to the other hand, and then (depending on the
+  // flip direction) rotate by half a turn.
+  bool flipsAcross = ((*rotationQuarters + static_cast<int>(flipDirection)) % 2 != 0);
+  switch (*segmentType) {
+    case FLSegmentTypeStraight:
+      if (flipsAcross) {
+        *rotationQuarters += 2;
+      }
+      break;
+    case FLSegmentTypeCurve:
+      *rotationQuarters += (flipsAcross ? 3 : 1);
+      break;
+    case FLSegmentTypeJoinLeft:
+      *segmentType = FLSegmentTypeJoinRight;
+      if (flipsAcross) {
+        *rotationQuarters += 2;
+      }
+      break;
+    case FLSegmentTypeJoinRight:
+      *segmentType = FLSegmentTypeJoinLeft;
+      if (flipsAcross) {
+        *rotationQuarters += 2;
+      }
+      break;
+    case FLSegmentTypeJogLeft:
+      *segmentType = FLSegmentTypeJogRight;
+      break;
+    case FLSegmentTypeJogRight:
+      *segmentType = FLSegmentTypeJogLeft;
+      break;
+    case FLSegmentTypeCross:
+      // note: Cross has both vertical and horizontal symmetry in all rotations.
+      break;
+    case FLSegmentTypePlatformLeft:
+      *segmentType = FLSegmentTypePlatformRight;
+      if (flipsAcross) {
+        *rotationQuarters += 2;
+      }
+      break;
+    case FLSegmentTypePlatformRight:
+      *segmentType = FLSegmentTypePlatformLeft;
+      if (flipsAcross) {
+        *rotationQuarters += 2;
+      }
+      break;
+    case FLSegmentTypePlatformStartLeft:
+      *segmentType = FLSegmentTypePlatformStartRight;
+      if (flipsAcross) {
+        *rotationQuarters += 2;
+      }
+      break;
+    case FLSegmentTypePlatformStartRight:
+      *segmentType = FLSegmentTypePlatformStartLeft;
+      if (flipsAcross) {
+        *rotationQuarters += 2;
+      }
+      break;
+    case FLSegmentTypePixel:
+      // note: Pixel has both vertical and horizontal symmetry in all rotations.
+      break;
+    case FLSegmentTypeReadoutInput:
+    case FLSegmentTypeReadoutOutput:
+    case FLSegmentTypeNone:
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,248 @@
+//
+//  FLSegment.h
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#ifndef __Flippy__FLSegment__
+#define __Flippy__FLSegment__
+
+#include <cstdint>
+#include <type_traits>
+
+// note: Segment types are shared with Objective-C code (where they are NS_ENUMs, and
+// where FLSegmentNode is the main client), but nothing here depends on Apple frameworks,
+// so that the segment model can be compiled and tested anywhere.  Both branches must
+// declare the same underlying type, since the same enums are used from Objective-C++ and
+// plain C++ translation units in one program.  (That type can't be NSInteger, which is
+// int on 32-bit devices but long on 64-bit ones; so it is long everywhere.)
+#ifdef __OBJC__
+#import <Foundation/Foundation.h>
+#define FL_SEGMENT_ENUM(_name) typedef NS_ENUM(long, _name)
+#else
+#define FL_SEGMENT_ENUM(_name) enum _name : long
+#endif
+
+FL_SEGMENT_ENUM(FLSegmentType) {
+  FLSegmentTypeNone = 0,
+  FLSegmentTypeStraight,
+  FLSegmentTypeCurve,
+  FLSegmentTypeJoinLeft,
+  FLSegmentTypeJoinRight,
+  FLSegmentTypeJogLeft,
+  FLSegmentTypeJogRight,
+  FLSegmentTypeCross,
+  FLSegmentTypePlatformLeft,
+  FLSegmentTypePlatformStartLeft,
+  FLSegmentTypeReadoutInput,
+  FLSegmentTypeReadoutOutput,
+  FLSegmentTypePlatformRight,
+  FLSegmentTypePlatformStartRight,
+  FLSegmentTypePixel,
+};
+
+FL_SEGMENT_ENUM(FLSegmentFlipDirection) {
+  FLSegmentFlipHorizontal = 0,
+  FLSegmentFlipVertical = 1,
+};
+
+static_assert(std::is_same<std::underlying_type<FLSegmentType>::type, long>::value, "FLSegmentType must be long in every language.");
+static_assert(std::is_same<std::underlying_type<FLSegmentFlipDirection>::type, long>::value, "FLSegmentFlipDirection must be long in every language.");
+
+const char FLSegmentLabelNone = '\0';
+
+/**
+ * A port is the end of a path, where it can connect to the path of another segment.  The
+ * location is in half-segment units relative to the segment center (so corners are at
+ * (+/-1, +/-1)), and the tangent is the direction of the path there (in the direction of
+ * increasing progress), in quarters.
+ */
+struct FLSegmentNodePort
+{
+  int8_t pathId;
+  int8_t progress;
+  int8_t halfX;
+  int8_t halfY;
+  int8_t tangentQuarters;
+};
+
+static const int FLSegmentNodePortsMax = 4;
+
+/**
+ * Returns true if a path arriving at a location, with a tangent (in quarters) and
+ * progress there, continues into a path leaving from the same location with another
+ * tangent and progress: the tangents must be the same, or exactly opposite if the
+ * progresses are the same.  This is the one rule by which segment paths connect.  (See
+ * getConnectingPath.)
+ */
+inline bool
+segmentTangentsConnect(int fromTangentQuarters, int fromProgress, int toTangentQuarters, int toProgress)
+{
+  int rotationDifference = (fromTangentQuarters - toTangentQuarters) % 4;
+  if (rotationDifference < 0) {
+    rotationDifference += 4;
+  }
+  bool expectOpposite = ((fromProgress == 0) == (toProgress == 0));
+  return rotationDifference == (expectOpposite ? 2 : 0);
+}
+
+/**
+ * Returns true if a path arriving at a port (fromPort, of some segment) continues into
+ * a path leaving from another port (toPort, of a neighboring segment) at the same
+ * location.  (See segmentTangentsConnect.)
+ */
+inline bool
+segmentPortsConnect(const FLSegmentNodePort& fromPort, const FLSegmentNodePort& toPort)
+{
+  return segmentTangentsConnect(fromPort.tangentQuarters, fromPort.progress, toPort.tangentQuarters, toPort.progress);
+}
+
+/// @name Corner Connections
+
+// note: Currently segments only connect at corners.  Corners are addressed in half-segment
+// units, so they have odd coordinates, and the four cells around a corner are searched in
+// a fixed order -- left cells first, then bottom before top -- so that wherever
+// connections are found (FLTrackGrid, FLTrackGraph, FLTrackModel, and FLSegmentNode's
+// geometric search) the first segment found is the same.
+
+static const int FLSegmentCornerCellCount = 4;
+
+/**
+ * Returns true if the port is on a corner of its segment (and so can connect).
+ */
+inline bool
+segmentPortIsCorner(const FLSegmentNodePort& port)
+{
+  return (port.halfX == 1 || port.halfX == -1) && (port.halfY == 1 || port.halfY == -1);
+}
+
+/**
+ * Gets the grid location of a cell around a corner, by its index (less than
+ * FLSegmentCornerCellCount) in search order.
+ */
+inline void
+segmentCornerCell(int cornerHalfX, int cornerHalfY, int cellIndex, int *gridX, int *gridY)
+{
+  // note: Corner coordinates are odd, so these divisions are exact.
+  *gridX = (cornerHalfX - 1) / 2 + cellIndex / 2;
+  *gridY = (cornerHalfY - 1) / 2 + cellIndex % 2;
+}
+
+/**
+ * Returns the index in search order of a cell around a corner; the inverse of
+ * segmentCornerCell.
+ */
+inline int
+segmentCornerCellIndex(int cornerHalfX, int cornerHalfY, int gridX, int gridY)
+{
+  return (gridX * 2 > cornerHalfX ? 2 : 0) + (gridY * 2 > cornerHalfY ? 1 : 0);
+}
+
+/**
+ * Gets the ports of a segment (in the cell at gridX, gridY, with the passed ports) that a
+ * path leaving from fromPort at the corner (cornerHalfX, cornerHalfY) continues into.
+ * Once one end of a path connects, its other end isn't considered.  The connecting port
+ * indexes are returned in port order, in an array with room for FLSegmentNodePortsMax
+ * indexes.  Returns the number of connecting ports.
+ */
+int segmentGetConnectingPorts(const FLSegmentNodePort& fromPort, int cornerHalfX, int cornerHalfY,
+                              int gridX, int gridY, const FLSegmentNodePort *ports, int portCount,
+                              int *connectingPortIndexes);
+
+/// @name Segment Type Properties
+
+/**
+ * Returns true if the segment type is one of the defined types (other than
+ * FLSegmentTypeNone).
+ */
+bool segmentTypeIsValid(FLSegmentType segmentType);
+
+/**
+ * Returns the number of paths of a segment type, or zero if the type is invalid.
+ */
+int segmentPathCount(FLSegmentType segmentType);
+
+/**
+ * Gets the ports of a segment type at a rotation: the ends of its paths, ordered by path
+ * and then by progress.  The rotation need not be normalized.  The array must have room
+ * for FLSegmentNodePortsMax ports.  Returns the number of ports, which is zero if the
+ * type is invalid.
+ */
+int segmentGetPorts(FLSegmentType segmentType, int rotationQuarters, FLSegmentNodePort *ports);
+
+/**
+ * Returns true if the segment type stores a switch value.  (See FLSegmentNode for the
+ * distinction between storing a switch and drawing one.)
+ */
+bool segmentCanSwitch(FLSegmentType segmentType);
+
+/**
+ * Returns true if the segment type's switch chooses between its paths: that is, if the
+ * segment has paths which share an end, and a train leaving that end goes along the path
+ * selected by the switch.  Other segments that can switch (readouts and pixels) only
+ * store a value, and are switched by links.
+ */
+bool segmentDoesSwitch(FLSegmentType segmentType);
+
+/**
+ * Returns the progress (0 or 1) of the end of a path where it meets the switch, for a
+ * segment type that does switch: a train leaving from that end is "going with" the
+ * switch, and a train arriving at it is "going against" the switch and sets it to the
+ * path the train is on.  Returns -1 if the path is not switched.
+ */
+int segmentSwitchProgress(FLSegmentType segmentType, int pathId);
+
+bool segmentCanFlip(FLSegmentType segmentType);
+
+/**
+ * Flips a segment, changing its type and rotation as needed (so that, for instance, a
+ * left join becomes a right join).  Flipping is not stored separately from type and
+ * rotation.  Returns false if the segment type is invalid.
+ */
+bool segmentFlip(FLSegmentType *segmentType, int *rotationQuarters, FLSegmentFlipDirection flipDirection);
+
+/**
+ * A segment of track as a plain value: its type, location, and state, but nothing about
+ * how it is drawn.  FLSegmentNode presents the same properties (through the functions
+ * above) for segments in a scene.
+ *
+ * note: Links between segments are owned by the container (see FLTrackModel), as they
+ * are by FLLinks, rather than stored in each segment.
+ *
+ * note: FLSegmentNode does not (yet) store its state as an FLSegment; it keeps its own
+ * type, switch, and label, and its grid location is implied by its position.  Where a
+ * value is needed from a node, it is copied (as FLTrackGrid does for its snapshots and
+ * for FLTrackGraph).  Making the node a view over a stored FLSegment would touch all of
+ * its drawing and archiving code, and is left for later.
+ */
+struct FLSegment
+{
+  FLSegment()
+    : segmentType(FLSegmentTypeNone), gridX(0), gridY(0), rotationQuarters(0), switchPathId(1), label(FLSegmentLabelNone) {}
+
+  FLSegment(FLSegmentType segmentType_, int gridX_, int gridY_, int rotationQuarters_ = 0)
+    : segmentType(segmentType_), gridX(gridX_), gridY(gridY_), rotationQuarters(rotationQuarters_), switchPathId(1), label(FLSegmentLabelNone) {}
+
+  int pathCount() const { return segmentPathCount(segmentType); }
+
+  int getPorts(FLSegmentNodePort *ports) const { return segmentGetPorts(segmentType, rotationQuarters, ports); }
+
+  bool canSwitch() const { return segmentCanSwitch(segmentType); }
+
+  bool doesSwitch() const { return segmentDoesSwitch(segmentType); }
+
+  bool canFlip() const { return segmentCanFlip(segmentType); }
+
+  void flip(FLSegmentFlipDirection flipDirection) { segmentFlip(&segmentType, &rotationQuarters, flipDirection); }
+
+  FLSegmentType segmentType;
+  int gridX;
+  int gridY;
+  int rotationQuarters;
+  int switchPathId;
+  char label;
+};
+
+#endif /* defined(__Flippy__FLSegment__) */
@@ -10,6 +10,8 @@
 
 #include <vector>
 
+#include "FLSegment.h"
+
 FOUNDATION_EXPORT const CGFloat FLSegmentArtSizeFull;
 FOUNDATION_EXPORT const CGFloat FLSegmentArtSizeBasic;
 // "Track normal width" is the pixel width of the drawn tracks (widest: sleepers).
@@ -22,31 +24,6 @@ FOUNDATION_EXPORT const CGFloat FLSegmentArtInsideDrawnTrackInset;
 FOUNDATION_EXPORT const CGFloat FLSegmentArtStraightShift;
 FOUNDATION_EXPORT const CGFloat FLSegmentArtCurveShift;
 
-FOUNDATION_EXPORT const char FLSegmentLabelNone;
-
-typedef NS_ENUM(NSInteger, FLSegmentType) {
-  FLSegmentTypeNone = 0,
-  FLSegmentTypeStraight,
-  FLSegmentTypeCurve,
-  FLSegmentTypeJoinLeft,
-  FLSegmentTypeJoinRight,
-  FLSegmentTypeJogLeft,
-  FLSegmentTypeJogRight,
-  FLSegmentTypeCross,
-  FLSegmentTypePlatformLeft,
-  FLSegmentTypePlatformStartLeft,
-  FLSegmentTypeReadoutInput,
-  FLSegmentTypeReadoutOutput,
-  FLSegmentTypePlatformRight,
-  FLSegmentTypePlatformStartRight,
-  FLSegmentTypePixel,
-};
-
-typedef NS_ENUM(NSInteger, FLSegmentFlipDirection) {
-  FLSegmentFlipHorizontal = 0,
-  FLSegmentFlipVertical = 1,
-};
-
 inline int
 convertRotationRadiansToQuarters(CGFloat radians)
 {
@@ -169,6 +146,13 @@ convertRotationQuartersToRadians(int quarters)
 
 - (BOOL)getClosestOnTrackPoint:(CGPoint *)onTrackPoint distance:(CGFloat *)distance rotation:(CGFloat *)rotationRadians path:(int *)pathId progress:(CGFloat *)progress forOffTrackPoint:(CGPoint)offSegmentPoint scale:(CGFloat)scale precision:(CGFloat)progressPrecision;
 
+/**
+ * Gets a lower bound for the distance that getClosestOnTrackPoint would find for the
+ * passed point, at any precision, without searching the paths: the distance to their
+ * (precomputed) bounding box.  Returns NO if the segment has no paths.
+ */
+- (BOOL)getClosestOnTrackDistanceLowerBound:(CGFloat *)distanceLowerBound forOffTrackPoint:(CGPoint)offTrackPoint scale:(CGFloat)scale;
+
 /**
  * Returns true if a path can be found that connects to the passed end point.
  * Importantly: If more than one path connects at that point, and the segment switches
@@ -210,6 +194,13 @@ convertRotationQuartersToRadians(int quarters)
 
 - (int)pathCount;
 
+/**
+ * Gets the ports of the segment at its current rotation: the ends of its paths, ordered
+ * by path and then by progress.  The array must have room for FLSegmentNodePortsMax
+ * ports.  Returns the number of ports.
+ */
+- (int)getPorts:(FLSegmentNodePort *)ports;
+
 - (CGFloat)pathLengthForPath:(int)pathId;
 
 /**
@@ -228,4 +219,13 @@ convertRotationQuartersToRadians(int quarters)
  */
 - (int)pathDirectionGoingWithSwitchForPath:(int)pathId;
 
+/// @name Tracking Segments in a Track Grid
+
+/**
+ * The handle assigned to this node by the FLSegmentHandleTable of the track grid that
+ * holds it, or zero if none.  Maintained by the handle table (and not encoded or
+ * copied); kept on the node so that the table needs no reverse index.
+ */
+@property (nonatomic, assign) uint32_t trackGridHandle;
+
 @end
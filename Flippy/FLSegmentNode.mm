@@ -32,8 +32,6 @@ const CGFloat FLSegmentArtStraightShift = (FLSegmentArtSizeFull / 2.0f) - FLSegm
 // aliasing (?).
 const CGFloat FLSegmentArtCurveShift = floorf(FLSegmentArtDrawnTrackNormalWidth / 4.0f);
 
-const char FLSegmentLabelNone = '\0';
-
 static const unsigned int FLSegmentNodePathsMax = 2;
 
 static const CGFloat FLZPositionBubble = -0.3f;
@@ -71,6 +69,63 @@ static CGPoint FLReadoutInOutPosition = {
   FLReadoutValue0Position.y
 };
 
+/**
+ * Gets the paths of a segment type at a rotation; returns -1 if the segment type is invalid.
+ */
+static int
+FL_getAllPaths(FLSegmentType segmentType, int rotationQuarters, const FLPath **paths)
+{
+  // note: Increase FLSegmentNodePathsMax to match largest return value here.
+  switch (segmentType) {
+    case FLSegmentTypeStraight:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeStraight, rotationQuarters);
+      return 1;
+    case FLSegmentTypeCurve:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeCurve, rotationQuarters);
+      return 1;
+    case FLSegmentTypeJoinLeft:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeCurve, rotationQuarters);
+      paths[1] = FLPathStore::sharedStore()->getPath(FLPathTypeStraight, rotationQuarters);
+      return 2;
+    case FLSegmentTypeJoinRight:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeCurve, rotationQuarters + 1);
+      paths[1] = FLPathStore::sharedStore()->getPath(FLPathTypeStraight, rotationQuarters);
+      return 2;
+    case FLSegmentTypeJogLeft:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeJogLeft, rotationQuarters);
+      return 1;
+    case FLSegmentTypeJogRight:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeJogRight, rotationQuarters);
+      return 1;
+    case FLSegmentTypeCross:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeJogLeft, rotationQuarters);
+      paths[1] = FLPathStore::sharedStore()->getPath(FLPathTypeJogRight, rotationQuarters);
+      return 2;
+    case FLSegmentTypePlatformLeft:
+    case FLSegmentTypePlatformStartLeft:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeHalfLeft, rotationQuarters);
+      return 1;
+    case FLSegmentTypePlatformRight:
+    case FLSegmentTypePlatformStartRight:
+      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeHalfRight, rotationQuarters);
+      return 1;
+    case FLSegmentTypeReadoutInput:
+    case FLSegmentTypeReadoutOutput:
+    case FLSegmentTypePixel:
+      return 0;
+    case FLSegmentTypeNone:
+    default:
+      return -1;
+  }
+}
+
+// note: The bounds of the paths of each segment type at each rotation, in the unit square
+// of the segment, padded to allow for rounding error in path points.  (CGRectNull if the
+// segment has no paths.)  Used to reject segments cheaply in distance searches; see
+// getClosestOnTrackDistanceLowerBound.
+static const int FLSegmentNodePathBoundsTypeCount = FLSegmentTypePixel + 1;
+static CGRect FLSegmentNodePathBounds[FLSegmentNodePathBoundsTypeCount][4];
+
 static SKColor *FLSegmentArtPixel0Color;
 static SKColor *FLSegmentArtPixel1Color;
 
@@ -89,6 +144,22 @@ using namespace std;
 {
   FLSegmentArtPixel0Color = [SKColor colorWithWhite:0.0f alpha:0.75f];
   FLSegmentArtPixel1Color = [SKColor colorWithWhite:1.0f alpha:0.75f];
+
+  const CGFloat FLPathBoundsPad = 0.001f;
+  for (int t = 0; t < FLSegmentNodePathBoundsTypeCount; ++t) {
+    for (int r = 0; r < 4; ++r) {
+      const FLPath *paths[FLSegmentNodePathsMax];
+      int pathCount = FL_getAllPaths(FLSegmentType(t), r, paths);
+      CGRect bounds = CGRectNull;
+      for (int p = 0; p < pathCount; ++p) {
+        bounds = CGRectUnion(bounds, paths[p]->getBounds());
+      }
+      if (!CGRectIsNull(bounds)) {
+        bounds = CGRectInset(bounds, -FLPathBoundsPad, -FLPathBoundsPad);
+      }
+      FLSegmentNodePathBounds[t][r] = bounds;
+    }
+  }
 }
 
 - (instancetype)initWithSegmentType:(FLSegmentType)segmentType
@@ -237,21 +308,12 @@ using namespace std;
 
 + (BOOL)canFlip:(FLSegmentType)segmentType
 {
-  // note: For now, determine canFlip based only on segmentType and not orientation (e.g. for
-  // a straight segment at rotation 0, a horizontal flip won't actually change anything, and
-  // so could be disallowed).  Keeping flippability separate from orientation makes things
-  // easier for our current callers, because then they don't have to keep checking back at
-  // each rotation change.
-  return (segmentType != FLSegmentTypeReadoutInput && segmentType != FLSegmentTypeReadoutOutput);
+  return segmentCanFlip(segmentType);
 }
 
 + (BOOL)canSwitch:(FLSegmentType)segmentType
 {
-  return segmentType == FLSegmentTypeJoinLeft
-    || segmentType == FLSegmentTypeJoinRight
-    || segmentType == FLSegmentTypeReadoutInput
-    || segmentType == FLSegmentTypeReadoutOutput
-    || segmentType == FLSegmentTypePixel;
+  return segmentCanSwitch(segmentType);
 }
 
 + (BOOL)FL_hasDynamicTexture:(FLSegmentType)segmentType
@@ -408,90 +470,17 @@ using namespace std;
 
 - (void)flip:(FLSegmentFlipDirection)flipDirection
 {
-  switch (_segmentType) {
-    case FLSegmentTypeStraight: {
-      int zRotationQuarters = self.zRotationQuarters;
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 2;
-      }
-      break;
-    }
-    case FLSegmentTypeCurve: {
-      int zRotationQuarters = self.zRotationQuarters;
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 3;
-      } else {
-        self.zRotationQuarters = zRotationQuarters + 1;
-      }
-      break;
-    }
-    case FLSegmentTypeJoinLeft: {
-      int zRotationQuarters = self.zRotationQuarters;
-      [self FL_setSegmentType:FLSegmentTypeJoinRight];
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 2;
-      }
-      break;
-    }
-    case FLSegmentTypeJoinRight: {
-      int zRotationQuarters = self.zRotationQuarters;
-      [self FL_setSegmentType:FLSegmentTypeJoinLeft];
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 2;
-      }
-      break;
-    }
-    case FLSegmentTypeJogLeft:
-      [self FL_setSegmentType:FLSegmentTypeJogRight];
-      break;
-    case FLSegmentTypeJogRight:
-      [self FL_setSegmentType:FLSegmentTypeJogLeft];
-      break;
-    case FLSegmentTypeCross:
-      // note: Cross has both vertical and horizontal symmetry in all rotations.
-      break;
-    case FLSegmentTypePlatformLeft: {
-      int zRotationQuarters = self.zRotationQuarters;
-      [self FL_setSegmentType:FLSegmentTypePlatformRight];
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 2;
-      }
-      break;
-    }
-    case FLSegmentTypePlatformRight: {
-      int zRotationQuarters = self.zRotationQuarters;
-      [self FL_setSegmentType:FLSegmentTypePlatformLeft];
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 2;
-      }
-      break;
-    }
-    case FLSegmentTypePlatformStartLeft: {
-      int zRotationQuarters = self.zRotationQuarters;
-      [self FL_setSegmentType:FLSegmentTypePlatformStartRight];
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 2;
-      }
-      break;
-    }
-    case FLSegmentTypePlatformStartRight: {
-      int zRotationQuarters = self.zRotationQuarters;
-      [self FL_setSegmentType:FLSegmentTypePlatformStartLeft];
-      if ((zRotationQuarters + flipDirection) % 2 != 0) {
-        self.zRotationQuarters = zRotationQuarters + 2;
-      }
-      break;
-    }
-    case FLSegmentTypePixel:
-      // note: Pixel has both vertical and horizontal symmetry in all rotations.
-      break;
-    case FLSegmentTypeReadoutInput:
-    case FLSegmentTypeReadoutOutput:
-    case FLSegmentTypeNone:
-      break;
-    default:
-      [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
-  };
+  FLSegmentType segmentType = _segmentType;
+  int zRotationQuarters = self.zRotationQuarters;
+  if (!segmentFlip(&segmentType, &zRotationQuarters, flipDirection)) {
+    [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
+  }
+  if (segmentType != _segmentType) {
+    [self FL_setSegmentType:segmentType];
+  }
+  if (zRotationQuarters != self.zRotationQuarters) {
+    self.zRotationQuarters = zRotationQuarters;
+  }
 }
 
 - (BOOL)canSwitch
@@ -724,6 +713,24 @@ using namespace std;
   return YES;
 }
 
+- (BOOL)getClosestOnTrackDistanceLowerBound:(CGFloat *)distanceLowerBound forOffTrackPoint:(CGPoint)offTrackPoint scale:(CGFloat)scale
+{
+  if (!segmentTypeIsValid(_segmentType)) {
+    [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
+  }
+  const CGRect& bounds = FLSegmentNodePathBounds[_segmentType][normalizeRotationQuarters(convertRotationRadiansToQuarters(self.zRotation))];
+  if (CGRectIsNull(bounds)) {
+    return NO;
+  }
+  // note: As in getClosestOnTrackPoint, compare in the segment's unit square.
+  CGFloat offPathX = (offTrackPoint.x - self.position.x) / scale;
+  CGFloat offPathY = (offTrackPoint.y - self.position.y) / scale;
+  CGFloat outsideX = fmax(0.0f, fmax(CGRectGetMinX(bounds) - offPathX, offPathX - CGRectGetMaxX(bounds)));
+  CGFloat outsideY = fmax(0.0f, fmax(CGRectGetMinY(bounds) - offPathY, offPathY - CGRectGetMaxY(bounds)));
+  *distanceLowerBound = sqrt(outsideX * outsideX + outsideY * outsideY);
+  return YES;
+}
+
 - (BOOL)getConnectingPath:(int *)pathId progress:(CGFloat *)progress forEndPoint:(CGPoint)endPoint scale:(CGFloat)scale
 {
   BOOL hasSwitch = [FLSegmentNode canSwitch:_segmentType];
@@ -773,14 +780,14 @@ using namespace std;
                    hasSwitch:(BOOL)hasSwitch
                 switchPathId:(int)switchPathId
 {
-  CGPoint pathEndPoint = CGPointMake((endPoint.x - self.position.x) / scale, (endPoint.y - self.position.y) / scale);
+  if (!segmentTypeIsValid(_segmentType)) {
+    [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
+  }
 
   // note: The required information about the paths -- i.e the path's endpoints, with
-  // tangent and progress at those endpoints -- is known statically by the path itself.
-  // Switch information -- i.e. which paths are being switched, and at which endpoints --
-  // is known statically by the segment.  So this entire function could be written as a
-  // single static lookup table.  But it seems like more fun to do all tests dynamically,
-  // using simple getPoint() and getTangent() methods.
+  // tangent and progress at those endpoints -- is known statically by the path itself,
+  // and precomputed as ports (see segmentGetPorts).  So this function finds the port (if any)
+  // at the end point, and compares integer tangent directions.
 
   // note: End points must be close together in order to connect, but there is currently
   // no need for a tight comparison, since end points are always snapped to a corner or
@@ -789,100 +796,69 @@ using namespace std;
   const CGFloat FLEndPointComparisonEpsilon = 0.1f;
   const CGFloat FLTangentComparisonEpsilon = 0.1f;
 
+  CGFloat endPointHalfX = (endPoint.x - self.position.x) / scale * 2.0f;
+  CGFloat endPointHalfY = (endPoint.y - self.position.y) / scale * 2.0f;
+  int halfX = int(floor(endPointHalfX + 0.5f));
+  int halfY = int(floor(endPointHalfY + 0.5f));
+  if (fabs(endPointHalfX - halfX) >= FLEndPointComparisonEpsilon * 2.0f
+      || fabs(endPointHalfY - halfY) >= FLEndPointComparisonEpsilon * 2.0f) {
+    return NO;
+  }
+
   // note: Tangents have direction (whatdya call it: theta vs theta+pi) based on progress
   // points.  Connecting paths won't "go back the other direction", e.g. two curve
   // segments placed as in the shape of the number 3.  If the progress points of the two
   // segments are the same, then they connect if the difference between the two tangents
-  // is pi.
+  // is pi.  Since all port tangents are at right angles, a rotation that isn't close to a
+  // right angle connects to nothing.
   const CGFloat FLProgressComparisonEpsilon = 0.1f;
   const BOOL forProgressIsZero = (forProgress < FLProgressComparisonEpsilon);
+  int forRotationQuarters = 0;
+  if (doRotationCheck) {
+    CGFloat forRotationQuartersNearest = floor(forRotationRadians / (CGFloat)M_PI_2 + 0.5f);
+    if (fabs(forRotationRadians - forRotationQuartersNearest * (CGFloat)M_PI_2) >= FLTangentComparisonEpsilon) {
+      return NO;
+    }
+    forRotationQuarters = normalizeRotationQuarters(int(fmod(forRotationQuartersNearest, 4.0f)));
+  }
 
   // note: If there are two connecting paths from this endpoint, then either there is a
   // switch to choose between them, or else we choose the first one found.
 
-  const FLPath *paths[FLSegmentNodePathsMax];
-  int pathCount = [self FL_allPaths:paths];
-
-  const CGFloat FL2Pi = (CGFloat)(M_PI * 2.0);
+  FLSegmentNodePort ports[FLSegmentNodePortsMax];
+  int portCount = segmentGetPorts(_segmentType, convertRotationRadiansToQuarters(self.zRotation), ports);
 
   BOOL foundOne = NO;
-  for (int p = 0; p < pathCount; ++p) {
-    const FLPath *path = paths[p];
-
-    CGPoint zeroProgressPoint = path->getPoint(0.0f);
-    if (fabs(pathEndPoint.x - zeroProgressPoint.x) < FLEndPointComparisonEpsilon
-        && fabs(pathEndPoint.y - zeroProgressPoint.y) < FLEndPointComparisonEpsilon) {
-      BOOL isConnectingRotation = NO;
-      if (doRotationCheck) {
-        CGFloat zeroProgressRotation = path->getTangent(0.0f);
-        CGFloat rotationDifference = fabs(fmod(forRotationRadians - zeroProgressRotation, FL2Pi));
-        if (forProgressIsZero) {
-          isConnectingRotation = (rotationDifference > M_PI - FLTangentComparisonEpsilon
-                                  && rotationDifference < M_PI + FLTangentComparisonEpsilon);
-        } else {
-          isConnectingRotation = (rotationDifference < FLTangentComparisonEpsilon
-                                  || rotationDifference > FL2Pi - FLTangentComparisonEpsilon);
-        }
-      }
-      if (isConnectingRotation || !doRotationCheck) {
-        if (!hasSwitch || switchPathId == p) {
-          // note: The switch might not be relevant, even if set to this path;
-          // it might only be for travel in the other direction.  But at least
-          // we know there is no other better alternative to consider.
-          *pathId = p;
-          *progress = 0.0f;
-          return YES;
-        }
-        // note: The switch is set, but not to this path.  So we need to check
-        // the path that the switch has selected to see if it's relevant to this
-        // intersection.  (It might be inefficient to continue in the loop when
-        // in fact there is only exactly one other path that we care about.  But
-        // segments generally contain so few paths that it doesn't really matter.)
-        // Check foundOne just so that we end up returning "the first one found" if
-        // the switch proves not to be relevant.
-        if (!foundOne) {
-          *pathId = p;
-          *progress = 0.0f;
-          foundOne = YES;
-        }
-        // note: No need to check the other endpoint, if this one hooks up.  That said:
-        // I can conceive of a switched segment with a path that loops around with both
-        // endpoints on the same corner with the same tangent.  So if such a segment
-        // exists, then don't continue the loop here (because we need to check the other
-        // endpoint).
-        continue;
-      }
+  int connectedPathId = -1;
+  for (int p = 0; p < portCount; ++p) {
+    const FLSegmentNodePort& port = ports[p];
+    if (port.pathId == connectedPathId || port.halfX != halfX || port.halfY != halfY) {
+      continue;
     }
-
-    CGPoint oneProgressPoint = path->getPoint(1.0f);
-    if (fabs(pathEndPoint.x - oneProgressPoint.x) < FLEndPointComparisonEpsilon
-        && fabs(pathEndPoint.y - oneProgressPoint.y) < FLEndPointComparisonEpsilon) {
-      BOOL isConnectingRotation = NO;
-      if (doRotationCheck) {
-        CGFloat oneProgressRotation = path->getTangent(1.0f);
-        CGFloat rotationDifference = fabs(fmod(forRotationRadians - oneProgressRotation, FL2Pi));
-        if (forProgressIsZero) {
-          isConnectingRotation = (rotationDifference < FLTangentComparisonEpsilon
-                                  || rotationDifference > FL2Pi - FLTangentComparisonEpsilon);
-        } else {
-          isConnectingRotation = (rotationDifference > M_PI - FLTangentComparisonEpsilon
-                                  && rotationDifference < M_PI + FLTangentComparisonEpsilon);
-        }
-      }
-      if (isConnectingRotation || !doRotationCheck) {
-        if (!hasSwitch || switchPathId == p) {
-          *pathId = p;
-          *progress = 1.0f;
-          return YES;
-        }
-        if (!foundOne) {
-          *pathId = p;
-          *progress = 1.0f;
-          foundOne = YES;
-        }
-        continue;
-      }
+    if (doRotationCheck && !segmentTangentsConnect(forRotationQuarters, (forProgressIsZero ? 0 : 1), port.tangentQuarters, port.progress)) {
+      continue;
+    }
+    if (!hasSwitch || switchPathId == port.pathId) {
+      // note: The switch might not be relevant, even if set to this path;
+      // it might only be for travel in the other direction.  But at least
+      // we know there is no other better alternative to consider.
+      *pathId = port.pathId;
+      *progress = CGFloat(port.progress);
+      return YES;
     }
+    // note: The switch is set, but not to this path.  So we need to check
+    // the path that the switch has selected to see if it's relevant to this
+    // intersection.  Check foundOne just so that we end up returning "the
+    // first one found" if the switch proves not to be relevant.
+    if (!foundOne) {
+      *pathId = port.pathId;
+      *progress = CGFloat(port.progress);
+      foundOne = YES;
+    }
+    // note: No need to check the other endpoint of this path, if this one hooks up.
+    // (As before, a path looping around to the same corner with the same tangent
+    // would need this to change.)
+    connectedPathId = port.pathId;
   }
 
   return foundOne;
@@ -898,23 +874,22 @@ using namespace std;
   return [self FL_allPathsCount];
 }
 
+- (int)getPorts:(FLSegmentNodePort *)ports
+{
+  if (!segmentTypeIsValid(_segmentType)) {
+    [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
+  }
+  return segmentGetPorts(_segmentType, convertRotationRadiansToQuarters(self.zRotation), ports);
+}
+
 - (int)pathDirectionGoingWithSwitchForPath:(int)pathId
 {
-  switch (_segmentType) {
-    case FLSegmentTypeJoinLeft:
-      if (pathId == 0) {
-        return FLPathDirectionDecreasing;
-      } else if (pathId == 1) {
-        return FLPathDirectionIncreasing;
-      }
-      break;
-    case FLSegmentTypeJoinRight:
-      if (pathId == 0) {
-        return FLPathDirectionIncreasing;
-      } else if (pathId == 1) {
-        return FLPathDirectionDecreasing;
-      }
-      break;
+  // note: Going with the switch means leaving from the end of the path at the switch.
+  switch (segmentSwitchProgress(_segmentType, pathId)) {
+    case 0:
+      return FLPathDirectionIncreasing;
+    case 1:
+      return FLPathDirectionDecreasing;
     default:
       break;
   }
@@ -1470,84 +1445,21 @@ using namespace std;
 
 - (int)FL_allPaths:(const FLPath **)paths
 {
-  // note: Increase FLSegmentNodePathsMax to match largest return value here.
-  int rotationQuarters = convertRotationRadiansToQuarters(self.zRotation);
-  switch (_segmentType) {
-    case FLSegmentTypeStraight:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeStraight, rotationQuarters);
-      return 1;
-    case FLSegmentTypeCurve:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeCurve, rotationQuarters);
-      return 1;
-    case FLSegmentTypeJoinLeft:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeCurve, rotationQuarters);
-      paths[1] = FLPathStore::sharedStore()->getPath(FLPathTypeStraight, rotationQuarters);
-      return 2;
-    case FLSegmentTypeJoinRight:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeCurve, rotationQuarters + 1);
-      paths[1] = FLPathStore::sharedStore()->getPath(FLPathTypeStraight, rotationQuarters);
-      return 2;
-    case FLSegmentTypeJogLeft:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeJogLeft, rotationQuarters);
-      return 1;
-    case FLSegmentTypeJogRight:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeJogRight, rotationQuarters);
-      return 1;
-    case FLSegmentTypeCross:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeJogLeft, rotationQuarters);
-      paths[1] = FLPathStore::sharedStore()->getPath(FLPathTypeJogRight, rotationQuarters);
-      return 2;
-    case FLSegmentTypePlatformLeft:
-    case FLSegmentTypePlatformStartLeft:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeHalfLeft, rotationQuarters);
-      return 1;
-    case FLSegmentTypePlatformRight:
-    case FLSegmentTypePlatformStartRight:
-      paths[0] = FLPathStore::sharedStore()->getPath(FLPathTypeHalfRight, rotationQuarters);
-      return 1;
-    case FLSegmentTypeReadoutInput:
-    case FLSegmentTypeReadoutOutput:
-    case FLSegmentTypePixel:
-      return 0;
-    case FLSegmentTypeNone:
-    default:
-      [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
-      return 0;
+  int pathCount = FL_getAllPaths(_segmentType, convertRotationRadiansToQuarters(self.zRotation), paths);
+  if (pathCount < 0) {
+    [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
+    return 0;
   }
+  return pathCount;
 }
 
 - (int)FL_allPathsCount
 {
-  // note: Increase FLSegmentNodePathsMax to match largest return value here.
-  switch (_segmentType) {
-    case FLSegmentTypeStraight:
-      return 1;
-    case FLSegmentTypeCurve:
-      return 1;
-    case FLSegmentTypeJoinLeft:
-      return 2;
-    case FLSegmentTypeJoinRight:
-      return 2;
-    case FLSegmentTypeJogLeft:
-      return 1;
-    case FLSegmentTypeJogRight:
-      return 1;
-    case FLSegmentTypeCross:
-      return 2;
-    case FLSegmentTypePlatformLeft:
-    case FLSegmentTypePlatformRight:
-    case FLSegmentTypePlatformStartLeft:
-    case FLSegmentTypePlatformStartRight:
-      return 1;
-    case FLSegmentTypeReadoutInput:
-    case FLSegmentTypeReadoutOutput:
-    case FLSegmentTypePixel:
-      return 0;
-    case FLSegmentTypeNone:
-    default:
-      [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
-      return 0;
+  // note: Increase FLSegmentNodePathsMax to match largest return value of segmentPathCount().
+  if (!segmentTypeIsValid(_segmentType)) {
+    [NSException raise:@"FLSegmentNodeSegmentTypeInvalid" format:@"Invalid segment type %ld.", (long)_segmentType];
   }
+  return segmentPathCount(_segmentType);
 }
 
 @end
@@ -0,0 +1,204 @@
+//
+//  FLTrackGraph.cpp
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#include "FLTrackGraph.h"
+
+#include <cassert>
+
+using namespace std;
+
+void
+FLTrackGraph::clear()
+{
+  segments_.clear();
+  edges_.clear();
+  vertices_.clear();
+}
+
+uint32_t
+FLTrackGraph::addSegment(const FLSegment& segment)
+{
+  uint32_t segmentId = static_cast<uint32_t>(segments_.size());
+  segments_.push_back(FLTrackGraphSegment(segment, static_cast<uint32_t>(edges_.size())));
+  // note: Ports are ordered by path, and then progress 0 before progress 1.
+  FLSegmentNodePort ports[FLSegmentNodePortsMax];
+  int portCount = segment.getPorts(ports);
+  for (int p = 0; p + 1 < portCount; p += 2) {
+    addEdge(segmentId, ports[p], ports[p + 1]);
+  }
+  return segmentId;
+}
+
+void
+FLTrackGraph::addEdge(uint32_t segmentId, const FLSegmentNodePort& port0, const FLSegmentNodePort& port1)
+{
+  FLTrackGraphSegment& segment = segments_[segmentId];
+  assert(segment.edgeCount == port0.pathId);
+
+  FLTrackGraphEdge edge;
+  edge.segmentId = segmentId;
+  edge.pathId = port0.pathId;
+  edge.vertexX[0] = segment.gridX * 2 + port0.halfX;
+  edge.vertexY[0] = segment.gridY * 2 + port0.halfY;
+  edge.tangentQuarters[0] = port0.tangentQuarters;
+  edge.vertexX[1] = segment.gridX * 2 + port1.halfX;
+  edge.vertexY[1] = segment.gridY * 2 + port1.halfY;
+  edge.tangentQuarters[1] = port1.tangentQuarters;
+  edges_.push_back(edge);
+  ++segment.edgeCount;
+
+  uint32_t edgeId = static_cast<uint32_t>(edges_.size() - 1);
+  addEnd(edgeId, 0);
+  addEnd(edgeId, 1);
+}
+
+void
+FLTrackGraph::addEnd(uint32_t edgeId, int progress)
+{
+  const FLTrackGraphEdge& edge = edges_[edgeId];
+  const FLTrackGraphSegment& segment = segments_[edge.segmentId];
+  int vertexX = edge.vertexX[progress];
+  int vertexY = edge.vertexY[progress];
+  auto v = vertices_.find(pair<int, int>(vertexX, vertexY));
+  if (v == vertices_.end()) {
+    v = vertices_.emplace(pair<int, int>(vertexX, vertexY), FLTrackGraphVertex()).first;
+    v->second.endCount = 0;
+  }
+  FLTrackGraphVertex& vertex = v->second;
+  assert(vertex.endCount < FLVertexEndsMax);
+
+  // note: Order segments by the position of their cell around the vertex, in the order
+  // that corners are searched (see segmentCornerCell).  Ends of the same segment stay in
+  // the order added.
+  int cellOrder = segmentCornerCellIndex(vertexX, vertexY, segment.gridX, segment.gridY);
+  int e = vertex.endCount;
+  while (e > 0 && vertex.endCellOrders[e - 1] > cellOrder) {
+    vertex.endCellOrders[e] = vertex.endCellOrders[e - 1];
+    vertex.ends[e] = vertex.ends[e - 1];
+    --e;
+  }
+  vertex.endCellOrders[e] = static_cast<int8_t>(cellOrder);
+  vertex.ends[e].edgeId = edgeId;
+  vertex.ends[e].progress = static_cast<int8_t>(progress);
+  vertex.ends[e].tangentQuarters = edge.tangentQuarters[progress];
+  ++vertex.endCount;
+}
+
+int
+FLTrackGraph::getEnds(int vertexX, int vertexY, const FLTrackGraphEnd **ends) const
+{
+  auto v = vertices_.find(pair<int, int>(vertexX, vertexY));
+  if (v == vertices_.end()) {
+    *ends = nullptr;
+    return 0;
+  }
+  *ends = v->second.ends;
+  return v->second.endCount;
+}
+
+int
+FLTrackGraph::getConnecting(uint32_t edgeId, int progress, FLTrackGraphEnd *connectingEnds) const
+{
+  const FLTrackGraphEdge& edge = edges_[edgeId];
+  int vertexX = edge.vertexX[progress];
+  int vertexY = edge.vertexY[progress];
+  // note: Currently segments only connect at corners (which have odd coordinates).
+  if (vertexX % 2 == 0 || vertexY % 2 == 0) {
+    return 0;
+  }
+  const FLTrackGraphEnd *ends;
+  int endCount = getEnds(vertexX, vertexY, &ends);
+
+  int connectingCount = 0;
+  uint32_t connectedEdgeId = edgeId;
+  for (int e = 0; e < endCount; ++e) {
+    const FLTrackGraphEnd& end = ends[e];
+    if (end.edgeId == connectedEdgeId
+        || edges_[end.edgeId].segmentId == edge.segmentId
+        || !segmentTangentsConnect(edge.tangentQuarters[progress], progress, end.tangentQuarters, end.progress)) {
+      continue;
+    }
+    connectingEnds[connectingCount] = end;
+    ++connectingCount;
+    connectedEdgeId = end.edgeId;
+  }
+  return connectingCount;
+}
+
+bool
+FLTrackGraph::findConnecting(uint32_t edgeId, int progress,
+                             FLTrackGraphEnd *connectingEnd,
+                             const unordered_map<uint32_t, int> *switchPathIds) const
+{
+  FLTrackGraphEnd connectingEnds[FLVertexEndsMax];
+  int connectingCount = getConnecting(edgeId, progress, connectingEnds);
+  if (connectingCount == 0) {
+    return false;
+  }
+
+  // note: The first segment found is the one that connects.  If it connects by more than
+  // one path, then its switch chooses between them (or else the first one found is chosen).
+  uint32_t segmentId = edges_[connectingEnds[0].edgeId].segmentId;
+  int switchPathId = segments_[segmentId].switchPathId;
+  int c = 0;
+  if (segments_[segmentId].canSwitch()) {
+    if (switchPathIds) {
+      auto spi = switchPathIds->find(segmentId);
+      if (spi != switchPathIds->end()) {
+        switchPathId = spi->second;
+      }
+    }
+    for (int sc = 0; sc < connectingCount && edges_[connectingEnds[sc].edgeId].segmentId == segmentId; ++sc) {
+      if (edges_[connectingEnds[sc].edgeId].pathId == switchPathId) {
+        c = sc;
+        break;
+      }
+    }
+  }
+  *connectingEnd = connectingEnds[c];
+  return true;
+}
+
+int
+FLTrackGraph::getSwitches(int vertexX, int vertexY, FLTrackGraphSwitch *switches) const
+{
+  const FLTrackGraphEnd *ends;
+  int endCount = getEnds(vertexX, vertexY, &ends);
+  int switchCount = 0;
+  for (int e = 0; e < endCount; ++e) {
+    uint32_t segmentId = edges_[ends[e].edgeId].segmentId;
+    const FLTrackGraphSegment& segment = segments_[segmentId];
+    if (!segment.canSwitch()) {
+      continue;
+    }
+    // note: Ends of a segment are adjacent in the vertex, so only look ahead while the
+    // segment is the same; and only the first pair with a given departure counts.
+    int departureQuarters = trackGraphEndDeparture(ends[e]);
+    bool alreadyFound = false;
+    for (int s = 0; s < switchCount; ++s) {
+      if (switches[s].segmentId == segmentId && switches[s].departureQuarters == departureQuarters) {
+        alreadyFound = true;
+        break;
+      }
+    }
+    if (alreadyFound) {
+      continue;
+    }
+    for (int f = e + 1; f < endCount && edges_[ends[f].edgeId].segmentId == segmentId; ++f) {
+      if (trackGraphEndDeparture(ends[f]) == departureQuarters) {
+        assert(switchCount < FLVertexSwitchesMax);
+        switches[switchCount].segmentId = segmentId;
+        switches[switchCount].departureQuarters = departureQuarters;
+        switches[switchCount].switchPathId = segment.switchPathId;
+        ++switchCount;
+        break;
+      }
+    }
+  }
+  return switchCount;
+}
@@ -0,0 +1,180 @@
+//
+//  FLTrackGraph.h
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#ifndef __Flippy__FLTrackGraph__
+#define __Flippy__FLTrackGraph__
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "DenseSectorTable.h"
+#include "FLSegment.h"
+
+/**
+ * A segment of track, as stored in an FLTrackGraph: the segment's plain value, and its
+ * paths, which are the edges [firstEdgeId, firstEdgeId + edgeCount), in path order.
+ */
+struct FLTrackGraphSegment : public FLSegment
+{
+  FLTrackGraphSegment(const FLSegment& segment, uint32_t firstEdgeId_)
+    : FLSegment(segment), firstEdgeId(firstEdgeId_), edgeCount(0) {}
+
+  uint32_t firstEdgeId;
+  int edgeCount;
+};
+
+/**
+ * A path of a segment, running between two vertices.  For each end (indexed by progress,
+ * 0 or 1) the edge knows its vertex and its tangent there (in the direction of increasing
+ * progress, in quarters).
+ */
+struct FLTrackGraphEdge
+{
+  uint32_t segmentId;
+  int8_t pathId;
+  int vertexX[2];
+  int vertexY[2];
+  int8_t tangentQuarters[2];
+};
+
+/**
+ * An end of an edge at a vertex.  (Equivalently, a path leaving the vertex.)
+ */
+struct FLTrackGraphEnd
+{
+  uint32_t edgeId;
+  int8_t progress;
+  int8_t tangentQuarters;
+};
+
+/**
+ * The direction (in quarters) that a train travels when it leaves a vertex along the
+ * passed edge end.  Two ends of a switching segment at a vertex with the same departure
+ * are switched between.  (Two ends at a vertex connect if their departures are opposite,
+ * which is the rule of segmentTangentsConnect.)
+ */
+inline int
+trackGraphEndDeparture(const FLTrackGraphEnd& end)
+{
+  return (end.progress == 0 ? end.tangentQuarters : end.tangentQuarters + 2) % 4;
+}
+
+/**
+ * A switch at a vertex: a segment with more than one path leaving the vertex in the same
+ * direction, and the path currently selected.
+ */
+struct FLTrackGraphSwitch
+{
+  uint32_t segmentId;
+  int departureQuarters;
+  int switchPathId;
+};
+
+/**
+ * A headless model of track as vertices and edges, as described in the "Alternate
+ * Implementation" note of FLTrackGrid: vertices lie on the corners and edge midpoints of
+ * the grid, and each path of each segment is an edge between two vertices.  Vertices are
+ * addressed in half-segment units, so that the vertex at (vertexX, vertexY) is at grid
+ * location (vertexX / 2, vertexY / 2); corners have odd coordinates.
+ *
+ * Connection queries are then local to a vertex, and cost is proportional to the number
+ * of edges meeting there (at most FLVertexEndsMax).  The graph doesn't depend on
+ * SpriteKit, so it can be built and queried anywhere (for instance, on another thread,
+ * or in a test); see trackGridExportGraph and trackGridImportGraph for conversion to and
+ * from FLTrackGrid.
+ *
+ * note: Currently built all at once (by addSegment()) and queried, rather than edited in
+ * place; only switch values can change.
+ */
+class FLTrackGraph
+{
+public:
+
+  // note: Two segments share an edge midpoint and four share a corner, and each segment
+  // has at most two path ends at any vertex (e.g. the switch point of a join).
+  static const int FLVertexEndsMax = 8;
+  static const int FLVertexSwitchesMax = 4;
+
+  FLTrackGraph() {}
+
+  void clear();
+
+  size_t segmentCount() const { return segments_.size(); }
+
+  size_t edgeCount() const { return edges_.size(); }
+
+  const FLTrackGraphSegment& segment(uint32_t segmentId) const { return segments_[segmentId]; }
+
+  const FLTrackGraphEdge& edge(uint32_t edgeId) const { return edges_[edgeId]; }
+
+  /**
+   * Adds a segment, and each of its paths as an edge (between the vertices of its
+   * ports), returning its id.  Segments are numbered from zero in the order added.
+   */
+  uint32_t addSegment(const FLSegment& segment);
+
+  /**
+   * Gets the edge ends at a vertex (that is, the paths that leave it), ordered by segment
+   * in the order trackGridFindConnecting considers the cells around a corner, and then by
+   * path and progress.  Returns the number of ends, which is zero if there is no vertex
+   * there.
+   */
+  int getEnds(int vertexX, int vertexY, const FLTrackGraphEnd **ends) const;
+
+  /**
+   * Gets the edge ends that the passed end of an edge connects to, at its vertex: the
+   * ends of other segments' paths that continue it, in getEnds() order.  As with
+   * FLTrackGrid connections, paths only connect at corners, and once a path connects by
+   * one end, its other end isn't considered.  Returns the number of ends found (at most
+   * FLVertexEndsMax).
+   */
+  int getConnecting(uint32_t edgeId, int progress, FLTrackGraphEnd *connectingEnds) const;
+
+  /**
+   * Finds the edge end that a train leaving the passed end of an edge continues onto,
+   * choosing as trackGridFindConnecting does: the first segment that connects, and if it
+   * connects by more than one path and has a switch, the path its switch selects.  If
+   * switchPathIds is passed, switch values are read from it (by segment id) where
+   * present.  Returns false if nothing connects.
+   */
+  bool findConnecting(uint32_t edgeId, int progress,
+                      FLTrackGraphEnd *connectingEnd,
+                      const std::unordered_map<uint32_t, int> *switchPathIds = nullptr) const;
+
+  /**
+   * Gets the switches at a vertex.  Returns the number of switches (at most
+   * FLVertexSwitchesMax).
+   */
+  int getSwitches(int vertexX, int vertexY, FLTrackGraphSwitch *switches) const;
+
+  void setSwitchPathId(uint32_t segmentId, int switchPathId) {
+    segments_[segmentId].switchPathId = switchPathId;
+  }
+
+private:
+
+  struct FLTrackGraphVertex
+  {
+    int endCount;
+    // note: The order (in getEnds) of the segment that owns each end.
+    int8_t endCellOrders[FLVertexEndsMax];
+    FLTrackGraphEnd ends[FLVertexEndsMax];
+  };
+
+  void addEdge(uint32_t segmentId, const FLSegmentNodePort& port0, const FLSegmentNodePort& port1);
+
+  void addEnd(uint32_t edgeId, int progress);
+
+  std::vector<FLTrackGraphSegment> segments_;
+  std::vector<FLTrackGraphEdge> edges_;
+  std::unordered_map<std::pair<int, int>, FLTrackGraphVertex, HLCommon::DenseSectorTableKeyHash> vertices_;
+};
+
+#endif /* defined(__Flippy__FLTrackGraph__) */
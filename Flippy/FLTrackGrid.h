@@ -9,14 +9,223 @@
 #ifndef __Flippy__FLTrackGrid__
 #define __Flippy__FLTrackGrid__
 
+#include <array>
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <tgmath.h>
 
 #import "FLSegmentNode.h"
 #include "DenseSectorTable.h"
+#include "FLConnectedComponents.h"
+#include "FLTrackGraph.h"
+#include "FLTrackModel.h"
 
 class FLLinks;
 
+/**
+ * Maps 32-bit segment handles to segment nodes, so that a track grid can store handles
+ * in its cells rather than 64-bit object pointers.  This makes cell contents independent
+ * of object addresses, so that they can be serialized or passed to worker threads as
+ * plain integers.  Sector blocks shrink by four bytes per cell, and the table costs a
+ * node pointer per segment; so on 64-bit devices this breaks even for a sparse world and
+ * costs memory for a dense one (see testHandleValueMemory).
+ *
+ * A segment node is held by at most one grid cell (the scene moves a segment by erasing
+ * it and then setting it), so handles aren't counted: the grid acquires a handle when it
+ * sets a node and releases it when the node's cell is erased or overwritten.  Released
+ * handles are reused.  Handle 0 (FLSegmentHandleNull) always maps to nil.
+ *
+ * The reverse mapping, from node to handle, is kept on the node itself (trackGridHandle),
+ * so the table needs no index of its own.  The handle on the node
+ * is checked against the table before use, so a stale one is never mistaken for another
+ * segment; but a node can only be found in one grid at a time (or in copies of one grid,
+ * which share handles).  Setting the same node into two diverging grids is unsupported.
+ */
+class FLSegmentHandleTable
+{
+public:
+
+  typedef uint32_t FLSegmentHandle;
+  static const FLSegmentHandle FLSegmentHandleNull = 0;
+
+  FLSegmentHandleTable() : segmentNodes_(1, nil) {}
+
+  FLSegmentNode *get(FLSegmentHandle handle) const { return segmentNodes_[handle]; }
+
+  /**
+   * Returns the handle for the passed segment node, or FLSegmentHandleNull if the node has
+   * none (because it isn't in a grid cell).
+   */
+  FLSegmentHandle find(FLSegmentNode *segmentNode) const {
+    if (!segmentNode) {
+      return FLSegmentHandleNull;
+    }
+    FLSegmentHandle handle = segmentNode.trackGridHandle;
+    if (handle >= segmentNodes_.size() || segmentNodes_[handle] != segmentNode) {
+      return FLSegmentHandleNull;
+    }
+    return handle;
+  }
+
+  /**
+   * Returns the handle for the passed segment node, assigning one if it has none.  Returns
+   * FLSegmentHandleNull for nil.
+   */
+  FLSegmentHandle acquire(FLSegmentNode *segmentNode) {
+    if (!segmentNode) {
+      return FLSegmentHandleNull;
+    }
+    FLSegmentHandle handle = find(segmentNode);
+    if (handle == FLSegmentHandleNull) {
+      if (freeHandles_.empty()) {
+        handle = static_cast<FLSegmentHandle>(segmentNodes_.size());
+        segmentNodes_.push_back(segmentNode);
+      } else {
+        handle = freeHandles_.back();
+        freeHandles_.pop_back();
+        segmentNodes_[handle] = segmentNode;
+      }
+      segmentNode.trackGridHandle = handle;
+    }
+    return handle;
+  }
+
+  /**
+   * Releases the passed handle (and the table's strong reference to its node), for reuse.
+   * No-op for FLSegmentHandleNull.
+   */
+  void release(FLSegmentHandle handle) {
+    if (handle == FLSegmentHandleNull) {
+      return;
+    }
+    assert(segmentNodes_[handle] != nil);
+    // note: The handle on the node is left stale rather than cleared, since a copy of this
+    // table might still use it; find() checks it against segmentNodes_ anyway.
+    segmentNodes_[handle] = nil;
+    freeHandles_.push_back(handle);
+  }
+
+  /**
+   * Returns the heap memory used by the handle table, in bytes.  (The handle stored on
+   * each node, four bytes, is not counted.)
+   */
+  size_t byteCount() const {
+    return segmentNodes_.capacity() * sizeof(void *)
+      + freeHandles_.capacity() * sizeof(FLSegmentHandle);
+  }
+
+private:
+
+  std::vector<FLSegmentNode *> segmentNodes_;
+  std::vector<FLSegmentHandle> freeHandles_;
+};
+
+/**
+ * Plain segment values (see FLSegment) stored by segment handle, so that the contents of
+ * a track grid can be read without touching its segment nodes.  Values are kept in
+ * fixed-size chunks which are shared between copies of the table and copied only when
+ * written, like the sector blocks of a DenseSectorTable; so a copy costs one pointer per
+ * chunk, and may be read on one thread while the original is written on another.
+ */
+class FLSegmentValueTable
+{
+public:
+
+  static const size_t FLSegmentValueChunkSize = 256;
+
+  /**
+   * Returns the value stored for a handle.  The handle must have been set.
+   */
+  const FLSegment& get(FLSegmentHandleTable::FLSegmentHandle handle) const {
+    return (*chunks_[handle / FLSegmentValueChunkSize])[handle % FLSegmentValueChunkSize];
+  }
+
+  void set(FLSegmentHandleTable::FLSegmentHandle handle, const FLSegment& segment) {
+    size_t chunkIndex = handle / FLSegmentValueChunkSize;
+    while (chunks_.size() <= chunkIndex) {
+      chunks_.push_back(std::make_shared<FLSegmentValueChunk>());
+    }
+    std::shared_ptr<FLSegmentValueChunk>& chunk = chunks_[chunkIndex];
+    if (chunk.use_count() != 1) {
+      chunk = std::make_shared<FLSegmentValueChunk>(*chunk);
+    } else {
+      // note: The last other owner (say, a snapshot on another thread) released the chunk
+      // with acq_rel ordering; make its reads happen before this write.
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    (*chunk)[handle % FLSegmentValueChunkSize] = segment;
+  }
+
+  size_t byteCount() const {
+    return chunks_.capacity() * sizeof(std::shared_ptr<FLSegmentValueChunk>)
+      + chunks_.size() * sizeof(FLSegmentValueChunk);
+  }
+
+private:
+
+  typedef std::array<FLSegment, FLSegmentValueChunkSize> FLSegmentValueChunk;
+
+  std::vector<std::shared_ptr<FLSegmentValueChunk>> chunks_;
+};
+
+class FLTrackGridSnapshot;
+
+/**
+ * Adapts a track grid table iterator (which yields segment handles) to yield segment
+ * nodes: `(*it).first` is the grid coordinate pair, and `(*it).second` the node.
+ */
+template<typename TableIterator>
+class FLTrackGridIterator : public std::iterator<std::forward_iterator_tag, FLSegmentNode *>
+{
+public:
+  FLTrackGridIterator() {}
+  FLTrackGridIterator(const TableIterator& tableIterator, const FLSegmentHandleTable *handleTable)
+    : tableIterator_(tableIterator), handleTable_(handleTable) {}
+  FLTrackGridIterator& operator++() {
+    ++tableIterator_;
+    return *this;
+  }
+  std::pair<std::pair<int, int>, FLSegmentNode *> operator*() {
+    auto s = *tableIterator_;
+    return std::pair<std::pair<int, int>, FLSegmentNode *>(s.first, handleTable_->get(s.second));
+  }
+  bool operator==(const FLTrackGridIterator& rhs) const { return tableIterator_ == rhs.tableIterator_; }
+  bool operator!=(const FLTrackGridIterator& rhs) const { return !(*this == rhs); }
+private:
+  TableIterator tableIterator_;
+  const FLSegmentHandleTable *handleTable_;
+};
+
+/**
+ * A connection from a port of one segment to a port (path and progress) of a segment in a
+ * neighboring cell; see FLTrackGrid::getConnections().
+ */
+struct FLTrackGridConnection
+{
+  FLSegmentHandleTable::FLSegmentHandle segmentHandle;
+  int8_t pathId;
+  int8_t progress;
+};
+
+/**
+ * The ports of the segment in one grid cell (as returned by FLSegmentNode getPorts), and
+ * the connections from each.  A port on a corner can connect to the segments in the three
+ * other cells sharing that corner, and (for instance, to both paths of a join) to up to
+ * two ports of each of those.
+ */
+struct FLTrackGridCellConnections
+{
+  static const int FLPortConnectionsMax = 6;
+  int portCount;
+  FLSegmentNodePort ports[FLSegmentNodePortsMax];
+  int connectionCounts[FLSegmentNodePortsMax];
+  FLTrackGridConnection connections[FLSegmentNodePortsMax][FLPortConnectionsMax];
+};
+
 /**
  * Represents square segments that occupy a two-dimensional world.  The track grid deals
  * in integer grid coordinates, and, given a segment edge size, floating point world
@@ -76,6 +285,9 @@ class FLLinks;
  *
  * Anyway, I think I'm going to pass on this for now, even though it would be pretty
  * clearly awesome.
+ *
+ * note: FLTrackGraph now implements the model (though not the interface) as a headless
+ * structure; see trackGridExportGraph and trackGridImportGraph.
  */
 class FLTrackGrid
 {
@@ -83,9 +295,16 @@ public:
 
   static const int FLTrackGridSectorSize = 16;
   static const int FLTrackGridSectorCount = 64;
+  static const size_t FLTrackGridJournalMax = 1024;
 
-  typedef HLCommon::DenseSectorTable<FLSegmentNode *>::iterator iterator;
-  typedef HLCommon::DenseSectorTable<FLSegmentNode *>::const_iterator const_iterator;
+  // note: Cells hold 32-bit segment handles rather than FLSegmentNode pointers; see
+  // FLSegmentHandleTable.
+  typedef FLSegmentHandleTable::FLSegmentHandle FLSegmentHandle;
+  typedef HLCommon::DenseSectorTable<FLSegmentHandle, HLCommon::DenseSectorTableBoundedBackend, FLTrackGridSectorSize> FLTrackGridTable;
+  typedef FLTrackGridIterator<FLTrackGridTable::const_iterator> iterator;
+  typedef FLTrackGridIterator<FLTrackGridTable::const_iterator> const_iterator;
+  typedef FLTrackGridIterator<FLTrackGridTable::const_morton_iterator> morton_iterator;
+  typedef FLTrackGridIterator<FLTrackGridTable::const_morton_iterator> const_morton_iterator;
 
   inline static void convert(CGPoint worldLocation, CGFloat segmentSize, int *gridX, int *gridY) {
     *gridX = int(floor(worldLocation.x / segmentSize + 0.5f));
@@ -96,21 +315,278 @@ public:
     return CGPointMake(gridX * segmentSize, gridY * segmentSize);
   }
 
-  FLTrackGrid(CGFloat segmentSize) : segmentSize_(segmentSize), grid_(FLTrackGridSectorSize, FLTrackGridSectorCount, nil) {}
+  FLTrackGrid(CGFloat segmentSize)
+    : segmentSize_(segmentSize),
+      grid_(FLTrackGridSectorSize, FLTrackGridSectorCount, FLSegmentHandleTable::FLSegmentHandleNull, FLTrackGrid::blockPool()),
+      occupancy_(FLTrackGridSectorSize),
+      epoch_(0),
+      journalStartEpoch_(0) {}
+
+  /**
+   * Constructs a grid for a world of known extent (inclusive, in grid coordinates), which
+   * stores its sectors in a directly-indexed array rather than a hash table.  Segments
+   * may still be set outside the bounds, but lookups there are slower.
+   */
+  FLTrackGrid(CGFloat segmentSize, int gridXMin, int gridYMin, int gridXMax, int gridYMax)
+    : segmentSize_(segmentSize),
+      grid_(FLTrackGridSectorSize, gridXMin, gridYMin, gridXMax, gridYMax, FLSegmentHandleTable::FLSegmentHandleNull, FLTrackGrid::blockPool()),
+      occupancy_(FLTrackGridSectorSize),
+      epoch_(0),
+      journalStartEpoch_(0) {}
+
+  FLSegmentNode *get(int gridX, int gridY) const { return handleTable_.get(grid_.getPoint(gridX, gridY)); }
+
+  /**
+   * Returns the segment handle stored in a cell (FLSegmentHandleNull if empty).  Handles,
+   * unlike node pointers, can be serialized or passed to another thread, and resolved
+   * through handleTable() (or, to plain values, through a snapshot).
+   */
+  FLSegmentHandle getHandle(int gridX, int gridY) const { return grid_.getPoint(gridX, gridY); }
+
+  const FLSegmentHandleTable& handleTable() const { return handleTable_; }
+
+  /**
+   * Copies the segment nodes in a rectangular window of the grid into a row-major array of
+   * width * height entries (nil for empty cells): block[(gy - gridY0) * width + (gx - gridX0)].
+   * Faster than calling get() for each cell, since each sector is looked up only once.
+   */
+  void getBlock(int gridX0, int gridY0, int width, int height, __strong FLSegmentNode *block[]) const {
+    // note: Callers mostly want a 3x3 or so neighborhood; avoid the heap for those.
+    const size_t FLBlockHandlesStackMax = 64;
+    size_t blockSize = static_cast<size_t>(width * height);
+    FLSegmentHandle stackHandles[FLBlockHandlesStackMax];
+    std::vector<FLSegmentHandle> heapHandles;
+    FLSegmentHandle *handles = stackHandles;
+    if (blockSize > FLBlockHandlesStackMax) {
+      heapHandles.resize(blockSize);
+      handles = heapHandles.data();
+    }
+    grid_.getBlock(gridX0, gridY0, width, height, handles);
+    for (size_t b = 0; b < blockSize; ++b) {
+      block[b] = handleTable_.get(handles[b]);
+    }
+  }
+
+  // note: Iteration is read-only (cells hold handles, so there are no node references
+  // to assign through); iterator and const_iterator are the same type.
+  const_iterator begin() const { return const_iterator(grid_.beginPoint(), &handleTable_); }
 
-  FLSegmentNode *get(int gridX, int gridY) const { return grid_.getPoint(gridX, gridY); }
+  const_iterator end() const { return const_iterator(grid_.endPoint(), &handleTable_); }
 
-  iterator begin() { return grid_.beginPoint(); }
-  const_iterator begin() const { return grid_.beginPoint(); }
+  /**
+   * Iterates over segment nodes in a stable spatial order (sectors in Morton order, and
+   * cells row-major within each sector) rather than in hash order.  Use this where the
+   * order of results is visible to the user or persisted.
+   */
+  const_morton_iterator beginMorton() const { return const_morton_iterator(grid_.beginPointMorton(), &handleTable_); }
 
-  iterator end() { return grid_.endPoint(); }
-  const_iterator end() const { return grid_.endPoint(); }
+  const_morton_iterator endMorton() const { return const_morton_iterator(grid_.endPointMorton(), &handleTable_); }
 
   size_t size() const { return grid_.pointCount(); }
 
-  void set(int gridX, int gridY, FLSegmentNode *segmentNode) { grid_.setPoint(gridX, gridY, segmentNode); }
+  /**
+   * Returns the heap memory used by the grid (sector table, bucket array, and sector
+   * blocks; see DenseSectorTableMemoryUsage) and a histogram of sector fill (the number of
+   * sectors holding 0, 1, ... FLTrackGridSectorSize^2 segments), for watching memory in a
+   * running app.  The handle table is reported separately by handleTableByteCount().
+   */
+  HLCommon::DenseSectorTableMemoryUsage memoryUsage() const { return grid_.memoryUsage(); }
+  size_t handleTableByteCount() const { return handleTable_.byteCount(); }
+  std::vector<size_t> sectorFillHistogram() const { return grid_.sectorFillHistogram(); }
+
+  /**
+   * Sets a segment node into a cell (or erases the cell, for nil).  A node may be in only
+   * one cell at a time: to move it, erase it from its old cell first.
+   */
+  void set(int gridX, int gridY, FLSegmentNode *segmentNode) {
+    FLSegmentHandle oldHandle = grid_.getPoint(gridX, gridY);
+    if (!segmentNode && oldHandle == FLSegmentHandleTable::FLSegmentHandleNull) {
+      // note: Setting nil in an empty cell is not an edit (as with erase()).
+      return;
+    }
+    // note: The node might be set where it already is, in which case it keeps its handle.
+    FLSegmentHandle newHandle = handleTable_.acquire(segmentNode);
+    grid_.setPoint(gridX, gridY, newHandle);
+    if (oldHandle != newHandle) {
+      handleTable_.release(oldHandle);
+    }
+    bool wasSet = (oldHandle != FLSegmentHandleTable::FLSegmentHandleNull);
+    if (!wasSet && segmentNode) {
+      occupancy_.add(gridX, gridY);
+    } else if (wasSet && !segmentNode) {
+      occupancy_.remove(gridX, gridY);
+    }
+    updateSegmentValue(gridX, gridY, newHandle);
+    updateConnections(gridX, gridY);
+    updateComponents(gridX, gridY, oldHandle, newHandle);
+    ++epoch_;
+    journalChange(gridX, gridY);
+  }
+
+  void erase(int gridX, int gridY) {
+    FLSegmentHandle oldHandle = grid_.getPoint(gridX, gridY);
+    if (oldHandle != FLSegmentHandleTable::FLSegmentHandleNull) {
+      grid_.erasePoint(gridX, gridY);
+      handleTable_.release(oldHandle);
+      occupancy_.remove(gridX, gridY);
+      updateConnections(gridX, gridY);
+      updateComponents(gridX, gridY, oldHandle, FLSegmentHandleTable::FLSegmentHandleNull);
+      ++epoch_;
+      journalChange(gridX, gridY);
+    }
+  }
+
+  /**
+   * Notifies the grid that the segment in a cell was changed in place (rotated or flipped)
+   * rather than by set(), so that its connections can be updated.  No-op for an empty
+   * cell (for instance if the segment was moved or deleted before a deferred update).
+   */
+  void update(int gridX, int gridY) {
+    FLSegmentHandle segmentHandle = grid_.getPoint(gridX, gridY);
+    if (segmentHandle == FLSegmentHandleTable::FLSegmentHandleNull) {
+      return;
+    }
+    updateSegmentValue(gridX, gridY, segmentHandle);
+    updateConnections(gridX, gridY);
+    updateComponents(gridX, gridY, segmentHandle, segmentHandle);
+    ++epoch_;
+    journalChange(gridX, gridY);
+  }
+
+  /**
+   * Notifies the grid that the switch or label of the segment in a cell was changed in
+   * place, so that later snapshots see it.  Cheaper than update(), since connections
+   * don't depend on switches or labels.
+   */
+  void updateSwitchAndLabel(int gridX, int gridY) {
+    FLSegmentHandle segmentHandle = grid_.getPoint(gridX, gridY);
+    if (segmentHandle != FLSegmentHandleTable::FLSegmentHandleNull) {
+      updateSegmentValue(gridX, gridY, segmentHandle);
+      ++epoch_;
+      journalChange(gridX, gridY);
+    }
+  }
+
+  /**
+   * Returns the edit epoch: the number of edits (by set(), erase(), update(),
+   * updateSwitchAndLabel(), or import())
+   * that have changed the grid.  A cache derived from the grid (connections, truth tables,
+   * thumbnails, and so on) can remember the epoch it was built at, and later find out what
+   * changed since then with getSectorEpoch() or getChangedCells().
+   *
+   * note: Segments changed in place without a call to update() are not seen by the
+   * journal (nor by rebuildConnections()).
+   */
+  uint64_t epoch() const { return epoch_; }
+
+  /**
+   * Gets the coordinates of the sector (a square of FLTrackGridSectorSize cells on a side)
+   * containing a cell.
+   */
+  static void getSector(int gridX, int gridY, int *sectorX, int *sectorY) {
+    // note: Arithmetic shift floors toward negative infinity, as in the sector table.
+    const int FLTrackGridSectorShift = HLCommon::DenseSectorTableLog2(FLTrackGridSectorSize);
+    *sectorX = gridX >> FLTrackGridSectorShift;
+    *sectorY = gridY >> FLTrackGridSectorShift;
+  }
+
+  /**
+   * Returns the epoch of the most recent edit to any cell of a sector (see getSector()),
+   * or zero if the sector has never been edited.  Constant time.
+   */
+  uint64_t getSectorEpoch(int sectorX, int sectorY) const {
+    auto s = sectorEpochs_.find(std::pair<int, int>(sectorX, sectorY));
+    return (s == sectorEpochs_.end() ? 0 : s->second);
+  }
+
+  /**
+   * Gets the cells edited after the passed epoch, each once, in sorted order.
+   * Returns false if the journal no longer goes back that far (it keeps only the most
+   * recent FLTrackGridJournalMax cell changes), in which case the caller should treat the
+   * whole grid as changed.
+   *
+   * note: An edit to a cell can also change the connections of the segments in the cells
+   * sharing a corner with it; consumers of connections should look one cell around.
+   */
+  bool getChangedCells(uint64_t sinceEpoch, std::vector<std::pair<int, int>> *cells) const;
+
+  /**
+   * Gets the connections from the port at the passed path and progress (0 or 1) of the
+   * segment in the passed cell: the ports of neighboring segments that the path continues
+   * into, ordered first by neighboring cell (in the order trackGridFindConnecting considers
+   * them) and then by port.  Constant time.  Returns false if the cell is empty or its
+   * segment has no such port; otherwise the connection count may still be zero.
+   *
+   * The connections are maintained incrementally by set(), erase(), and update(), which
+   * only recompute the changed cell and the cells sharing a corner with it.
+   */
+  bool getConnections(int gridX, int gridY, int pathId, int progress,
+                      const FLTrackGridConnection **connections, int *connectionCount) const {
+    auto c = connections_.find(std::pair<int, int>(gridX, gridY));
+    if (c == connections_.end()) {
+      return false;
+    }
+    const FLTrackGridCellConnections& cellConnections = c->second;
+    for (int p = 0; p < cellConnections.portCount; ++p) {
+      if (cellConnections.ports[p].pathId == pathId && cellConnections.ports[p].progress == progress) {
+        *connections = cellConnections.connections[p];
+        *connectionCount = cellConnections.connectionCounts[p];
+        return true;
+      }
+    }
+    return false;
+  }
 
-  void erase(int gridX, int gridY) { grid_.erasePoint(gridX, gridY); }
+  /**
+   * Rebuilds all connections (and connected components) from scratch.  Only needed if
+   * segments in the grid were changed in place without calling update().
+   */
+  void rebuildConnections();
+
+  /**
+   * Gets the handles of all segments connected, directly or indirectly, to the segment
+   * with the passed handle (including itself).  Components are maintained with
+   * union-find as segments are added; removing a segment (or a connection) marks its
+   * component dirty, to be rebuilt on the next call here.  So the cost is usually
+   * proportional to the size of the component.
+   */
+  void getComponent(FLSegmentHandle segmentHandle, std::vector<FLSegmentHandle> *segmentHandles) const;
+
+  /**
+   * Gets the bounding box (inclusive, in grid coordinates) of all segments in the grid.
+   * Constant time.  Returns false if the grid is empty.
+   */
+  bool getBounds(int *gridXMin, int *gridYMin, int *gridXMax, int *gridYMax) const {
+    return occupancy_.getBounds(gridXMin, gridYMin, gridXMax, gridYMax);
+  }
+
+  /**
+   * Returns the origin (minimum grid coordinates) of each region of the passed size which
+   * contains segments and intersects the passed window (inclusive, in grid coordinates).
+   * Region size must be FLTrackGridSectorSize times a power of four (16, 64, 256, ...).
+   * The cost is proportional to the number of regions returned (times the logarithm of
+   * the world size), not to the size of the window, so it's suitable for an overview map
+   * of an infinite grid.
+   */
+  std::vector<std::pair<int, int>> getOccupiedRegions(int regionSize, int gridXMin, int gridYMin, int gridXMax, int gridYMax) const {
+    int level = 0;
+    while (occupancy_.cellSize(level) < regionSize) {
+      ++level;
+    }
+    assert(occupancy_.cellSize(level) == regionSize);
+    std::vector<std::pair<int, int>> regions;
+    occupancy_.getOccupiedCells(level, gridXMin, gridYMin, gridXMax, gridYMax, &regions);
+    return regions;
+  }
+
+  /**
+   * Returns a bitmap of occupied cells, for whole-grid neighborhood logic (isolated
+   * segments, segments with one neighbor, empty cells next to track) using word-wide
+   * stencil operations rather than a get() per cell.  See DenseSectorTableOccupancyBitmap.
+   */
+  HLCommon::DenseSectorTableOccupancyBitmap<FLTrackGridSectorSize> occupancyBitmap() const {
+    return HLCommon::DenseSectorTableOccupancyBitmap<FLTrackGridSectorSize>(grid_);
+  }
 
   CGFloat segmentSize() const { return segmentSize_; }
 
@@ -122,12 +598,105 @@ public:
     return FLTrackGrid::convert(gridX, gridY, segmentSize_);
   }
 
+  /**
+   * Returns a read-only view of the segments in the grid, as plain values, for use by
+   * another thread (for instance, to generate a truth table while the user continues
+   * editing).  The snapshot shares sector blocks and segment value chunks with the grid
+   * until the grid writes to them, so the cost is proportional to the number of sectors;
+   * connections, components, and the journal are not copied.  Links, if passed, are
+   * captured by cell, at a cost proportional to their number.
+   *
+   * The snapshot holds no segment nodes, so it may be read and destroyed on any thread.
+   * It sees segments as of their last set(), update(), updateSwitchAndLabel(), or
+   * import().
+   */
+  std::shared_ptr<const FLTrackGridSnapshot> snapshot(const FLLinks *links = nullptr) const;
+
+  /**
+   * Sets the segment nodes among the children of the passed node into the cells at their
+   * positions, with the same result as calling set() for each in order, but in bulk: the
+   * cost is proportional to the number of imported nodes, not to the size of the grid.
+   * Counts as one edit.
+   */
   void import(SKNode *parentNode);
 
 private:
 
-  HLCommon::DenseSectorTable<FLSegmentNode *> grid_;
+  static HLCommon::DenseSectorTableBlockPool *blockPool();
+
+  void updateConnections(int gridX, int gridY);
+  void connectCell(int gridX, int gridY, FLTrackGridCellConnections& cellConnections);
+  void updateComponents(int gridX, int gridY, FLSegmentHandle oldHandle, FLSegmentHandle newHandle);
+  void getNeighbors(FLSegmentHandle segmentHandle, std::vector<FLSegmentHandle> *neighborHandles) const;
+  void journalChange(int gridX, int gridY);
+  void updateSegmentValue(int gridX, int gridY, FLSegmentHandle segmentHandle);
+
+  FLTrackGridTable grid_;
+  FLSegmentHandleTable handleTable_;
+  FLSegmentValueTable segmentValues_;
   CGFloat segmentSize_;
+  HLCommon::DenseSectorTableOccupancyPyramid occupancy_;
+  std::unordered_map<std::pair<int, int>, FLTrackGridCellConnections, HLCommon::DenseSectorTableKeyHash> connections_;
+  // note: Mutable because dirty components are rebuilt lazily, by const queries.
+  mutable FLConnectedComponents components_;
+  // note: The journal holds (epoch, cell) for recent changes, oldest first; changes at or
+  // before journalStartEpoch_ might have been dropped from it.
+  uint64_t epoch_;
+  uint64_t journalStartEpoch_;
+  std::deque<std::pair<uint64_t, std::pair<int, int>>> journal_;
+  std::unordered_map<std::pair<int, int>, uint64_t, HLCommon::DenseSectorTableKeyHash> sectorEpochs_;
+};
+
+/**
+ * A read-only view of the segments of a track grid at one moment, as plain values; see
+ * FLTrackGrid::snapshot().
+ */
+class FLTrackGridSnapshot
+{
+public:
+
+  FLTrackGridSnapshot(const FLTrackGrid::FLTrackGridTable& grid, const FLSegmentValueTable& segmentValues,
+                      CGFloat segmentSize, uint64_t epoch,
+                      std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> links)
+    : grid_(grid), segmentValues_(segmentValues), segmentSize_(segmentSize), epoch_(epoch), links_(std::move(links)) {}
+
+  size_t size() const { return grid_.pointCount(); }
+
+  CGFloat segmentSize() const { return segmentSize_; }
+
+  /**
+   * Returns the edit epoch of the grid (see FLTrackGrid::epoch()) when the snapshot was
+   * taken.
+   */
+  uint64_t epoch() const { return epoch_; }
+
+  /**
+   * Gets the segment in a cell.  Returns false if the cell is empty.
+   */
+  bool get(int gridX, int gridY, FLSegment *segment) const {
+    FLSegmentHandleTable::FLSegmentHandle segmentHandle = grid_.getPoint(gridX, gridY);
+    if (segmentHandle == FLSegmentHandleTable::FLSegmentHandleNull) {
+      return false;
+    }
+    *segment = segmentValues_.get(segmentHandle);
+    segment->gridX = gridX;
+    segment->gridY = gridY;
+    return true;
+  }
+
+  /**
+   * Copies the segments (and captured links) into a track model, replacing its contents,
+   * so that trains can be run on them.
+   */
+  void exportModel(FLTrackModel *trackModel) const;
+
+private:
+
+  FLTrackGrid::FLTrackGridTable grid_;
+  FLSegmentValueTable segmentValues_;
+  CGFloat segmentSize_;
+  uint64_t epoch_;
+  std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> links_;
 };
 
 class FLTruthTable
@@ -250,6 +819,32 @@ trackGridConvertErase(FLTrackGrid& trackGrid, CGPoint worldLocation)
   trackGrid.erase(gridX, gridY);
 }
 
+/**
+ * Convenience method for converting a world location to grid coordinates and then
+ * calling update().  Useful when the caller has no use for the grid coordinates.
+ */
+inline void
+trackGridConvertUpdate(FLTrackGrid& trackGrid, CGPoint worldLocation)
+{
+  int gridX;
+  int gridY;
+  trackGrid.convert(worldLocation, &gridX, &gridY);
+  trackGrid.update(gridX, gridY);
+}
+
+/**
+ * Convenience method for converting a world location to grid coordinates and then
+ * calling updateSwitchAndLabel().
+ */
+inline void
+trackGridConvertUpdateSwitchAndLabel(FLTrackGrid& trackGrid, CGPoint worldLocation)
+{
+  int gridX;
+  int gridY;
+  trackGrid.convert(worldLocation, &gridX, &gridY);
+  trackGrid.updateSwitchAndLabel(gridX, gridY);
+}
+
 /**
  * Convenience method for returning any segments "adjacent" to a provided point.
  * To be precise:
@@ -278,6 +873,10 @@ trackGridFindAdjacent(const FLTrackGrid& trackGrid, CGPoint worldLocation, __str
  * some Bezier curve paths).  Returns false if no point could be found within the
  * search area.
  *
+ * Segments are rejected by the bounds of their paths before any closer search, and
+ * the search stops early when no farther cell could hold anything closer, so large
+ * search distances cost little when track is nearby.
+ *
  * note: In future, might be a nice feature to accept a search radius in world
  * distance rather than a gridSearchDistance defining a square.
  */
@@ -316,11 +915,49 @@ trackGridFindConnecting(const FLTrackGrid& trackGrid,
                         const std::unordered_map<void *, int> *switchPathIds);
 
 /**
- * Returns all segments connected, directly and indirectly, to the passed segment.
+ * Same as trackGridFindConnecting, but always searches geometrically (asking the segments
+ * around the end point), rather than looking up the grid's connections.  This is what
+ * trackGridFindConnecting falls back on, and a reference for testing the connections.
+ */
+bool
+trackGridFindConnectingGeometric(const FLTrackGrid& trackGrid,
+                                 FLSegmentNode *startSegmentNode, int startPathId, CGFloat startProgress,
+                                 FLSegmentNode **connectingSegmentNode, int *connectingPathId, CGFloat *connectingProgress,
+                                 const std::unordered_map<void *, int> *switchPathIds);
+
+/**
+ * Returns all segments connected, directly and indirectly, to the passed segment (not
+ * including the passed segment itself), in no particular order.  Returns an empty array
+ * if the passed segment isn't in the grid.
  */
 NSArray *
 trackGridGetAllConnecting(const FLTrackGrid& trackGrid, FLSegmentNode *startSegmentNode);
 
+/**
+ * Converts the track in the grid to a vertex and edge model, clearing the passed graph
+ * first.  Each segment is added (in grid order) along with its paths as edges; segments
+ * without paths (e.g. readouts) are added without edges, so that converting back with
+ * trackGridImportGraph recreates them, too.
+ */
+void
+trackGridExportGraph(const FLTrackGrid& trackGrid, FLTrackGraph *trackGraph);
+
+/**
+ * Creates a segment node for each segment in the passed graph (with its type, rotation,
+ * switch value, and label) and sets it into the grid in its cell, replacing any segment
+ * already there.  The caller is responsible for adding the new nodes to a scene.
+ */
+void
+trackGridImportGraph(FLTrackGrid& trackGrid, const FLTrackGraph& trackGraph);
+
+/**
+ * Converts the track in the grid, along with the links between its segments, to a
+ * headless track model, clearing the passed model first.  Links to segments that aren't
+ * in the grid are skipped.
+ */
+void
+trackGridExportModel(const FLTrackGrid& trackGrid, const FLLinks& links, FLTrackModel *trackModel);
+
 /**
  * Generates a truth table of the current track as follows:
  *
@@ -8,6 +8,7 @@
 
 #include "FLTrackGrid.h"
 
+#include <algorithm>
 #include <tgmath.h>
 #include <unordered_set>
 
@@ -20,9 +21,22 @@ using namespace hash;
 
 const size_t FLTrackGridAdjacentMax = 4;
 
+const FLSegmentHandleTable::FLSegmentHandle FLSegmentHandleTable::FLSegmentHandleNull;
+
+HLCommon::DenseSectorTableBlockPool *
+FLTrackGrid::blockPool()
+{
+  // note: Shared by all track grids, and never destroyed, since grid snapshots (which
+  // share sector blocks) might outlive the grid that made them.
+  static HLCommon::DenseSectorTableBlockPool *blockPool = new HLCommon::DenseSectorTableBlockPool;
+  return blockPool;
+}
+
 void
 FLTrackGrid::import(SKNode *parentNode)
 {
+  vector<tuple<int, int, FLSegmentHandle>> segmentHandles;
+  segmentHandles.reserve([[parentNode children] count]);
   for (SKNode *childNode in [parentNode children]) {
     if (![childNode isKindOfClass:[FLSegmentNode class]]) {
       continue;
@@ -30,7 +44,307 @@ FLTrackGrid::import(SKNode *parentNode)
     int gridX;
     int gridY;
     FLTrackGrid::convert(childNode.position, segmentSize_, &gridX, &gridY);
-    grid_.setPoint(gridX, gridY, (FLSegmentNode *)childNode);
+    segmentHandles.emplace_back(gridX, gridY, handleTable_.acquire((FLSegmentNode *)childNode));
+  }
+  if (segmentHandles.empty()) {
+    return;
+  }
+
+  // note: Where several nodes land in the same cell, the last one wins (as with set());
+  // drop the others now, so that everything below is done once per imported cell.
+  unordered_map<pair<int, int>, size_t, HLCommon::DenseSectorTableKeyHash> lastIndexes;
+  lastIndexes.reserve(segmentHandles.size());
+  for (size_t i = 0; i < segmentHandles.size(); ++i) {
+    lastIndexes[pair<int, int>(std::get<0>(segmentHandles[i]), std::get<1>(segmentHandles[i]))] = i;
+  }
+  if (lastIndexes.size() < segmentHandles.size()) {
+    size_t keptCount = 0;
+    for (size_t i = 0; i < segmentHandles.size(); ++i) {
+      int gridX = std::get<0>(segmentHandles[i]);
+      int gridY = std::get<1>(segmentHandles[i]);
+      FLSegmentHandle segmentHandle = std::get<2>(segmentHandles[i]);
+      if (lastIndexes[pair<int, int>(gridX, gridY)] == i) {
+        segmentHandles[keptCount++] = segmentHandles[i];
+      } else if (segmentHandle != grid_.getPoint(gridX, gridY)) {
+        // note: (Unless the superseded node is the one already in the cell, which is
+        // released below as the cell's old handle.)
+        handleTable_.release(segmentHandle);
+      }
+    }
+    segmentHandles.resize(keptCount);
+  }
+
+  // note: As for set(), but in passes over the imported cells only: connections can only
+  // be updated once all their neighbors are in place, and components once all the new
+  // segments are present.
+  vector<FLSegmentHandle> oldHandles;
+  oldHandles.reserve(segmentHandles.size());
+  for (const auto& s : segmentHandles) {
+    oldHandles.push_back(grid_.getPoint(std::get<0>(s), std::get<1>(s)));
+  }
+  grid_.setPoints(segmentHandles);
+  ++epoch_;
+  for (size_t i = 0; i < segmentHandles.size(); ++i) {
+    int gridX = std::get<0>(segmentHandles[i]);
+    int gridY = std::get<1>(segmentHandles[i]);
+    if (oldHandles[i] != std::get<2>(segmentHandles[i])) {
+      handleTable_.release(oldHandles[i]);
+    }
+    if (oldHandles[i] == FLSegmentHandleTable::FLSegmentHandleNull) {
+      occupancy_.add(gridX, gridY);
+    }
+    updateSegmentValue(gridX, gridY, std::get<2>(segmentHandles[i]));
+    journalChange(gridX, gridY);
+  }
+  for (const auto& s : segmentHandles) {
+    updateConnections(std::get<0>(s), std::get<1>(s));
+  }
+  for (const auto& s : segmentHandles) {
+    components_.insert(std::get<2>(s));
+  }
+  for (size_t i = 0; i < segmentHandles.size(); ++i) {
+    updateComponents(std::get<0>(segmentHandles[i]), std::get<1>(segmentHandles[i]), oldHandles[i], std::get<2>(segmentHandles[i]));
+  }
+}
+
+/**
+ * Returns the plain value of a segment node in a cell.
+ */
+static FLSegment
+FL_segmentValue(FLSegmentNode *segmentNode, int gridX, int gridY)
+{
+  FLSegment segment(segmentNode.segmentType, gridX, gridY, normalizeRotationQuarters(segmentNode.zRotationQuarters));
+  segment.switchPathId = segmentNode.switchPathId;
+  segment.label = segmentNode.label;
+  return segment;
+}
+
+void
+FLTrackGrid::updateSegmentValue(int gridX, int gridY, FLSegmentHandle segmentHandle)
+{
+  if (segmentHandle != FLSegmentHandleTable::FLSegmentHandleNull) {
+    segmentValues_.set(segmentHandle, FL_segmentValue(handleTable_.get(segmentHandle), gridX, gridY));
+  }
+}
+
+shared_ptr<const FLTrackGridSnapshot>
+FLTrackGrid::snapshot(const FLLinks *links) const
+{
+  vector<pair<pair<int, int>, pair<int, int>>> linkedCells;
+  if (links) {
+    for (auto link : *links) {
+      FLSegmentNode *segmentNode = (__bridge FLSegmentNode *)link.first.first;
+      FLSegmentNode *linkedSegmentNode = (__bridge FLSegmentNode *)link.first.second;
+      pair<int, int> cell;
+      convert(segmentNode.position, &cell.first, &cell.second);
+      pair<int, int> linkedCell;
+      convert(linkedSegmentNode.position, &linkedCell.first, &linkedCell.second);
+      if (get(cell.first, cell.second) == segmentNode && get(linkedCell.first, linkedCell.second) == linkedSegmentNode) {
+        linkedCells.emplace_back(cell, linkedCell);
+      }
+    }
+  }
+  return make_shared<FLTrackGridSnapshot>(grid_, segmentValues_, segmentSize_, epoch_, std::move(linkedCells));
+}
+
+void
+FLTrackGridSnapshot::exportModel(FLTrackModel *trackModel) const
+{
+  trackModel->clear();
+  for (auto s = grid_.beginPoint(); s != grid_.endPoint(); ++s) {
+    auto point = *s;
+    FLSegment segment = segmentValues_.get(point.second);
+    segment.gridX = point.first.first;
+    segment.gridY = point.first.second;
+    trackModel->set(segment);
+  }
+  for (const auto& link : links_) {
+    trackModel->link(link.first.first, link.first.second, link.second.first, link.second.second);
+  }
+}
+
+bool
+FLTrackGrid::getChangedCells(uint64_t sinceEpoch, vector<pair<int, int>> *cells) const
+{
+  if (sinceEpoch < journalStartEpoch_) {
+    return false;
+  }
+  size_t cellsStart = cells->size();
+  for (auto j = journal_.rbegin(); j != journal_.rend() && j->first > sinceEpoch; ++j) {
+    cells->push_back(j->second);
+  }
+  sort(cells->begin() + static_cast<ptrdiff_t>(cellsStart), cells->end());
+  cells->erase(unique(cells->begin() + static_cast<ptrdiff_t>(cellsStart), cells->end()), cells->end());
+  return true;
+}
+
+void
+FLTrackGrid::journalChange(int gridX, int gridY)
+{
+  journal_.emplace_back(epoch_, pair<int, int>(gridX, gridY));
+  if (journal_.size() > FLTrackGridJournalMax) {
+    journalStartEpoch_ = journal_.front().first;
+    journal_.pop_front();
+  }
+  int sectorX;
+  int sectorY;
+  FLTrackGrid::getSector(gridX, gridY, &sectorX, &sectorY);
+  sectorEpochs_[pair<int, int>(sectorX, sectorY)] = epoch_;
+}
+
+void
+FLTrackGrid::rebuildConnections()
+{
+  connections_.clear();
+  for (auto s = grid_.beginPoint(); s != grid_.endPoint(); ++s) {
+    auto point = *s;
+    FLTrackGridCellConnections& cellConnections = connections_[point.first];
+    cellConnections.portCount = [handleTable_.get(point.second) getPorts:cellConnections.ports];
+  }
+  for (auto& c : connections_) {
+    connectCell(c.first.first, c.first.second, c.second);
+  }
+
+  components_.clear();
+  for (auto s = grid_.beginPoint(); s != grid_.endPoint(); ++s) {
+    components_.insert((*s).second);
+  }
+  for (auto& c : connections_) {
+    FLSegmentHandle segmentHandle = grid_.getPoint(c.first.first, c.first.second);
+    const FLTrackGridCellConnections& cellConnections = c.second;
+    for (int p = 0; p < cellConnections.portCount; ++p) {
+      for (int pc = 0; pc < cellConnections.connectionCounts[p]; ++pc) {
+        components_.unite(segmentHandle, cellConnections.connections[p][pc].segmentHandle);
+      }
+    }
+  }
+}
+
+void
+FLTrackGrid::getComponent(FLSegmentHandle segmentHandle, vector<FLSegmentHandle> *segmentHandles) const
+{
+  if (!components_.contains(segmentHandle)) {
+    segmentHandles->clear();
+    return;
+  }
+  components_.getComponent(segmentHandle, [this](FLSegmentHandle h, vector<FLSegmentHandle> *neighborHandles) {
+    getNeighbors(h, neighborHandles);
+  }, segmentHandles);
+}
+
+void
+FLTrackGrid::updateComponents(int gridX, int gridY, FLSegmentHandle oldHandle, FLSegmentHandle newHandle)
+{
+  // note: Removed segments (and removed connections, if a segment was replaced or changed
+  // in place) might split a component, so mark it for rebuilding.  New connections can
+  // only join components, which is cheap.
+  if (oldHandle != FLSegmentHandleTable::FLSegmentHandleNull) {
+    if (handleTable_.get(oldHandle)) {
+      components_.invalidate(oldHandle);
+    } else {
+      components_.erase(oldHandle);
+    }
+  }
+  if (newHandle != FLSegmentHandleTable::FLSegmentHandleNull) {
+    components_.insert(newHandle);
+    const FLTrackGridCellConnections& cellConnections = connections_.at(pair<int, int>(gridX, gridY));
+    for (int p = 0; p < cellConnections.portCount; ++p) {
+      for (int pc = 0; pc < cellConnections.connectionCounts[p]; ++pc) {
+        components_.unite(newHandle, cellConnections.connections[p][pc].segmentHandle);
+      }
+    }
+  }
+  if (components_.needsCompaction()) {
+    components_.rebuildDirty([this](FLSegmentHandle h, vector<FLSegmentHandle> *neighborHandles) {
+      getNeighbors(h, neighborHandles);
+    });
+  }
+}
+
+void
+FLTrackGrid::getNeighbors(FLSegmentHandle segmentHandle, vector<FLSegmentHandle> *neighborHandles) const
+{
+  // note: Connections are stored by cell, so find the segment's cell by its position (which,
+  // as for trackGridFindConnecting, is assumed to agree with the grid).
+  int gridX;
+  int gridY;
+  convert(handleTable_.get(segmentHandle).position, &gridX, &gridY);
+  if (grid_.getPoint(gridX, gridY) != segmentHandle) {
+    return;
+  }
+  const FLTrackGridCellConnections& cellConnections = connections_.at(pair<int, int>(gridX, gridY));
+  for (int p = 0; p < cellConnections.portCount; ++p) {
+    for (int pc = 0; pc < cellConnections.connectionCounts[p]; ++pc) {
+      neighborHandles->push_back(cellConnections.connections[p][pc].segmentHandle);
+    }
+  }
+}
+
+void
+FLTrackGrid::updateConnections(int gridX, int gridY)
+{
+  pair<int, int> key(gridX, gridY);
+  FLSegmentNode *segmentNode = get(gridX, gridY);
+  if (segmentNode) {
+    FLTrackGridCellConnections& cellConnections = connections_[key];
+    cellConnections.portCount = [segmentNode getPorts:cellConnections.ports];
+  } else {
+    connections_.erase(key);
+  }
+  // note: Segments only connect at corners, so the only connections that can change are
+  // those of the changed cell and the eight cells sharing a corner with it.
+  for (int dx = -1; dx <= 1; ++dx) {
+    for (int dy = -1; dy <= 1; ++dy) {
+      auto c = connections_.find(pair<int, int>(gridX + dx, gridY + dy));
+      if (c != connections_.end()) {
+        connectCell(gridX + dx, gridY + dy, c->second);
+      }
+    }
+  }
+}
+
+void
+FLTrackGrid::connectCell(int gridX, int gridY, FLTrackGridCellConnections& cellConnections)
+{
+  // note: Mirrors the geometric search (formerly in trackGridFindConnecting) of the cells
+  // around a corner, but compares the ports cached for each cell rather than asking the
+  // segments about their paths.
+  FLSegmentHandle segmentHandle = grid_.getPoint(gridX, gridY);
+  for (int p = 0; p < cellConnections.portCount; ++p) {
+    const FLSegmentNodePort& port = cellConnections.ports[p];
+    int& connectionCount = cellConnections.connectionCounts[p];
+    connectionCount = 0;
+    // note: If the end point isn't on a corner (e.g. for the end of a platform) then it
+    // doesn't connect to anything.
+    if (!segmentPortIsCorner(port)) {
+      continue;
+    }
+    int cornerHalfX = gridX * 2 + port.halfX;
+    int cornerHalfY = gridY * 2 + port.halfY;
+    for (int c = 0; c < FLSegmentCornerCellCount; ++c) {
+      int adjacentGridX;
+      int adjacentGridY;
+      segmentCornerCell(cornerHalfX, cornerHalfY, c, &adjacentGridX, &adjacentGridY);
+      FLSegmentHandle adjacentSegmentHandle = grid_.getPoint(adjacentGridX, adjacentGridY);
+      if (adjacentSegmentHandle == FLSegmentHandleTable::FLSegmentHandleNull || adjacentSegmentHandle == segmentHandle) {
+        continue;
+      }
+      const FLTrackGridCellConnections& adjacentCellConnections = connections_.at(pair<int, int>(adjacentGridX, adjacentGridY));
+      int connectingPortIndexes[FLSegmentNodePortsMax];
+      int connectingCount = segmentGetConnectingPorts(port, cornerHalfX, cornerHalfY,
+                                                      adjacentGridX, adjacentGridY,
+                                                      adjacentCellConnections.ports, adjacentCellConnections.portCount,
+                                                      connectingPortIndexes);
+      for (int cp = 0; cp < connectingCount; ++cp) {
+        const FLSegmentNodePort& adjacentPort = adjacentCellConnections.ports[connectingPortIndexes[cp]];
+        assert(connectionCount < FLTrackGridCellConnections::FLPortConnectionsMax);
+        FLTrackGridConnection& connection = cellConnections.connections[p][connectionCount];
+        connection.segmentHandle = adjacentSegmentHandle;
+        connection.pathId = adjacentPort.pathId;
+        connection.progress = adjacentPort.progress;
+        ++connectionCount;
+      }
+    }
   }
 }
 
@@ -195,9 +509,11 @@ trackGridFindAdjacent(const FLTrackGrid& trackGrid, CGPoint worldLocation, __str
     // Corner.
     int rightGridX = int(floor((worldLocation.x + halfSegmentSize) / segmentSize + 0.5f));
     int topGridY = int(floor((worldLocation.y + halfSegmentSize) / segmentSize + 0.5f));
-    for (int gx = rightGridX - 1; gx <= rightGridX; ++gx) {
-      for (int gy = topGridY - 1; gy <= topGridY; ++gy) {
-        adjacent[adjacentCount] = trackGrid.get(gx, gy);
+    FLSegmentNode *block[4];
+    trackGrid.getBlock(rightGridX - 1, topGridY - 1, 2, 2, block);
+    for (int bx = 0; bx < 2; ++bx) {
+      for (int by = 0; by < 2; ++by) {
+        adjacent[adjacentCount] = block[by * 2 + bx];
         if (adjacent[adjacentCount]) {
           ++adjacentCount;
         }
@@ -206,24 +522,24 @@ trackGridFindAdjacent(const FLTrackGrid& trackGrid, CGPoint worldLocation, __str
   } else if (onEdgeX) {
     // Left or right edge.
     int rightGridX = int(floor((worldLocation.x + halfSegmentSize) / segmentSize + 0.5f));
-    adjacent[adjacentCount] = trackGrid.get(rightGridX - 1, gridY);
-    if (adjacent[adjacentCount]) {
-      ++adjacentCount;
-    }
-    adjacent[adjacentCount] = trackGrid.get(rightGridX, gridY);
-    if (adjacent[adjacentCount]) {
-      ++adjacentCount;
+    FLSegmentNode *block[2];
+    trackGrid.getBlock(rightGridX - 1, gridY, 2, 1, block);
+    for (int b = 0; b < 2; ++b) {
+      adjacent[adjacentCount] = block[b];
+      if (adjacent[adjacentCount]) {
+        ++adjacentCount;
+      }
     }
   } else if (onEdgeY) {
     // Top or bottom edge.
     int topGridY = int(floor((worldLocation.y + halfSegmentSize) / segmentSize + 0.5f));
-    adjacent[adjacentCount] = trackGrid.get(gridX, topGridY - 1);
-    if (adjacent[adjacentCount]) {
-      ++adjacentCount;
-    }
-    adjacent[adjacentCount] = trackGrid.get(gridX, topGridY);
-    if (adjacent[adjacentCount]) {
-      ++adjacentCount;
+    FLSegmentNode *block[2];
+    trackGrid.getBlock(gridX, topGridY - 1, 1, 2, block);
+    for (int b = 0; b < 2; ++b) {
+      adjacent[adjacentCount] = block[b];
+      if (adjacent[adjacentCount]) {
+        ++adjacentCount;
+      }
     }
   } else {
     // Middle.
@@ -249,23 +565,62 @@ trackGridFindClosestOnTrackPoint(const FLTrackGrid& trackGrid,
   CGFloat segmentSize = trackGrid.segmentSize();
 
   // Do a less-precise search among all nearby segments.
+  //
+  // note: Cells are visited in rings outward from the center cell.  A segment is searched
+  // only if the bounding box of its paths is no farther than the closest distance found so
+  // far, and the search stops at the first ring whose cells are all farther.  Ties go to
+  // the cell a full scan (by column and then row) would have found first, so pruning
+  // doesn't change the result.
   CGFloat closestSegmentPrecision = progressPrecision * 10.0f;
   FLSegmentNode *closestSegmentNode = nil;
-  CGFloat closestDistance;
-  for (int gx = gridX - gridSearchDistance; gx <= gridX + gridSearchDistance; ++gx) {
-    for (int gy = gridY - gridSearchDistance; gy <= gridY + gridSearchDistance; ++gy) {
-      FLSegmentNode *segmentNode = trackGrid.get(gx, gy);
-      if (!segmentNode) {
-        continue;
-      }
-      CGFloat distance;
-      if ([segmentNode getClosestOnTrackPoint:nil distance:&distance rotation:nil path:nil progress:nil
-                             forOffTrackPoint:worldLocation scale:segmentSize precision:closestSegmentPrecision]) {
-        if (!closestSegmentNode || distance < closestDistance) {
-          closestSegmentNode = segmentNode;
-          closestDistance = distance;
-        }
-      }
+  CGFloat closestDistance = 0.0f;
+  int closestScanIndex = 0;
+  int blockSize = gridSearchDistance * 2 + 1;
+  vector<FLSegmentNode *> block(static_cast<size_t>(blockSize * blockSize));
+  trackGrid.getBlock(gridX - gridSearchDistance, gridY - gridSearchDistance, blockSize, blockSize, block.data());
+  auto searchCell = [&](int bx, int by) {
+    FLSegmentNode *segmentNode = block[static_cast<size_t>(by * blockSize + bx)];
+    if (!segmentNode) {
+      return;
+    }
+    CGFloat distanceLowerBound;
+    if (![segmentNode getClosestOnTrackDistanceLowerBound:&distanceLowerBound forOffTrackPoint:worldLocation scale:segmentSize]
+        || (closestSegmentNode && distanceLowerBound > closestDistance)) {
+      return;
+    }
+    CGFloat distance;
+    [segmentNode getClosestOnTrackPoint:nil distance:&distance rotation:nil path:nil progress:nil
+                       forOffTrackPoint:worldLocation scale:segmentSize precision:closestSegmentPrecision];
+    int scanIndex = bx * blockSize + by;
+    if (!closestSegmentNode
+        || distance < closestDistance
+        || (distance == closestDistance && scanIndex < closestScanIndex)) {
+      closestSegmentNode = segmentNode;
+      closestDistance = distance;
+      closestScanIndex = scanIndex;
+    }
+  };
+  // note: Paths lie inside their cells, so nothing in a ring is closer than the distance
+  // from the location to the ring's inside edge (allowing a little for rounding).
+  const CGFloat FLRingDistancePad = 0.001f;
+  CGFloat centerOffset = fmax(fabs(worldLocation.x / segmentSize - gridX), fabs(worldLocation.y / segmentSize - gridY));
+  for (int ring = 0; ring <= gridSearchDistance; ++ring) {
+    if (closestSegmentNode && ring - 0.5f - centerOffset - FLRingDistancePad > closestDistance) {
+      break;
+    }
+    int low = gridSearchDistance - ring;
+    int high = gridSearchDistance + ring;
+    if (ring == 0) {
+      searchCell(low, low);
+      continue;
+    }
+    for (int b = low; b <= high; ++b) {
+      searchCell(b, low);
+      searchCell(b, high);
+    }
+    for (int b = low + 1; b < high; ++b) {
+      searchCell(low, b);
+      searchCell(high, b);
     }
   }
   if (!closestSegmentNode) {
@@ -281,17 +636,11 @@ trackGridFindClosestOnTrackPoint(const FLTrackGrid& trackGrid,
 }
 
 bool
-trackGridFindConnecting(const FLTrackGrid& trackGrid,
-                        FLSegmentNode *startSegmentNode, int startPathId, CGFloat startProgress,
-                        FLSegmentNode **connectingSegmentNode, int *connectingPathId, CGFloat *connectingProgress,
-                        const unordered_map<void *, int> *switchPathIds)
+trackGridFindConnectingGeometric(const FLTrackGrid& trackGrid,
+                                 FLSegmentNode *startSegmentNode, int startPathId, CGFloat startProgress,
+                                 FLSegmentNode **connectingSegmentNode, int *connectingPathId, CGFloat *connectingProgress,
+                                 const unordered_map<void *, int> *switchPathIds)
 {
-  // note: The paths know statically whether or not they connect at a particular corner, and what their
-  // tangent is at that point.  However, that would require extending their interface (as well as adding
-  // more compile-time information to the file), and it appeals to me to figure out what we need to know
-  // at runtime using getPoint() and getTangent() and testing all endpoints.  My instinct is that it won't
-  // be much slower.
-
   CGFloat segmentSize = trackGrid.segmentSize();
   CGPoint endPoint;
   CGFloat startRotation;
@@ -310,10 +659,12 @@ trackGridFindConnecting(const FLTrackGrid& trackGrid,
   int rightGridX = int(floor((endPoint.x + halfSegmentSize) / segmentSize + 0.5f));
   int topGridY = int(floor((endPoint.y + halfSegmentSize) / segmentSize + 0.5f));
 
-  for (int gx = rightGridX - 1; gx <= rightGridX; ++gx) {
-    for (int gy = topGridY - 1; gy <= topGridY; ++gy) {
+  FLSegmentNode *block[4];
+  trackGrid.getBlock(rightGridX - 1, topGridY - 1, 2, 2, block);
+  for (int bx = 0; bx < 2; ++bx) {
+    for (int by = 0; by < 2; ++by) {
 
-      FLSegmentNode *segmentNode = trackGrid.get(gx, gy);
+      FLSegmentNode *segmentNode = block[by * 2 + bx];
       if (!segmentNode || segmentNode == startSegmentNode) {
         continue;
       }
@@ -343,91 +694,128 @@ trackGridFindConnecting(const FLTrackGrid& trackGrid,
   return false;
 }
 
-static NSSet *
-FL_getAllDirectlyConnecting(const FLTrackGrid& trackGrid, FLSegmentNode *segmentNode, FLSegmentNode *sourceSegmentNode)
+bool
+trackGridFindConnecting(const FLTrackGrid& trackGrid,
+                        FLSegmentNode *startSegmentNode, int startPathId, CGFloat startProgress,
+                        FLSegmentNode **connectingSegmentNode, int *connectingPathId, CGFloat *connectingProgress,
+                        const unordered_map<void *, int> *switchPathIds)
 {
-  NSMutableSet *directlyConnectingSegmentNodes = [NSMutableSet set];
-
-  CGFloat segmentSize = trackGrid.segmentSize();
-  CGFloat halfSegmentSize = segmentSize / 2.0f;
-
-  int pathCount = [segmentNode pathCount];
-  for (int pathId = 0; pathId < pathCount; ++pathId) {
-
-    for (NSInteger progressInt = 0; progressInt <= 1; ++progressInt) {
-      CGFloat progress = (CGFloat)progressInt;
-
-      CGPoint endPoint;
-      CGFloat rotation;
-      [segmentNode getPoint:&endPoint rotation:&rotation forPath:pathId progress:progress scale:segmentSize];
+  // note: The grid keeps the connections of every path end up to date, so usually this is
+  // just a lookup.  If the start segment isn't actually in the grid where its position says
+  // it is (say, a segment being dragged), or if the start progress isn't an end point, then
+  // search geometrically instead.
+  int gridX;
+  int gridY;
+  trackGrid.convert(startSegmentNode.position, &gridX, &gridY);
+  const FLTrackGridConnection *connections;
+  int connectionCount;
+  if ((startProgress != 0.0f && startProgress != 1.0f)
+      || trackGrid.get(gridX, gridY) != startSegmentNode
+      || !trackGrid.getConnections(gridX, gridY, startPathId, int(startProgress), &connections, &connectionCount)) {
+    return trackGridFindConnectingGeometric(trackGrid,
+                                            startSegmentNode, startPathId, startProgress,
+                                            connectingSegmentNode, connectingPathId, connectingProgress,
+                                            switchPathIds);
+  }
+  if (connectionCount == 0) {
+    return false;
+  }
 
-      // note: Currently segments only connect at corners.  If the end point isn't on a corner (e.g.
-      // for the end of a platform) then it doesn't connect to anything.
-      bool onEdgeX;
-      bool onEdgeY;
-      trackGridIsOnEdge(trackGrid, endPoint, &onEdgeX, &onEdgeY);
-      if (!onEdgeX || !onEdgeY) {
-        continue;
+  // note: Connections are ordered by segment, so the first segment found is the one that
+  // connects.  If it connects by more than one path, then its switch chooses between them
+  // (or else the first one found is chosen).
+  FLSegmentHandleTable::FLSegmentHandle segmentHandle = connections[0].segmentHandle;
+  FLSegmentNode *segmentNode = trackGrid.handleTable().get(segmentHandle);
+  int c = 0;
+  if ([segmentNode canSwitch]) {
+    int switchPathId = segmentNode.switchPathId;
+    if (switchPathIds) {
+      auto spi = switchPathIds->find((__bridge void *)segmentNode);
+      if (spi != switchPathIds->end()) {
+        switchPathId = spi->second;
       }
-  
-      int rightGridX = int(floor((endPoint.x + halfSegmentSize) / segmentSize + 0.5f));
-      int topGridY = int(floor((endPoint.y + halfSegmentSize) / segmentSize + 0.5f));
-  
-      for (int gx = rightGridX - 1; gx <= rightGridX; ++gx) {
-        for (int gy = topGridY - 1; gy <= topGridY; ++gy) {
-      
-          FLSegmentNode *adjacentSegmentNode = trackGrid.get(gx, gy);
-          if (!adjacentSegmentNode || adjacentSegmentNode == segmentNode || adjacentSegmentNode == sourceSegmentNode) {
-            continue;
-          }
-      
-          if ([adjacentSegmentNode hasConnectingPathForEndPoint:endPoint
-                                                       rotation:rotation
-                                                       progress:progress
-                                                          scale:segmentSize]) {
-            [directlyConnectingSegmentNodes addObject:adjacentSegmentNode];
-          }
-        }
+    }
+    for (int sc = 0; sc < connectionCount && connections[sc].segmentHandle == segmentHandle; ++sc) {
+      if (connections[sc].pathId == switchPathId) {
+        c = sc;
+        break;
       }
     }
   }
-  return directlyConnectingSegmentNodes;
+  *connectingSegmentNode = segmentNode;
+  *connectingPathId = connections[c].pathId;
+  *connectingProgress = CGFloat(connections[c].progress);
+  return true;
 }
 
 NSArray *
 trackGridGetAllConnecting(const FLTrackGrid& trackGrid, FLSegmentNode *startSegmentNode)
 {
   NSMutableArray *connectingSegmentNodes = [NSMutableArray array];
-  NSMutableSet *connectingSegmentNodePointers = [NSMutableSet set];
-
-  NSMutableArray *unprocessedSegmentNodes = [NSMutableArray array];
-  NSMutableArray *unprocessedSegmentNodeSources = [NSMutableArray array];
-
-  // note: The "source" is the node which was processed to find the connection to this node.
-  FLSegmentNode *segmentNode = startSegmentNode;
-  FLSegmentNode *sourceSegmentNode = nil;
+  const FLSegmentHandleTable& handleTable = trackGrid.handleTable();
+  FLSegmentHandleTable::FLSegmentHandle startSegmentHandle = handleTable.find(startSegmentNode);
+  if (startSegmentHandle == FLSegmentHandleTable::FLSegmentHandleNull) {
+    return connectingSegmentNodes;
+  }
+  vector<FLSegmentHandleTable::FLSegmentHandle> segmentHandles;
+  trackGrid.getComponent(startSegmentHandle, &segmentHandles);
+  for (auto segmentHandle : segmentHandles) {
+    if (segmentHandle != startSegmentHandle) {
+      [connectingSegmentNodes addObject:handleTable.get(segmentHandle)];
+    }
+  }
+  return connectingSegmentNodes;
+}
 
-  while (segmentNode) {
+void
+trackGridExportGraph(const FLTrackGrid& trackGrid, FLTrackGraph *trackGraph)
+{
+  trackGraph->clear();
+  for (auto s = trackGrid.begin(); s != trackGrid.end(); ++s) {
+    auto cell = *s;
+    trackGraph->addSegment(FL_segmentValue(cell.second, cell.first.first, cell.first.second));
+  }
+}
 
-    NSSet *directlyConnectingSegmentNodes = FL_getAllDirectlyConnecting(trackGrid, segmentNode, sourceSegmentNode);
-    for (FLSegmentNode *directlyConnectingSegmentNode in directlyConnectingSegmentNodes) {
-      NSValue *directlyConnectingSegmentNodePointer = [NSValue valueWithNonretainedObject:directlyConnectingSegmentNode];
-      if (![connectingSegmentNodePointers containsObject:directlyConnectingSegmentNodePointer]) {
-        [connectingSegmentNodes addObject:directlyConnectingSegmentNode];
-        [connectingSegmentNodePointers addObject:directlyConnectingSegmentNodePointer];
-        [unprocessedSegmentNodes addObject:directlyConnectingSegmentNode];
-        [unprocessedSegmentNodeSources addObject:segmentNode];
-      }
+void
+trackGridImportGraph(FLTrackGrid& trackGrid, const FLTrackGraph& trackGraph)
+{
+  for (uint32_t segmentId = 0; segmentId < trackGraph.segmentCount(); ++segmentId) {
+    const FLTrackGraphSegment& segment = trackGraph.segment(segmentId);
+    FLSegmentNode *segmentNode = [[FLSegmentNode alloc] initWithSegmentType:segment.segmentType];
+    segmentNode.position = trackGrid.convert(segment.gridX, segment.gridY);
+    segmentNode.zRotationQuarters = segment.rotationQuarters;
+    if (segment.canSwitch()) {
+      [segmentNode setSwitchPathId:segment.switchPathId animated:NO];
+    }
+    if (segment.label != FLSegmentLabelNone) {
+      segmentNode.label = segment.label;
     }
+    trackGrid.set(segment.gridX, segment.gridY, segmentNode);
+  }
+}
 
-    segmentNode = [unprocessedSegmentNodes lastObject];
-    sourceSegmentNode = [unprocessedSegmentNodeSources lastObject];
-    if (segmentNode) {
-      [unprocessedSegmentNodes removeLastObject];
-      [unprocessedSegmentNodeSources removeLastObject];
+void
+trackGridExportModel(const FLTrackGrid& trackGrid, const FLLinks& links, FLTrackModel *trackModel)
+{
+  trackModel->clear();
+  for (auto s = trackGrid.begin(); s != trackGrid.end(); ++s) {
+    auto cell = *s;
+    trackModel->set(FL_segmentValue(cell.second, cell.first.first, cell.first.second));
+  }
+  for (auto link : links) {
+    FLSegmentNode *segmentNode = (__bridge FLSegmentNode *)link.first.first;
+    FLSegmentNode *linkedSegmentNode = (__bridge FLSegmentNode *)link.first.second;
+    int gridX;
+    int gridY;
+    trackGrid.convert(segmentNode.position, &gridX, &gridY);
+    int linkedGridX;
+    int linkedGridY;
+    trackGrid.convert(linkedSegmentNode.position, &linkedGridX, &linkedGridY);
+    if (trackGrid.get(gridX, gridY) == segmentNode && trackGrid.get(linkedGridX, linkedGridY) == linkedSegmentNode) {
+      trackModel->link(gridX, gridY, linkedGridX, linkedGridY);
     }
   }
-  return connectingSegmentNodes;
 }
 
 struct FLRunState
@@ -539,8 +927,10 @@ trackGridGenerateTruthTable(const FLTrackGrid& trackGrid, const FLLinks& links,
   NSMutableArray *platformStartSegmentNodes = [NSMutableArray array];
   NSMutableArray *inputSegmentNodes = [NSMutableArray array];
   NSMutableArray *outputSegmentNodes = [NSMutableArray array];
-  for (auto s : trackGrid) {
-    FLSegmentNode *segmentNode = s.second;
+  // note: Collect in a stable spatial order, so that (when not sorted by label) the inputs
+  // and outputs come out the same way every time.
+  for (auto s = trackGrid.beginMorton(); s != trackGrid.endMorton(); ++s) {
+    FLSegmentNode *segmentNode = (*s).second;
     switch (segmentNode.segmentType) {
       case FLSegmentTypeReadoutInput:
         [inputSegmentNodes addObject:segmentNode];
@@ -0,0 +1,252 @@
+//
+//  FLTrackModel.cpp
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#include "FLTrackModel.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace HLCommon;
+
+const uint32_t FLTrackModel::FLSegmentIndexNull;
+
+void
+FLTrackModel::clear()
+{
+  for (const FLSegment& segment : segments_) {
+    grid_.erasePoint(segment.gridX, segment.gridY, true);
+  }
+  segments_.clear();
+  links_.clear();
+}
+
+void
+FLTrackModel::set(const FLSegment& segment)
+{
+  uint32_t segmentIndex = grid_.getPoint(segment.gridX, segment.gridY);
+  if (segmentIndex != FLSegmentIndexNull) {
+    segments_[segmentIndex - 1] = segment;
+    return;
+  }
+  segments_.push_back(segment);
+  grid_.setPoint(segment.gridX, segment.gridY, static_cast<uint32_t>(segments_.size()));
+}
+
+bool
+FLTrackModel::erase(int gridX, int gridY)
+{
+  uint32_t segmentIndex = grid_.getPoint(gridX, gridY);
+  if (segmentIndex == FLSegmentIndexNull) {
+    return false;
+  }
+  // note: Keep the array compact by moving the last segment into the hole.
+  uint32_t lastSegmentIndex = static_cast<uint32_t>(segments_.size());
+  if (segmentIndex != lastSegmentIndex) {
+    FLSegment& movedSegment = segments_[segmentIndex - 1];
+    movedSegment = segments_[lastSegmentIndex - 1];
+    grid_.setPoint(movedSegment.gridX, movedSegment.gridY, segmentIndex);
+  }
+  segments_.pop_back();
+  grid_.erasePoint(gridX, gridY, true);
+
+  auto l = links_.find(pair<int, int>(gridX, gridY));
+  if (l != links_.end()) {
+    for (const pair<int, int>& linkedCell : l->second) {
+      auto ll = links_.find(linkedCell);
+      ll->second.erase(std::remove(ll->second.begin(), ll->second.end(), l->first), ll->second.end());
+      if (ll->second.empty()) {
+        links_.erase(ll);
+      }
+    }
+    links_.erase(l);
+  }
+  return true;
+}
+
+void
+FLTrackModel::link(int gridX, int gridY, int linkedGridX, int linkedGridY)
+{
+  pair<int, int> cell(gridX, gridY);
+  pair<int, int> linkedCell(linkedGridX, linkedGridY);
+  if (cell == linkedCell) {
+    return;
+  }
+  vector<pair<int, int>>& cellLinks = links_[cell];
+  if (std::find(cellLinks.begin(), cellLinks.end(), linkedCell) != cellLinks.end()) {
+    return;
+  }
+  cellLinks.push_back(linkedCell);
+  links_[linkedCell].push_back(cell);
+}
+
+void
+FLTrackModel::unlink(int gridX, int gridY, int linkedGridX, int linkedGridY)
+{
+  pair<int, int> cell(gridX, gridY);
+  pair<int, int> linkedCell(linkedGridX, linkedGridY);
+  auto l = links_.find(cell);
+  if (l == links_.end()) {
+    return;
+  }
+  l->second.erase(std::remove(l->second.begin(), l->second.end(), linkedCell), l->second.end());
+  if (l->second.empty()) {
+    links_.erase(l);
+  }
+  l = links_.find(linkedCell);
+  if (l == links_.end()) {
+    return;
+  }
+  l->second.erase(std::remove(l->second.begin(), l->second.end(), cell), l->second.end());
+  if (l->second.empty()) {
+    links_.erase(l);
+  }
+}
+
+void
+FLTrackModel::getLinks(int gridX, int gridY, vector<pair<int, int>> *linkedCells) const
+{
+  auto l = links_.find(pair<int, int>(gridX, gridY));
+  if (l != links_.end()) {
+    linkedCells->insert(linkedCells->end(), l->second.begin(), l->second.end());
+  }
+}
+
+bool
+FLTrackModel::hasAnyLinks(int gridX, int gridY) const
+{
+  return links_.find(pair<int, int>(gridX, gridY)) != links_.end();
+}
+
+void
+FLTrackModel::setSwitchPathId(int gridX, int gridY, int switchPathId)
+{
+  uint32_t segmentIndex = grid_.getPoint(gridX, gridY);
+  if (segmentIndex != FLSegmentIndexNull && segments_[segmentIndex - 1].canSwitch()) {
+    segments_[segmentIndex - 1].switchPathId = switchPathId;
+  }
+  auto l = links_.find(pair<int, int>(gridX, gridY));
+  if (l == links_.end()) {
+    return;
+  }
+  for (const pair<int, int>& linkedCell : l->second) {
+    uint32_t linkedSegmentIndex = grid_.getPoint(linkedCell.first, linkedCell.second);
+    if (linkedSegmentIndex != FLSegmentIndexNull && segments_[linkedSegmentIndex - 1].canSwitch()) {
+      segments_[linkedSegmentIndex - 1].switchPathId = switchPathId;
+    }
+  }
+}
+
+bool
+FLTrackModel::findConnecting(const FLTrackModelPosition& fromPosition, FLTrackModelPosition *connectingPosition) const
+{
+  const FLSegment *segment = get(fromPosition.gridX, fromPosition.gridY);
+  if (!segment) {
+    return false;
+  }
+  FLSegmentNodePort ports[FLSegmentNodePortsMax];
+  int portCount = segment->getPorts(ports);
+  // note: Ports are ordered by path, and then progress 0 before progress 1.
+  int fromPortIndex = fromPosition.pathId * 2 + fromPosition.progress;
+  if (fromPortIndex < 0 || fromPortIndex >= portCount) {
+    return false;
+  }
+  const FLSegmentNodePort& fromPort = ports[fromPortIndex];
+  if (!segmentPortIsCorner(fromPort)) {
+    return false;
+  }
+  int cornerHalfX = fromPosition.gridX * 2 + fromPort.halfX;
+  int cornerHalfY = fromPosition.gridY * 2 + fromPort.halfY;
+
+  for (int c = 0; c < FLSegmentCornerCellCount; ++c) {
+    int adjacentGridX;
+    int adjacentGridY;
+    segmentCornerCell(cornerHalfX, cornerHalfY, c, &adjacentGridX, &adjacentGridY);
+    if (adjacentGridX == fromPosition.gridX && adjacentGridY == fromPosition.gridY) {
+      continue;
+    }
+    const FLSegment *adjacentSegment = get(adjacentGridX, adjacentGridY);
+    if (!adjacentSegment) {
+      continue;
+    }
+    FLSegmentNodePort adjacentPorts[FLSegmentNodePortsMax];
+    int adjacentPortCount = adjacentSegment->getPorts(adjacentPorts);
+    int connectingPortIndexes[FLSegmentNodePortsMax];
+    int connectingCount = segmentGetConnectingPorts(fromPort, cornerHalfX, cornerHalfY,
+                                                    adjacentGridX, adjacentGridY, adjacentPorts, adjacentPortCount,
+                                                    connectingPortIndexes);
+    if (connectingCount == 0) {
+      continue;
+    }
+    // note: If the segment connects by more than one path, then its switch chooses
+    // between them (or else the first one found is chosen).
+    const FLSegmentNodePort *connectingPort = &adjacentPorts[connectingPortIndexes[0]];
+    if (adjacentSegment->canSwitch()) {
+      for (int cp = 1; cp < connectingCount; ++cp) {
+        if (adjacentPorts[connectingPortIndexes[cp]].pathId == adjacentSegment->switchPathId) {
+          connectingPort = &adjacentPorts[connectingPortIndexes[cp]];
+          break;
+        }
+      }
+    }
+    connectingPosition->gridX = adjacentGridX;
+    connectingPosition->gridY = adjacentGridY;
+    connectingPosition->pathId = connectingPort->pathId;
+    connectingPosition->progress = connectingPort->progress;
+    return true;
+  }
+  return false;
+}
+
+bool
+FLTrackModel::runTrain(int platformStartGridX, int platformStartGridY, FLTrackModelPosition *stopPosition)
+{
+  // note: As in trackGridGenerateTruthTable, loops are detected only by revisiting the
+  // same path (going the same direction) of a segment with more than one path.  Each
+  // segment has at most FLSegmentNodePortsMax path ends, so the visited ends of a segment
+  // fit in a bitmask.
+  unordered_map<pair<int, int>, uint8_t, DenseSectorTableKeyHash> visitedEnds;
+
+  FLTrackModelPosition position;
+  position.gridX = platformStartGridX;
+  position.gridY = platformStartGridY;
+  position.pathId = 0;
+  position.progress = 1;
+
+  while (true) {
+    const FLSegment *segment = get(position.gridX, position.gridY);
+    if (!segment) {
+      break;
+    }
+
+    // note: Going "against" the switch, not "with" it, triggers it to change value
+    // according to the path just taken.
+    if (segment->doesSwitch() && segmentSwitchProgress(segment->segmentType, position.pathId) == position.progress) {
+      setSwitchPathId(position.gridX, position.gridY, position.pathId);
+    }
+
+    if (segment->pathCount() > 1) {
+      uint8_t& segmentVisitedEnds = visitedEnds[pair<int, int>(position.gridX, position.gridY)];
+      uint8_t end = static_cast<uint8_t>(1 << (position.pathId * 2 + position.progress));
+      if ((segmentVisitedEnds & end) != 0) {
+        *stopPosition = position;
+        return false;
+      }
+      segmentVisitedEnds |= end;
+    }
+
+    FLTrackModelPosition connectingPosition;
+    if (!findConnecting(position, &connectingPosition)) {
+      break;
+    }
+    position = connectingPosition;
+    position.progress = 1 - connectingPosition.progress;
+  }
+
+  *stopPosition = position;
+  return true;
+}
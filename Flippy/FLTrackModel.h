@@ -0,0 +1,128 @@
+//
+//  FLTrackModel.h
+//  Flippy
+//
+//  Created by Karl Voskuil on 11/25/14.
+//  Copyright (c) 2014 Hilo Games. All rights reserved.
+//
+
+#ifndef __Flippy__FLTrackModel__
+#define __Flippy__FLTrackModel__
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "DenseSectorTable.h"
+#include "FLSegment.h"
+
+/**
+ * A place on the track: a segment (by its cell), a path of the segment, and an end of the
+ * path (by progress, 0 or 1).
+ */
+struct FLTrackModelPosition
+{
+  int gridX;
+  int gridY;
+  int pathId;
+  int progress;
+};
+
+/**
+ * A headless container of track: FLSegment values stored by cell, in the same kind of
+ * sector table as FLTrackGrid, plus the links between segments (as in FLLinks).  Nothing
+ * here depends on SpriteKit, so a track can be built, edited, and run (see runTrain())
+ * anywhere, for instance in a test or on another thread; see trackGridExportModel for
+ * conversion from a track grid.
+ *
+ * Segments are stored by value in a compact array, and cells hold their indexes; the
+ * array order is not meaningful, and changes when segments are erased.
+ */
+class FLTrackModel
+{
+public:
+
+  static const int FLTrackModelSectorSize = 16;
+  static const int FLTrackModelSectorCount = 64;
+
+  FLTrackModel() : grid_(FLTrackModelSectorSize, FLTrackModelSectorCount, FLSegmentIndexNull) {}
+
+  void clear();
+
+  size_t size() const { return segments_.size(); }
+
+  const std::vector<FLSegment>& segments() const { return segments_; }
+
+  /**
+   * Returns the segment in a cell, or nullptr if the cell is empty.  The pointer is
+   * invalidated by set() or erase().
+   */
+  const FLSegment *get(int gridX, int gridY) const {
+    uint32_t segmentIndex = grid_.getPoint(gridX, gridY);
+    return (segmentIndex == FLSegmentIndexNull ? nullptr : &segments_[segmentIndex - 1]);
+  }
+
+  /**
+   * Sets a segment in the cell given by its grid location, replacing any segment already
+   * there.  Links of the cell are kept.
+   */
+  void set(const FLSegment& segment);
+
+  /**
+   * Erases the segment in a cell, along with its links.  Returns false if the cell was
+   * empty.
+   */
+  bool erase(int gridX, int gridY);
+
+  /**
+   * Links two segments (by cell) so that they switch together; see setSwitchPathId().
+   * Linking is symmetric.
+   */
+  void link(int gridX, int gridY, int linkedGridX, int linkedGridY);
+
+  void unlink(int gridX, int gridY, int linkedGridX, int linkedGridY);
+
+  void getLinks(int gridX, int gridY, std::vector<std::pair<int, int>> *linkedCells) const;
+
+  bool hasAnyLinks(int gridX, int gridY) const;
+
+  /**
+   * Sets the switch path id of a segment and of the segments linked to it.  As with
+   * linksSetSwitchPathId, propagation is not recursive.  Segments that can't switch are
+   * ignored.
+   */
+  void setSwitchPathId(int gridX, int gridY, int switchPathId);
+
+  /**
+   * Finds where a train leaving a segment from the end of a path continues, choosing as
+   * trackGridFindConnecting does: paths connect only at corners; the first neighboring
+   * cell (left cells first, then bottom before top) with a connecting path is chosen; and
+   * if it connects by more than one path and can switch, then its switch selects the path.
+   * The connecting position is the end of the path where the train arrives.  Returns
+   * false if nothing connects.
+   */
+  bool findConnecting(const FLTrackModelPosition& fromPosition, FLTrackModelPosition *connectingPosition) const;
+
+  /**
+   * Runs a train from a platform start segment until it can go no further, as
+   * trackGridGenerateTruthTable does: a train going against a switch sets it (and the
+   * segments linked to it) to the path the train is on.  The switches of the model are
+   * changed accordingly; run a copy to leave them alone.  Gets the end of the path where
+   * the train stopped, and returns false if the train was caught in an infinite loop (in
+   * which case the position is where the loop was detected).
+   */
+  bool runTrain(int platformStartGridX, int platformStartGridY, FLTrackModelPosition *stopPosition);
+
+private:
+
+  // note: Cells hold one plus the index of their segment, so that zero is empty.
+  static const uint32_t FLSegmentIndexNull = 0;
+
+  typedef HLCommon::DenseSectorTable<uint32_t, HLCommon::DenseSectorTableBoundedBackend, FLTrackModelSectorSize> FLTrackModelTable;
+
+  FLTrackModelTable grid_;
+  std::vector<FLSegment> segments_;
+  std::unordered_map<std::pair<int, int>, std::vector<std::pair<int, int>>, HLCommon::DenseSectorTableKeyHash> links_;
+};
+
+#endif /* defined(__Flippy__FLTrackModel__) */
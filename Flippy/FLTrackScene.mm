@@ -500,7 +500,7 @@ struct PointerPairHash
     _cameraMode = FLCameraModeManual;
     _simulationRunning = NO;
     _simulationSpeed = 0;
-    _trackGrid.reset(new FLTrackGrid(FLTrackSegmentSize));
+    _trackGrid.reset(new FLTrackGrid(FLTrackSegmentSize, FLTrackGridXMin, FLTrackGridYMin, FLTrackGridXMax, FLTrackGridYMax));
     self.gestureTargetHitTestMode = HLSceneGestureTargetHitTestModeZPositionThenParent;
   }
   return self;
@@ -559,7 +559,7 @@ struct PointerPairHash
     [self FL_simulationToolbarSetVisible:YES];
 
     // Recreate track grid based on segments in track node.
-    _trackGrid.reset(new FLTrackGrid(FLSegmentArtSizeBasic * FLTrackArtScale));
+    _trackGrid.reset(new FLTrackGrid(FLSegmentArtSizeBasic * FLTrackArtScale, FLTrackGridXMin, FLTrackGridYMin, FLTrackGridXMax, FLTrackGridYMax));
     _trackGrid->import(_trackNode);
 
     // Decode links model and re-create links layer.
@@ -4856,6 +4856,7 @@ writeArchiveWithPath:exportPath
       [_linkEditState.connectorNode runAction:blinkAction];
       _links.insert(_linkEditState.beginNode, _linkEditState.endNode, _linkEditState.connectorNode);
       [_linkEditState.endNode setSwitchPathId:[_linkEditState.beginNode switchPathId] animated:YES];
+      trackGridConvertUpdateSwitchAndLabel(*_trackGrid, _linkEditState.endNode.position);
       preserveConnectorNode = YES;
       if (_tutorialState.tutorialActive) {
         [self FL_tutorialRecognizedAction:FLTutorialActionLinkCreated withArguments:nil];
@@ -4931,6 +4932,7 @@ writeArchiveWithPath:exportPath
     return;
   }
   linksSetSwitchPathId(_links, segmentNode, pathId, animated);
+  [self FL_trackGridUpdateSwitchesLinkedToSegment:segmentNode];
   if (animated) {
     [_trackNode runAction:[SKAction playSoundFileNamed:@"ka-chick.caf" waitForCompletion:NO]];
   }
@@ -4939,6 +4941,7 @@ writeArchiveWithPath:exportPath
 - (void)FL_linkSwitchTogglePathIdForSegment:(FLSegmentNode *)segmentNode animated:(BOOL)animated
 {
   linksToggleSwitchPathId(_links, segmentNode, animated);
+  [self FL_trackGridUpdateSwitchesLinkedToSegment:segmentNode];
   if (animated) {
     [_trackNode runAction:[SKAction playSoundFileNamed:@"ka-chick.caf" waitForCompletion:NO]];
   }
@@ -4948,12 +4951,25 @@ writeArchiveWithPath:exportPath
 {
   for (FLSegmentNode *segmentNode in segmentNodes) {
     linksToggleSwitchPathId(_links, segmentNode, animated);
+    [self FL_trackGridUpdateSwitchesLinkedToSegment:segmentNode];
   }
   if (animated) {
     [_trackNode runAction:[SKAction playSoundFileNamed:@"ka-chick.caf" waitForCompletion:NO]];
   }
 }
 
+- (void)FL_trackGridUpdateSwitchesLinkedToSegment:(FLSegmentNode *)segmentNode
+{
+  // note: Switches are changed on the nodes directly (by linksSetSwitchPathId and
+  // friends); tell the track grid, so that its snapshots see them.
+  trackGridConvertUpdateSwitchAndLabel(*_trackGrid, segmentNode.position);
+  vector<FLSegmentNode *> linkedSegmentNodes;
+  _links.get(segmentNode, &linkedSegmentNodes);
+  for (FLSegmentNode *linkedSegmentNode : linkedSegmentNodes) {
+    trackGridConvertUpdateSwitchAndLabel(*_trackGrid, linkedSegmentNode.position);
+  }
+}
+
 - (FLSegmentNode *)FL_linkSwitchFindSegmentNearLocation:(CGPoint)worldLocation
 {
   int gridX;
@@ -4962,9 +4978,11 @@ writeArchiveWithPath:exportPath
 
   FLSegmentNode *closestSegmentNode = nil;
   CGFloat closestDistanceSquared;
-  for (int gx = gridX - 1; gx <= gridX + 1; ++gx) {
-    for (int gy = gridY - 1; gy <= gridY + 1; ++gy) {
-      FLSegmentNode *segmentNode = _trackGrid->get(gx, gy);
+  FLSegmentNode *block[9];
+  _trackGrid->getBlock(gridX - 1, gridY - 1, 3, 3, block);
+  for (int bx = 0; bx < 3; ++bx) {
+    for (int by = 0; by < 3; ++by) {
+      FLSegmentNode *segmentNode = block[by * 3 + bx];
       if (!segmentNode || !segmentNode.canSwitch) {
         continue;
       }
@@ -5137,6 +5155,7 @@ writeArchiveWithPath:exportPath
     [_labelState.labelPicker setSelectionForSquare:squareIndex];
     for (FLSegmentNode *segmentNode in _labelState.segmentNodesToBeLabeled) {
       segmentNode.label = FLLabelPickerLabels[squareIndex];
+      trackGridConvertUpdateSwitchAndLabel(*_trackGrid, segmentNode.position);
     }
   }
   _labelState.segmentNodesToBeLabeled = nil;
@@ -5167,12 +5186,14 @@ writeArchiveWithPath:exportPath
   // angle; recalculate it.
   if (!animated) {
     segmentNode.zRotationQuarters = newRotationQuarters;
+    trackGridConvertUpdate(*_trackGrid, segmentNode.position);
     [self FL_linkRedrawForSegment:segmentNode];
   } else {
     [self FL_linkHideForSegment:segmentNode];
     segmentNode.mayShowLabel = NO;
     segmentNode.mayShowBubble = NO;
     [segmentNode runAction:[SKAction rotateToAngle:(newRotationQuarters * (CGFloat)M_PI_2) duration:FLTrackRotateDuration shortestUnitArc:YES] completion:^{
+      trackGridConvertUpdate(*(self->_trackGrid), segmentNode.position);
       [self FL_linkRedrawForSegment:segmentNode];
       segmentNode.mayShowLabel = self->_labelsVisible;
       segmentNode.mayShowBubble = self->_valuesVisible;
@@ -5303,6 +5324,7 @@ writeArchiveWithPath:exportPath
 - (void)FL_trackFlipSegment:(FLSegmentNode *)segmentNode direction:(FLSegmentFlipDirection)direction
 {
   [segmentNode flip:direction];
+  trackGridConvertUpdate(*_trackGrid, segmentNode.position);
   [self FL_linkRedrawForSegment:segmentNode];
   [_trackNode runAction:[SKAction playSoundFileNamed:@"wooden-click-1.caf" waitForCompletion:NO]];
 }